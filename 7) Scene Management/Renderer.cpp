@@ -31,6 +31,7 @@ Renderer::Renderer(Window& parent) : OGLRenderer(parent) {
 	}
 
 	root->AddChild(new CubeRobot(cube));
+	sceneBounds.InsertSubtree(root);
 
 	projMatrix = Matrix4::Perspective(1.0f, 10000.0f, (float)width/(float)height, 45.0f);
 
@@ -55,21 +56,21 @@ void Renderer::UpdateScene(float dt) {
 	frameFrustrum.FromMatrix(projMatrix * viewMatrix);
 
 	root->Update(dt);
+	sceneBounds.Refit();
 }
 
-void Renderer::BuildNodeLists(SceneNode* from) {
-	if (frameFrustrum.InsideFrustrum(*from)) {
-		Vector3 dir = from->GetWorldTransform().GetPositionVector() - camera->GetPosition();
-		from->SetCameraDistance(Vector3::Dot(dir, dir));
+void Renderer::BuildNodeLists() {
+	vector<SceneNode*> visible;
+	sceneBounds.QueryFrustrum(frameFrustrum, visible);
 
-		if (from->GetColour().w < 1.0f)
-			transparentNodeList.push_back(from);
-		else
-			nodeList.push_back(from);
+	for (SceneNode* node : visible) {
+		Vector3 dir = node->GetWorldTransform().GetPositionVector() - camera->GetPosition();
+		node->SetCameraDistance(Vector3::Dot(dir, dir));
 
-		for (vector<SceneNode*>::const_iterator i = from->GetChildIteratorStart(); i != from->GetChildIteratorEnd(); i++) {
-			BuildNodeLists((*i));
-		}
+		if (node->GetColour().w < 1.0f)
+			transparentNodeList.push_back(node);
+		else
+			nodeList.push_back(node);
 	}
 }
 
@@ -105,7 +106,7 @@ void Renderer::DrawNode(SceneNode* node) {
 }
 
 void Renderer::RenderScene() {
-	BuildNodeLists(root);
+	BuildNodeLists();
 	SortNodeLists();
 
 	glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
@@ -3,6 +3,7 @@
 #include "../nclgl/OGLRenderer.h"
 #include "../nclgl/SceneNode.h"
 #include "../nclgl/Frustrum.h"
+#include "../nclgl/BoundingVolumeHierarchy.h"
 
 class Camera;
 class SceneNode;
@@ -19,7 +20,7 @@ public:
 	void RenderScene() override;
 
 protected:
-	void BuildNodeLists(SceneNode* from);
+	void BuildNodeLists();
 	void SortNodeLists();
 	void ClearNodeLists();
 	void DrawNodes();
@@ -33,6 +34,7 @@ protected:
 	GLuint texture;
 
 	Frustrum frameFrustrum;
+	BoundingVolumeHierarchy sceneBounds;
 
 	vector<SceneNode*> transparentNodeList;
 	vector<SceneNode*> nodeList;
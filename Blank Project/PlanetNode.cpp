@@ -6,10 +6,10 @@ PlanetNode::PlanetNode(Mesh* mesh, GLuint texture, Shader* newShader, Vector3 sc
 	this->parent = NULL;
 	this->modelScale = scale;
 	this->shader = newShader;
-	this->boundingRadius = 50.0f;
+	SetBoundingRadius(50.0f);
 	this->distanceFromCamera = 0.0f;
-	this->texture = texture;
-	this->transform = Matrix4::Translation(transform);
+	SetTexture(texture);
+	SetTransform(Matrix4::Translation(transform));
 	this->isHeightMap = 0;
 	this->isSkinned = 0;
 	this->spin = spin;
@@ -18,7 +18,6 @@ PlanetNode::PlanetNode(Mesh* mesh, GLuint texture, Shader* newShader, Vector3 sc
 }
 
 PlanetNode::~PlanetNode(void) {
-	SceneNode::~SceneNode();
 }
 
 void PlanetNode::Draw(const OGLRenderer& r) {
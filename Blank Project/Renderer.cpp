@@ -2,6 +2,7 @@
 #include "../nclgl/Shader.h"
 #include "../nclgl/HeightMap.h"
 #include "../nclgl/Light.h"
+#include "../nclgl/TextureCache.h"
 
 #include "Renderer.h"
 #include "TerrainNode.h"
@@ -11,34 +12,59 @@
 
 #include <algorithm>
 
+static const int MODEL_MATRIX	= Shader::GetUniformID("modelMatrix");
+static const int ROCK_TEX	= Shader::GetUniformID("rockTex");
+static const int PLANET_TEX	= Shader::GetUniformID("planetTex");
+static const int BUMP_TEX	= Shader::GetUniformID("bumpTex");
+static const int SHADOW_TEX	= Shader::GetUniformID("shadowTex");
+static const int DIFFUSE_TEX	= Shader::GetUniformID("diffuseTex");
+static const int CUBE_TEX	= Shader::GetUniformID("cubeTex");
+static const int SCENE_TEX	= Shader::GetUniformID("sceneTex");
+static const int IS_VERTICAL	= Shader::GetUniformID("isVertical");
+static const int CAMERA_POS	= Shader::GetUniformID("cameraPos");
+
 const int SHADOWSIZE = 2048;
 int POSTPASSES = 0;
 
 Renderer::Renderer(Window& parent) : OGLRenderer(parent) {
-	SetUpMeshes();
-
+	// textures are only requested here - they decode while everything else loads
 	SetUpTextures();
 
+	SetUpMeshes();
+
 	SetUpShaders();
 
 	SetUpShadowMapping();
 
 	SetUpPostProcessing();
 
+	// the scene nodes need real texture ids, so wait for the last uploads
+	textureLoader.Finish();
+
 	SetUpSceneHierarchies();
 
+	// the skinned node holds its own references now
+	for (GLuint x : skinnedTextures) {
+		TextureCache::GetShared().Release(x);
+	}
+
 
 	ResetCameras();
 	freeMovement = false;
 
+	// texture loading and buffer set up above bind with plain gl calls,
+	// so start the state cache from scratch and let it skip repeats from here on
+	glState.Invalidate();
+	GLStateCache::SetSkipRedundantCalls(true);
+
 	// turn depth test on and start rendering
-	glEnable(GL_DEPTH_TEST);
+	glState.SetCapability(GL_DEPTH_TEST, true);
 	// needed to render water
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glState.SetCapability(GL_BLEND, true);
+	glState.SetBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 	// allows us to sample linearly between cube map faces
 	glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glState.BindFramebuffer(0);
 	init = true;
 }
 
@@ -57,8 +83,7 @@ Renderer::~Renderer(void) {
 	delete light;
 
 	delete terrainShader;
-	delete planetShader;
-	delete planetShaderShadows;
+	delete planetShader;	// and its shadowed variant
 	delete waterShader;
 	delete skyBoxShader;
 	delete shadowShader;
@@ -66,14 +91,15 @@ Renderer::~Renderer(void) {
 	delete sceneShader;
 	delete processShader;
 
-	glDeleteTextures(1, &cubeMap);
-	glDeleteTextures(1, &planetTexture1);
-	glDeleteTextures(1, &planetTexture2);
-	glDeleteTextures(1, &planetTexture3);
-	glDeleteTextures(1, &rockTexture);
-	glDeleteTextures(1, &redPlanetTexture);
-	glDeleteTextures(1, &waterTexture);
-	glDeleteTextures(1, &bumpMap);
+	TextureCache& textures = TextureCache::GetShared();
+	textures.Release(cubeMap);
+	textures.Release(planetTexture1);
+	textures.Release(planetTexture2);
+	textures.Release(planetTexture3);
+	textures.Release(rockTexture);
+	textures.Release(redPlanetTexture);
+	textures.Release(waterTexture);
+	textures.Release(bumpMap);
 	glDeleteTextures(1, &bufferFBO);
 	glDeleteTextures(1, &processFBO);
 	glDeleteTextures(1, &bufferColourTex[0]);
@@ -106,19 +132,20 @@ Renderer::~Renderer(void) {
 	delete orbitControllerMoon1;
 	delete planet_2;
 	delete planet_3;
-
-	for (SceneNode* x : transparentNodeList) {
-		delete x;
-	}
-	for (SceneNode* x : nodeList) {
-		delete x;
-	}
 }
 
 void Renderer::UpdateScene(float dt) {
 	if (freeMovement) {
 		activeCamera = cameraViews[cameraIndex];
 		activeCamera->UpdateCamera(dt);
+		// don't let the free camera fly into the ground
+		if (sceneView == 1) {
+			Vector3 pos = activeCamera->GetPosition();
+			if (pos.x >= 0 && pos.z >= 0 && pos.x <= heightMapSize.x && pos.z <= heightMapSize.z) {
+				pos.y = std::max(pos.y, heightMap->GetHeightAt(pos.x, pos.z) + 20.0f);
+				activeCamera->SetPosition(pos);
+			}
+		}
 	}
 	else {
 		activeCamera = cameraViews[cameraIndex];
@@ -138,10 +165,14 @@ void Renderer::UpdateScene(float dt) {
 	}
 	viewMatrix = activeCamera->BuildViewMatrix();
 	projMatrix = Matrix4::Perspective(1.0f, 15000.0f, (float)width / (float)height, 45.0f);
+	frameFrustrum.FromMatrix(projMatrix * viewMatrix);
+	// terrain detail follows the camera, and is shared by the shadow pass
+	terrainNode->SelectLOD(activeCamera->GetPosition(), 45.0f, height);
 
 	waterNode->SetWaterRotate(dt, 2.0f);
 	waterNode->SetWaterCycle(dt, 0.25f);
 
+	SceneNode::ResetTransformUpdateCount();
 	switch (sceneView) {
 	case (1):
 		root_1->Update(dt);
@@ -150,23 +181,26 @@ void Renderer::UpdateScene(float dt) {
 		root_2->Update(dt);
 		break;
 	}
+	// move anything that's left its box in the culling tree
+	sceneBounds[sceneView - 1].Refit();
 }
 
 void Renderer::RenderScene() {
+	Shader::ResetUniformStats();
 	// set up node lists for building
 	switch (sceneView) {
 	case (1):
 		light = new Light(Vector3(0.0f, 4, 0.0f) * heightMapSize, Vector4(1, 1, 1, 1), heightMapSize.x * 15);
-		BuildNodeLists(root_1);
+		BuildNodeLists(sceneBounds[0]);
 		break;
 	case(2):
 		light = new Light(Vector3(3475.92, 593.262, 952.303), Vector4(1, 1, 1, 1), heightMapSize.x * 15);
-		BuildNodeLists(root_2);
+		BuildNodeLists(sceneBounds[1]);
 		break;
 	}
 	SortNodeLists();
 
-	glBindFramebuffer(GL_FRAMEBUFFER, bufferFBO);
+	glState.BindFramebuffer(bufferFBO);
 	glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
 
 	DrawSkyBox();
@@ -176,6 +210,7 @@ void Renderer::RenderScene() {
 	// rebuild view and projection matrix for main scene
 	viewMatrix = activeCamera->BuildViewMatrix();
 	projMatrix = Matrix4::Perspective(1.0f, 15000.0f, (float)width / (float)height, 45.0f);
+	terrainNode->SetViewProjection(projMatrix * viewMatrix);
 
 	DrawNodes();
 
@@ -184,7 +219,7 @@ void Renderer::RenderScene() {
 
 	ClearNodeLists();
 
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glState.BindFramebuffer(0);
 
 	DrawPostProcess();
 
@@ -195,8 +230,14 @@ void Renderer::RenderScene() {
 
 void Renderer::SetUpMeshes() {
 	// set meshes up
-	// height map for terrain
-	heightMap = new HeightMap(TEXTUREDIR"noise.png");
+	// reorder indices for the vertex cache as meshes load
+	Mesh::SetOptimiseOnLoad(true);
+	// and interleave + quantise the vertex attributes
+	Mesh::SetPackVertices(true);
+	// every draw here goes through Shader::SetUniform, so repeats can be dropped
+	Shader::SetSkipRedundantUploads(true);
+	// height map for terrain - the quadtree builds its own patches, so no mesh
+	heightMap = new HeightMap(TEXTUREDIR"noise.png", false);
 	heightMapSize = heightMap->GetHeightMapSize();
 
 	// sphere and quad for water, cubemap, and planets
@@ -213,45 +254,68 @@ void Renderer::SetUpMeshes() {
 	skinnedMesh = Mesh::LoadFromMeshFile("Role_T.msh");
 	anim = new MeshAnimation("Role_T.anm");
 	material = new MeshMaterial("Role_T.mat");
+	// start the skinned mesh's textures decoding too
+	skinnedTextures.resize(skinnedMesh->GetSubMeshCount());
+	for (int i = 0; i < skinnedMesh->GetSubMeshCount(); i++) {
+		const string* filename = nullptr;
+		material->GetMaterialForLayer(i)->GetEntry("Diffuse", &filename);
+		textureLoader.Request(TEXTUREDIR + *filename, SOIL_FLAG_MIPMAPS | SOIL_FLAG_INVERT_Y, &skinnedTextures[i]);
+	}
 }
 
 void Renderer::SetUpTextures() {
 	// set textures up
-	rockTexture = SOIL_load_OGL_texture(TEXTUREDIR"Barren Reds.JPG", SOIL_LOAD_AUTO, SOIL_CREATE_NEW_ID, SOIL_FLAG_MIPMAPS);
-	planetTexture1 = SOIL_load_OGL_texture(TEXTUREDIR"planet.jpg", SOIL_LOAD_AUTO, SOIL_CREATE_NEW_ID, SOIL_FLAG_MIPMAPS);
-	planetTexture2 = SOIL_load_OGL_texture(TEXTUREDIR"planet_2.jpg", SOIL_LOAD_AUTO, SOIL_CREATE_NEW_ID, SOIL_FLAG_MIPMAPS);
-	planetTexture3 = SOIL_load_OGL_texture(TEXTUREDIR"planet_3.jpg", SOIL_LOAD_AUTO, SOIL_CREATE_NEW_ID, SOIL_FLAG_MIPMAPS);
-	redPlanetTexture = SOIL_load_OGL_texture(TEXTUREDIR"red_planet.JPG", SOIL_LOAD_AUTO, SOIL_CREATE_NEW_ID, SOIL_FLAG_MIPMAPS);
-	waterTexture = SOIL_load_OGL_texture(TEXTUREDIR"water.TGA", SOIL_LOAD_AUTO, SOIL_CREATE_NEW_ID, SOIL_FLAG_MIPMAPS);
-	bumpMap = SOIL_load_OGL_texture(TEXTUREDIR"Barren RedsDOT3.JPG", SOIL_LOAD_AUTO, SOIL_CREATE_NEW_ID, SOIL_FLAG_MIPMAPS);
-	cubeMap = SOIL_load_OGL_cubemap(TEXTUREDIR"right.png", TEXTUREDIR"left.png",
+	// from cooked files, so after the first run they're only mapped and uploaded
+	const unsigned int flags = SOIL_FLAG_MIPMAPS | SOIL_FLAG_TEXTURE_REPEATS;
+	// colour maps go to the gpu block compressed, at a quarter (or eighth) of the size
+	const unsigned int colourFlags = flags | SOIL_FLAG_COMPRESS_TO_DXT;
+	textureLoader.Request(Cooked(TEXTUREDIR"Barren Reds.JPG", colourFlags), colourFlags, &rockTexture);
+	textureLoader.Request(Cooked(TEXTUREDIR"planet.jpg", colourFlags), colourFlags, &planetTexture1);
+	textureLoader.Request(Cooked(TEXTUREDIR"planet_2.jpg", colourFlags), colourFlags, &planetTexture2);
+	textureLoader.Request(Cooked(TEXTUREDIR"planet_3.jpg", colourFlags), colourFlags, &planetTexture3);
+	textureLoader.Request(Cooked(TEXTUREDIR"red_planet.JPG", colourFlags), colourFlags, &redPlanetTexture);
+	textureLoader.Request(Cooked(TEXTUREDIR"water.TGA", colourFlags), colourFlags, &waterTexture);
+	// the shaders read all three channels of the normals, so no BC5 here
+	textureLoader.Request(Cooked(TEXTUREDIR"Barren RedsDOT3.JPG", flags), flags, &bumpMap);
+	const std::string skyFaces[6] = {
+		TEXTUREDIR"right.png", TEXTUREDIR"left.png",
 		TEXTUREDIR"top.png", TEXTUREDIR"bottom.png",
-		TEXTUREDIR"front.png", TEXTUREDIR"back.png",
-		SOIL_LOAD_RGB, SOIL_CREATE_NEW_ID, 0);
-	if (!rockTexture || !planetTexture1 || !planetTexture2 || !planetTexture3 || !redPlanetTexture || !waterTexture || !cubeMap || !bumpMap)
-		return;
-	SetTextureRepeating(rockTexture, true);
-	SetTextureRepeating(planetTexture1, true);
-	SetTextureRepeating(planetTexture2, true);
-	SetTextureRepeating(planetTexture3, true);
-	SetTextureRepeating(redPlanetTexture, true);
-	SetTextureRepeating(waterTexture, true);
-	SetTextureRepeating(bumpMap, true);
+		TEXTUREDIR"front.png", TEXTUREDIR"back.png"
+	};
+	std::string cookedSkyFaces[6];
+	for (int i = 0; i < 6; ++i) {
+		cookedSkyFaces[i] = Cooked(skyFaces[i], SOIL_FLAG_COMPRESS_TO_DXT, SOIL_LOAD_RGB);
+	}
+	textureLoader.RequestCubeMap(cookedSkyFaces, SOIL_FLAG_COMPRESS_TO_DXT, &cubeMap);
+}
+
+std::string Renderer::Cooked(const std::string& source, unsigned int flags, int channels) {
+	std::string cooked = TextureImage::GetCookedName(source);
+	if (TextureImage::NeedsCooking(source, cooked, flags, channels) &&
+		!TextureImage::Cook(source, cooked, flags, channels, &JobSystem::GetShared())) {
+		return source; // fall back to decoding it every time
+	}
+	return cooked;
 }
 
 void Renderer::SetUpShaders() {
 	// set shaders up
+	// keep linked programs between runs, so only edited shaders get recompiled
+	Shader::SetBinaryCacheDirectory("ShaderCache/");
 	terrainShader = new Shader("TerrainVertex.glsl", "TerrainFragment.glsl");
-	planetShader = new Shader("BumpVertex.glsl", "BumpFragment.glsl");
-	planetShaderShadows = new Shader("ShadowSceneVertex.glsl", "ShadowSceneFragment.glsl");
+	// one pair of files for both planet shaders - the shadowed one is a variant
+	planetShader = new Shader("PlanetVertex.glsl", "PlanetFragment.glsl");
+	planetShaderShadows = planetShader->GetVariant({ "USE_SHADOWS" });
 	waterShader = new Shader("ReflectVertex.glsl", "ReflectFragment.glsl");
 	skinnedMeshShader = new Shader("SkinningVertex.glsl", "TexturedFragment.glsl");
 
 	skyBoxShader = new Shader("SkyBoxVertex.glsl", "SkyBoxFragment.glsl");
 	shadowShader = new Shader("ShadowVertex.glsl", "ShadowFragment.glsl");
+	// terrain patches work their positions out from the grid
+	shadowTerrainShader = shadowShader->GetVariant({ "TERRAIN_GRID" });
 	processShader = new Shader("TexturedVertex.glsl", "ProcessFragment.glsl");
 	sceneShader = new Shader("TexturedVertex.glsl", "TexturedFragment.glsl");
-	if (!terrainShader->LoadSuccess() || !planetShader->LoadSuccess() || !planetShaderShadows->LoadSuccess() || !waterShader->LoadSuccess() || !skyBoxShader->LoadSuccess() || !shadowShader->LoadSuccess() || !skinnedMeshShader->LoadSuccess() || !processShader->LoadSuccess() || !sceneShader->LoadSuccess())
+	if (!terrainShader->LoadSuccess() || !planetShader->LoadSuccess() || !planetShaderShadows->LoadSuccess() || !waterShader->LoadSuccess() || !skyBoxShader->LoadSuccess() || !shadowShader->LoadSuccess() || !shadowTerrainShader->LoadSuccess() || !skinnedMeshShader->LoadSuccess() || !processShader->LoadSuccess() || !sceneShader->LoadSuccess())
 		return;
 }
 
@@ -309,19 +373,32 @@ void Renderer::SetUpSceneHierarchies() {
 	SetUpGroundScene();
 
 	SetUpSpaceScene();
+
+	FitBoundingRadii(root_1);
+	FitBoundingRadii(root_2);
+	sceneBounds[0].InsertSubtree(root_1);
+	sceneBounds[1].InsertSubtree(root_2);
+}
+
+Vector3 Renderer::GroundAt(float x, float z) const {
+	x *= heightMapSize.x;
+	z *= heightMapSize.z;
+	return Vector3(x, heightMap->GetHeightAt(x, z), z);
 }
 
 void Renderer::SetUpGroundScene() {
+	// big subtrees update on the job system's worker threads
+	SceneNode::SetParallelUpdate(true);
 	// generate ground scene
 	root_1 = new SceneNode();
 	terrainNode = new TerrainNode(heightMap, planetTexture1, rockTexture, terrainShader);
-	rockNode1 = new PlanetNode(rock_1, rockTexture, planetShaderShadows, Vector3(100, 100, 100), Vector3(0.2f, 0.8f, 0.75) * heightMapSize, Vector3(0, 0, 0), false, 0);
-	rockNode2 = new PlanetNode(rock_2, rockTexture, planetShaderShadows, Vector3(130, 130, 130), Vector3(0.5f, 0.8f, 0.2f) * heightMapSize, Vector3(0, 0, 0), false, 0);
-	rockNode3 = new PlanetNode(rock_3, rockTexture, planetShaderShadows, Vector3(200, 100, 200), Vector3(0.4f, 0.8f, 0.7f) * heightMapSize, Vector3(0, 0, 0), false, 0);
+	rockNode1 = new PlanetNode(rock_1, rockTexture, planetShaderShadows, Vector3(100, 100, 100), GroundAt(0.2f, 0.75f), Vector3(0, 0, 0), false, 0);
+	rockNode2 = new PlanetNode(rock_2, rockTexture, planetShaderShadows, Vector3(130, 130, 130), GroundAt(0.5f, 0.2f), Vector3(0, 0, 0), false, 0);
+	rockNode3 = new PlanetNode(rock_3, rockTexture, planetShaderShadows, Vector3(200, 100, 200), GroundAt(0.4f, 0.7f), Vector3(0, 0, 0), false, 0);
 	floatingCube = new PlanetNode(cube, redPlanetTexture, planetShaderShadows, Vector3(200, 200, 200), Vector3(0.3f, 3.5f, 0.3f) * heightMapSize, Vector3(1, 1, 1), true, 30.0f);
 	orbitController = new PlanetNode(NULL, NULL, NULL, Vector3(0, 0, 0), Vector3(0, 0, 0), Vector3(0, 1, 0), true, 40.0f);
 	cubeMoon = new PlanetNode(cube, rockTexture, planetShaderShadows, Vector3(50, 50, 50), Vector3(300, 0, 0), Vector3(1, 1, 1), true, 45.0f);
-	cubeNode = new PlanetNode(cube, rockTexture, planetShaderShadows, Vector3(500, 300, 500), Vector3(0.3f, 0.5f, 0.3f) * heightMapSize, Vector3(0, 0, 0), false, 0.0f);
+	cubeNode = new PlanetNode(cube, rockTexture, planetShaderShadows, Vector3(500, 300, 500), GroundAt(0.3f, 0.3f), Vector3(0, 0, 0), false, 0.0f);
 	waterNode = new WaterNode(waterQuad, waterTexture, waterShader, terrainNode->GetModelScale());
 	skinnedNode = new SkinnedNode(skinnedMesh, anim, material, skinnedMeshShader, Vector3(-50, 150, 100));
 	root_1->AddChild(terrainNode);
@@ -363,32 +440,39 @@ void Renderer::SetUpSpaceScene() {
 
 // methods for scene hierarchy
 
-void Renderer::BuildNodeLists(SceneNode* from) {
-	Vector3 dir = from->GetWorldTransform().GetPositionVector() - activeCamera->GetPosition();
-	from->SetCameraDistance(Vector3::Dot(dir, dir));
+// bounding spheres big enough for each node's scaled mesh
+void Renderer::FitBoundingRadii(SceneNode* from) {
+	if (from->GetMesh()) {
+		Vector3 scale = from->GetModelScale();
+		float maxScale = std::max(fabs(scale.x), std::max(fabs(scale.y), fabs(scale.z)));
+		from->SetBoundingRadius(from->GetMesh()->GetBoundingRadius() * maxScale);
+	}
+	for (vector<SceneNode*>::const_iterator i = from->GetChildIteratorStart(); i != from->GetChildIteratorEnd(); i++) {
+		FitBoundingRadii((*i));
+	}
+}
 
-	// add to transparent list or solid list
-	if (from->GetColour().w < 1.0f)
-		transparentNodeList.push_back(from);
-	else
-		nodeList.push_back(from);
+void Renderer::BuildNodeLists(const BoundingVolumeHierarchy& bounds) {
+	// only nodes the camera can see
+	vector<SceneNode*> visible;
+	bounds.QueryFrustrum(frameFrustrum, visible);
 
-	// iterate until all nodes are built
-	for (vector<SceneNode*>::const_iterator i = from->GetChildIteratorStart(); i != from->GetChildIteratorEnd(); i++) {
-		BuildNodeLists((*i));
+	for (SceneNode* node : visible) {
+		Vector3 dir = node->GetWorldTransform().GetPositionVector() - activeCamera->GetPosition();
+		node->SetCameraDistance(Vector3::Dot(dir, dir));
+
+		// queue picks the transparent or solid pass from the node's colour
+		renderQueue.Add(node, node->GetCameraDistance());
 	}
 }
 
 void Renderer::SortNodeLists() {
-	std::sort(transparentNodeList.rbegin(), transparentNodeList.rend(), SceneNode::CompareByCameraDistance);
-	std::sort(nodeList.rbegin(), nodeList.rend(), SceneNode::CompareByCameraDistance);
+	// solid nodes grouped by state then front to back, transparent ones back to front after them
+	renderQueue.Sort();
 }
 
 void Renderer::DrawNodes() {
-	for (const auto& i : nodeList) {
-		DrawNode(i);
-	}
-	for (const auto& i : transparentNodeList) {
+	for (const auto& i : renderQueue) {
 		DrawNode(i);
 	}
 }
@@ -401,10 +485,10 @@ void Renderer::DrawNode(SceneNode* node) {
 			return;
 		}
 		if (node->GetIsSkinned() == 1) {
-			glEnable(GL_CULL_FACE);
+			glState.SetCapability(GL_CULL_FACE, true);
 			DrawSkinned(node);
 			node->Draw(*this);
-			glDisable(GL_CULL_FACE);
+			glState.SetCapability(GL_CULL_FACE, false);
 			return;
 		}
 		if (node->GetIsHeightMap() == 0 && node->GetIsSkinned() == 0) {
@@ -416,21 +500,21 @@ void Renderer::DrawNode(SceneNode* node) {
 }
 
 void Renderer::ClearNodeLists() {
-	transparentNodeList.clear();
-	nodeList.clear();
+	renderQueue.Clear();
+	shadowNodeList.clear();
 }
 
 // methods used to draw objects
 
 void Renderer::DrawSkyBox() {
-	glDepthMask(GL_FALSE);
+	glState.SetDepthMask(false);
 
 	BindShader(skyBoxShader);
 	UpdateShaderMatrices();
 
 	skyBoxQuad->Draw();
 
-	glDepthMask(GL_TRUE);
+	glState.SetDepthMask(true);
 }
 
 void Renderer::DrawTerrain(SceneNode* node) {
@@ -439,25 +523,21 @@ void Renderer::DrawTerrain(SceneNode* node) {
 
 	// get world transform of vertices not local transform
 	Matrix4 model = node->GetWorldTransform() * Matrix4::Scale(node->GetModelScale());
-	glUniformMatrix4fv(glGetUniformLocation(node->GetShader()->GetProgram(), "modelMatrix"), 1, false, model.values);
+	node->GetShader()->SetUniform(MODEL_MATRIX, model);
 
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, node->GetRockTexture());
-	glUniform1i(glGetUniformLocation(node->GetShader()->GetProgram(), "rockTex"), 0);
+	glState.BindTexture(0, GL_TEXTURE_2D, node->GetRockTexture());
+	node->GetShader()->SetUniform(ROCK_TEX, 0);
 
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, node->GetPlanetTexture());
-	glUniform1i(glGetUniformLocation(node->GetShader()->GetProgram(), "planetTex"), 1);
+	glState.BindTexture(1, GL_TEXTURE_2D, node->GetPlanetTexture());
+	node->GetShader()->SetUniform(PLANET_TEX, 1);
 
-	glActiveTexture(GL_TEXTURE2);
-	glBindTexture(GL_TEXTURE_2D, bumpMap);
-	glUniform1i(glGetUniformLocation(node->GetShader()->GetProgram(), "bumpTex"), 2);
+	glState.BindTexture(2, GL_TEXTURE_2D, bumpMap);
+	node->GetShader()->SetUniform(BUMP_TEX, 2);
 
-	glUniform1i(glGetUniformLocation(node->GetShader()->GetProgram(), "shadowTex"), 3);
-	glActiveTexture(GL_TEXTURE3);
-	glBindTexture(GL_TEXTURE_2D, shadowTex);
+	node->GetShader()->SetUniform(SHADOW_TEX, 3);
+	glState.BindTexture(3, GL_TEXTURE_2D, shadowTex);
 
-	glUniform3fv(glGetUniformLocation(node->GetShader()->GetProgram(), "cameraPos"), 1, (float*)&activeCamera->GetPosition());
+	node->GetShader()->SetUniform(CAMERA_POS, activeCamera->GetPosition());
 
 	SetShaderLight(*light);
 }
@@ -468,48 +548,43 @@ void Renderer::DrawPlanets(SceneNode* node) {
 
 	// get world transform of vertices not local transform
 	Matrix4 model = node->GetWorldTransform() * Matrix4::Scale(node->GetModelScale());
-	glUniformMatrix4fv(glGetUniformLocation(node->GetShader()->GetProgram(), "modelMatrix"), 1, false, model.values);
+	node->GetShader()->SetUniform(MODEL_MATRIX, model);
 
 	// set Texture up
-	glUniform1i(glGetUniformLocation(node->GetShader()->GetProgram(), "diffuseTex"), 0);
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, node->GetTexture());
+	node->GetShader()->SetUniform(DIFFUSE_TEX, 0);
+	glState.BindTexture(0, GL_TEXTURE_2D, node->GetTexture());
 
-	glUniform1i(glGetUniformLocation(node->GetShader()->GetProgram(), "bumpTex"), 1);
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, bumpMap);
+	node->GetShader()->SetUniform(BUMP_TEX, 1);
+	glState.BindTexture(1, GL_TEXTURE_2D, bumpMap);
 
-	glUniform1i(glGetUniformLocation(node->GetShader()->GetProgram(), "shadowTex"), 2);
-	glActiveTexture(GL_TEXTURE2);
-	glBindTexture(GL_TEXTURE_2D, shadowTex);
+	node->GetShader()->SetUniform(SHADOW_TEX, 2);
+	glState.BindTexture(2, GL_TEXTURE_2D, shadowTex);
 
-	glUniform3fv(glGetUniformLocation(node->GetShader()->GetProgram(), "cameraPos"), 1, (float*)&activeCamera->GetPosition());
+	node->GetShader()->SetUniform(CAMERA_POS, activeCamera->GetPosition());
 
 	SetShaderLight(*light);
 }
 
 void Renderer::DrawSkinned(SceneNode* node) {
 	BindShader(node->GetShader());
-	glUniform1i(glGetUniformLocation(node->GetShader()->GetProgram(), "diffuseTex"), 0);
+	node->GetShader()->SetUniform(DIFFUSE_TEX, 0);
 
 	UpdateShaderMatrices();
 	Matrix4 model = node->GetWorldTransform() * Matrix4::Scale(node->GetModelScale());
-	glUniformMatrix4fv(glGetUniformLocation(node->GetShader()->GetProgram(), "modelMatrix"), 1, false, model.values);
+	node->GetShader()->SetUniform(MODEL_MATRIX, model);
 }
 
 void Renderer::DrawWater() {
 	BindShader(waterNode->GetShader());
 
-	glUniform3fv(glGetUniformLocation(waterNode->GetShader()->GetProgram(), "cameraPos"), 1, (float*)&activeCamera->GetPosition());
+	waterNode->GetShader()->SetUniform(CAMERA_POS, activeCamera->GetPosition());
 
-	glUniform1i(glGetUniformLocation(waterNode->GetShader()->GetProgram(), "diffuseTex"), 0);
-	glUniform1i(glGetUniformLocation(waterNode->GetShader()->GetProgram(), "cubeTex"), 2);
+	waterNode->GetShader()->SetUniform(DIFFUSE_TEX, 0);
+	waterNode->GetShader()->SetUniform(CUBE_TEX, 2);
 
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, waterNode->GetTexture());
+	glState.BindTexture(0, GL_TEXTURE_2D, waterNode->GetTexture());
 
-	glActiveTexture(GL_TEXTURE2);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, cubeMap);
+	glState.BindTexture(2, GL_TEXTURE_CUBE_MAP, cubeMap);
 
 	// matrix will now be in center of height map, stretches it across the hieghtmap, and rotates it
 	//modelMatrix = Matrix4::Translation(heightMapSize * 0.5f) * Matrix4::Scale(heightMapSize * 0.5f) * Matrix4::Rotation(90, Vector3(1, 0, 0));
@@ -517,7 +592,7 @@ void Renderer::DrawWater() {
 	textureMatrix = Matrix4::Translation(Vector3(waterNode->GetWaterCycle(), 0.0f, waterNode->GetWaterCycle())) * Matrix4::Scale(Vector3(10, 10, 10)) * Matrix4::Rotation(90, Vector3(0, 0, 1));
 	UpdateShaderMatrices();
 	Matrix4 model = Matrix4::Translation(heightMapSize * 0.5f) * waterNode->GetTransform() * Matrix4::Scale(heightMapSize * 0.5f) * Matrix4::Rotation(90, Vector3(1, 0, 0));
-	glUniformMatrix4fv(glGetUniformLocation(waterNode->GetShader()->GetProgram(), "modelMatrix"), 1, false, model.values);
+	waterNode->GetShader()->SetUniform(MODEL_MATRIX, model);
 	waterQuad->Draw();
 
 	textureMatrix.ToIdentity();
@@ -527,9 +602,9 @@ void Renderer::DrawWater() {
 
 void Renderer::DrawShadowScene() {
 	// set up gl for shadow map
-	glBindFramebuffer(GL_FRAMEBUFFER, shadowFBO);
+	glState.BindFramebuffer(shadowFBO);
 	glClear(GL_DEPTH_BUFFER_BIT);
-	glViewport(0, 0, SHADOWSIZE, SHADOWSIZE);
+	glState.SetViewport(0, 0, SHADOWSIZE, SHADOWSIZE);
 	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
 
 	// generate shadow map
@@ -538,28 +613,35 @@ void Renderer::DrawShadowScene() {
 	projMatrix = Matrix4::Perspective(1, 15000, (float)width / (float)height, 90);
 	shadowMatrix = projMatrix * viewMatrix;
 
+	// only nodes inside the light's frustum can cast into the shadow map
+	Frustrum lightFrustrum;
+	lightFrustrum.FromMatrix(shadowMatrix);
+	sceneBounds[sceneView - 1].QueryFrustrum(lightFrustrum, shadowNodeList);
+	terrainNode->SetViewProjection(shadowMatrix);
+
 	// draw nodes
 	DrawShadowNodes();
 
 	// undo above changes to set up gl for object generation
 	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
-	glViewport(0, 0, width, height);
-	glBindFramebuffer(GL_FRAMEBUFFER, bufferFBO);
+	glState.SetViewport(0, 0, width, height);
+	glState.BindFramebuffer(bufferFBO);
 }
 
 void Renderer::DrawShadowNodes() {
-	for (const auto& i : nodeList) {
-		DrawShadowNode(i);
-	}
-	for (const auto& i : transparentNodeList) {
-		DrawShadowNode(i);
+	for (const auto& i : shadowNodeList) {
+		if (i->GetMesh())
+			DrawShadowNode(i);
 	}
 }
 
 void Renderer::DrawShadowNode(SceneNode* node) {
+	// the state cache skips the rebind when it's the same shader as last time
+	Shader* shader = node->GetIsHeightMap() == 1 ? shadowTerrainShader : shadowShader;
+	BindShader(shader);
 	UpdateShaderMatrices();
 	Matrix4 model = node->GetWorldTransform() * Matrix4::Scale(node->GetModelScale());
-	glUniformMatrix4fv(glGetUniformLocation(shadowShader->GetProgram(), "modelMatrix"), 1, false, model.values);
+	shader->SetUniform(MODEL_MATRIX, model);
 	if (node->GetIsSkinned()) {
 		node->SwitchShadowSkinned();
 		node->Draw(*this);
@@ -573,7 +655,7 @@ void Renderer::DrawShadowNode(SceneNode* node) {
 // methods for post processing
 
 void Renderer::DrawPostProcess() {
-	glBindFramebuffer(GL_FRAMEBUFFER, processFBO);
+	glState.BindFramebuffer(processFBO);
 	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, bufferColourTex[1], 0);
 	glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
 
@@ -583,27 +665,26 @@ void Renderer::DrawPostProcess() {
 	projMatrix.ToIdentity();
 	UpdateShaderMatrices();
 
-	glDisable(GL_DEPTH_TEST);
+	glState.SetCapability(GL_DEPTH_TEST, false);
 
 	// apply post processing
-	glActiveTexture(GL_TEXTURE0);
-	glUniform1i(glGetUniformLocation(processShader->GetProgram(), "sceneTex"), 0);
+	processShader->SetUniform(SCENE_TEX, 0);
 	for (int i = 0; i < POSTPASSES; i++) {
 		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, bufferColourTex[1], 0);
-		glUniform1i(glGetUniformLocation(processShader->GetProgram(), "isVertical"), 0);
-		glBindTexture(GL_TEXTURE_2D, bufferColourTex[0]);
+		processShader->SetUniform(IS_VERTICAL, 0);
+		glState.BindTexture(0, GL_TEXTURE_2D, bufferColourTex[0]);
 		quad->Draw();
 		// swap colour buffers for second blur
-		glUniform1i(glGetUniformLocation(processShader->GetProgram(), "isVertical"), 1);
+		processShader->SetUniform(IS_VERTICAL, 1);
 		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, bufferColourTex[0], 0);
-		glBindTexture(GL_TEXTURE_2D, bufferColourTex[1]);
+		glState.BindTexture(0, GL_TEXTURE_2D, bufferColourTex[1]);
 		quad->Draw();
 	}
-	glEnable(GL_DEPTH_TEST);
+	glState.SetCapability(GL_DEPTH_TEST, true);
 }
 
 void Renderer::PresentScreen() {
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glState.BindFramebuffer(0);
 	glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
 	BindShader(sceneShader);
 
@@ -612,9 +693,8 @@ void Renderer::PresentScreen() {
 	projMatrix.ToIdentity();
 	UpdateShaderMatrices();
 
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, bufferColourTex[0]);
-	glUniform1i(glGetUniformLocation(sceneShader->GetProgram(), "diffuseTex"), 0);
+	glState.BindTexture(0, GL_TEXTURE_2D, bufferColourTex[0]);
+	sceneShader->SetUniform(DIFFUSE_TEX, 0);
 	quad->Draw();
 }
 
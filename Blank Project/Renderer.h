@@ -2,6 +2,10 @@
 
 #include "../nclgl/OGLRenderer.h"
 #include "../nclgl/SceneNode.h"
+#include "../nclgl/Frustrum.h"
+#include "../nclgl/BoundingVolumeHierarchy.h"
+#include "../nclgl/RenderQueue.h"
+#include "../nclgl/AsyncTextureLoader.h"
 
 #include "../nclgl/MeshMaterial.h"
 #include "../nclgl/MeshAnimation.h"
@@ -34,15 +38,20 @@ private:
 	// methods for setting up scene
 	void SetUpMeshes();
 	void SetUpTextures();
+	// the cooked copy of a texture, cooked first if it's missing or out of date
+	std::string Cooked(const std::string& source, unsigned int flags, int channels = 0);
 	void SetUpShaders();
 	void SetUpShadowMapping();
 	void SetUpPostProcessing();
 	void SetUpSceneHierarchies();
 	void SetUpGroundScene();
+	// a point on the terrain, x and z given as fractions of its size
+	Vector3 GroundAt(float x, float z) const;
 	void SetUpSpaceScene();
 
 	// methods for scene hierarchy
-	void BuildNodeLists(SceneNode* from);
+	void FitBoundingRadii(SceneNode* from);
+	void BuildNodeLists(const BoundingVolumeHierarchy& bounds);
 	void SortNodeLists();
 	void ClearNodeLists();
 	void DrawNodes();
@@ -96,6 +105,7 @@ private:
 	Shader* waterShader;
 	Shader* skyBoxShader;
 	Shader* shadowShader;
+	Shader* shadowTerrainShader;
 	Shader* skinnedMeshShader;
 	Shader* sceneShader;
 	Shader* processShader;
@@ -109,6 +119,10 @@ private:
 	GLuint redPlanetTexture;
 	GLuint waterTexture;
 	GLuint bumpMap;
+	// decodes the above on worker threads while meshes and shaders load
+	AsyncTextureLoader textureLoader;
+	// the skinned mesh's textures, fetched early so its node finds them cached
+	vector<GLuint> skinnedTextures;
 	// post processing
 	GLuint bufferFBO;
 	GLuint processFBO;
@@ -147,7 +161,12 @@ private:
 	PlanetNode* planet_2;
 	PlanetNode* planet_3;
 
-	vector<SceneNode*> transparentNodeList;
-	vector<SceneNode*> nodeList;
+	// one per scene, for culling
+	BoundingVolumeHierarchy sceneBounds[2];
+	Frustrum frameFrustrum;
+
+	// visible nodes, sorted by state and depth
+	RenderQueue renderQueue;
+	vector<SceneNode*> shadowNodeList;
 };
 
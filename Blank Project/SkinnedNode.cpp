@@ -1,4 +1,7 @@
 #include "SkinnedNode.h"
+#include "../nclgl/TextureCache.h"
+
+static const int JOINTS = Shader::GetUniformID("joints");
 
 SkinnedNode::SkinnedNode(Mesh* mesh, MeshAnimation* anim, MeshMaterial* material, Shader* shader, Vector3 transform) {
 	this->mesh = mesh;
@@ -8,7 +11,7 @@ SkinnedNode::SkinnedNode(Mesh* mesh, MeshAnimation* anim, MeshMaterial* material
 	this->isSkinned = 1;
 	this->isHeightMap = 0;
 	this->modelScale = Vector3(45, 45, 45);
-	this->transform = Matrix4::Translation(transform);
+	SetTransform(Matrix4::Translation(transform));
 	this->isShadow = false;
 
 	// for every submesh get its respective texture
@@ -17,7 +20,8 @@ SkinnedNode::SkinnedNode(Mesh* mesh, MeshAnimation* anim, MeshMaterial* material
 		const string* filename = nullptr;
 		matEntry->GetEntry("Diffuse", &filename);
 		string path = TEXTUREDIR + *filename;
-		GLuint texID = SOIL_load_OGL_texture(path.c_str(), SOIL_LOAD_AUTO, SOIL_CREATE_NEW_ID, SOIL_FLAG_MIPMAPS | SOIL_FLAG_INVERT_Y);
+		// submeshes often share a material, so most of these come straight from the cache
+		GLuint texID = TextureCache::GetShared().Load(path, SOIL_FLAG_MIPMAPS | SOIL_FLAG_INVERT_Y);
 		matTextures.emplace_back(texID);
 	}
 
@@ -27,13 +31,11 @@ SkinnedNode::SkinnedNode(Mesh* mesh, MeshAnimation* anim, MeshMaterial* material
 }
 
 SkinnedNode::~SkinnedNode(void) {
-	SceneNode::~SceneNode();
-
 	delete anim;
 	delete material;
 
 	for (GLuint x : matTextures) {
-		glDeleteTextures(1, &x);
+		TextureCache::GetShared().Release(x);
 	}
 }
 
@@ -45,32 +47,28 @@ void SkinnedNode::Update(float dt) {
 		framesWalking += 1;
 	}
 	if (this->framesWalking > 20) {
-		this->transform = this->transform * Matrix4::Rotation(90, Vector3(0, 1, 0));
+		SetTransform(GetTransform() * Matrix4::Rotation(90, Vector3(0, 1, 0)));
 		this->framesWalking = 0;
 	}
-	this->transform = this->transform * Matrix4::Translation(Vector3(0,0,0.5f));
+	SetTransform(GetTransform() * Matrix4::Translation(Vector3(0,0,0.5f)));
 
 	SceneNode::Update(dt);
 }
 
 void SkinnedNode::Draw(const OGLRenderer& r) {
-	vector<Matrix4> frameMatrices;
+	vector<Matrix4> frameMatrices(mesh->GetJointCount());
 
 	const Matrix4* invBindPose = mesh->GetInverseBindPose();
 	const Matrix4* frameData = anim->GetJointData(currentFrame);
 
-	for (unsigned int i = 0; i < mesh->GetJointCount(); i++) {
-		frameMatrices.emplace_back(frameData[i] * invBindPose[i]);
-	}
+	Matrix4::MultiplyPairs(frameData, invBindPose, frameMatrices.data(), frameMatrices.size());
 	if(!isShadow) {
-		int j = glGetUniformLocation(shader->GetProgram(), "joints");
-		glUniformMatrix4fv(j, frameMatrices.size(), false, (float*)frameMatrices.data());
+		shader->SetUniformArray(JOINTS, frameMatrices.data(), (int)frameMatrices.size());
 	}
 	
 	for (int i = 0; i < mesh->GetSubMeshCount(); i++)
 	{
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, matTextures[i]);
+		GLStateCache::GetShared().BindTexture(0, GL_TEXTURE_2D, matTextures[i]);
 		mesh->DrawSubMesh(i);
 	}
 }
\ No newline at end of file
@@ -1,4 +1,7 @@
 #include "TerrainNode.h"
+#include "../nclgl/TextureCache.h"
+#include "../nclgl/Frustrum.h"
+#include "../nclgl/JobSystem.h"
 
 TerrainNode::TerrainNode(HeightMap* heightMap, GLuint givenPlanetTexture, GLuint givenRockTexture, Shader* newShader) {
 	this->mesh = heightMap;
@@ -6,26 +9,36 @@ TerrainNode::TerrainNode(HeightMap* heightMap, GLuint givenPlanetTexture, GLuint
 	this->parent = NULL;
 	this->modelScale = Vector3(1, 1, 1);
 	this->shader = newShader;
-	this->boundingRadius = 0.0f;
+	SetBoundingRadius(0.0f);
 	this->distanceFromCamera = 0.0f;
 	this->planetTexture = givenPlanetTexture;
 	this->rockTexture = givenRockTexture;
+	TextureCache::GetShared().AddReference(planetTexture);
+	TextureCache::GetShared().AddReference(rockTexture);
 	this->isHeightMap = 1;
 	this->isSkinned = 0;
 	// shouldn't be used but if needed
-	this->texture = givenRockTexture;
+	SetTexture(givenRockTexture);
+	this->terrain = new TerrainQuadtree(*heightMap, TerrainQuadtree::DEFAULT_PATCH_SIZE, &JobSystem::GetShared());
 }
 
 TerrainNode::~TerrainNode(void) {
-	SceneNode::~SceneNode();
-
-	glDeleteTextures(1, &rockTexture);
-	glDeleteTextures(1, &planetTexture);
+	delete terrain;
+	TextureCache::GetShared().Release(rockTexture);
+	TextureCache::GetShared().Release(planetTexture);
 }
 
 void TerrainNode::Draw(const OGLRenderer& r) {
 	// set texture and shader
-	SceneNode::Draw(r);
+	// patches are culled in the terrain's own space
+	Frustrum frustum;
+	frustum.FromMatrix(viewProjection * GetWorldTransform() * Matrix4::Scale(modelScale));
+	terrain->Draw(frustum, r.GetCurrentShader());
+}
+
+void TerrainNode::SelectLOD(const Vector3& cameraPos, float fov, int viewportHeight) {
+	Matrix4 toLocal = (GetWorldTransform() * Matrix4::Scale(modelScale)).Inverse();
+	terrain->SelectLOD(toLocal * cameraPos, fov, viewportHeight);
 }
 
 void TerrainNode::Update(float dt) {
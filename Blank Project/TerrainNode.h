@@ -2,6 +2,7 @@
 
 #include "../nclgl/SceneNode.h"
 #include "../nclgl/HeightMap.h"
+#include "../nclgl/TerrainQuadtree.h"
 
 class TerrainNode : public SceneNode
 {
@@ -14,8 +15,17 @@ public:
 
 	GLuint GetPlanetTexture() override { return planetTexture; }
 	GLuint GetRockTexture() override { return rockTexture; }
+
+	// picks the terrain's patches for this frame's camera, before any pass draws it
+	void SelectLOD(const Vector3& cameraPos, float fov, int viewportHeight);
+	// the next Draw only draws patches inside this projection * view's frustum
+	void SetViewProjection(const Matrix4& matrix) { viewProjection = matrix; }
+	TerrainQuadtree* GetTerrain() const { return terrain; }
 protected:
 	GLuint rockTexture;
 	GLuint planetTexture;
+	// drawn instead of the heightmap, which has no mesh of its own here
+	TerrainQuadtree* terrain;
+	Matrix4 viewProjection;
 };
 
@@ -6,10 +6,10 @@ WaterNode::WaterNode(Mesh* mesh, GLuint texture, Shader* shader, Vector3 scale)
 	this->parent = NULL;
 	this->modelScale = scale;
 	this->shader = shader;
-	this->boundingRadius = 50.0f;
+	SetBoundingRadius(50.0f);
 	this->distanceFromCamera = 0.0f;
-	this->texture = texture;
-	this->transform = Matrix4::Translation(Vector3(0,-20,0));
+	SetTexture(texture);
+	SetTransform(Matrix4::Translation(Vector3(0,-20,0)));
 	this->isHeightMap = 0;
 	this->isSkinned = 0;
 	waterRotate = 0.0f;
@@ -17,7 +17,6 @@ WaterNode::WaterNode(Mesh* mesh, GLuint texture, Shader* shader, Vector3 scale)
 }
 
 WaterNode::~WaterNode(void) {
-	SceneNode::~SceneNode();
 }
 
 void WaterNode::Draw(const OGLRenderer& r) {
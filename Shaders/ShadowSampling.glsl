@@ -0,0 +1,13 @@
+// shadowProj is the fragment's position as seen by the light (shadowMatrix * worldPos)
+// returns 1 - no shadow while 0 = full shadow
+float SampleShadow(sampler2D shadowMap, vec4 shadowProj) {
+	vec3 shadowNDC = shadowProj.xyz / shadowProj.w;
+	if (abs(shadowNDC.x) < 1.0f && abs(shadowNDC.y) < 1.0f && abs(shadowNDC.z) < 1.0f) {
+		vec3 biasCoord = shadowNDC * 0.5 + 0.5;
+		float shadowZ = texture(shadowMap, biasCoord.xy).x;
+		if (shadowZ < biasCoord.z) {
+			return 0.0f;
+		}
+	}
+	return 1.0f;
+}
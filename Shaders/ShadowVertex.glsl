@@ -1,11 +1,20 @@
 #version 330 core
 
+// compiled again with TERRAIN_GRID defined for the terrain's patches
+
 uniform mat4 modelMatrix;
 uniform mat4 viewMatrix;
 uniform mat4 projMatrix;
 
+#ifdef TERRAIN_GRID
+#include "TerrainGrid.glsl"
+#else
 in vec3 position;
+#endif
 
 void main(void) {
+#ifdef TERRAIN_GRID
+	vec3 position = TerrainPosition(TerrainGridPos());
+#endif
 	gl_Position = (projMatrix * viewMatrix * modelMatrix) * vec4(position, 1.0);
 }
\ No newline at end of file
@@ -24,6 +24,8 @@ in Vertex {
 
 out vec4 fragColour;
 
+#include "ShadowSampling.glsl"
+
 void main(void) {
  // normal light shader
 	vec3 incident = normalize(lightPos - IN.worldPos);
@@ -51,18 +53,9 @@ void main(void) {
 	float specFactor = clamp(dot(halfDir, normal), 0.0, 1.0);
 	specFactor = pow(specFactor, 60.0);
 
-	// new stuff
 	// 1 - no shadow while 0 = full shadow
-	float shadow = 1.0;
+	float shadow = SampleShadow(shadowTex, IN.shadowProj);
 
-	vec3 shadowNDC = IN.shadowProj.xyz / IN.shadowProj.w;
-	if (abs(shadowNDC.x) < 1.0f && abs(shadowNDC.y) < 1.0f && abs(shadowNDC.z) < 1.0f) {
-		vec3 biasCoord = shadowNDC * 0.5 + 0.5;
-		float shadowZ = texture(shadowTex, biasCoord.xy).x;
-		if (shadowZ < biasCoord.z) {
-			shadow = 0.0f;
-		}
-	}
 	vec3 surface = (diffuse.rgb * lightColour.rgb);
 	fragColour.rgb = surface * attenuation * lambert;
 	fragColour.rgb += (lightColour.rgb * attenuation * specFactor) * 0.33;
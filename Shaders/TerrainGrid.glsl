@@ -0,0 +1,28 @@
+// terrain patches (see TerrainQuadtree) only store each vertex's height and
+// normal - which sample a vertex is comes from gl_VertexID and the patch
+
+uniform vec3 terrainGrid;	// vertices along a patch's side, last sample in x and z
+uniform vec4 terrainScale;	// vertexScale.xz, textureScale
+uniform vec3 terrainPatch;	// the patch's first sample in x and z, samples between vertices
+
+layout(location = 0) in float height;	// VERTEX_BUFFER
+
+// sample coordinates of this vertex - partly filled patches clamp to the edge
+vec2 TerrainGridPos() {
+	int row = int(terrainGrid.x);
+	vec2 vertex = vec2(gl_VertexID % row, gl_VertexID / row);
+	return min(terrainPatch.xy + vertex * terrainPatch.z, terrainGrid.yz);
+}
+
+vec3 TerrainPosition(vec2 gridPos) {
+	return vec3(gridPos.x * terrainScale.x, height, gridPos.y * terrainScale.y);
+}
+
+vec2 TerrainTexCoord(vec2 gridPos) {
+	return gridPos * terrainScale.zw;
+}
+
+// along x, as Mesh::GenerateTangents would give for the grid
+vec4 TerrainTangent(vec3 normal) {
+	return vec4(normalize(vec3(normal.y, -normal.x, 0.0)), 1.0);
+}
@@ -7,11 +7,10 @@ uniform mat4 shadowMatrix;
 
 uniform vec3 lightPos;
 
-in vec3 position;
 in vec3 colour;
 in vec3 normal;
-in vec4 tangent;
-in vec2 texCoord;
+
+#include "TerrainGrid.glsl"
 
 out Vertex {
 	vec3 colour;
@@ -25,8 +24,12 @@ out Vertex {
 } OUT;
 
 void main(void) {
+	vec2 gridPos = TerrainGridPos();
+	vec3 position = TerrainPosition(gridPos);
+	vec4 tangent = TerrainTangent(normalize(normal));
+
 	OUT.colour = colour;
-	OUT.texCoord = texCoord;
+	OUT.texCoord = TerrainTexCoord(gridPos);
 
 	mat3 normalMatrix = transpose(inverse(mat3(modelMatrix)));
 	vec3 wNormal  = normalize(normalMatrix * normalize(normal));
@@ -0,0 +1,159 @@
+#include "Test.h"
+#include "../nclgl/BlockCompressor.h"
+#include "../nclgl/JobSystem.h"
+
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace {
+	//Smooth gradients with a little noise over them, like most photos - the
+	//same whatever the image's size, so small images aren't just noise
+	std::vector<unsigned char> MakeImage(int width, int height, int channels, unsigned int seed) {
+		std::mt19937 random(seed);
+		std::uniform_int_distribution<int> noise(-3, 3);
+		std::vector<unsigned char> pixels((size_t)width * height * channels);
+		for (int y = 0; y < height; ++y) {
+			for (int x = 0; x < width; ++x) {
+				float u = x / 64.0f, v = y / 64.0f;
+				float values[4] = {
+					255.0f * u,
+					255.0f * v,
+					127.5f + 127.5f * sin(6.0f * (u + v)),
+					255.0f * (1.0f - u * v / 4.0f)
+				};
+				for (int k = 0; k < channels; ++k) {
+					int value = (int)values[k] + noise(random);
+					pixels[((size_t)y * width + x) * channels + k] = (unsigned char)std::min(std::max(value, 0), 255);
+				}
+			}
+		}
+		return pixels;
+	}
+
+	std::vector<unsigned char> Compress(const std::vector<unsigned char>& pixels, int width, int height, int channels,
+		BlockFormat format, JobSystem* jobs = nullptr) {
+		std::vector<unsigned char> blocks(BlockCompressor::GetCompressedSize(width, height, format));
+		BlockCompressor::Compress(pixels.data(), width, height, channels, format, blocks.data(), jobs);
+		return blocks;
+	}
+
+	//Every BC1 block (or BC3's colour half) has to be in 4 colour mode - the
+	//other mode's black is transparent in some decoders
+	bool AllColourBlocksOpaque(const std::vector<unsigned char>& blocks, BlockFormat format) {
+		size_t blockSize = BlockCompressor::GetBlockSize(format);
+		size_t colour = format == BlockFormat::BC3 ? 8 : 0;
+		for (size_t at = 0; at < blocks.size(); at += blockSize) {
+			const unsigned char* b = &blocks[at + colour];
+			uint16_t c0 = (uint16_t)(b[0] | b[1] << 8);
+			uint16_t c1 = (uint16_t)(b[2] | b[3] << 8);
+			bool noIndices = (b[4] | b[5] | b[6] | b[7]) == 0;
+			if (c0 < c1 || (c0 == c1 && !noIndices)) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	struct RoundTrip {
+		BlockFormat	format;
+		int			channels;
+		double		minPSNR;
+	};
+	//a dB or two under what MakeImage's images reach
+	const RoundTrip ROUND_TRIPS[] = {
+		{ BlockFormat::BC1, 3, 34.0 },
+		{ BlockFormat::BC3, 4, 35.0 },
+		{ BlockFormat::BC4, 1, 50.0 },
+		{ BlockFormat::BC5, 2, 50.0 },
+	};
+}
+
+TEST(BlockCompressorRoundTrips) {
+	//odd sizes, so the edge blocks are only partly covered
+	const int sizes[3][2] = { { 37, 29 }, { 1, 1 }, { 6, 3 } };
+	for (const RoundTrip& r : ROUND_TRIPS) {
+		for (const auto& size : sizes) {
+			std::vector<unsigned char> pixels = MakeImage(size[0], size[1], r.channels, 1);
+			std::vector<unsigned char> blocks = Compress(pixels, size[0], size[1], r.channels, r.format);
+			double psnr = BlockCompressor::ComputePSNR(pixels.data(), size[0], size[1], r.channels, r.format, blocks.data());
+			if (psnr < r.minPSNR) {
+				Test::Fail(__FILE__, __LINE__, "format " + std::to_string((int)r.format) + " at " + std::to_string(size[0]) +
+					"x" + std::to_string(size[1]) + " only reached " + std::to_string(psnr) + "dB");
+			}
+			if (r.format == BlockFormat::BC1 || r.format == BlockFormat::BC3) {
+				CHECK(AllColourBlocksOpaque(blocks, r.format));
+			}
+		}
+	}
+	CHECK(BlockCompressor::ComputePSNR(nullptr, 0, 0, 3, BlockFormat::BC1, nullptr) == 0.0);
+}
+
+TEST(BlockCompressorFlatImages) {
+	const int width = 13, height = 10;
+	const unsigned char colours[3][4] = { { 0, 0, 0, 255 }, { 255, 255, 255, 0 }, { 200, 100, 50, 128 } };
+	for (const auto& colour : colours) {
+		for (const RoundTrip& r : ROUND_TRIPS) {
+			std::vector<unsigned char> pixels((size_t)width * height * r.channels);
+			for (size_t i = 0; i < pixels.size(); ++i) {
+				pixels[i] = colour[i % r.channels];
+			}
+			std::vector<unsigned char> blocks = Compress(pixels, width, height, r.channels, r.format);
+			double psnr = BlockCompressor::ComputePSNR(pixels.data(), width, height, r.channels, r.format, blocks.data());
+			//single channels are exact, and 565 colours are within a few steps
+			if (r.format == BlockFormat::BC4 || r.format == BlockFormat::BC5) {
+				CHECK(std::isinf(psnr));
+			}
+			else {
+				CHECK(psnr > 40.0);
+				CHECK(AllColourBlocksOpaque(blocks, r.format));
+			}
+		}
+	}
+}
+
+TEST(BlockCompressorThreadsMatchSerial) {
+	//enough blocks to be split into jobs, with a ragged last row
+	const int width = 259, height = 130;
+	JobSystem jobs(4);
+	for (const RoundTrip& r : ROUND_TRIPS) {
+		std::vector<unsigned char> pixels = MakeImage(width, height, r.channels, 2);
+		std::vector<unsigned char> serial	= Compress(pixels, width, height, r.channels, r.format);
+		std::vector<unsigned char> threaded	= Compress(pixels, width, height, r.channels, r.format, &jobs);
+		CHECK(serial == threaded);
+	}
+}
+
+TEST(BlockCompressorChannelExtremes) {
+	//a hand made 6 value block - indices 6 and 7 are always 0 and 255
+	unsigned char block[8] = { 40, 60 };
+	uint64_t bits = 0;
+	for (int i = 0; i < 16; ++i) {
+		bits |= (uint64_t)(i % 2 ? 7 : 6) << (i * 3);
+	}
+	for (int i = 0; i < 6; ++i) {
+		block[2 + i] = (unsigned char)(bits >> (i * 8));
+	}
+	unsigned char decoded[16];
+	BlockCompressor::Decompress(block, 4, 4, 1, BlockFormat::BC4, decoded);
+	for (int i = 0; i < 16; ++i) {
+		CHECK(decoded[i] == (i % 2 ? 255 : 0));
+	}
+
+	//and the compressor uses it when there's a 0 or 255 to keep, alongside a narrow range
+	std::vector<unsigned char> pixels(16);
+	for (int i = 0; i < 16; ++i) {
+		pixels[i] = i == 3 ? 0 : (i == 12 ? 255 : (unsigned char)(100 + i));
+	}
+	std::vector<unsigned char> blocks = Compress(pixels, 4, 4, 1, BlockFormat::BC4);
+	CHECK(blocks[0] <= blocks[1]);
+	BlockCompressor::Decompress(blocks.data(), 4, 4, 1, BlockFormat::BC4, decoded);
+	CHECK(decoded[3] == 0);
+	CHECK(decoded[12] == 255);
+	for (int i = 0; i < 16; ++i) {
+		if (i != 3 && i != 12) {
+			CHECK(abs(decoded[i] - pixels[i]) <= 2);
+		}
+	}
+}
@@ -0,0 +1,104 @@
+#include "Test.h"
+#include "../nclgl/Frustrum.h"
+#include "../nclgl/Matrix4.h"
+
+#include <limits>
+#include <random>
+
+namespace {
+	Matrix4 CameraMatrix() {
+		return Matrix4::Perspective(1.0f, 1000.0f, 16.0f / 9.0f, 45.0f) *
+			Matrix4::BuildViewMatrix(Vector3(10, 20, 30), Vector3(100, 0, -200));
+	}
+
+	//Like the shadow map's light frustrum
+	Matrix4 LightMatrix() {
+		return Matrix4::Orthographic(-500.0f, 500.0f, 300.0f, -200.0f, 250.0f, -150.0f) *
+			Matrix4::BuildViewMatrix(Vector3(-100, 400, 50), Vector3(0, 0, 0));
+	}
+}
+
+TEST(SpheresInFrustrumMatchesScalar) {
+	Frustrum frustrum;
+	frustrum.FromMatrix(CameraMatrix());
+
+	std::mt19937 random(3);
+	std::uniform_real_distribution<float> position(-1200.0f, 1200.0f);
+	std::uniform_real_distribution<float> radius(0.0f, 100.0f);
+
+	//An odd count, so the scalar tail after the last SIMD block gets used too
+	const size_t count = 100003;
+	std::vector<float> x(count), y(count), z(count), r(count);
+	for (size_t i = 0; i < count; ++i) {
+		x[i] = position(random);
+		y[i] = position(random);
+		z[i] = position(random);
+		r[i] = radius(random);
+	}
+	r[7]	= 0.0f;
+	x[11]	= std::numeric_limits<float>::quiet_NaN();
+	r[13]	= std::numeric_limits<float>::infinity();
+
+	std::vector<uint32_t> visible((count + 31) / 32);
+	size_t visibleCount = frustrum.SpheresInFrustrum(x.data(), y.data(), z.data(), r.data(), count, visible.data());
+
+	size_t	expectedCount	= 0;
+	int		wrong			= 0;
+	for (size_t i = 0; i < count; ++i) {
+		bool expected	= frustrum.SphereInFrustrum(Vector3(x[i], y[i], z[i]), r[i]);
+		bool got		= (visible[i / 32] >> (i % 32)) & 1;
+		expectedCount	+= expected;
+		wrong			+= expected != got;
+	}
+	CHECK(wrong == 0);
+	CHECK(visibleCount == expectedCount);
+	CHECK(expectedCount > 0 && expectedCount < count);
+}
+
+TEST(FrustrumPlanesMatchClipSpace) {
+	std::mt19937 random(4);
+	std::uniform_real_distribution<float> position(-1200.0f, 1200.0f);
+
+	for (const Matrix4& m : { CameraMatrix(), LightMatrix() }) {
+		Frustrum frustrum;
+		frustrum.FromMatrix(m);
+
+		int inside	= 0;
+		int wrong	= 0;
+		for (int i = 0; i < 100000; ++i) {
+			Vector3 p(position(random), position(random), position(random));
+			Vector4 clip = m * Vector4(p.x, p.y, p.z, 1.0f);
+
+			//Too close to a plane to call either way
+			float margin = std::fabs(clip.w) * 1e-3f + 1e-3f;
+			float nearest = std::min({ clip.w - std::fabs(clip.x), clip.w - std::fabs(clip.y), clip.w - std::fabs(clip.z) });
+			if (std::fabs(nearest) < margin) {
+				continue;
+			}
+			bool expected = nearest > 0.0f;	//-w <= x, y, z <= w
+			inside += expected;
+			wrong += frustrum.SphereInFrustrum(p, 0.0f) != expected;
+			if (expected) {	//Boxes may be let through when outside, but never culled when inside
+				wrong += !frustrum.BoxInFrustrum(p + Vector3(5, -3, 2), Vector3(6, 4, 3));
+			}
+		}
+		CHECK(wrong == 0);
+		CHECK(inside > 100);
+	}
+
+	//A sphere poking through the left side of the view is still visible
+	Frustrum frustrum;
+	Matrix4 m = CameraMatrix();
+	frustrum.FromMatrix(m);
+	Vector3 left;
+	for (float x = 0.0f; x > -1000.0f; x -= 1.0f) {
+		Vector3 p = Matrix4::BuildViewMatrix(Vector3(10, 20, 30), Vector3(100, 0, -200)).Inverse() * Vector3(x, 0.0f, -100.0f);
+		Vector4 clip = m * Vector4(p.x, p.y, p.z, 1.0f);
+		if (clip.x < -clip.w) {
+			left = p;
+			break;
+		}
+	}
+	CHECK(!frustrum.SphereInFrustrum(left, 0.0f));
+	CHECK(frustrum.SphereInFrustrum(left, 10.0f));
+}
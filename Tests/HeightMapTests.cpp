@@ -0,0 +1,319 @@
+#include "Test.h"
+#include "../nclgl/HeightMap.h"
+#include "../nclgl/JobSystem.h"
+
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <vector>
+
+namespace {
+	//Opens up the ray casting internals, for a cell by cell version to check against
+	class TestHeightMap : public HeightMap {
+	public:
+		TestHeightMap(const std::string& name) : HeightMap(name, false) {}
+
+		//Every cell the ray passes over, nearest hit wins - no pyramid
+		bool BruteForceRayCast(const Vector3& origin, const Vector3& direction, float maxDistance, Vector3& hit) const {
+			bool overMap =	origin.x >= 0.0f && origin.x <= heightMapSize.x &&
+							origin.z >= 0.0f && origin.z <= heightMapSize.z;
+			if (overMap && origin.y <= GetHeightAt(origin.x, origin.z)) {
+				hit = origin;
+				return true;
+			}
+			Vector3 o(origin.x / vertexScale.x, origin.y, origin.z / vertexScale.z);
+			Vector3 d(direction.x / vertexScale.x, direction.y, direction.z / vertexScale.z);
+			float nearest = FLT_MAX;
+			for (int z = 0; z < depth - 1; ++z) {
+				for (int x = 0; x < width - 1; ++x) {
+					float tMin = 0.0f, tMax = maxDistance;
+					if (!ClipAxis(o.x, d.x, (float)x, (float)x + 1, tMin, tMax) ||
+						!ClipAxis(o.z, d.z, (float)z, (float)z + 1, tMin, tMax)) {
+						continue;
+					}
+					float t;
+					if (RayCastCell(x, z, o, d, tMin, tMax, t)) {
+						nearest = std::min(nearest, t);
+					}
+				}
+			}
+			if (nearest == FLT_MAX) {
+				return false;
+			}
+			hit = origin + direction * nearest;
+			return true;
+		}
+
+	protected:
+		static bool ClipAxis(float o, float d, float low, float high, float& tMin, float& tMax) {
+			if (d == 0.0f) {
+				return o >= low && o <= high;
+			}
+			float t0 = (low - o) / d;
+			float t1 = (high - o) / d;
+			tMin = std::max(tMin, std::min(t0, t1));
+			tMax = std::min(tMax, std::max(t0, t1));
+			return tMin <= tMax;
+		}
+	};
+
+	std::filesystem::path TestDirectory() {
+		std::filesystem::path directory = std::filesystem::temp_directory_path() / "nclglTestsHeightMap";
+		std::error_code error;
+		std::filesystem::create_directories(directory, error);
+		return directory;
+	}
+
+	//samples are 0-1, as .r32 files hold them
+	std::string WriteR32(const std::string& fileName, const std::vector<float>& samples) {
+		std::string name = (TestDirectory() / fileName).string();
+		std::ofstream file(name, std::ios::binary);
+		file.write((const char*)samples.data(), samples.size() * sizeof(float));
+		return name;
+	}
+
+	std::vector<float> RandomSamples(int side, unsigned int seed) {
+		std::mt19937 random(seed);
+		std::uniform_real_distribution<float> height(0.0f, 1.0f);
+		std::vector<float> samples((size_t)side * side);
+		for (float& s : samples) {
+			s = height(random);
+		}
+		return samples;
+	}
+
+	//Checks a hit the way a ray marcher would see it - on the surface, with
+	//nothing under it on the way there - independently of RayCastCell
+	bool IsFirstHit(const HeightMap& map, const Vector3& origin, const Vector3& direction, const Vector3& hit) {
+		if (fabs(hit.y - map.GetHeightAt(hit.x, hit.z)) > 1e-2f) {
+			return false;
+		}
+		float distance = (hit - origin).Length();
+		for (float t = 0.0f; t < distance - 0.25f; t += 0.25f) {
+			Vector3 p = origin + direction * t;
+			if (p.y < map.GetHeightAt(p.x, p.z) - 1e-2f) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	//What Data/heights16*.png and Data/heights.r16 hold, as 16 bit samples -
+	//every bit of them varies, and each PNG row uses the next of the 5 filters
+	int FixtureSample(int x, int z) {
+		return (x * 7919 + z * 104729 + x * z * 31) & 0xFFFF;
+	}
+
+	bool SameHit(bool hitA, const Vector3& a, bool hitB, const Vector3& b) {
+		return hitA == hitB && (!hitA || (a - b).Length() < 1e-2f);
+	}
+}
+
+TEST(HeightMapBoundsWithoutAMesh) {
+	if (!Test::HasGLContext()) {
+		return;
+	}
+	//a bump in the middle, so the furthest vertex isn't just a corner
+	const int side = 33;
+	std::vector<float> samples((size_t)side * side);
+	for (int z = 0; z < side; ++z) {
+		for (int x = 0; x < side; ++x) {
+			float dx = x - side / 2.0f, dz = z - side / 2.0f;
+			samples[(size_t)z * side + x] = std::exp(-(dx * dx + dz * dz) / 8.0f) * 0.9f;
+		}
+	}
+	const std::string name = WriteR32("bump.r32", samples);
+	{
+		HeightMap meshed(name);
+		HeightMap bare(name, false);
+		CHECK(meshed.GetTriCount() == (side - 1) * (side - 1) * 2);
+		CHECK(bare.GetTriCount() == 0);
+		CHECK(bare.GetWidth() == side && bare.GetDepth() == side);
+		CHECK_NEAR(bare.GetBoundingRadius(), meshed.GetBoundingRadius(), 1e-3f);
+		CHECK(bare.GetHeightMapSize() == meshed.GetHeightMapSize());
+		CHECK_NEAR(bare.GetHeightAt(256.0f, 256.0f), meshed.GetHeightAt(256.0f, 256.0f), 1e-5f);
+		//drawing one without a mesh is just an empty draw
+		bare.Draw();
+	}
+	std::error_code error;
+	std::filesystem::remove_all(TestDirectory(), error);
+}
+
+TEST(HeightMapHeightsAtSamplesAndCells) {
+	if (!Test::HasGLContext()) {
+		return;
+	}
+	const int side = 17;
+	std::vector<float> samples = RandomSamples(side, 1);
+	{
+		HeightMap map(WriteR32("heights.r32", samples), false);
+		Vector3 scale = map.GetVertexScale();
+		auto sample = [&](int x, int z) { return samples[(size_t)z * side + x] * 255.0f * scale.y; };
+		for (int z = 0; z < side; ++z) {
+			for (int x = 0; x < side; ++x) {
+				CHECK_NEAR(map.GetHeightAt(x * scale.x, z * scale.z), sample(x, z), 1e-3);
+			}
+		}
+		for (int z = 0; z < side - 1; ++z) {
+			for (int x = 0; x < side - 1; ++x) {
+				float centre = (sample(x, z) + sample(x + 1, z) + sample(x, z + 1) + sample(x + 1, z + 1)) / 4.0f;
+				CHECK_NEAR(map.GetHeightAt((x + 0.5f) * scale.x, (z + 0.5f) * scale.z), centre, 1e-3);
+			}
+		}
+		//off the map takes the nearest edge
+		CHECK_NEAR(map.GetHeightAt(-100.0f, 3 * scale.z), sample(0, 3), 1e-3);
+		CHECK_NEAR(map.GetHeightAt(1e6f, 1e6f), sample(side - 1, side - 1), 1e-3);
+	}
+	std::error_code error;
+	std::filesystem::remove_all(TestDirectory(), error);
+}
+
+TEST(HeightMapSampleHeightsMatchesSerial) {
+	if (!Test::HasGLContext()) {
+		return;
+	}
+	const int side = 33;
+	{
+		HeightMap map(WriteR32("sampled.r32", RandomSamples(side, 2)), false);
+		Vector3 size = map.GetHeightMapSize();
+		//enough points to be split into jobs, some of them off the map
+		std::mt19937 random(3);
+		std::uniform_real_distribution<float> x(-50.0f, size.x + 50.0f), z(-50.0f, size.z + 50.0f);
+		std::vector<Vector3> points(8192);
+		for (Vector3& p : points) {
+			p = Vector3(x(random), 0.0f, z(random));
+		}
+		std::vector<float>		serialHeights(points.size()), jobHeights(points.size());
+		std::vector<Vector3>	serialNormals(points.size()), jobNormals(points.size());
+		map.SampleHeights(points.data(), points.size(), serialHeights.data(), serialNormals.data());
+		JobSystem jobs(4);
+		map.SampleHeights(points.data(), points.size(), jobHeights.data(), jobNormals.data(), &jobs);
+
+		CHECK(memcmp(serialHeights.data(), jobHeights.data(), serialHeights.size() * sizeof(float)) == 0);
+		CHECK(memcmp(serialNormals.data(), jobNormals.data(), serialNormals.size() * sizeof(Vector3)) == 0);
+		int mismatches = 0;
+		for (size_t i = 0; i < points.size(); ++i) {
+			mismatches += serialHeights[i] != map.GetHeightAt(points[i].x, points[i].z);
+			mismatches += !(serialNormals[i] == map.GetNormalAt(points[i].x, points[i].z));
+		}
+		CHECK(mismatches == 0);
+		//just one of the outputs is fine too
+		map.SampleHeights(points.data(), points.size(), jobHeights.data(), nullptr, &jobs);
+		CHECK(memcmp(serialHeights.data(), jobHeights.data(), serialHeights.size() * sizeof(float)) == 0);
+	}
+	std::error_code error;
+	std::filesystem::remove_all(TestDirectory(), error);
+}
+
+TEST(HeightMapRayCastMatchesBruteForce) {
+	if (!Test::HasGLContext()) {
+		return;
+	}
+	//not a power of two across, so the pyramid has ragged edges
+	const int side = 23;
+	{
+		TestHeightMap map(WriteR32("rays.r32", RandomSamples(side, 4)));
+		Vector3 size = map.GetHeightMapSize();
+		const float maxDistance = 2000.0f;
+		std::mt19937 random(5);
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+		auto randomDirection = [&]() {
+			Vector3 d;
+			do {
+				d = Vector3(unit(random) * 2 - 1, unit(random) * 2 - 1, unit(random) * 2 - 1);
+			} while (d.Length() < 0.1f);
+			return d.Normalised();
+		};
+		int mismatches	= 0;
+		int hits		= 0;
+		auto check = [&](const Vector3& origin, const Vector3& direction) {
+			Vector3 fast, slow;
+			bool hitFast = map.RayCast(origin, direction, maxDistance, fast);
+			bool hitSlow = map.BruteForceRayCast(origin, direction, maxDistance, slow);
+			mismatches	+= !SameHit(hitFast, fast, hitSlow, slow);
+			hits		+= hitFast;
+		};
+
+		//from above the map, mostly looking down - and these hits are checked by marching along the ray too
+		int notFirst = 0;
+		for (int i = 0; i < 1000; ++i) {
+			Vector3 origin(unit(random) * size.x, 260.0f + unit(random) * 200.0f, unit(random) * size.z);
+			Vector3 d = randomDirection();
+			d.y = -fabs(d.y);
+			d.Normalise();
+			check(origin, d);
+			Vector3 hit;
+			if (map.RayCast(origin, d, maxDistance, hit)) {
+				notFirst += !IsFirstHit(map, origin, d, hit);
+			}
+		}
+		CHECK(notFirst == 0);
+		//from off the map, low down - these come in through its sides, often below the surface
+		for (int i = 0; i < 1000; ++i) {
+			float angle = unit(random) * 6.2832f;
+			Vector3 origin(size.x / 2 + cos(angle) * size.x, unit(random) * 300.0f - 20.0f, size.z / 2 + sin(angle) * size.z);
+			Vector3 towards = Vector3(unit(random) * size.x, unit(random) * 255.0f, unit(random) * size.z) - origin;
+			check(origin, towards.Normalised());
+			check(origin, randomDirection());
+		}
+		//along the axes, and straight up and down
+		const Vector3 axes[8] = {
+			Vector3(1, 0, 0), Vector3(-1, 0, 0), Vector3(0, 0, 1), Vector3(0, 0, -1), Vector3(0, -1, 0), Vector3(0, 1, 0),
+			Vector3(1, -1, 0).Normalised(), Vector3(0, -0.2f, -1).Normalised()
+		};
+		for (int i = 0; i < 250; ++i) {
+			Vector3 origin(unit(random) * (size.x + 100) - 50, unit(random) * 300.0f, unit(random) * (size.z + 100) - 50);
+			for (const Vector3& d : axes) {
+				check(origin, d);
+			}
+		}
+		CHECK(mismatches == 0);
+		CHECK(hits > 1000);
+
+		//starting under the surface hits straight away
+		Vector3 hit;
+		Vector3 under(size.x / 3, map.GetHeightAt(size.x / 3, size.z / 3) - 1.0f, size.z / 3);
+		CHECK(map.RayCast(under, Vector3(0, 1, 0), maxDistance, hit) && hit == under);
+		//and looking up from above it, or away from it, misses
+		CHECK(!map.RayCast(Vector3(size.x / 2, 300.0f, size.z / 2), Vector3(0, 1, 0), maxDistance, hit));
+		CHECK(!map.RayCast(Vector3(-10.0f, 100.0f, -10.0f), Vector3(-1, 0, 0), maxDistance, hit));
+		//nor does it reach past maxDistance
+		CHECK(!map.RayCast(Vector3(size.x / 2, 1000.0f, size.z / 2), Vector3(0, -1, 0), 500.0f, hit));
+	}
+	std::error_code error;
+	std::filesystem::remove_all(TestDirectory(), error);
+}
+
+TEST(HeightMapLoads16BitFiles) {
+	if (!Test::HasGLContext()) {
+		return;
+	}
+	//grey, RGB, grey + alpha and RGBA, with their data split over 3 IDAT chunks
+	struct Fixture {
+		const char*	name;
+		int			width;
+		int			depth;
+	};
+	const Fixture fixtures[5] = {
+		{ "Data/heights16Grey.png", 9, 7 }, { "Data/heights16RGB.png", 9, 7 }, { "Data/heights16GreyAlpha.png", 9, 7 },
+		{ "Data/heights16RGBA.png", 9, 7 }, { "Data/heights.r16", 9, 9 }
+	};
+	for (const Fixture& f : fixtures) {
+		HeightMap map(f.name, false);
+		const int width = f.width, depth = f.depth;
+		if (map.GetWidth() != width || map.GetDepth() != depth) {
+			Test::Fail(__FILE__, __LINE__, std::string("can't load ") + f.name + " - is the working directory Tests?");
+			continue;
+		}
+		int mismatches = 0;
+		for (int z = 0; z < depth; ++z) {
+			for (int x = 0; x < width; ++x) {
+				mismatches += map.GetHeights()[(size_t)z * width + x] != FixtureSample(x, z) / 257.0f;
+			}
+		}
+		CHECK(mismatches == 0);
+	}
+}
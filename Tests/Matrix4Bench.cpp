@@ -0,0 +1,105 @@
+#include "Test.h"
+#include "../nclgl/Matrix4.h"
+
+#include <cstdlib>
+
+namespace {
+	//The plain loop operator* uses when there's no SSE
+	Matrix4 ScalarMultiply(const Matrix4& m, const Matrix4& a) {
+		Matrix4 out;
+		for (unsigned int r = 0; r < 4; ++r) {
+			for (unsigned int c = 0; c < 4; ++c) {
+				out.values[c + (r * 4)] = 0.0f;
+				for (unsigned int i = 0; i < 4; ++i) {
+					out.values[c + (r * 4)] += m.values[c + (i * 4)] * a.values[(r * 4) + i];
+				}
+			}
+		}
+		return out;
+	}
+
+	std::vector<Matrix4> RandomMatrices(size_t count) {
+		std::vector<Matrix4> matrices(count);
+		for (Matrix4& m : matrices) {
+			for (float& v : m.values) {
+				v = (rand() / (float)RAND_MAX) - 0.5f;
+			}
+		}
+		return matrices;
+	}
+
+	bool Matches(const Matrix4& a, const Matrix4& b) {
+		for (int i = 0; i < 16; ++i) {
+			if (std::fabs(a.values[i] - b.values[i]) > 1e-5f) {
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
+TEST(Matrix4BatchesMatchScalar) {
+	srand(1);
+	const size_t count = 1000;
+	std::vector<Matrix4> a = RandomMatrices(count);
+	std::vector<Matrix4> b = RandomMatrices(count);
+	std::vector<Matrix4> out(count);
+
+	int wrong = 0;
+	Matrix4::MultiplyPairs(a.data(), b.data(), out.data(), count);
+	for (size_t i = 0; i < count; ++i) {
+		wrong += !Matches(out[i], ScalarMultiply(a[i], b[i]));
+		wrong += !Matches(a[i] * b[i], ScalarMultiply(a[i], b[i]));
+	}
+	Matrix4::MultiplyBatch(a[0], b.data(), out.data(), count);
+	for (size_t i = 0; i < count; ++i) {
+		wrong += !Matches(out[i], ScalarMultiply(a[0], b[i]));
+	}
+	CHECK(wrong == 0);
+
+	Matrix4 projection = Matrix4::Perspective(1.0f, 100.0f, 1.3f, 45.0f) * a[3];
+	std::vector<Vector3> points(count), transformed(count);
+	std::vector<Vector4> points4(count), transformed4(count);
+	for (size_t i = 0; i < count; ++i) {
+		points[i]	= Vector3((float)i, i * 0.5f, -(float)i);
+		points4[i]	= Vector4((float)i, 1.0f, 2.0f, 1.0f);
+	}
+	Matrix4::TransformPoints(projection, points.data(), transformed.data(), count);
+	Matrix4::TransformPoints(projection, points4.data(), transformed4.data(), count);
+	for (size_t i = 0; i < count; ++i) {
+		Vector3 p	= projection * points[i];
+		Vector4 p4	= projection * points4[i];
+		float scale	= 1e-5f * (1.0f + std::fabs(p4.w) + p.Length());
+		wrong += (p - transformed[i]).Length() > scale;
+		wrong += std::fabs(p4.x - transformed4[i].x) > scale || std::fabs(p4.y - transformed4[i].y) > scale
+			|| std::fabs(p4.z - transformed4[i].z) > scale || std::fabs(p4.w - transformed4[i].w) > scale;
+	}
+	CHECK(wrong == 0);
+}
+
+BENCHMARK(Matrix4Multiply) {
+	srand(1);
+	const size_t count = 10000;
+	std::vector<Matrix4> a = RandomMatrices(count);
+	std::vector<Matrix4> b = RandomMatrices(count);
+	std::vector<Matrix4> out(count);
+
+	double scalar = Test::Time(20, [&] {
+		for (size_t i = 0; i < count; ++i) {
+			out[i] = ScalarMultiply(a[i], b[i]);
+		}
+	});
+	double single = Test::Time(20, [&] {
+		for (size_t i = 0; i < count; ++i) {
+			out[i] = a[i] * b[i];
+		}
+	});
+	double pairs = Test::Time(20, [&] {
+		Matrix4::MultiplyPairs(a.data(), b.data(), out.data(), count);
+	});
+	double batch = Test::Time(20, [&] {
+		Matrix4::MultiplyBatch(a[0], b.data(), out.data(), count);
+	});
+	std::cout << "\t" << count << " multiplies: scalar " << scalar << "ms, operator* " << single
+		<< "ms, MultiplyPairs " << pairs << "ms, MultiplyBatch " << batch << "ms\n";
+}
@@ -0,0 +1,61 @@
+#include "Test.h"
+#include "../nclgl/Mesh.h"
+#include "../nclgl/MeshFile.h"
+#include "../nclgl/common.h"
+
+#include <cstdio>
+#include <memory>
+
+namespace {
+	//A quad, as two triangles in one submesh
+	MeshFileData MakeQuad() {
+		MeshFileData data;
+		data.numMeshes		= 1;
+		data.numVertices	= 4;
+		data.numIndices		= 6;
+		data.positions		= { Vector3(0, 0, 0), Vector3(1, 0, 0), Vector3(1, 1, 0), Vector3(0, 1, 0) };
+		data.indices		= { 0, 1, 2, 2, 3, 0 };
+		data.subMeshes		= { { 0, 6 } };
+		return data;
+	}
+
+	//Loads from ../Meshes, as LoadFromBinaryMeshFile only looks there
+	bool Loads(const MeshFileData& data) {
+		const std::string name = "nclglTestsMesh.mshb";
+		if (!WriteBinaryMeshFile(MESHDIR + name, data)) {
+			Test::Fail(__FILE__, __LINE__, "can't write to " MESHDIR " - is the working directory Tests?");
+			return false;
+		}
+		std::unique_ptr<Mesh> mesh(Mesh::LoadFromBinaryMeshFile(name));
+		std::remove((MESHDIR + name).c_str());
+		return mesh != nullptr;
+	}
+}
+
+TEST(BinaryMeshRangesAreChecked) {
+	if (!Test::HasGLContext()) {
+		return;
+	}
+	CHECK(Loads(MakeQuad()));
+
+	MeshFileData badIndex = MakeQuad();
+	badIndex.indices[4] = 4;
+	CHECK(!Loads(badIndex));
+
+	MeshFileData pastTheEnd = MakeQuad();
+	pastTheEnd.subMeshes = { { 0, 3 }, { 3, 4 } };
+	CHECK(!Loads(pastTheEnd));
+
+	MeshFileData negative = MakeQuad();
+	negative.subMeshes = { { -3, 6 } };
+	CHECK(!Loads(negative));
+
+	//without indices, submeshes are ranges of vertices
+	MeshFileData unindexed = MakeQuad();
+	unindexed.numIndices = 0;
+	unindexed.indices.clear();
+	unindexed.subMeshes = { { 0, 4 } };
+	CHECK(Loads(unindexed));
+	unindexed.subMeshes = { { 2, 3 } };
+	CHECK(!Loads(unindexed));
+}
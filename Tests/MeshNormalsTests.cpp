@@ -0,0 +1,115 @@
+#include "Test.h"
+#include "../nclgl/Mesh.h"
+#include "../nclgl/JobSystem.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+namespace {
+	//A bumpy grid, big enough for GenerateNormals / GenerateTangents to split
+	//it over the JobSystem when there's more than one thread
+	class GridMesh : public Mesh {
+	public:
+		GridMesh(int side, bool indexed) {
+			std::mt19937 random(side);
+			std::uniform_real_distribution<float> bump(-0.5f, 0.5f);
+			std::vector<Vector3>	gridVertices;
+			std::vector<Vector2>	gridCoords;
+			for (int z = 0; z < side; ++z) {
+				for (int x = 0; x < side; ++x) {
+					gridVertices.push_back(Vector3((float)x, bump(random), (float)z));
+					gridCoords.push_back(Vector2(x / 8.0f, z / 8.0f));
+				}
+			}
+			std::vector<GLuint> gridIndices;
+			for (int z = 0; z < side - 1; ++z) {
+				for (int x = 0; x < side - 1; ++x) {
+					GLuint a = z * side + x, b = a + 1, c = a + side + 1, d = a + side;
+					GLuint quad[6] = { a, c, b, c, a, d };
+					gridIndices.insert(gridIndices.end(), quad, quad + 6);
+				}
+			}
+			if (indexed) {
+				numVertices	= (GLuint)gridVertices.size();
+				numIndices	= (GLuint)gridIndices.size();
+				indices		= new GLuint[numIndices];
+				std::copy(gridIndices.begin(), gridIndices.end(), indices);
+			}
+			else {
+				numVertices	= (GLuint)gridIndices.size();
+			}
+			vertices		= new Vector3[numVertices];
+			textureCoords	= new Vector2[numVertices];
+			for (GLuint i = 0; i < numVertices; ++i) {
+				GLuint from		= indexed ? i : gridIndices[i];
+				vertices[i]		= gridVertices[from];
+				textureCoords[i] = gridCoords[from];
+			}
+		}
+
+		GLuint			GetVertexCount() const	{ return numVertices; }
+		const Vector3*	GetVertices() const		{ return vertices; }
+		const Vector3*	GetNormals() const		{ return normals; }
+		const Vector4*	GetTangents() const		{ return tangents; }
+	};
+
+	//The single threaded way - every triangle adds itself straight onto its vertices
+	void SerialNormalsAndTangents(GridMesh& mesh, std::vector<Vector3>& normals, std::vector<Vector4>& tangents) {
+		const Vector3* vertices = mesh.GetVertices();
+		normals.assign(mesh.GetVertexCount(), Vector3());
+		tangents.assign(mesh.GetVertexCount(), Vector4(0, 0, 0, 0));
+		for (unsigned int t = 0; t < mesh.GetTriCount(); ++t) {
+			unsigned int a, b, c;
+			mesh.GetVertexIndicesForTri(t, a, b, c);
+			Vector3 normal	= Vector3::Cross(vertices[b] - vertices[a], vertices[c] - vertices[a]);
+			Vector4 tangent	= mesh.GenerateTangent(a, b, c);
+			for (unsigned int v : { a, b, c }) {
+				normals[v]	+= normal;
+				tangents[v]	+= tangent;
+			}
+		}
+		for (size_t v = 0; v < normals.size(); ++v) {
+			normals[v].Normalise();
+			float handedness = tangents[v].w > 0.0f ? 1.0f : -1.0f;
+			tangents[v].w = 0.0f;
+			tangents[v].Normalise();
+			tangents[v].w = handedness;
+		}
+	}
+
+	void CheckAgainstSerial(bool indexed) {
+		//(side - 1)^2 * 2 triangles - plenty over the 8192 it takes to split
+		GridMesh mesh(160, indexed);
+		std::vector<Vector3>	normals;
+		std::vector<Vector4>	tangents;
+		SerialNormalsAndTangents(mesh, normals, tangents);
+		mesh.GenerateNormals();
+		mesh.GenerateTangents();
+
+		double worstNormal = 0.0, worstTangent = 0.0;
+		int flippedHandedness = 0;
+		for (GLuint i = 0; i < mesh.GetVertexCount(); ++i) {
+			const Vector4& t = mesh.GetTangents()[i];
+			worstNormal		= std::max(worstNormal, (double)(mesh.GetNormals()[i] - normals[i]).Length());
+			worstTangent	= std::max(worstTangent, (double)(Vector3(t.x, t.y, t.z) -
+				Vector3(tangents[i].x, tangents[i].y, tangents[i].z)).Length());
+			flippedHandedness += t.w != tangents[i].w;
+		}
+		CHECK_NEAR(worstNormal, 0.0, 1e-5);
+		CHECK_NEAR(worstTangent, 0.0, 1e-5);
+		CHECK(flippedHandedness == 0);
+	}
+}
+
+TEST(MeshNormalsMatchSerial) {
+	if (!Test::HasGLContext()) {
+		return;	//Mesh makes its VAO as it's built
+	}
+	if (JobSystem::GetShared().GetThreadCount() == 1) {
+		std::cout << "  (one thread - only the serial path is checked)" << std::endl;
+	}
+	CheckAgainstSerial(true);
+	CheckAgainstSerial(false);
+}
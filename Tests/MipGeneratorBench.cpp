@@ -0,0 +1,101 @@
+#include "Test.h"
+#include "../nclgl/MipGenerator.h"
+#include "../nclgl/JobSystem.h"
+
+#include <cstdlib>
+
+namespace {
+	//Plain 2x2 box filter, repeating the last row / column of odd sized images
+	void ReferenceBox(const unsigned char* src, int srcWidth, int srcHeight, int channels, unsigned char* dst) {
+		int dstWidth	= std::max(1, srcWidth / 2);
+		int dstHeight	= std::max(1, srcHeight / 2);
+		for (int y = 0; y < dstHeight; ++y) {
+			int y0 = std::min(y * 2, srcHeight - 1);
+			int y1 = std::min(y * 2 + 1, srcHeight - 1);
+			for (int x = 0; x < dstWidth; ++x) {
+				int x0 = std::min(x * 2, srcWidth - 1);
+				int x1 = std::min(x * 2 + 1, srcWidth - 1);
+				for (int c = 0; c < channels; ++c) {
+					*dst++ = (unsigned char)((src[(y0 * srcWidth + x0) * channels + c] + src[(y0 * srcWidth + x1) * channels + c] +
+						src[(y1 * srcWidth + x0) * channels + c] + src[(y1 * srcWidth + x1) * channels + c] + 2) >> 2);
+				}
+			}
+		}
+	}
+
+	std::vector<unsigned char> RandomImage(int width, int height, int channels) {
+		std::vector<unsigned char> image((size_t)width * height * channels);
+		for (unsigned char& v : image) {
+			v = (unsigned char)rand();
+		}
+		return image;
+	}
+}
+
+TEST(MipGeneratorBoxMatchesReference) {
+	srand(5);
+	MipGenerator	box;
+	JobSystem		jobs(4);
+	const int sizes[][2] = { {1, 1}, {1, 7}, {7, 1}, {2, 2}, {3, 5}, {17, 9}, {33, 64}, {64, 33}, {100, 77}, {513, 257}, {600, 600} };
+	for (int channels = 1; channels <= 4; ++channels) {
+		for (const int* size : sizes) {
+			int dstSize = std::max(1, size[0] / 2) * std::max(1, size[1] / 2) * channels;
+			std::vector<unsigned char> src = RandomImage(size[0], size[1], channels);
+			std::vector<unsigned char> expected(dstSize), single(dstSize), threaded(dstSize);
+
+			ReferenceBox(src.data(), size[0], size[1], channels, expected.data());
+			box.Downsample(src.data(), size[0], size[1], channels, single.data());
+			box.Downsample(src.data(), size[0], size[1], channels, threaded.data(), &jobs);
+			CHECK(single == expected);
+			CHECK(threaded == expected);
+		}
+	}
+}
+
+TEST(MipGeneratorFlatImages) {
+	//A flat image stays flat, whatever the filter
+	MipGenerator filters[] = { MipGenerator(MipFilter::Box, true), MipGenerator(MipFilter::Lanczos), MipGenerator(MipFilter::Lanczos, true) };
+	std::vector<unsigned char> src(40 * 30 * 4), dst(20 * 15 * 4);
+	for (const MipGenerator& m : filters) {
+		int worst = 0;
+		for (int v = 0; v < 256; ++v) {
+			std::fill(src.begin(), src.end(), (unsigned char)v);
+			m.Downsample(src.data(), 40, 30, 4, dst.data());
+			for (unsigned char d : dst) {
+				worst = std::max(worst, std::abs(d - v));
+			}
+		}
+		CHECK(worst <= (m.IsSRGB() ? 1 : 0));
+	}
+
+	//An sRGB black / white checker averages to half the light, not half the value
+	MipGenerator sRGB(MipFilter::Box, true);
+	unsigned char checker[16] = { 0, 0, 0, 255,  255, 255, 255, 255,  255, 255, 255, 0,  0, 0, 0, 0 };
+	unsigned char average[4];
+	sRGB.Downsample(checker, 2, 2, 4, average);
+	CHECK(average[0] == 188);
+	CHECK(average[3] == 128);
+}
+
+BENCHMARK(MipGeneratorThroughput) {
+	srand(6);
+	const int size = 2048;
+	MipGenerator	box;
+	MipGenerator	boxSRGB(MipFilter::Box, true);
+	MipGenerator	lanczos(MipFilter::Lanczos);
+	for (int channels : { 3, 4 }) {
+		std::vector<unsigned char> src = RandomImage(size, size, channels);
+		std::vector<unsigned char> dst((size_t)(size / 2) * (size / 2) * channels);
+		double megabytes = src.size() / 1e6;
+
+		auto report = [&](const char* name, double ms) {
+			std::cout << "\t\t" << name << ": " << ms << "ms, " << megabytes / (ms / 1000.0) << " MB/s\n";
+		};
+		std::cout << "\t" << size << "x" << size << ", " << channels << " channels\n";
+		report("scalar box",	Test::Time(10, [&] { ReferenceBox(src.data(), size, size, channels, dst.data()); }));
+		report("box",			Test::Time(10, [&] { box.Downsample(src.data(), size, size, channels, dst.data()); }));
+		report("box, threaded",	Test::Time(10, [&] { box.Downsample(src.data(), size, size, channels, dst.data(), &JobSystem::GetShared()); }));
+		report("sRGB box",		Test::Time(10, [&] { boxSRGB.Downsample(src.data(), size, size, channels, dst.data()); }));
+		report("lanczos",		Test::Time(10, [&] { lanczos.Downsample(src.data(), size, size, channels, dst.data()); }));
+	}
+}
@@ -0,0 +1,156 @@
+#include "Test.h"
+#include "../nclgl/ProgramBinaryCache.h"
+
+#include <filesystem>
+#include <fstream>
+
+namespace {
+	//Starts out empty
+	std::string CacheDirectory() {
+		std::filesystem::path path = std::filesystem::temp_directory_path() / "nclglTestsProgramCache";
+		std::error_code error;
+		std::filesystem::remove_all(path, error);
+		return path.string();
+	}
+
+	void OverwriteByte(const std::string& path, std::streamoff at, char value) {
+		std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+		file.seekp(at);
+		file.put(value);
+	}
+
+	const std::string vertexSource =
+		"#version 330 core\n"
+		"in vec3 position;\n"
+		"uniform mat4 mvp;\n"
+		"void main() { gl_Position = mvp * vec4(position, 1.0); }\n";
+	const std::string fragmentSource =
+		"#version 330 core\n"
+		"out vec4 colour;\n"
+		"void main() { colour = vec4(1.0, 0.5, 0.25, 1.0); }\n";
+
+	GLuint CompileStage(GLenum type, const std::string& source) {
+		GLuint shader = glCreateShader(type);
+		const char* text = source.c_str();
+		glShaderSource(shader, 1, &text, nullptr);
+		glCompileShader(shader);
+		return shader;
+	}
+
+	GLuint LinkProgram() {
+		GLuint program		= glCreateProgram();
+		GLuint vertex		= CompileStage(GL_VERTEX_SHADER, vertexSource);
+		GLuint fragment		= CompileStage(GL_FRAGMENT_SHADER, fragmentSource);
+		glAttachShader(program, vertex);
+		glAttachShader(program, fragment);
+		ProgramBinaryCache::SetRetrievable(program);
+		glLinkProgram(program);
+		glDetachShader(program, vertex);
+		glDetachShader(program, fragment);
+		glDeleteShader(vertex);
+		glDeleteShader(fragment);
+		return program;
+	}
+}
+
+TEST(ProgramBinaryCacheKeys) {
+	std::string sources[2] = { "void main() {}", "void main() { discard; }" };
+	uint64_t key = ProgramBinaryCache::MakeKey(sources, 2, "driver");
+	CHECK(key != 0);
+	CHECK(key == ProgramBinaryCache::MakeKey(sources, 2, "driver"));
+	CHECK(key != ProgramBinaryCache::MakeKey(sources, 2, "new driver"));
+
+	std::string edited[2] = { "void main() {}", "void main() { discard;}" };
+	CHECK(key != ProgramBinaryCache::MakeKey(edited, 2, "driver"));
+
+	//Same text, split differently between the stages
+	std::string moved[2] = { "void main() {} ", "void main() { discard; }" };
+	std::string moved2[2] = { "void main() {}", " void main() { discard; }" };
+	CHECK(ProgramBinaryCache::MakeKey(moved, 2, "driver") != ProgramBinaryCache::MakeKey(moved2, 2, "driver"));
+}
+
+TEST(ProgramBinaryCacheEntries) {
+	ProgramBinaryCache	cache(CacheDirectory());
+	std::vector<char>	binary(1000);
+	for (size_t i = 0; i < binary.size(); ++i) {
+		binary[i] = (char)(i * 7);
+	}
+	const uint64_t key = 0x1234abcd5678ef00ull;
+
+	GLenum				format = 0;
+	std::vector<char>	read;
+	CHECK(!cache.ReadEntry(key, format, read));	//nothing there yet
+
+	CHECK(cache.WriteEntry(key, 42, binary));
+	CHECK(cache.ReadEntry(key, format, read));
+	CHECK(format == 42);
+	CHECK(read == binary);
+
+	//A flipped byte in the binary fails the checksum, and the entry goes
+	std::string path = cache.GetEntryPath(key);
+	OverwriteByte(path, (std::streamoff)std::filesystem::file_size(path) - 10, 'X');
+	CHECK(!cache.ReadEntry(key, format, read));
+	CHECK(!std::filesystem::exists(path));
+
+	//As does a truncated one
+	CHECK(cache.WriteEntry(key, 42, binary));
+	std::filesystem::resize_file(path, 500);
+	CHECK(!cache.ReadEntry(key, format, read));
+	CHECK(!std::filesystem::exists(path));
+
+	//And one that's been filed under the wrong key
+	CHECK(cache.WriteEntry(key, 42, binary));
+	std::filesystem::rename(path, cache.GetEntryPath(key + 1));
+	CHECK(!cache.ReadEntry(key + 1, format, read));
+	CHECK(!std::filesystem::exists(cache.GetEntryPath(key + 1)));
+
+	CacheDirectory();
+}
+
+TEST(ProgramBinaryCacheLoad) {
+	if (!Test::HasGLContext()) {
+		return;
+	}
+	std::string	sources[2]	= { vertexSource, fragmentSource };
+	uint64_t	key			= ProgramBinaryCache::MakeKey(sources, 2);
+	if (!key) {
+		std::cout << "\tDriver has no program binary formats, skipped\n";
+		return;
+	}
+	ProgramBinaryCache cache(CacheDirectory());
+
+	GLuint linked = LinkProgram();
+	GLint status = GL_FALSE;
+	glGetProgramiv(linked, GL_LINK_STATUS, &status);
+	CHECK(status == GL_TRUE);
+	CHECK(cache.Save(linked, key));
+	glDeleteProgram(linked);
+
+	GLuint loaded = glCreateProgram();
+	CHECK(cache.Load(loaded, key));
+	CHECK(glGetUniformLocation(loaded, "mvp") >= 0);
+	glDeleteProgram(loaded);
+
+	//Corrupt entries are thrown away rather than handed to the driver
+	std::string path = cache.GetEntryPath(key);
+	OverwriteByte(path, (std::streamoff)std::filesystem::file_size(path) / 2, 'X');
+	loaded = glCreateProgram();
+	CHECK(!cache.Load(loaded, key));
+	CHECK(!std::filesystem::exists(path));
+	glDeleteProgram(loaded);
+
+	//A binary with a good checksum that the driver won't take goes too
+	linked = LinkProgram();
+	CHECK(cache.Save(linked, key));
+	glDeleteProgram(linked);
+	GLenum				format;
+	std::vector<char>	binary;
+	CHECK(cache.ReadEntry(key, format, binary));
+	CHECK(cache.WriteEntry(key, format + 12345, binary));
+	loaded = glCreateProgram();
+	CHECK(!cache.Load(loaded, key));
+	CHECK(!std::filesystem::exists(path));
+	glDeleteProgram(loaded);
+
+	CacheDirectory();
+}
@@ -0,0 +1,376 @@
+#include "Test.h"
+#include "../nclgl/TerrainQuadtree.h"
+#include "../nclgl/Frustrum.h"
+#include "../nclgl/GLStateCache.h"
+#include "../nclgl/Matrix4.h"
+
+#include <array>
+#include <climits>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <random>
+
+namespace {
+	const int		SIZE	= 257;
+	const Vector3	SCALE	= Vector3(8.0f, 2.0f, 8.0f);
+
+	float RawHeight(int x, int z) {
+		return 30.0f + 20.0f * sin(x * 0.05f) * cos(z * 0.07f);
+	}
+
+	//The full detail surface, in local units
+	float Surface(float x, float z) {
+		float sx = x / SCALE.x;
+		float sz = z / SCALE.z;
+		int ix = std::min(std::max((int)sx, 0), SIZE - 2);
+		int iz = std::min(std::max((int)sz, 0), SIZE - 2);
+		float fx = sx - ix;
+		float fz = sz - iz;
+		float top		= RawHeight(ix, iz) * (1.0f - fx) + RawHeight(ix + 1, iz) * fx;
+		float bottom	= RawHeight(ix, iz + 1) * (1.0f - fx) + RawHeight(ix + 1, iz + 1) * fx;
+		return (top * (1.0f - fz) + bottom * fz) * SCALE.y;
+	}
+
+	std::vector<float> MakeHeights(int side = SIZE) {
+		std::vector<float> heights((size_t)side * side);
+		for (int z = 0; z < side; ++z) {
+			for (int x = 0; x < side; ++x) {
+				heights[(size_t)z * side + x] = RawHeight(x, z);
+			}
+		}
+		return heights;
+	}
+
+	//Gets at the selection, without drawing it
+	class TestTerrain : public TerrainQuadtree {
+	public:
+		TestTerrain(const std::vector<float>& heights, int side = SIZE) :
+			TerrainQuadtree(heights, side, side, SCALE, Vector2(1.0f, 1.0f), 16) {}
+		TestTerrain(const std::string& tileFile, JobSystem& jobs) : TerrainQuadtree(tileFile, jobs) {}
+
+		//Each selected patch's first sample and depth, in order
+		std::vector<std::array<int, 3>> GetSelection() const {
+			std::vector<std::array<int, 3>> patches;
+			for (int i : selected) {
+				patches.push_back({ nodes[i].x, nodes[i].z, nodes[i].depth });
+			}
+			std::sort(patches.begin(), patches.end());
+			return patches;
+		}
+
+		//Largest difference in depth between the selected patches either side of
+		//any edge between leaf sized cells
+		int GetLargestDepthChange() const {
+			std::vector<int> cellDepths((size_t)cellsX * cellsZ, -1);
+			for (int i : selected) {
+				const Node& n = nodes[i];
+				for (int cz = n.z / patchSize; cz < std::min(n.z / patchSize + n.step, cellsZ); ++cz) {
+					for (int cx = n.x / patchSize; cx < std::min(n.x / patchSize + n.step, cellsX); ++cx) {
+						cellDepths[(size_t)cz * cellsX + cx] = n.depth;
+					}
+				}
+			}
+			int largest = 0;
+			for (int cz = 0; cz < cellsZ; ++cz) {
+				for (int cx = 0; cx < cellsX; ++cx) {
+					int d = cellDepths[(size_t)cz * cellsX + cx];
+					if (d < 0) {
+						return INT_MAX;	//a hole
+					}
+					if (cx + 1 < cellsX) largest = std::max(largest, abs(d - cellDepths[(size_t)cz * cellsX + cx + 1]));
+					if (cz + 1 < cellsZ) largest = std::max(largest, abs(d - cellDepths[(size_t)(cz + 1) * cellsX + cx]));
+				}
+			}
+			return largest;
+		}
+
+		//Puts every selected patch's stitched triangles together, over the
+		//heightfield's samples, and counts the edges that aren't shared by two
+		//triangles - or by just one, along the heightfield's own edges
+		int CountCrackedEdges() const {
+			std::map<std::pair<int, int>, int> uses;
+			const int row = patchSize + 1;
+			for (int i : selected) {
+				const Node& n = nodes[i];
+				const GLuint* indices = GetVariantIndices(n.edges);
+				for (int t = 0; t < GetVariantTriangles(n.edges); ++t) {
+					int corners[3];
+					for (int k = 0; k < 3; ++k) {
+						int v = (int)indices[t * 3 + k];
+						corners[k] = (n.z + v / row * n.step) * width + n.x + v % row * n.step;
+					}
+					for (int k = 0; k < 3; ++k) {
+						int a = corners[k], b = corners[(k + 1) % 3];
+						uses[{ std::min(a, b), std::max(a, b) }]++;
+					}
+				}
+			}
+			int cracked = 0;
+			for (const auto& edge : uses) {
+				int ax = edge.first.first % width,	az = edge.first.first / width;
+				int bx = edge.first.second % width, bz = edge.first.second / width;
+				bool outside =	(ax == bx && (ax == 0 || ax == width - 1)) ||
+								(az == bz && (az == 0 || az == depth - 1));
+				cracked += edge.second != (outside ? 1 : 2);
+			}
+			return cracked;
+		}
+
+		//Whether Draw would cull the selected patch over local (x, z)
+		bool IsPatchDrawn(float x, float z, const Frustrum& frustum) const {
+			for (int i : selected) {
+				Vector3 minCorner, maxCorner;
+				GetBounds(nodes[i], minCorner, maxCorner);
+				if (x >= minCorner.x && x <= maxCorner.x && z >= minCorner.z && z <= maxCorner.z) {
+					return frustum.BoxInFrustrum((minCorner + maxCorner) * 0.5f, (maxCorner - minCorner) * 0.5f);
+				}
+			}
+			return false;
+		}
+	};
+
+	std::filesystem::path TestDirectory() {
+		std::filesystem::path directory = std::filesystem::temp_directory_path() / "nclglTestsTerrain";
+		std::error_code error;
+		std::filesystem::create_directories(directory, error);
+		return directory;
+	}
+}
+
+TEST(TerrainPatchesInViewAreDrawn) {
+	TestTerrain terrain(MakeHeights());
+	CHECK(terrain.GetDepthCount() > 2);
+
+	const float extent = (SIZE - 1) * SCALE.x;
+	std::mt19937 random(7);
+	std::uniform_real_distribution<float> position(0.0f, extent);
+	std::uniform_real_distribution<float> height(1.0f, 300.0f);
+	std::uniform_real_distribution<float> yaw(0.0f, 360.0f);
+	std::uniform_real_distribution<float> pitch(-85.0f, -5.0f);
+	Matrix4 projection = Matrix4::Perspective(1.0f, 10000.0f, 16.0f / 9.0f, 45.0f);
+
+	int underCulled		= 0;
+	int aheadCulled		= 0;
+	int aheadTested		= 0;
+	for (int i = 0; i < 2000; ++i) {
+		Vector3 camera(position(random), 0.0f, position(random));
+		camera.y = Surface(camera.x, camera.z) + height(random);
+
+		//Every fourth camera looks (almost) straight down, at the patch it's over
+		float p = ((i % 4 == 0) ? -89.0f : pitch(random)) * PI / 180.0f;
+		float y = yaw(random) * PI / 180.0f;
+		Vector3 direction(cos(p) * sin(y), sin(p), cos(p) * cos(y));
+
+		terrain.SelectLOD(camera, 45.0f, 720);
+		Frustrum frustum;
+		frustum.FromMatrix(projection * Matrix4::BuildViewMatrix(camera, camera + direction));
+
+		//Follow the middle of the view down to the ground - whichever patch is
+		//there is on screen, so it mustn't be culled
+		for (float t = 1.0f; t < 10000.0f; t += 1.0f) {
+			Vector3 at = camera + direction * t;
+			if (at.x < 0.0f || at.z < 0.0f || at.x > extent || at.z > extent) {
+				break;
+			}
+			if (at.y <= Surface(at.x, at.z)) {
+				bool drawn = terrain.IsPatchDrawn(at.x, at.z, frustum);
+				if (i % 4 == 0) {
+					underCulled += !drawn;
+				}
+				else {
+					aheadCulled += !drawn;
+					aheadTested++;
+				}
+				break;
+			}
+		}
+	}
+	CHECK(underCulled == 0);
+	CHECK(aheadCulled == 0);
+	CHECK(aheadTested > 500);
+}
+
+TEST(TerrainSelectionIsBalancedAndWatertight) {
+	TestTerrain terrain(MakeHeights());
+	const float extent = (SIZE - 1) * SCALE.x;
+	std::mt19937 random(11);
+	std::uniform_real_distribution<float> position(-0.25f * extent, 1.25f * extent);
+	std::uniform_real_distribution<float> height(1.0f, 300.0f);
+	std::uniform_real_distribution<float> pixelError(0.5f, 4.0f);
+
+	int unbalanced	= 0;
+	int cracked		= 0;
+	int mixed		= 0;	//selections with more than one depth in, so there's stitching to check
+	for (int i = 0; i < 100; ++i) {
+		Vector3 camera(position(random), 0.0f, position(random));
+		camera.y = Surface(camera.x, camera.z) + height(random);
+		terrain.SelectLOD(camera, 45.0f, 720, pixelError(random));
+
+		int change = terrain.GetLargestDepthChange();
+		unbalanced	+= change > 1;
+		mixed		+= change == 1;
+		cracked		+= terrain.CountCrackedEdges();
+	}
+	CHECK(unbalanced == 0);
+	CHECK(cracked == 0);
+	CHECK(mixed > 50);
+}
+
+TEST(TerrainTrianglesDontGrowWithTheMap) {
+	//the same view over bigger and bigger maps - only the distant, coarse, part grows
+	int triangles[4];
+	const int sides[4] = { 129, 257, 513, 1025 };
+	for (int i = 0; i < 4; ++i) {
+		TestTerrain terrain(MakeHeights(sides[i]), sides[i]);
+		Vector3 camera(400.0f, 0.0f, 400.0f);
+		camera.y = Surface(camera.x, camera.z) + 50.0f;
+		terrain.SelectLOD(camera, 45.0f, 720);
+		triangles[i] = terrain.GetStats().selectedTriangles;
+		std::cout << "  " << sides[i] << "^2 samples: " << triangles[i] << " triangles" << std::endl;
+	}
+	//each map has 4 times the samples of the last
+	for (int i = 1; i < 4; ++i) {
+		CHECK(triangles[i] < triangles[i - 1] * 2);
+	}
+	CHECK(triangles[3] < (sides[3] - 1) * (sides[3] - 1) * 2 / 50);
+}
+
+TEST(TerrainUploadKeepsOtherIndexBuffers) {
+	if (!Test::HasGLContext()) {
+		return;
+	}
+	bool skipping = GLStateCache::GetSkipRedundantCalls();
+	GLStateCache::SetSkipRedundantCalls(true);
+	GLStateCache& state = GLStateCache::GetShared();
+
+	//Set up like a Mesh, and 'drawn' - so with redundant calls skipped its VAO stays bound
+	GLuint arrayObject, indexBuffer;
+	const GLuint indices[3] = { 0, 1, 2 };
+	glGenVertexArrays(1, &arrayObject);
+	state.BindVertexArray(arrayObject);
+	glGenBuffers(1, &indexBuffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+	state.ReleaseVertexArray();
+
+	{	//The terrain's first patch upload makes its own index buffer
+		TestTerrain terrain(MakeHeights());
+		terrain.SelectLOD(Vector3(1000.0f, 500.0f, 1000.0f), 45.0f, 720);
+		terrain.Draw(nullptr);
+		CHECK(terrain.GetStats().patchesBuilt > 0);
+	}
+
+	GLint bound = 0;
+	state.BindVertexArray(arrayObject);
+	glGetIntegerv(GL_ELEMENT_ARRAY_BUFFER_BINDING, &bound);
+	CHECK(bound == (GLint)indexBuffer);
+
+	state.BindVertexArray(0);
+	state.ForgetVertexArray(arrayObject);
+	glDeleteVertexArrays(1, &arrayObject);
+	glDeleteBuffers(1, &indexBuffer);
+	GLStateCache::SetSkipRedundantCalls(skipping);
+}
+
+TEST(TerrainTileFilesAreChecked) {
+	const std::string name = (TestDirectory() / "tiles.ttil").string();
+	{
+		TestTerrain terrain(MakeHeights());
+		CHECK(terrain.WriteTiles(name));
+	}
+	std::vector<char> original;
+	{
+		std::ifstream file(name, std::ios::binary);
+		original.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	}
+	CHECK(TestTerrain(name, JobSystem::GetShared()).IsValid());
+
+	//Each of these would have had SelectNode recurse forever, or shift by 32 or more
+	auto node = [](std::vector<char>& bytes, int i) {
+		return (TerrainTileNode*)(bytes.data() + sizeof(TerrainTileHeader) + i * sizeof(TerrainTileNode));
+	};
+	const auto breakages = {
+		+[](TerrainTileNode* root, TerrainTileNode* second) { second->depth = 40; },
+		+[](TerrainTileNode* root, TerrainTileNode* second) { second->children[0] = 1; },
+		+[](TerrainTileNode* root, TerrainTileNode* second) { second->children[2] = 0; },
+		+[](TerrainTileNode* root, TerrainTileNode* second) { root->children[3] = 100000; },
+		+[](TerrainTileNode* root, TerrainTileNode* second) { second->x = SIZE; },
+		+[](TerrainTileNode* root, TerrainTileNode* second) { second->z = 1u << 31; },
+	};
+	for (auto breakage : breakages) {
+		std::vector<char> bytes = original;
+		breakage(node(bytes, 0), node(bytes, 1));
+		{
+			std::ofstream file(name, std::ios::binary | std::ios::trunc);
+			file.write(bytes.data(), bytes.size());
+		}
+		CHECK(!TestTerrain(name, JobSystem::GetShared()).IsValid());
+	}
+	std::error_code error;
+	std::filesystem::remove_all(TestDirectory(), error);
+}
+
+TEST(TerrainStreamingStaysInBudget) {
+	if (!Test::HasGLContext()) {
+		return;
+	}
+	const std::string name = (TestDirectory() / "streamed.ttil").string();
+	TestTerrain inMemory(MakeHeights());
+	CHECK(inMemory.WriteTiles(name));
+	{
+		//a worker thread of its own to read the tiles, whatever the machine
+		JobSystem jobs(2);
+		TestTerrain streamed(name, jobs);
+		CHECK(streamed.IsStreaming());
+		//low over different corners, so most of what's resident has to go each time
+		const float extent = (SIZE - 1) * SCALE.x;
+		Vector3 cameras[4] = {
+			Vector3(0.1f * extent, 0.0f, 0.1f * extent), Vector3(0.9f * extent, 0.0f, 0.2f * extent),
+			Vector3(0.5f * extent, 0.0f, 0.9f * extent), Vector3(0.1f * extent, 0.0f, 0.1f * extent)
+		};
+		//The budget's only just enough for the biggest selection - which has to
+		//have all of its patches' parents resident as well
+		size_t mostPatches = 0;
+		for (Vector3& camera : cameras) {
+			camera.y = Surface(camera.x, camera.z) + 20.0f;
+			inMemory.SelectLOD(camera, 45.0f, 720);
+			std::vector<std::array<int, 3>> needed;
+			for (std::array<int, 3> patch : inMemory.GetSelection()) {
+				for (; patch[2] >= 0; --patch[2]) {
+					int size = 16 << (inMemory.GetDepthCount() - patch[2]);	//of its parent
+					needed.push_back(patch);
+					patch[0] -= patch[0] % size;
+					patch[1] -= patch[1] % size;
+				}
+			}
+			std::sort(needed.begin(), needed.end());
+			mostPatches = std::max(mostPatches, (size_t)(std::unique(needed.begin(), needed.end()) - needed.begin()));
+		}
+		const size_t budget = streamed.GetPatchBytes() * mostPatches;
+		streamed.SetMemoryBudget(budget);
+
+		int overBudget	= 0;
+		int converged	= 0;
+		for (const Vector3& camera : cameras) {
+			inMemory.SelectLOD(camera, 45.0f, 720);
+			for (int frame = 0; frame < 500; ++frame) {
+				streamed.SelectLOD(camera, 45.0f, 720);
+				streamed.Draw(nullptr);
+				overBudget += streamed.GetStats().residentBytes > budget;
+				if (streamed.GetStats().pendingLoads == 0 && streamed.GetSelection() == inMemory.GetSelection()) {
+					++converged;
+					break;
+				}
+				std::this_thread::yield();
+			}
+		}
+		CHECK(overBudget == 0);
+		CHECK(converged == 4);
+		CHECK(streamed.GetStats().patchesBuilt > (int)mostPatches);	//so some were thrown away and read again
+	}
+	std::error_code error;
+	std::filesystem::remove_all(TestDirectory(), error);
+}
@@ -0,0 +1,73 @@
+/*
+A tiny test runner for nclgl. Each TEST or BENCHMARK below registers itself;
+Tests.exe runs every test (and the benchmarks too, given --bench), or just the
+ones named on the command line. A failed CHECK is reported and counted, and
+main returns the number of tests that failed.
+*/
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace Test {
+	typedef void (*TestFunction)();
+
+	struct Case {
+		const char*		name;
+		TestFunction	function;
+		bool			benchmark;
+	};
+
+	std::vector<Case>&	GetCases();
+	void				Fail(const char* file, int line, const std::string& message);
+
+	struct Registrar {
+		Registrar(const char* name, TestFunction function, bool benchmark) {
+			GetCases().push_back({ name, function, benchmark });
+		}
+	};
+
+	//Makes a GL 3.2 context current (on a small hidden window) the first time
+	//it's called. Tests that need GL should return early if this is false.
+	bool HasGLContext();
+
+	//Fastest of 'repeats' calls to f, in milliseconds
+	template <typename F> double Time(int repeats, const F& f) {
+		double best = 1e30;
+		for (int i = 0; i < repeats; ++i) {
+			auto start = std::chrono::high_resolution_clock::now();
+			f();
+			std::chrono::duration<double, std::milli> taken = std::chrono::high_resolution_clock::now() - start;
+			best = std::min(best, taken.count());
+		}
+		return best;
+	}
+}
+
+#define TEST(name) \
+	static void name(); \
+	static Test::Registrar name##Registrar(#name, name, false); \
+	static void name()
+
+#define BENCHMARK(name) \
+	static void name(); \
+	static Test::Registrar name##Registrar(#name, name, true); \
+	static void name()
+
+#define CHECK(condition) \
+	do { if (!(condition)) Test::Fail(__FILE__, __LINE__, #condition); } while (0)
+
+#define CHECK_NEAR(a, b, tolerance) \
+	do { \
+		const double checkA = (a), checkB = (b); \
+		if (!(std::fabs(checkA - checkB) <= (tolerance))) { \
+			std::ostringstream checkMessage; \
+			checkMessage << #a << " = " << checkA << ", " << #b << " = " << checkB; \
+			Test::Fail(__FILE__, __LINE__, checkMessage.str()); \
+		} \
+	} while (0)
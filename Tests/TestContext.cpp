@@ -0,0 +1,22 @@
+#include "Test.h"
+#include "../nclgl/Window.h"
+#include "../nclgl/OGLRenderer.h"
+
+namespace {
+	//OGLRenderer does all the context creation - it just needs a scene to not draw
+	class TestRenderer : public OGLRenderer {
+	public:
+		TestRenderer(Window& parent) : OGLRenderer(parent) {}
+		void RenderScene() override {}
+	};
+}
+
+bool Test::HasGLContext() {
+	static Window		window("nclgl Tests", 64, 64, false);
+	static TestRenderer	renderer(window);
+	static bool			ready = window.HasInitialised() && renderer.HasInitialised();
+	if (!ready) {
+		std::cout << "\tNo OpenGL 3.2 context, skipped\n";
+	}
+	return ready;
+}
@@ -0,0 +1,63 @@
+/*
+Runs the nclgl tests. Usage:
+
+	Tests				- runs every test
+	Tests --bench		- runs every test, then every benchmark
+	Tests Name ...		- runs just the named tests or benchmarks
+
+Run it from the Tests directory, so the ../Meshes and ../Textures paths the
+library uses resolve.
+*/
+#include "Test.h"
+
+namespace {
+	int failedChecks = 0;
+}
+
+std::vector<Test::Case>& Test::GetCases() {
+	static std::vector<Case> cases;
+	return cases;
+}
+
+void Test::Fail(const char* file, int line, const std::string& message) {
+	std::cout << "\t" << file << "(" << line << "): CHECK failed: " << message << "\n";
+	++failedChecks;
+}
+
+int main(int argc, char** argv) {
+	bool						benchmarks = false;
+	std::vector<std::string>	named;
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--bench") {
+			benchmarks = true;
+		}
+		else {
+			named.push_back(arg);
+		}
+	}
+
+	int run		= 0;
+	int failed	= 0;
+	for (int pass = 0; pass < 2; ++pass) { //Tests first, then benchmarks
+		for (const Test::Case& c : Test::GetCases()) {
+			if (c.benchmark != (pass == 1)) {
+				continue;
+			}
+			if (named.empty() ? (c.benchmark && !benchmarks)
+				: std::find(named.begin(), named.end(), c.name) == named.end()) {
+				continue;
+			}
+			std::cout << c.name << "\n";
+			int before = failedChecks;
+			c.function();
+			++run;
+			if (failedChecks != before) {
+				std::cout << c.name << " FAILED\n";
+				++failed;
+			}
+		}
+	}
+	std::cout << run << " run, " << failed << " failed\n";
+	return failed;
+}
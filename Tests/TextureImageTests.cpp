@@ -0,0 +1,51 @@
+#include "Test.h"
+#include "../nclgl/TextureImage.h"
+#include "../nclgl/common.h"
+#include "SOIL/SOIL.h"
+
+#include <filesystem>
+
+TEST(CookedNamesKeepTheExtension) {
+	CHECK(TextureImage::GetCookedName("Textures/x.jpg") != TextureImage::GetCookedName("Textures/x.png"));
+	CHECK(TextureImage::IsCookedFile(TextureImage::GetCookedName("Textures/x.jpg")));
+	CHECK(!TextureImage::IsCookedFile("Textures/x.jpg"));
+}
+
+TEST(StaleCookedTexturesAreRecooked) {
+	std::filesystem::path directory = std::filesystem::temp_directory_path() / "nclglTestsCooked";
+	std::error_code error;
+	std::filesystem::create_directories(directory, error);
+
+	const std::string	source	= TEXTUREDIR"star.png";
+	const std::string	cooked	= (directory / "star.png.ctex").string();
+	const unsigned int	flags	= SOIL_FLAG_MIPMAPS | SOIL_FLAG_INVERT_Y;
+	std::filesystem::remove(cooked, error);
+
+	CHECK(TextureImage::NeedsCooking(source, cooked, flags));
+	if (!TextureImage::Cook(source, cooked, flags)) {
+		Test::Fail(__FILE__, __LINE__, "can't cook " + source + " - is the working directory Tests?");
+		return;
+	}
+	CHECK(!TextureImage::NeedsCooking(source, cooked, flags));
+	//Upload only flags don't change what's cooked
+	CHECK(!TextureImage::NeedsCooking(source, cooked, flags | SOIL_FLAG_TEXTURE_REPEATS));
+
+	CHECK(TextureImage::NeedsCooking(source, cooked, SOIL_FLAG_MIPMAPS));
+	CHECK(TextureImage::NeedsCooking(source, cooked, flags | SOIL_FLAG_COMPRESS_TO_DXT));
+	CHECK(TextureImage::NeedsCooking(source, cooked, flags, SOIL_LOAD_RGB));
+
+	CHECK(TextureImage::Cook(source, cooked, flags, SOIL_LOAD_RGB));
+	CHECK(!TextureImage::NeedsCooking(source, cooked, flags, SOIL_LOAD_RGB));
+	{
+		TextureImage image;	//unmapped again before the resize below
+		CHECK(image.Map(cooked));
+		CHECK(image.GetChannels() == 3);
+		CHECK(image.GetLevelCount() > 1);
+	}
+
+	//A truncated file is newer than its source, but won't map
+	std::filesystem::resize_file(cooked, std::filesystem::file_size(cooked) / 2);
+	CHECK(TextureImage::NeedsCooking(source, cooked, flags, SOIL_LOAD_RGB));
+
+	std::filesystem::remove_all(directory, error);
+}
@@ -0,0 +1,121 @@
+#include "Test.h"
+#include "../nclgl/TransformHierarchy.h"
+
+#include <algorithm>
+#include <memory>
+#include <random>
+
+namespace {
+	//A SceneNode style pointer tree, updated recursively, to compare against
+	struct PointerNode {
+		Matrix4						local;
+		Matrix4						world;
+		PointerNode*				parent = nullptr;
+		std::vector<PointerNode*>	children;
+
+		void Update() {
+			world = parent ? parent->world * local : local;
+			for (PointerNode* c : children) {
+				c->Update();
+			}
+		}
+	};
+
+	struct Trees {
+		std::vector<std::unique_ptr<PointerNode>>	pointerNodes;	//shuffled, like nodes scattered around the heap
+		TransformHierarchy							hierarchy;
+		std::vector<int>							handles;
+	};
+
+	//A tree of 'count' nodes, 4 children each
+	void BuildTrees(Trees& t, int count) {
+		std::mt19937 random(count);
+		for (int i = 0; i < count; ++i) {
+			t.pointerNodes.emplace_back(new PointerNode());
+		}
+		std::shuffle(t.pointerNodes.begin(), t.pointerNodes.end(), random);
+
+		for (int i = 0; i < count; ++i) {
+			Matrix4 m = Matrix4::Rotation((float)(i % 90), Vector3(0, 1, 0)) * Matrix4::Translation(Vector3(1, 2, 3));
+			t.pointerNodes[i]->local = m;
+			t.handles.push_back(t.hierarchy.AddNode());
+			t.hierarchy.SetLocalTransform(t.handles[i], m);
+		}
+		for (int i = 1; i < count; ++i) {
+			int parent = (i - 1) / 4;
+			t.pointerNodes[parent]->children.push_back(t.pointerNodes[i].get());
+			t.pointerNodes[i]->parent = t.pointerNodes[parent].get();
+			t.hierarchy.SetParent(t.handles[i], t.handles[parent]);
+		}
+	}
+
+	double WorstDifference(const Trees& t) {
+		double worst = 0.0;
+		for (size_t i = 0; i < t.handles.size(); ++i) {
+			const Matrix4& a = t.hierarchy.GetWorldTransform(t.handles[i]);
+			for (int j = 0; j < 16; ++j) {
+				worst = std::max(worst, (double)std::fabs(a.values[j] - t.pointerNodes[i]->world.values[j]));
+			}
+		}
+		return worst;
+	}
+}
+
+TEST(TransformHierarchyMatchesRecursiveUpdate) {
+	Trees t;
+	BuildTrees(t, 1000);
+	CHECK(t.hierarchy.UpdateWorldTransforms() == 1000);
+	t.pointerNodes[0]->Update();
+	CHECK(WorstDifference(t) < 1e-3);
+
+	//Nothing dirty, nothing recomputed
+	CHECK(t.hierarchy.UpdateWorldTransforms() == 0);
+
+	//Moving a leaf only recomputes that leaf
+	Matrix4 moved = Matrix4::Translation(Vector3(5, 0, 0));
+	t.pointerNodes[999]->local = moved;
+	t.hierarchy.SetLocalTransform(t.handles[999], moved);
+	CHECK(t.hierarchy.UpdateWorldTransforms() == 1);
+
+	//Reparenting a node under one of its later siblings puts it before its parent,
+	//which has to be re-sorted before the update
+	int node = 5, parent = 900;
+	PointerNode* p = t.pointerNodes[node].get();
+	std::vector<PointerNode*>& oldSiblings = p->parent->children;
+	oldSiblings.erase(std::find(oldSiblings.begin(), oldSiblings.end(), p));
+	p->parent = t.pointerNodes[parent].get();
+	p->parent->children.push_back(p);
+	t.hierarchy.SetParent(t.handles[node], t.handles[parent]);
+	CHECK(t.hierarchy.GetParent(t.handles[node]) == t.handles[parent]);
+
+	t.hierarchy.UpdateWorldTransforms();
+	t.pointerNodes[0]->Update();
+	CHECK(WorstDifference(t) < 1e-3);
+}
+
+BENCHMARK(TransformHierarchyUpdate) {
+	for (int count : { 10000, 100000, 1000000 }) {
+		Trees t;
+		BuildTrees(t, count);
+		t.hierarchy.UpdateWorldTransforms();
+
+		int repeats = count >= 1000000 ? 5 : 20;
+		double recursive = Test::Time(repeats, [&] {
+			t.pointerNodes[0]->Update();
+		});
+		double allDirty = Test::Time(repeats, [&] {
+			t.hierarchy.SetLocalTransform(t.handles[0], t.pointerNodes[0]->local);
+			t.hierarchy.UpdateWorldTransforms();
+		});
+		size_t recomputed = 0;
+		double fewDirty = Test::Time(repeats, [&] {
+			for (int i = count - 1; i >= count - count / 100; --i) {
+				t.hierarchy.SetLocalTransform(t.handles[i], t.pointerNodes[i]->local);
+			}
+			recomputed = t.hierarchy.UpdateWorldTransforms();
+		});
+		std::cout << "\t" << count << " nodes: recursive " << recursive << "ms, flat (all dirty) " << allDirty
+			<< "ms, flat (1% dirty, " << recomputed << " recomputed) " << fewDirty << "ms\n";
+		CHECK(WorstDifference(t) < 1e-3);
+	}
+}
@@ -0,0 +1,112 @@
+#include "Test.h"
+#include "../nclgl/VertexPacking.h"
+
+#include <cstring>
+#include <random>
+
+TEST(HalfRoundTrip) {
+	//Every finite half survives the trip through float and back
+	int wrong = 0;
+	for (uint32_t h = 0; h < 0x10000; ++h) {
+		float f = HalfToFloat((uint16_t)h);
+		if (f == f && FloatToHalf(f) != h && h != 0x8000) {	//-0 may come back as +0
+			++wrong;
+		}
+	}
+	CHECK(wrong == 0);
+
+	std::mt19937 random(1);
+	std::uniform_real_distribution<float> uvs(0.0f, 16.0f);
+	double worst = 0.0;
+	for (int i = 0; i < 100000; ++i) {
+		float f = uvs(random);
+		worst = std::max(worst, (double)std::fabs(HalfToFloat(FloatToHalf(f)) - f) / std::max(1.0f, f));
+	}
+	CHECK(worst <= 1.0 / 2048.0);	//10 bit mantissa, rounded
+}
+
+TEST(SnormRoundTrip) {
+	std::mt19937 random(2);
+	std::uniform_real_distribution<float> signedUnit(-1.0f, 1.0f);
+	double worst16		= 0.0;
+	double worst1010102	= 0.0;
+	int wrongW = 0;
+	for (int i = 0; i < 100000; ++i) {
+		float s = signedUnit(random);
+		worst16 = std::max(worst16, (double)std::fabs(UnpackSnorm16(PackSnorm16(s)) - s));
+
+		Vector3 n(signedUnit(random), signedUnit(random), signedUnit(random));
+		n.Normalise();
+		float w = (i & 1) ? 1.0f : -1.0f;
+		Vector4 back = UnpackSnorm1010102(PackSnorm1010102(Vector4(n.x, n.y, n.z, w)));
+		worst1010102 = std::max(worst1010102, (double)std::max({ std::fabs(back.x - n.x), std::fabs(back.y - n.y), std::fabs(back.z - n.z) }));
+		wrongW += back.w != w;
+	}
+	CHECK(worst16 <= 0.5 / 32767.0 + 1e-6);
+	CHECK(worst1010102 <= 0.5 / 511.0 + 1e-6);
+	CHECK(wrongW == 0);
+
+	CHECK(UnpackSnorm16(PackSnorm16(1.0f)) == 1.0f);
+	CHECK(UnpackSnorm16(PackSnorm16(-1.0f)) == -1.0f);
+	CHECK(UnpackSnorm16(PackSnorm16(0.0f)) == 0.0f);
+}
+
+TEST(UnormRoundTrip) {
+	for (int i = 0; i < 256; ++i) {
+		CHECK(PackUnorm8(UnpackUnorm8((uint8_t)i)) == i);
+	}
+	CHECK(PackUnorm8(-1.0f) == 0);
+	CHECK(PackUnorm8(2.0f) == 255);
+
+	Vector4 colour(0.1f, 0.5f, 0.75f, 1.0f);
+	Vector4 back = UnpackUnorm8x4(PackUnorm8x4(colour));
+	CHECK_NEAR(back.x, colour.x, 0.5 / 255.0 + 1e-6);
+	CHECK_NEAR(back.y, colour.y, 0.5 / 255.0 + 1e-6);
+	CHECK_NEAR(back.z, colour.z, 0.5 / 255.0 + 1e-6);
+	CHECK_NEAR(back.w, colour.w, 0.5 / 255.0 + 1e-6);
+}
+
+TEST(PackedVerticesRoundTrip) {
+	Vector3	positions[2]	= { Vector3(1.0f, 2.0f, 3.0f), Vector3(-4000.5f, 5.25f, 6.0f) };
+	Vector2	texCoords[2]	= { Vector2(0.25f, 0.5f), Vector2(8.0f, 1.0f) };
+	Vector3	normals[2]		= { Vector3(0.0f, 1.0f, 0.0f), Vector3(0.6f, 0.0f, -0.8f) };
+	Vector4	weights[2]		= { Vector4(0.333f, 0.333f, 0.334f, 0.0f), Vector4(1.0f, 0.0f, 0.0f, 0.0f) };
+	int		joints[8]		= { 1, 2, 3, 0, 4, 0, 0, 0 };
+
+	std::vector<uint8_t> packed;
+	PackedVertexLayout layout = PackVertices(2, positions, texCoords, nullptr, normals, nullptr, weights, joints, packed);
+	CHECK(layout.colourOffset < 0);
+	CHECK(layout.tangentOffset < 0);
+	CHECK(packed.size() == 2 * (size_t)layout.stride);
+	CHECK(layout.stride % 4 == 0);
+
+	for (int i = 0; i < 2; ++i) {
+		const uint8_t* vertex = packed.data() + i * layout.stride;
+
+		Vector3 position;
+		memcpy(&position, vertex + layout.positionOffset, sizeof(position));
+		CHECK(position.x == positions[i].x && position.y == positions[i].y && position.z == positions[i].z);
+
+		uint16_t uv[2];
+		memcpy(uv, vertex + layout.texCoordOffset, sizeof(uv));
+		CHECK(HalfToFloat(uv[0]) == texCoords[i].x);
+		CHECK(HalfToFloat(uv[1]) == texCoords[i].y);
+
+		uint32_t normal;
+		memcpy(&normal, vertex + layout.normalOffset, sizeof(normal));
+		Vector4 n = UnpackSnorm1010102(normal);
+		CHECK_NEAR(n.x, normals[i].x, 0.5 / 511.0);
+		CHECK_NEAR(n.y, normals[i].y, 0.5 / 511.0);
+		CHECK_NEAR(n.z, normals[i].z, 0.5 / 511.0);
+
+		//Rounded weights still have to add up to exactly 1
+		uint32_t weight;
+		memcpy(&weight, vertex + layout.weightOffset, sizeof(weight));
+		CHECK((weight & 255) + ((weight >> 8) & 255) + ((weight >> 16) & 255) + (weight >> 24) == 255);
+
+		const uint8_t* index = vertex + layout.weightIndexOffset;
+		for (int j = 0; j < 4; ++j) {
+			CHECK(index[j] == joints[i * 4 + j]);
+		}
+	}
+}
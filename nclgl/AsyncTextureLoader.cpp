@@ -0,0 +1,134 @@
+#include "AsyncTextureLoader.h"
+#include "SOIL/SOIL.h"
+
+#include <iostream>
+#include <thread>
+
+namespace {
+	const unsigned int ASYNC_FLAGS = SOIL_FLAG_MIPMAPS | SOIL_FLAG_INVERT_Y | SOIL_FLAG_TEXTURE_REPEATS | SOIL_FLAG_COMPRESS_TO_DXT;
+}
+
+AsyncTextureLoader::AsyncTextureLoader(TextureCache& cache, JobSystem& jobs) : cache(cache), jobs(jobs), finishedHead(nullptr) {
+}
+
+AsyncTextureLoader::~AsyncTextureLoader() {
+	jobs.Wait(decodes);
+}
+
+void AsyncTextureLoader::Request(const std::string& filename, unsigned int flags, GLuint* into) {
+	if (flags & ~ASYNC_FLAGS) {
+		*into = cache.Load(filename, flags);
+		return;
+	}
+	StartLoad(TextureCache::MakeKey(filename, flags), &filename, 1, flags, into);
+}
+
+void AsyncTextureLoader::RequestCubeMap(const std::string faces[6], unsigned int flags, GLuint* into) {
+	if (flags & ~ASYNC_FLAGS) {
+		*into = cache.LoadCubeMap(faces, flags);
+		return;
+	}
+	StartLoad(TextureCache::MakeCubeMapKey(faces, flags), faces, 6, flags, into);
+}
+
+void AsyncTextureLoader::StartLoad(const std::string& key, const std::string* files, int faceCount, unsigned int flags, GLuint* into) {
+	auto inFlight = pending.find(key);
+	if (inFlight != pending.end()) {
+		inFlight->second->outputs.push_back(into);
+		return;
+	}
+	if (GLuint texture = cache.Acquire(key)) {
+		*into = texture;
+		return;
+	}
+	Load* load = new Load();
+	load->key			= key;
+	load->faceCount		= faceCount;
+	load->target		= faceCount == 6 ? GL_TEXTURE_CUBE_MAP : GL_TEXTURE_2D;
+	load->flags			= flags;
+	load->mipGenerator	= mipGenerator;
+	load->facesLeft		= faceCount;
+	load->failed		= false;
+	load->nextFinished	= nullptr;
+	load->outputs.push_back(into);
+	for (int i = 0; i < faceCount; ++i) {
+		load->files[i] = files[i];
+	}
+	pending[key].reset(load);
+
+	for (int i = 0; i < faceCount; ++i) {
+		jobs.Run(decodes, [this, load, i]() { Decode(load, i); });
+	}
+}
+
+void AsyncTextureLoader::Decode(Load* load, int face) {
+	//Cube maps are always RGB, as TextureCache::LoadCubeMap has them. Big mip
+	//levels get split up into further jobs, and cooked files just get mapped
+	if (!load->images[face].Load(load->files[face], load->flags,
+		load->faceCount == 6 ? SOIL_LOAD_RGB : SOIL_LOAD_AUTO, load->mipGenerator, &jobs)) {
+		load->failed = true;
+	}
+	//Last face out hands the whole load over - after this it belongs to the GL thread again
+	if (load->facesLeft.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+		PushFinished(load);
+	}
+}
+
+void AsyncTextureLoader::PushFinished(Load* load) {
+	Load* head = finishedHead.load(std::memory_order_relaxed);
+	do {
+		load->nextFinished = head;
+	} while (!finishedHead.compare_exchange_weak(head, load, std::memory_order_release, std::memory_order_relaxed));
+}
+
+AsyncTextureLoader::Load* AsyncTextureLoader::TakeFinished() {
+	//Comes off the stack newest first, so flip it back into finishing order
+	Load* list		= finishedHead.exchange(nullptr, std::memory_order_acquire);
+	Load* reversed	= nullptr;
+	while (list) {
+		Load* next = list->nextFinished;
+		list->nextFinished = reversed;
+		reversed = list;
+		list = next;
+	}
+	return reversed;
+}
+
+int AsyncTextureLoader::Update(int maxUploads) {
+	for (Load* l = TakeFinished(); l; l = l->nextFinished) {
+		decoded.push_back(l);
+	}
+	int completed = 0;
+	while (!decoded.empty() && completed < maxUploads) {
+		Load* load = decoded.front();
+		decoded.pop_front();
+		Complete(load);
+		++completed;
+	}
+	return completed;
+}
+
+void AsyncTextureLoader::Finish() {
+	while (!pending.empty()) {
+		if (Update() == 0 && !jobs.RunOneJob()) {
+			std::this_thread::yield();	//the last decodes are running on other threads
+		}
+	}
+}
+
+void AsyncTextureLoader::Complete(Load* load) {
+	GLuint texture = load->failed ? 0 : TextureCache::Upload(load->images, load->faceCount, load->flags);
+	if (texture) {
+		cache.Adopt(load->key, texture, load->target);
+		for (size_t i = 1; i < load->outputs.size(); ++i) {
+			cache.AddReference(texture);
+		}
+	}
+	else {
+		std::cout << "AsyncTextureLoader: Can't load " << load->files[0] << (load->faceCount == 6 ? " (cube map)\n" : "\n");
+	}
+	for (GLuint* into : load->outputs) {
+		*into = texture;
+	}
+	pending.erase(load->key);
+}
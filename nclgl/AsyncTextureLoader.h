@@ -0,0 +1,93 @@
+#pragma once
+/*
+Class:AsyncTextureLoader
+Description:Loads textures without stalling the GL thread. Each request is
+decoded (and mipmapped, if asked for) on the JobSystem's worker threads into
+a TextureImage; finished images are handed back over a lock-free queue, and
+Update - called on the GL thread - uploads them and passes them over to the
+TextureCache, so they're reference counted exactly like TextureCache::Load's.
+
+Requests write their texture to the GLuint they're given once it's on the GPU
+(or straight away, if the cache already has it), so that GLuint has to outlive
+the request. A request for something already in flight just waits on the same
+load, and Finish blocks until everything requested so far is resident.
+
+Only SOIL_FLAG_MIPMAPS, SOIL_FLAG_INVERT_Y, SOIL_FLAG_TEXTURE_REPEATS and
+SOIL_FLAG_COMPRESS_TO_DXT are handled here - requests with any other flags are
+loaded through the cache straight away instead. Compression goes through the
+BlockCompressor, so grey images get BC4 / BC5 rather than SOIL's DXT1 / DXT5.
+Cooked files (see TextureImage::Cook) skip all of that - the workers just map
+them and fault their pages in, leaving the upload as the only work.
+*/
+#include "KHR\khrplatform.h"
+#include "glad\glad.h"
+
+#include "JobSystem.h"
+#include "TextureCache.h"
+#include "TextureImage.h"
+
+#include <atomic>
+#include <climits>
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class AsyncTextureLoader {
+public:
+	AsyncTextureLoader(TextureCache& cache = TextureCache::GetShared(), JobSystem& jobs = JobSystem::GetShared());
+	//Waits for any decodes still running, but doesn't upload them
+	~AsyncTextureLoader();
+
+	void	Request(const std::string& filename, unsigned int flags, GLuint* into);
+	//Faces in the order +x, -x, +y, -y, +z, -z
+	void	RequestCubeMap(const std::string faces[6], unsigned int flags, GLuint* into);
+
+	//GL thread only. Uploads up to maxUploads decoded textures, and returns
+	//how many requests it completed (failed loads included)
+	int		Update(int maxUploads = INT_MAX);
+	//GL thread only. Helps out with the decoding until everything's uploaded
+	void	Finish();
+
+	size_t	GetPendingCount() const { return pending.size(); }
+
+	//Only affects requests made after it's set
+	void	SetMipGenerator(const MipGenerator& generator) { mipGenerator = generator; }
+
+protected:
+	AsyncTextureLoader(const AsyncTextureLoader&) = delete;
+	AsyncTextureLoader& operator=(const AsyncTextureLoader&) = delete;
+
+	struct Load {
+		std::string			key;
+		std::string			files[6];
+		int					faceCount;
+		GLenum				target;
+		unsigned int		flags;
+		MipGenerator		mipGenerator;
+		TextureImage		images[6];
+		std::atomic<int>	facesLeft;
+		std::atomic<bool>	failed;
+		std::vector<GLuint*> outputs;
+		Load*				nextFinished;
+	};
+
+	void	StartLoad(const std::string& key, const std::string* files, int faceCount, unsigned int flags, GLuint* into);
+	void	Decode(Load* load, int face);
+	void	Complete(Load* load);
+
+	//Multiple producer, single consumer - decode jobs push, the GL thread takes the lot
+	void	PushFinished(Load* load);
+	Load*	TakeFinished();
+
+	TextureCache&	cache;
+	JobSystem&		jobs;
+	JobGroup		decodes;
+	MipGenerator	mipGenerator;
+
+	//Everything below belongs to the GL thread, apart from finishedHead
+	std::unordered_map<std::string, std::unique_ptr<Load>>	pending;
+	std::deque<Load*>		decoded;	//taken from the queue, waiting for an upload slot
+	std::atomic<Load*>		finishedHead;
+};
@@ -0,0 +1,593 @@
+#include "BlockCompressor.h"
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+//SSE2 is part of the x64 baseline - as with MipGenerator
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define NCLGL_SIMD_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace {
+	const int PARALLEL_BLOCKS = 1024;	//fewer than this aren't worth splitting up
+
+	//Index -> weight of the first endpoint, in BC1's 4 colour mode
+	const float COLOUR_WEIGHTS[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+
+	inline int Expand5(int v) { return (v << 3) | (v >> 2); }
+	inline int Expand6(int v) { return (v << 2) | (v >> 4); }
+
+	inline int Quantise(float v, int maxValue) {
+		return (int)(std::min(std::max(v, 0.0f), 255.0f) * maxValue / 255.0f + 0.5f);
+	}
+
+	inline uint16_t Pack565(const float (&c)[3]) {
+		return (uint16_t)((Quantise(c[0], 31) << 11) | (Quantise(c[1], 63) << 5) | Quantise(c[2], 31));
+	}
+
+	inline void Unpack565(uint16_t v, int (&c)[3]) {
+		c[0] = Expand5((v >> 11) & 31);
+		c[1] = Expand6((v >> 5) & 63);
+		c[2] = Expand5(v & 31);
+	}
+
+	inline void WriteShort(unsigned char* out, uint16_t v) {
+		out[0] = (unsigned char)(v & 0xFF);
+		out[1] = (unsigned char)(v >> 8);
+	}
+
+	inline uint16_t ReadShort(const unsigned char* in) {
+		return (uint16_t)(in[0] | (in[1] << 8));
+	}
+
+	float Dot16(const float* a, const float* b) {
+#ifdef NCLGL_SIMD_SSE2
+		__m128 sum = _mm_setzero_ps();
+		for (int i = 0; i < 16; i += 4) {
+			sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+		}
+		float lanes[4];
+		_mm_storeu_ps(lanes, sum);
+		return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#else
+		float sum = 0.0f;
+		for (int i = 0; i < 16; ++i) {
+			sum += a[i] * b[i];
+		}
+		return sum;
+#endif
+	}
+
+	//Picks the nearest of 4 palette colours for each pixel, returning the total squared error
+	float FindColourIndices(const float* r, const float* g, const float* b, const float (&palette)[4][3], unsigned char (&indices)[16]) {
+#ifdef NCLGL_SIMD_SSE2
+		__m128 total = _mm_setzero_ps();
+		for (int i = 0; i < 16; i += 4) {
+			__m128 pr			= _mm_loadu_ps(r + i);
+			__m128 pg			= _mm_loadu_ps(g + i);
+			__m128 pb			= _mm_loadu_ps(b + i);
+			__m128 best			= _mm_set1_ps(FLT_MAX);
+			__m128 bestIndex	= _mm_setzero_ps();
+			for (int p = 0; p < 4; ++p) {
+				__m128 dr		= _mm_sub_ps(pr, _mm_set1_ps(palette[p][0]));
+				__m128 dg		= _mm_sub_ps(pg, _mm_set1_ps(palette[p][1]));
+				__m128 db		= _mm_sub_ps(pb, _mm_set1_ps(palette[p][2]));
+				__m128 d		= _mm_add_ps(_mm_add_ps(_mm_mul_ps(dr, dr), _mm_mul_ps(dg, dg)), _mm_mul_ps(db, db));
+				__m128 closer	= _mm_cmplt_ps(d, best);
+				best			= _mm_min_ps(d, best);
+				bestIndex		= _mm_or_ps(_mm_and_ps(closer, _mm_set1_ps((float)p)), _mm_andnot_ps(closer, bestIndex));
+			}
+			total = _mm_add_ps(total, best);
+			float found[4];
+			_mm_storeu_ps(found, bestIndex);
+			for (int j = 0; j < 4; ++j) {
+				indices[i + j] = (unsigned char)found[j];
+			}
+		}
+		float lanes[4];
+		_mm_storeu_ps(lanes, total);
+		return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#else
+		float total = 0.0f;
+		for (int i = 0; i < 16; ++i) {
+			float best = FLT_MAX;
+			for (int p = 0; p < 4; ++p) {
+				float dr	= r[i] - palette[p][0];
+				float dg	= g[i] - palette[p][1];
+				float db	= b[i] - palette[p][2];
+				float d		= dr * dr + dg * dg + db * db;
+				if (d < best) {
+					best		= d;
+					indices[i]	= (unsigned char)p;
+				}
+			}
+			total += best;
+		}
+		return total;
+#endif
+	}
+
+	//As above, for one channel against an 8 entry palette
+	float FindChannelIndices(const float* v, const float (&palette)[8], unsigned char (&indices)[16]) {
+#ifdef NCLGL_SIMD_SSE2
+		__m128 total = _mm_setzero_ps();
+		for (int i = 0; i < 16; i += 4) {
+			__m128 pv			= _mm_loadu_ps(v + i);
+			__m128 best			= _mm_set1_ps(FLT_MAX);
+			__m128 bestIndex	= _mm_setzero_ps();
+			for (int p = 0; p < 8; ++p) {
+				__m128 dv		= _mm_sub_ps(pv, _mm_set1_ps(palette[p]));
+				__m128 d		= _mm_mul_ps(dv, dv);
+				__m128 closer	= _mm_cmplt_ps(d, best);
+				best			= _mm_min_ps(d, best);
+				bestIndex		= _mm_or_ps(_mm_and_ps(closer, _mm_set1_ps((float)p)), _mm_andnot_ps(closer, bestIndex));
+			}
+			total = _mm_add_ps(total, best);
+			float found[4];
+			_mm_storeu_ps(found, bestIndex);
+			for (int j = 0; j < 4; ++j) {
+				indices[i + j] = (unsigned char)found[j];
+			}
+		}
+		float lanes[4];
+		_mm_storeu_ps(lanes, total);
+		return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#else
+		float total = 0.0f;
+		for (int i = 0; i < 16; ++i) {
+			float best = FLT_MAX;
+			for (int p = 0; p < 8; ++p) {
+				float d = (v[i] - palette[p]) * (v[i] - palette[p]);
+				if (d < best) {
+					best		= d;
+					indices[i]	= (unsigned char)p;
+				}
+			}
+			total += best;
+		}
+		return total;
+#endif
+	}
+
+	//Both BC4 palette modes, rounded the way an 8 bit decode would
+	void MakeChannelPalette(int a0, int a1, int (&palette)[8]) {
+		palette[0] = a0;
+		palette[1] = a1;
+		if (a0 > a1) {
+			for (int i = 2; i < 8; ++i) {
+				palette[i] = ((8 - i) * a0 + (i - 1) * a1 + 3) / 7;
+			}
+		}
+		else {
+			for (int i = 2; i < 6; ++i) {
+				palette[i] = ((6 - i) * a0 + (i - 1) * a1 + 2) / 5;
+			}
+			palette[6] = 0;
+			palette[7] = 255;
+		}
+	}
+
+	void MakeColourPalette(uint16_t c0, uint16_t c1, int (&palette)[4][3]) {
+		Unpack565(c0, palette[0]);
+		Unpack565(c1, palette[1]);
+		for (int k = 0; k < 3; ++k) {
+			if (c0 > c1) {
+				palette[2][k] = (2 * palette[0][k] + palette[1][k]) / 3;
+				palette[3][k] = (palette[0][k] + 2 * palette[1][k]) / 3;
+			}
+			else {
+				palette[2][k] = (palette[0][k] + palette[1][k]) / 2;
+				palette[3][k] = 0;
+			}
+		}
+	}
+
+	struct ColourFit {
+		uint16_t		c0;
+		uint16_t		c1;
+		unsigned char	indices[16];
+		float			error;
+	};
+
+	//Quantises a pair of endpoints and finds the indices to go with them, always
+	//in 4 colour mode - which endpoint ends up first is sorted out when writing
+	void FitColourEndpoints(const float* r, const float* g, const float* b, const float (&e0)[3], const float (&e1)[3], ColourFit& fit) {
+		fit.c0 = Pack565(e0);
+		fit.c1 = Pack565(e1);
+		int p0[3], p1[3];
+		Unpack565(fit.c0, p0);
+		Unpack565(fit.c1, p1);
+		float palette[4][3];
+		for (int k = 0; k < 3; ++k) {
+			palette[0][k] = (float)p0[k];
+			palette[1][k] = (float)p1[k];
+			palette[2][k] = (float)((2 * p0[k] + p1[k]) / 3);
+			palette[3][k] = (float)((p0[k] + 2 * p1[k]) / 3);
+		}
+		fit.error = FindColourIndices(r, g, b, palette, fit.indices);
+	}
+}
+
+BlockFormat BlockCompressor::ChooseFormat(int channels) {
+	switch (channels) {
+		case 1:		return BlockFormat::BC4;
+		case 2:		return BlockFormat::BC5;
+		case 3:		return BlockFormat::BC1;
+		default:	return BlockFormat::BC3;
+	}
+}
+
+size_t BlockCompressor::GetBlockSize(BlockFormat format) {
+	return (format == BlockFormat::BC1 || format == BlockFormat::BC4) ? 8 : 16;
+}
+
+size_t BlockCompressor::GetCompressedSize(int width, int height, BlockFormat format) {
+	return (size_t)((width + 3) / 4) * ((height + 3) / 4) * GetBlockSize(format);
+}
+
+void BlockCompressor::Compress(const unsigned char* pixels, int width, int height, int channels,
+	BlockFormat format, unsigned char* out, JobSystem* jobs) {
+	int blockRows	= (height + 3) / 4;
+	int blockCols	= (width + 3) / 4;
+	if (!jobs || jobs->GetThreadCount() == 1 || blockRows * blockCols < PARALLEL_BLOCKS) {
+		CompressRows(pixels, width, height, channels, format, out, 0, blockRows);
+		return;
+	}
+	int bands = std::min((int)jobs->GetThreadCount() * 4, blockRows);
+	JobGroup group;
+	for (int b = 0; b < bands; ++b) {
+		int first	= blockRows * b / bands;
+		int last	= blockRows * (b + 1) / bands;
+		jobs->Run(group, [=]() { CompressRows(pixels, width, height, channels, format, out, first, last); });
+	}
+	jobs->Wait(group);
+}
+
+void BlockCompressor::CompressRows(const unsigned char* pixels, int width, int height, int channels,
+	BlockFormat format, unsigned char* out, int firstRow, int lastRow) {
+	const int		blockCols	= (width + 3) / 4;
+	const size_t	blockSize	= GetBlockSize(format);
+
+	unsigned char	rgba[16][4];
+	unsigned char	raw[16][4];
+	unsigned char	values[16];
+	ColourBlock		colour;
+	for (int by = firstRow; by < lastRow; ++by) {
+		unsigned char* block = out + (size_t)by * blockCols * blockSize;
+		for (int bx = 0; bx < blockCols; ++bx, block += blockSize) {
+			LoadBlock(pixels, width, height, channels, bx, by, rgba, raw);
+			switch (format) {
+				case BlockFormat::BC3:
+					for (int i = 0; i < 16; ++i) {
+						values[i] = rgba[i][3];
+					}
+					CompressChannel(values, block);
+					[[fallthrough]];	//for the colour half
+				case BlockFormat::BC1:
+					for (int i = 0; i < 16; ++i) {
+						colour.r[i] = rgba[i][0];
+						colour.g[i] = rgba[i][1];
+						colour.b[i] = rgba[i][2];
+					}
+					CompressColour(colour, format == BlockFormat::BC3 ? block + 8 : block);
+					break;
+				case BlockFormat::BC4:
+				case BlockFormat::BC5:
+					for (int i = 0; i < 16; ++i) {
+						values[i] = raw[i][0];
+					}
+					CompressChannel(values, block);
+					if (format == BlockFormat::BC5) {
+						for (int i = 0; i < 16; ++i) {
+							values[i] = raw[i][1];
+						}
+						CompressChannel(values, block + 8);
+					}
+					break;
+			}
+		}
+	}
+}
+
+void BlockCompressor::LoadBlock(const unsigned char* pixels, int width, int height, int channels,
+	int bx, int by, unsigned char (&rgba)[16][4], unsigned char (&raw)[16][4]) {
+	for (int i = 0; i < 16; ++i) {
+		int x = std::min(bx * 4 + (i & 3),	width - 1);
+		int y = std::min(by * 4 + (i >> 2), height - 1);
+		const unsigned char* p = pixels + ((size_t)y * width + x) * channels;
+		for (int k = 0; k < 4; ++k) {
+			raw[i][k] = k < channels ? p[k] : 0;
+		}
+		bool grey	= channels < 3;
+		rgba[i][0]	= p[0];
+		rgba[i][1]	= grey ? p[0] : p[1];
+		rgba[i][2]	= grey ? p[0] : p[2];
+		rgba[i][3]	= channels == 2 ? p[1] : (channels == 4 ? p[3] : 255);
+	}
+}
+
+void BlockCompressor::CompressColour(const ColourBlock& block, unsigned char* out) {
+	const float* channel[3] = { block.r, block.g, block.b };
+
+	float mean[3];
+	for (int k = 0; k < 3; ++k) {
+		mean[k] = 0.0f;
+		for (int i = 0; i < 16; ++i) {
+			mean[k] += channel[k][i];
+		}
+		mean[k] /= 16.0f;
+	}
+	//Principal axis of the block's colours, by power iteration on their covariance
+	float centred[3][16];
+	for (int k = 0; k < 3; ++k) {
+		for (int i = 0; i < 16; ++i) {
+			centred[k][i] = channel[k][i] - mean[k];
+		}
+	}
+	float cov[3][3];
+	for (int a = 0; a < 3; ++a) {
+		for (int b = a; b < 3; ++b) {
+			cov[a][b] = cov[b][a] = Dot16(centred[a], centred[b]);
+		}
+	}
+	float axis[3] = { 1.0f, 1.0f, 1.0f };
+	for (int iteration = 0; iteration < 8; ++iteration) {
+		float next[3];
+		for (int k = 0; k < 3; ++k) {
+			next[k] = cov[k][0] * axis[0] + cov[k][1] * axis[1] + cov[k][2] * axis[2];
+		}
+		float largest = std::max(fabsf(next[0]), std::max(fabsf(next[1]), fabsf(next[2])));
+		if (largest < 1e-6f) {
+			break;	//flat block - any axis will do
+		}
+		for (int k = 0; k < 3; ++k) {
+			axis[k] = next[k] / largest;
+		}
+	}
+	float length = sqrtf(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+	for (float& a : axis) {
+		a /= length;
+	}
+	float minT = FLT_MAX;
+	float maxT = -FLT_MAX;
+	for (int i = 0; i < 16; ++i) {
+		float t = centred[0][i] * axis[0] + centred[1][i] * axis[1] + centred[2][i] * axis[2];
+		minT = std::min(minT, t);
+		maxT = std::max(maxT, t);
+	}
+	float e0[3];
+	float e1[3];
+	for (int k = 0; k < 3; ++k) {
+		e0[k] = mean[k] + axis[k] * maxT;
+		e1[k] = mean[k] + axis[k] * minT;
+	}
+	ColourFit best;
+	FitColourEndpoints(block.r, block.g, block.b, e0, e1, best);
+
+	//Refit the endpoints by least squares, given the indices just picked
+	for (int iteration = 0; iteration < 2 && best.error > 0.0f; ++iteration) {
+		float w0[16];
+		float w1[16];
+		for (int i = 0; i < 16; ++i) {
+			w0[i] = COLOUR_WEIGHTS[best.indices[i]];
+			w1[i] = 1.0f - w0[i];
+		}
+		float a00 = Dot16(w0, w0);
+		float a01 = Dot16(w0, w1);
+		float a11 = Dot16(w1, w1);
+		float det = a00 * a11 - a01 * a01;
+		if (fabsf(det) < 1e-6f) {
+			break;	//every pixel on one index - nothing to solve
+		}
+		for (int k = 0; k < 3; ++k) {
+			float x0 = Dot16(w0, channel[k]);
+			float x1 = Dot16(w1, channel[k]);
+			e0[k] = (a11 * x0 - a01 * x1) / det;
+			e1[k] = (a00 * x1 - a01 * x0) / det;
+		}
+		ColourFit refit;
+		FitColourEndpoints(block.r, block.g, block.b, e0, e1, refit);
+		if (refit.error >= best.error) {
+			break;
+		}
+		best = refit;
+	}
+
+	//4 colour mode needs c0 > c1 - swapping the endpoints swaps index 0 with 1 and 2 with 3
+	uint32_t bits = 0;
+	if (best.c0 != best.c1) {
+		bool swap = best.c0 < best.c1;
+		for (int i = 0; i < 16; ++i) {
+			bits |= (uint32_t)(swap ? best.indices[i] ^ 1 : best.indices[i]) << (i * 2);
+		}
+		if (swap) {
+			std::swap(best.c0, best.c1);
+		}
+	}
+	WriteShort(out,		best.c0);
+	WriteShort(out + 2, best.c1);
+	for (int i = 0; i < 4; ++i) {
+		out[4 + i] = (unsigned char)(bits >> (i * 8));
+	}
+}
+
+void BlockCompressor::CompressChannel(const unsigned char (&values)[16], unsigned char* out) {
+	float	v[16];
+	int		lowest		= 255;
+	int		highest		= 0;
+	int		lowestInner	= 255;	//ignoring 0 and 255, which the 6 value mode has for free
+	int		highestInner = 0;
+	for (int i = 0; i < 16; ++i) {
+		v[i]	= values[i];
+		lowest	= std::min(lowest,	(int)values[i]);
+		highest = std::max(highest, (int)values[i]);
+		if (values[i] != 0 && values[i] != 255) {
+			lowestInner		= std::min(lowestInner,		(int)values[i]);
+			highestInner	= std::max(highestInner,	(int)values[i]);
+		}
+	}
+	int				bestA0		= lowest;
+	int				bestA1		= lowest;
+	unsigned char	bestIndices[16] = {};
+	float			bestError	= FLT_MAX;
+
+	auto tryEndpoints = [&](int a0, int a1) {
+		int		paletteInts[8];
+		float	palette[8];
+		MakeChannelPalette(a0, a1, paletteInts);
+		for (int i = 0; i < 8; ++i) {
+			palette[i] = (float)paletteInts[i];
+		}
+		unsigned char indices[16];
+		float error = FindChannelIndices(v, palette, indices);
+		if (error < bestError) {
+			bestError	= error;
+			bestA0		= a0;
+			bestA1		= a1;
+			std::copy(indices, indices + 16, bestIndices);
+		}
+	};
+
+	if (lowest == highest) {
+		bestError = 0.0f;	//a0 == a1 is 6 value mode, and index 0 is exactly a0
+	}
+	else {
+		//8 value mode, with the ends pulled in a little, as the extremes rarely need an entry to themselves
+		int inset = std::min(2, (highest - lowest) / 8);
+		for (int top = 0; top <= inset; ++top) {
+			for (int bottom = 0; bottom <= inset; ++bottom) {
+				tryEndpoints(highest - top, lowest + bottom);
+			}
+		}
+		//6 value mode, when there's a 0 or 255 it can get for free
+		if ((lowest == 0 || highest == 255) && bestError > 0.0f) {
+			if (lowestInner > highestInner) {
+				tryEndpoints(0, 0);	//nothing but 0s and 255s
+			}
+			else {
+				tryEndpoints(lowestInner, highestInner);
+			}
+		}
+	}
+	out[0] = (unsigned char)bestA0;
+	out[1] = (unsigned char)bestA1;
+	uint64_t bits = 0;
+	for (int i = 0; i < 16; ++i) {
+		bits |= (uint64_t)bestIndices[i] << (i * 3);
+	}
+	for (int i = 0; i < 6; ++i) {
+		out[2 + i] = (unsigned char)(bits >> (i * 8));
+	}
+}
+
+void BlockCompressor::DecompressColour(const unsigned char* in, unsigned char (&rgb)[16][3]) {
+	int palette[4][3];
+	MakeColourPalette(ReadShort(in), ReadShort(in + 2), palette);
+	uint32_t bits = in[4] | (in[5] << 8) | (in[6] << 16) | ((uint32_t)in[7] << 24);
+	for (int i = 0; i < 16; ++i) {
+		int index = (bits >> (i * 2)) & 3;
+		for (int k = 0; k < 3; ++k) {
+			rgb[i][k] = (unsigned char)palette[index][k];
+		}
+	}
+}
+
+void BlockCompressor::DecompressChannel(const unsigned char* in, unsigned char (&values)[16]) {
+	int palette[8];
+	MakeChannelPalette(in[0], in[1], palette);
+	uint64_t bits = 0;
+	for (int i = 0; i < 6; ++i) {
+		bits |= (uint64_t)in[2 + i] << (i * 8);
+	}
+	for (int i = 0; i < 16; ++i) {
+		values[i] = (unsigned char)palette[(bits >> (i * 3)) & 7];
+	}
+}
+
+void BlockCompressor::Decompress(const unsigned char* blocks, int width, int height, int channels,
+	BlockFormat format, unsigned char* pixels) {
+	const int		blockCols	= (width + 3) / 4;
+	const int		blockRows	= (height + 3) / 4;
+	const size_t	blockSize	= GetBlockSize(format);
+	const int		alpha		= (channels == 2 || channels == 4) ? channels - 1 : -1;
+
+	unsigned char rgb[16][3];
+	unsigned char first[16];
+	unsigned char second[16];
+	for (int by = 0; by < blockRows; ++by) {
+		for (int bx = 0; bx < blockCols; ++bx) {
+			const unsigned char* block = blocks + ((size_t)by * blockCols + bx) * blockSize;
+			switch (format) {
+				case BlockFormat::BC1: DecompressColour(block, rgb); break;
+				case BlockFormat::BC3: DecompressChannel(block, second); DecompressColour(block + 8, rgb); break;
+				case BlockFormat::BC4: DecompressChannel(block, first); break;
+				case BlockFormat::BC5: DecompressChannel(block, first); DecompressChannel(block + 8, second); break;
+			}
+			for (int i = 0; i < 16; ++i) {
+				int x = bx * 4 + (i & 3);
+				int y = by * 4 + (i >> 2);
+				if (x >= width || y >= height) {
+					continue;
+				}
+				unsigned char* p = pixels + ((size_t)y * width + x) * channels;
+				for (int k = 0; k < channels; ++k) {
+					p[k] = k == alpha ? 255 : 0;
+				}
+				if (format == BlockFormat::BC4 || format == BlockFormat::BC5) {
+					p[0] = first[i];
+					if (format == BlockFormat::BC5 && channels > 1) {
+						p[1] = second[i];
+					}
+					continue;
+				}
+				for (int k = 0; k < std::min(channels, 3); ++k) {
+					if (k != alpha) {
+						p[k] = rgb[i][k];
+					}
+				}
+				if (format == BlockFormat::BC3 && alpha >= 0) {
+					p[alpha] = second[i];
+				}
+			}
+		}
+	}
+}
+
+double BlockCompressor::ComputePSNR(const unsigned char* original, int width, int height, int channels,
+	BlockFormat format, const unsigned char* blocks) {
+	if (width == 0 || height == 0) {
+		return 0.0;
+	}
+	std::vector<unsigned char> decoded((size_t)width * height * channels);
+	Decompress(blocks, width, height, channels, format, decoded.data());
+
+	const int alpha = (channels == 2 || channels == 4) ? channels - 1 : -1;
+	bool stored[4] = {};
+	for (int k = 0; k < channels; ++k) {
+		switch (format) {
+			case BlockFormat::BC1: stored[k] = k < 3 && k != alpha;						break;
+			case BlockFormat::BC3: stored[k] = k < 3 || k == alpha;						break;
+			case BlockFormat::BC4: stored[k] = k == 0;									break;
+			case BlockFormat::BC5: stored[k] = k < 2;									break;
+		}
+	}
+	double	squaredError	= 0.0;
+	size_t	count			= 0;
+	for (size_t i = 0; i < decoded.size(); ++i) {
+		if (stored[i % channels]) {
+			double d = (double)original[i] - decoded[i];
+			squaredError += d * d;
+			++count;
+		}
+	}
+	if (squaredError == 0.0) {
+		return std::numeric_limits<double>::infinity();
+	}
+	return 10.0 * log10(255.0 * 255.0 / (squaredError / count));
+}
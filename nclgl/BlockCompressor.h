@@ -0,0 +1,66 @@
+#pragma once
+/*
+Class:BlockCompressor
+Description:Compresses 8 bit images to the BCn block formats GL can sample
+directly - 4x4 pixel blocks at 4 (BC1, BC4) or 8 (BC3, BC5) bits per pixel.
+
+Colour endpoints start from the block's principal axis and are then refitted
+by least squares against the chosen indices, keeping whichever is closest;
+BC4 channels (BC3's alpha, and both halves of BC5) try both of the format's
+palette modes. Nearest palette entries are found 4 pixels at a time with SSE.
+Rows of blocks are spread over a JobSystem, if one's given.
+
+BC1 and BC3 read grey (1 and 2 channel) images as grey RGB; BC4 takes the
+first channel and BC5 the first two as they are - which is what heightmaps
+(BC4) and normal maps (BC5, with Z rebuilt in the shader) want.
+*/
+#include <cstddef>
+
+class JobSystem;
+
+enum class BlockFormat {
+	BC1,	//DXT1 - RGB
+	BC3,	//DXT5 - RGB + alpha
+	BC4,	//RGTC1 - one channel
+	BC5		//RGTC2 - two channels
+};
+
+class BlockCompressor {
+public:
+	//BC4 / BC5 for grey images (with and without alpha), BC1 / BC3 otherwise
+	static BlockFormat	ChooseFormat(int channels);
+
+	static size_t	GetBlockSize(BlockFormat format);
+	static size_t	GetCompressedSize(int width, int height, BlockFormat format);
+
+	//out needs GetCompressedSize bytes. Edge blocks repeat the last row / column
+	static void		Compress(const unsigned char* pixels, int width, int height, int channels,
+						BlockFormat format, unsigned char* out, JobSystem* jobs = nullptr);
+	//Writes back into the same channel layout Compress read from - channels
+	//the format doesn't store come back as 0, or 255 for alpha
+	static void		Decompress(const unsigned char* blocks, int width, int height, int channels,
+						BlockFormat format, unsigned char* pixels);
+
+	//Over just the channels the format stores - infinite if they all came back
+	//exactly, and 0 for an empty image
+	static double	ComputePSNR(const unsigned char* original, int width, int height, int channels,
+						BlockFormat format, const unsigned char* blocks);
+
+protected:
+	struct ColourBlock {
+		float			r[16];
+		float			g[16];
+		float			b[16];
+	};
+
+	static void		CompressRows(const unsigned char* pixels, int width, int height, int channels,
+						BlockFormat format, unsigned char* out, int firstRow, int lastRow);
+	static void		LoadBlock(const unsigned char* pixels, int width, int height, int channels,
+						int bx, int by, unsigned char (&rgba)[16][4], unsigned char (&raw)[16][4]);
+
+	static void		CompressColour(const ColourBlock& block, unsigned char* out);
+	static void		CompressChannel(const unsigned char (&values)[16], unsigned char* out);
+
+	static void		DecompressColour(const unsigned char* in, unsigned char (&rgb)[16][3]);
+	static void		DecompressChannel(const unsigned char* in, unsigned char (&values)[16]);
+};
@@ -0,0 +1,378 @@
+#include "BoundingVolumeHierarchy.h"
+#include "SceneNode.h"
+#include "Frustrum.h"
+#include <algorithm>
+#include <cmath>
+
+static Vector3 MinVector(const Vector3& a, const Vector3& b) {
+	return Vector3(std::min(a.x, b.x), std::min(a.y, b.y), std::min(a.z, b.z));
+}
+
+static Vector3 MaxVector(const Vector3& a, const Vector3& b) {
+	return Vector3(std::max(a.x, b.x), std::max(a.y, b.y), std::max(a.z, b.z));
+}
+
+//Half the surface area - only ever compared, so the factor of 2 doesn't matter
+static float BoxArea(const Vector3& boxMin, const Vector3& boxMax) {
+	Vector3 d = boxMax - boxMin;
+	return d.x * d.y + d.y * d.z + d.z * d.x;
+}
+
+static bool BoxContains(const Vector3& outerMin, const Vector3& outerMax, const Vector3& innerMin, const Vector3& innerMax) {
+	return	outerMin.x <= innerMin.x && outerMin.y <= innerMin.y && outerMin.z <= innerMin.z &&
+			innerMax.x <= outerMax.x && innerMax.y <= outerMax.y && innerMax.z <= outerMax.z;
+}
+
+static bool BoxOverlapsSphere(const Vector3& boxMin, const Vector3& boxMax, const Vector3& centre, float radius) {
+	Vector3 closest = MaxVector(boxMin, MinVector(centre, boxMax));
+	Vector3 d = centre - closest;
+	return Vector3::Dot(d, d) <= radius * radius;
+}
+
+//Slab test - inverseDir can have infinities in it for axis aligned rays, which works out fine
+static bool RayHitsBox(const Vector3& boxMin, const Vector3& boxMax, const Vector3& origin, const Vector3& inverseDir, float maxDistance) {
+	float tMin = 0.0f;
+	float tMax = maxDistance;
+	const float* bMin	= &boxMin.x;
+	const float* bMax	= &boxMax.x;
+	const float* o		= &origin.x;
+	const float* inv	= &inverseDir.x;
+	for (int i = 0; i < 3; ++i) {
+		float t1 = (bMin[i] - o[i]) * inv[i];
+		float t2 = (bMax[i] - o[i]) * inv[i];
+		if (t1 > t2) {
+			std::swap(t1, t2);
+		}
+		if (!(t1 <= t2)) {	//NaN from 0 * infinity - the ray runs along the slab's face
+			continue;
+		}
+		tMin = std::max(tMin, t1);
+		tMax = std::min(tMax, t2);
+		if (tMin > tMax) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool RayHitsSphere(const Vector3& centre, float radius, const Vector3& origin, const Vector3& direction, float maxDistance) {
+	Vector3 toCentre	= centre - origin;
+	float	along		= Vector3::Dot(toCentre, direction);
+	float	distSq		= Vector3::Dot(toCentre, toCentre) - along * along;
+	float	radiusSq	= radius * radius;
+	if (distSq > radiusSq) {
+		return false;
+	}
+	float halfChord = sqrt(radiusSq - distSq);
+	float tNear		= along - halfChord;
+	float tFar		= along + halfChord;
+	return tFar >= 0.0f && tNear <= maxDistance;
+}
+
+BoundingVolumeHierarchy::BoundingVolumeHierarchy(float margin) {
+	this->margin	= margin;
+	root			= NULL_NODE;
+	freeList		= NULL_NODE;
+}
+
+int BoundingVolumeHierarchy::AllocateNode() {
+	int index;
+	if (freeList != NULL_NODE) {
+		index		= freeList;
+		freeList	= nodes[index].parent;
+	}
+	else {
+		index = (int)nodes.size();
+		nodes.emplace_back();
+	}
+	TreeNode& n	= nodes[index];
+	n.parent	= NULL_NODE;
+	n.left		= NULL_NODE;
+	n.right		= NULL_NODE;
+	n.height	= 0;
+	n.item		= nullptr;
+	n.radius	= 0.0f;
+	return index;
+}
+
+void BoundingVolumeHierarchy::FreeNode(int index) {
+	nodes[index].parent = freeList;
+	nodes[index].height = -1;
+	nodes[index].item	= nullptr;
+	freeList = index;
+}
+
+void BoundingVolumeHierarchy::Insert(SceneNode* node) {
+	if (leaves.count(node)) {
+		return;
+	}
+	int leaf = AllocateNode();
+	nodes[leaf].item = node;
+	FitLeaf(leaf);
+	InsertLeaf(leaf);
+	leaves[node] = leaf;
+}
+
+void BoundingVolumeHierarchy::InsertSubtree(SceneNode* node) {
+	Insert(node);
+	for (std::vector<SceneNode*>::const_iterator i = node->GetChildIteratorStart(); i != node->GetChildIteratorEnd(); ++i) {
+		InsertSubtree(*i);
+	}
+}
+
+void BoundingVolumeHierarchy::Remove(SceneNode* node) {
+	std::unordered_map<SceneNode*, int>::iterator i = leaves.find(node);
+	if (i == leaves.end()) {
+		return;
+	}
+	RemoveLeaf(i->second);
+	FreeNode(i->second);
+	leaves.erase(i);
+}
+
+void BoundingVolumeHierarchy::Clear() {
+	nodes.clear();
+	leaves.clear();
+	root		= NULL_NODE;
+	freeList	= NULL_NODE;
+}
+
+void BoundingVolumeHierarchy::FitLeaf(int leaf) {
+	TreeNode& n = nodes[leaf];
+	n.centre = n.item->GetWorldTransform().GetPositionVector();
+	n.radius = n.item->GetBoundingRadius();
+
+	float fatRadius = n.radius * (1.0f + margin);
+	n.boxMin = n.centre - Vector3(fatRadius, fatRadius, fatRadius);
+	n.boxMax = n.centre + Vector3(fatRadius, fatRadius, fatRadius);
+}
+
+void BoundingVolumeHierarchy::FitParent(int index) {
+	TreeNode& n			= nodes[index];
+	const TreeNode& l	= nodes[n.left];
+	const TreeNode& r	= nodes[n.right];
+	n.boxMin = MinVector(l.boxMin, r.boxMin);
+	n.boxMax = MaxVector(l.boxMax, r.boxMax);
+	n.height = 1 + std::max(l.height, r.height);
+}
+
+size_t BoundingVolumeHierarchy::Refit() {
+	std::vector<int> moved;
+	for (const std::pair<SceneNode* const, int>& i : leaves) {
+		const TreeNode& n	= nodes[i.second];
+		Vector3 centre		= i.first->GetWorldTransform().GetPositionVector();
+		float	radius		= i.first->GetBoundingRadius();
+		Vector3 extent(radius, radius, radius);
+
+		if (radius != n.radius || !BoxContains(n.boxMin, n.boxMax, centre - extent, centre + extent)) {
+			moved.push_back(i.second);
+		}
+		else {
+			nodes[i.second].centre = centre;	//still fits, but the culling tests use the exact sphere
+		}
+	}
+	for (int leaf : moved) {
+		RemoveLeaf(leaf);
+		FitLeaf(leaf);
+		InsertLeaf(leaf);
+	}
+	return moved.size();
+}
+
+void BoundingVolumeHierarchy::InsertLeaf(int leaf) {
+	if (root == NULL_NODE) {
+		root = leaf;
+		nodes[leaf].parent = NULL_NODE;
+		return;
+	}
+	//Walk down, picking whichever child would cost least to put the leaf under
+	const Vector3 leafMin = nodes[leaf].boxMin;
+	const Vector3 leafMax = nodes[leaf].boxMax;
+	int index = root;
+	while (!nodes[index].IsLeaf()) {
+		const TreeNode& n	= nodes[index];
+		float area			= BoxArea(n.boxMin, n.boxMax);
+		float combinedArea	= BoxArea(MinVector(n.boxMin, leafMin), MaxVector(n.boxMax, leafMax));
+
+		float cost			= 2.0f * combinedArea;				//new parent for this node and the leaf
+		float inheritance	= 2.0f * (combinedArea - area);		//growth pushed onto the ancestors
+
+		float childCost[2];
+		const int children[2] = { n.left, n.right };
+		for (int c = 0; c < 2; ++c) {
+			const TreeNode& child = nodes[children[c]];
+			float grown = BoxArea(MinVector(child.boxMin, leafMin), MaxVector(child.boxMax, leafMax));
+			childCost[c] = child.IsLeaf() ? grown + inheritance : (grown - BoxArea(child.boxMin, child.boxMax)) + inheritance;
+		}
+		if (cost < childCost[0] && cost < childCost[1]) {
+			break;
+		}
+		index = childCost[0] < childCost[1] ? n.left : n.right;
+	}
+
+	int sibling		= index;
+	int oldParent	= nodes[sibling].parent;
+	int newParent	= AllocateNode();
+	nodes[newParent].parent = oldParent;
+	nodes[newParent].left	= sibling;
+	nodes[newParent].right	= leaf;
+	nodes[sibling].parent	= newParent;
+	nodes[leaf].parent		= newParent;
+
+	if (oldParent == NULL_NODE) {
+		root = newParent;
+	}
+	else if (nodes[oldParent].left == sibling) {
+		nodes[oldParent].left = newParent;
+	}
+	else {
+		nodes[oldParent].right = newParent;
+	}
+
+	for (index = newParent; index != NULL_NODE; index = nodes[index].parent) {
+		index = Balance(index);
+		FitParent(index);
+	}
+}
+
+void BoundingVolumeHierarchy::RemoveLeaf(int leaf) {
+	if (leaf == root) {
+		root = NULL_NODE;
+		return;
+	}
+	int parent		= nodes[leaf].parent;
+	int grandParent = nodes[parent].parent;
+	int sibling		= nodes[parent].left == leaf ? nodes[parent].right : nodes[parent].left;
+
+	FreeNode(parent);
+	nodes[sibling].parent = grandParent;
+
+	if (grandParent == NULL_NODE) {
+		root = sibling;
+		return;
+	}
+	if (nodes[grandParent].left == parent) {
+		nodes[grandParent].left = sibling;
+	}
+	else {
+		nodes[grandParent].right = sibling;
+	}
+	for (int index = grandParent; index != NULL_NODE; index = nodes[index].parent) {
+		index = Balance(index);
+		FitParent(index);
+	}
+}
+
+//If one child of a is more than one level taller than the other, rotate that
+//child up into a's place. Returns the index of whichever node is now at a's position
+int BoundingVolumeHierarchy::Balance(int a) {
+	TreeNode& A = nodes[a];
+	if (A.IsLeaf() || A.height < 2) {
+		return a;
+	}
+	int b = A.left;
+	int c = A.right;
+	int balance = nodes[c].height - nodes[b].height;
+	if (balance >= -1 && balance <= 1) {
+		return a;
+	}
+	//Rotate the taller child (up) into a's place
+	int up		= balance > 1 ? c : b;
+	int other	= balance > 1 ? b : c;
+	int f		= nodes[up].left;
+	int g		= nodes[up].right;
+
+	nodes[up].left		= a;
+	nodes[up].parent	= A.parent;
+	A.parent			= up;
+
+	if (nodes[up].parent == NULL_NODE) {
+		root = up;
+	}
+	else if (nodes[nodes[up].parent].left == a) {
+		nodes[nodes[up].parent].left = up;
+	}
+	else {
+		nodes[nodes[up].parent].right = up;
+	}
+	//The taller of up's children stays with it, the other goes under a
+	int keep = nodes[f].height > nodes[g].height ? f : g;
+	int give = keep == f ? g : f;
+	nodes[up].right			= keep;
+	nodes[give].parent		= a;
+	if (balance > 1) {
+		A.right = give;
+		A.left	= other;
+	}
+	else {
+		A.left	= give;
+		A.right = other;
+	}
+	FitParent(a);
+	FitParent(up);
+	return up;
+}
+
+void BoundingVolumeHierarchy::QueryFrustrum(const Frustrum& frustrum, std::vector<SceneNode*>& results) const {
+	if (root == NULL_NODE) {
+		return;
+	}
+	std::vector<int> stack(1, root);
+	while (!stack.empty()) {
+		const TreeNode& n = nodes[stack.back()];
+		stack.pop_back();
+		if (n.IsLeaf()) {
+			if (frustrum.SphereInFrustrum(n.centre, n.radius)) {
+				results.push_back(n.item);
+			}
+		}
+		else if (frustrum.BoxInFrustrum((n.boxMin + n.boxMax) * 0.5f, (n.boxMax - n.boxMin) * 0.5f)) {
+			stack.push_back(n.left);
+			stack.push_back(n.right);
+		}
+	}
+}
+
+void BoundingVolumeHierarchy::QuerySphere(const Vector3& centre, float radius, std::vector<SceneNode*>& results) const {
+	if (root == NULL_NODE) {
+		return;
+	}
+	std::vector<int> stack(1, root);
+	while (!stack.empty()) {
+		const TreeNode& n = nodes[stack.back()];
+		stack.pop_back();
+		if (n.IsLeaf()) {
+			Vector3 d		= n.centre - centre;
+			float	reach	= n.radius + radius;
+			if (Vector3::Dot(d, d) <= reach * reach) {
+				results.push_back(n.item);
+			}
+		}
+		else if (BoxOverlapsSphere(n.boxMin, n.boxMax, centre, radius)) {
+			stack.push_back(n.left);
+			stack.push_back(n.right);
+		}
+	}
+}
+
+void BoundingVolumeHierarchy::QueryRay(const Vector3& origin, const Vector3& direction, float maxDistance, std::vector<SceneNode*>& results) const {
+	if (root == NULL_NODE) {
+		return;
+	}
+	Vector3 inverseDir(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+
+	std::vector<int> stack(1, root);
+	while (!stack.empty()) {
+		const TreeNode& n = nodes[stack.back()];
+		stack.pop_back();
+		if (n.IsLeaf()) {
+			if (RayHitsSphere(n.centre, n.radius, origin, direction, maxDistance)) {
+				results.push_back(n.item);
+			}
+		}
+		else if (RayHitsBox(n.boxMin, n.boxMax, origin, inverseDir, maxDistance)) {
+			stack.push_back(n.left);
+			stack.push_back(n.right);
+		}
+	}
+}
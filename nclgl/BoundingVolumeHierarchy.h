@@ -0,0 +1,80 @@
+#pragma once
+/*
+Class:BoundingVolumeHierarchy
+Description:A dynamic tree of axis aligned boxes around SceneNode bounding
+spheres, for culling and spatial queries that only visit the parts of the
+scene that could match, instead of every node.
+
+Built the same way as Box2D's dynamic tree - nodes go in next to whichever
+sibling makes the boxes' surface area grow least, with AVL style rotations
+keeping it balanced. Each leaf's box is made a bit bigger than its sphere, so
+Refit only has to move the nodes that have left their box.
+
+Nodes must be removed before they're deleted, and Refit needs calling after
+the scene's Update so the leaves match the new world transforms.
+*/
+#include <vector>
+#include <unordered_map>
+#include "Vector3.h"
+
+class SceneNode;
+class Frustrum;
+
+class BoundingVolumeHierarchy {
+public:
+	//Leaf boxes are grown by this fraction of each node's radius
+	BoundingVolumeHierarchy(float margin = 0.2f);
+	~BoundingVolumeHierarchy() {}
+
+	void	Insert(SceneNode* node);
+	//Inserts node and all of its descendants
+	void	InsertSubtree(SceneNode* node);
+	void	Remove(SceneNode* node);
+	void	Clear();
+
+	//Re-reads every node's world position and bounding radius, and reinserts
+	//the ones that no longer fit their leaf's box. Returns how many moved
+	size_t	Refit();
+
+	//Nodes whose bounding spheres pass Frustrum::SphereInFrustrum
+	void	QueryFrustrum(const Frustrum& frustrum, std::vector<SceneNode*>& results) const;
+	//Nodes whose bounding spheres overlap the sphere
+	void	QuerySphere(const Vector3& centre, float radius, std::vector<SceneNode*>& results) const;
+	//Nodes whose bounding spheres the ray hits within maxDistance, in no particular order.
+	//direction must be normalised
+	void	QueryRay(const Vector3& origin, const Vector3& direction, float maxDistance, std::vector<SceneNode*>& results) const;
+
+	size_t	GetNodeCount() const	{ return leaves.size(); }
+	int		GetHeight() const		{ return root == NULL_NODE ? 0 : nodes[root].height; }
+
+protected:
+	static constexpr int NULL_NODE = -1;
+
+	struct TreeNode {
+		Vector3		boxMin;
+		Vector3		boxMax;
+		int			parent;
+		int			left;
+		int			right;
+		int			height;		//0 for leaves, -1 for unused nodes
+		SceneNode*	item;
+		Vector3		centre;		//the sphere the leaf was built from
+		float		radius;
+
+		bool IsLeaf() const { return left == NULL_NODE; }
+	};
+
+	int		AllocateNode();
+	void	FreeNode(int index);
+	void	InsertLeaf(int leaf);
+	void	RemoveLeaf(int leaf);
+	int		Balance(int index);
+	void	FitLeaf(int leaf);
+	void	FitParent(int index);
+
+	std::vector<TreeNode>				nodes;
+	int									root;
+	int									freeList;
+	float								margin;
+	std::unordered_map<SceneNode*, int>	leaves;
+};
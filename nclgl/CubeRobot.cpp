@@ -43,7 +43,7 @@ CubeRobot::CubeRobot(Mesh* cube) {
 }
 
 void CubeRobot::Update(float dt) {
-	transform = transform * Matrix4::Rotation(30.0f * dt, Vector3(0, 1, 0));
+	SetTransform(GetTransform() * Matrix4::Rotation(30.0f * dt, Vector3(0, 1, 0)));
 
 	head->SetTransform(head->GetTransform() *			Matrix4::Rotation(-30.0f * dt, Vector3(0, 1, 0)));
 
@@ -1,16 +1,102 @@
 #include "Frustrum.h"
 #include "SceneNode.h"
 #include "Matrix4.h"
+#include <cstring>
+#include <cmath>
 
 bool Frustrum::InsideFrustrum(SceneNode& node) {
+	return SphereInFrustrum(node.GetWorldTransform().GetPositionVector(), node.GetBoundingRadius());
+}
+
+bool Frustrum::SphereInFrustrum(const Vector3& centre, float radius) const {
+	for (int p = 0; p < 6; p++)
+	{
+		if (!planes[p].SphereInPlane(centre, radius))
+			return false;
+	}
+	return true;
+}
+
+bool Frustrum::BoxInFrustrum(const Vector3& centre, const Vector3& halfSize) const {
 	for (int p = 0; p < 6; p++)
 	{
-		if (!planes[p].SphereInPlane(node.GetWorldTransform().GetPositionVector(), node.GetBoundingRadius()))
+		Vector3 n = planes[p].GetNormal();
+		float extent = fabs(n.x) * halfSize.x + fabs(n.y) * halfSize.y + fabs(n.z) * halfSize.z;
+		if (!planes[p].SphereInPlane(centre, extent))
 			return false;
 	}
 	return true;
 }
 
+static size_t CountBits(uint32_t bits) {
+	size_t count = 0;
+	for (; bits; bits &= bits - 1) {
+		++count;
+	}
+	return count;
+}
+
+//The SIMD versions do the same multiplies and adds in the same order as
+//Vector3::Dot + distance, and visible is !(dist <= -radius) - so the results
+//are identical, NaNs included. Each block stops once every sphere in it is out.
+size_t Frustrum::SpheresInFrustrum(const float* x, const float* y, const float* z, const float* radii,
+	size_t count, uint32_t* visible) const {
+	memset(visible, 0, ((count + 31) / 32) * sizeof(uint32_t));
+
+	float nx[6], ny[6], nz[6], d[6];
+	for (int p = 0; p < 6; ++p) {
+		Vector3 n	= planes[p].GetNormal();
+		nx[p]		= n.x;
+		ny[p]		= n.y;
+		nz[p]		= n.z;
+		d[p]		= planes[p].GetDistance();
+	}
+	size_t visibleCount = 0;
+	size_t i = 0;
+#if defined(NCLGL_SIMD_AVX)
+	const __m256 signBit = _mm256_set1_ps(-0.0f);
+	for (; i + 8 <= count; i += 8) {
+		__m256 px		= _mm256_loadu_ps(x + i);
+		__m256 py		= _mm256_loadu_ps(y + i);
+		__m256 pz		= _mm256_loadu_ps(z + i);
+		__m256 negR		= _mm256_xor_ps(_mm256_loadu_ps(radii + i), signBit);
+		int mask = 0xFF;
+		for (int p = 0; p < 6 && mask; ++p) {
+			__m256 dist = _mm256_add_ps(_mm256_mul_ps(px, _mm256_set1_ps(nx[p])), _mm256_mul_ps(py, _mm256_set1_ps(ny[p])));
+			dist = _mm256_add_ps(dist, _mm256_mul_ps(pz, _mm256_set1_ps(nz[p])));
+			dist = _mm256_add_ps(dist, _mm256_set1_ps(d[p]));
+			mask &= _mm256_movemask_ps(_mm256_cmp_ps(dist, negR, _CMP_NLE_UQ));
+		}
+		visible[i / 32] |= (uint32_t)mask << (i % 32);
+		visibleCount	+= CountBits((uint32_t)mask);
+	}
+#elif defined(NCLGL_SIMD_SSE)
+	const __m128 signBit = _mm_set1_ps(-0.0f);
+	for (; i + 4 <= count; i += 4) {
+		__m128 px		= _mm_loadu_ps(x + i);
+		__m128 py		= _mm_loadu_ps(y + i);
+		__m128 pz		= _mm_loadu_ps(z + i);
+		__m128 negR		= _mm_xor_ps(_mm_loadu_ps(radii + i), signBit);
+		int mask = 0xF;
+		for (int p = 0; p < 6 && mask; ++p) {
+			__m128 dist = _mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(nx[p])), _mm_mul_ps(py, _mm_set1_ps(ny[p])));
+			dist = _mm_add_ps(dist, _mm_mul_ps(pz, _mm_set1_ps(nz[p])));
+			dist = _mm_add_ps(dist, _mm_set1_ps(d[p]));
+			mask &= _mm_movemask_ps(_mm_cmpnle_ps(dist, negR));
+		}
+		visible[i / 32] |= (uint32_t)mask << (i % 32);
+		visibleCount	+= CountBits((uint32_t)mask);
+	}
+#endif
+	for (; i < count; ++i) {
+		if (SphereInFrustrum(Vector3(x[i], y[i], z[i]), radii[i])) {
+			visible[i / 32] |= 1u << (i % 32);
+			++visibleCount;
+		}
+	}
+	return visibleCount;
+}
+
 void Frustrum::FromMatrix(const Matrix4& mat) {
 	Vector3 xaxis = Vector3(mat.values[0], mat.values[4], mat.values[8]);
 	Vector3 yaxis = Vector3(mat.values[1], mat.values[5], mat.values[9]);
@@ -18,22 +104,23 @@ void Frustrum::FromMatrix(const Matrix4& mat) {
 	Vector3 waxis = Vector3(mat.values[3], mat.values[7], mat.values[11]);
 
 
-	// normal determines which way plane faces
+	// normal determines which way plane faces - each plane is one side of
+	// -w <= x, y, z <= w in clip space, ie w - x >= 0, w + x >= 0 and so on
 
 	// RIGHT
 	planes[0] = Plane(waxis - xaxis, (mat.values[15] - mat.values[12]), true);
 
 	// LEFT
-	planes[1] = Plane(waxis + xaxis, (mat.values[15] - mat.values[12]), true);
+	planes[1] = Plane(waxis + xaxis, (mat.values[15] + mat.values[12]), true);
 
 	//BOTTOM
-	planes[2] = Plane(waxis + yaxis, (mat.values[15] - mat.values[13]), true);
+	planes[2] = Plane(waxis + yaxis, (mat.values[15] + mat.values[13]), true);
 
 	// TOP
 	planes[3] = Plane(waxis - yaxis, (mat.values[15] - mat.values[13]), true);
 
 	// NEAR
-	planes[4] = Plane(waxis + zaxis, (mat.values[15] - mat.values[14]), true);
+	planes[4] = Plane(waxis + zaxis, (mat.values[15] + mat.values[14]), true);
 
 	// FAR
 	planes[5] = Plane(waxis - zaxis, (mat.values[15] - mat.values[14]), true);
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "Plane.h"
+#include <cstdint>
+#include <cstddef>
 class SceneNode;
 class Matrix4;
 
@@ -13,6 +15,20 @@ public:
 	void FromMatrix(const Matrix4& mvp);
 	bool InsideFrustrum(SceneNode& node);
 
+	//The plain one sphere at a time test - SpheresInFrustrum must match it exactly
+	bool SphereInFrustrum(const Vector3& centre, float radius) const;
+
+	//Axis aligned box, as a centre and half size on each axis. Can say a box is inside
+	//when it's actually just outside near a corner, but never the other way round
+	bool BoxInFrustrum(const Vector3& centre, const Vector3& halfSize) const;
+
+	//Tests count spheres at once, 4 or 8 at a time with SSE / AVX. Takes separate
+	//arrays of centre x, y and z and radii. Bit (i % 32) of visible[i / 32] gets
+	//set if sphere i is inside; visible needs room for (count + 31) / 32 entries.
+	//Returns the number of visible spheres.
+	size_t SpheresInFrustrum(const float* x, const float* y, const float* z, const float* radii,
+		size_t count, uint32_t* visible) const;
+
 protected:
 	Plane planes[6];
 };
@@ -0,0 +1,200 @@
+#include "GLStateCache.h"
+
+bool GLStateCache::skipRedundantCalls = false;
+
+size_t GLStateCache::Stats::TotalRequests() const {
+	size_t total = 0;
+	for (int i = 0; i < STATE_MAX; ++i) {
+		total += requests[i];
+	}
+	return total;
+}
+
+size_t GLStateCache::Stats::TotalRedundant() const {
+	size_t total = 0;
+	for (int i = 0; i < STATE_MAX; ++i) {
+		total += redundant[i];
+	}
+	return total;
+}
+
+GLStateCache::GLStateCache() {
+	Invalidate();
+}
+
+GLStateCache& GLStateCache::GetShared() {
+	static GLStateCache shared;
+	return shared;
+}
+
+int GLStateCache::TargetIndex(GLenum target) {
+	switch (target) {
+	case GL_TEXTURE_2D:			return TARGET_2D;
+	case GL_TEXTURE_CUBE_MAP:	return TARGET_CUBE_MAP;
+	}
+	return -1;
+}
+
+int GLStateCache::CapabilityIndex(GLenum cap) {
+	switch (cap) {
+	case GL_BLEND:			return CAP_BLEND;
+	case GL_CULL_FACE:		return CAP_CULL_FACE;
+	case GL_DEPTH_TEST:		return CAP_DEPTH_TEST;
+	case GL_SCISSOR_TEST:	return CAP_SCISSOR_TEST;
+	case GL_STENCIL_TEST:	return CAP_STENCIL_TEST;
+	}
+	return -1;
+}
+
+bool GLStateCache::Changed(StateType type, bool redundant) {
+	thisFrame.requests[type]++;
+	if (redundant) {
+		thisFrame.redundant[type]++;
+		return !skipRedundantCalls;
+	}
+	return true;
+}
+
+void GLStateCache::UseProgram(GLuint newProgram) {
+	if (Changed(STATE_PROGRAM, program == newProgram)) {
+		glUseProgram(newProgram);
+		program = newProgram;
+	}
+}
+
+void GLStateCache::BindVertexArray(GLuint vao) {
+	if (Changed(STATE_VERTEX_ARRAY, vertexArray == vao)) {
+		glBindVertexArray(vao);
+		vertexArray = vao;
+	}
+}
+
+void GLStateCache::ReleaseVertexArray() {
+	if (!skipRedundantCalls) {
+		BindVertexArray(0);
+	}
+}
+
+void GLStateCache::BindFramebuffer(GLuint fbo) {
+	if (Changed(STATE_FRAMEBUFFER, framebuffer == fbo)) {
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+		framebuffer = fbo;
+	}
+}
+
+void GLStateCache::SetActiveUnit(int unit) {
+	if (activeUnit != (GLuint)unit) {
+		glActiveTexture(GL_TEXTURE0 + unit);
+		activeUnit = unit;
+	}
+}
+
+void GLStateCache::BindTexture(int unit, GLenum target, GLuint texture) {
+	int t = TargetIndex(target);
+	if (t < 0 || unit < 0 || unit >= MAX_TEXTURE_UNITS) {
+		Changed(STATE_TEXTURE, false);
+		SetActiveUnit(unit);
+		glBindTexture(target, texture);
+		return;
+	}
+	if (Changed(STATE_TEXTURE, textures[unit][t] == texture)) {
+		SetActiveUnit(unit);
+		glBindTexture(target, texture);
+		textures[unit][t] = texture;
+	}
+}
+
+void GLStateCache::SetCapability(GLenum cap, bool enabled) {
+	int c = CapabilityIndex(cap);
+	if (Changed(STATE_CAPABILITY, c >= 0 && capabilities[c] == (int)enabled)) {
+		if (enabled) {
+			glEnable(cap);
+		}
+		else {
+			glDisable(cap);
+		}
+		if (c >= 0) {
+			capabilities[c] = enabled;
+		}
+	}
+}
+
+void GLStateCache::SetDepthMask(bool enabled) {
+	if (Changed(STATE_DEPTH_MASK, depthMask == (int)enabled)) {
+		glDepthMask(enabled ? GL_TRUE : GL_FALSE);
+		depthMask = enabled;
+	}
+}
+
+void GLStateCache::SetBlendFunc(GLenum source, GLenum destination) {
+	if (Changed(STATE_BLEND_FUNC, blendSource == source && blendDestination == destination)) {
+		glBlendFunc(source, destination);
+		blendSource			= source;
+		blendDestination	= destination;
+	}
+}
+
+void GLStateCache::SetViewport(GLint x, GLint y, GLsizei width, GLsizei height) {
+	bool same = viewportKnown &&
+		viewport[0] == x && viewport[1] == y && viewport[2] == width && viewport[3] == height;
+	if (Changed(STATE_VIEWPORT, same)) {
+		glViewport(x, y, width, height);
+		viewport[0] = x;
+		viewport[1] = y;
+		viewport[2] = width;
+		viewport[3] = height;
+		viewportKnown = true;
+	}
+}
+
+void GLStateCache::ForgetTexture(GLuint texture) {
+	for (int i = 0; i < MAX_TEXTURE_UNITS; ++i) {
+		for (int t = 0; t < TARGET_MAX; ++t) {
+			if (textures[i][t] == texture) {
+				textures[i][t] = 0;
+			}
+		}
+	}
+}
+
+void GLStateCache::ForgetVertexArray(GLuint vao) {
+	if (vertexArray == vao) {
+		vertexArray = 0;
+	}
+}
+
+void GLStateCache::ForgetFramebuffer(GLuint fbo) {
+	if (framebuffer == fbo) {
+		framebuffer = 0;
+	}
+}
+
+void GLStateCache::ForgetProgram(GLuint oldProgram) {
+	if (program == oldProgram) {
+		program = UNKNOWN;
+	}
+}
+
+void GLStateCache::Invalidate() {
+	program		= UNKNOWN;
+	vertexArray = UNKNOWN;
+	framebuffer = UNKNOWN;
+	activeUnit	= UNKNOWN;
+	for (int i = 0; i < MAX_TEXTURE_UNITS; ++i) {
+		for (int t = 0; t < TARGET_MAX; ++t) {
+			textures[i][t] = UNKNOWN;
+		}
+	}
+	for (int i = 0; i < CAP_MAX; ++i) {
+		capabilities[i] = -1;
+	}
+	depthMask			= -1;
+	blendSource			= UNKNOWN;
+	blendDestination	= UNKNOWN;
+	viewportKnown		= false;
+}
+
+void GLStateCache::EndFrame() {
+	lastFrame = thisFrame;
+	thisFrame = Stats();
+}
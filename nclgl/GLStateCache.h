@@ -0,0 +1,123 @@
+#pragma once
+/*
+Class:GLStateCache
+Description:Remembers the GL state the renderer last set - program, VAO,
+framebuffer, texture unit bindings, a few enable caps, depth mask, blend
+function and viewport - so binds that wouldn't change anything can be dropped.
+
+Every request is checked against what's cached and counted, and EndFrame rolls
+the counts over so the last full frame's numbers can be read back. Calls are
+only actually skipped with SetSkipRedundantCalls(true), as the cache is only
+right if nothing changes that state behind its back: anything that binds with
+raw GL calls (SOIL, for instance) should be followed by an Invalidate().
+*/
+#include "KHR\khrplatform.h"
+#include "glad\glad.h"
+
+#include <cstddef>
+
+class GLStateCache {
+public:
+	enum StateType {
+		STATE_PROGRAM,
+		STATE_VERTEX_ARRAY,
+		STATE_FRAMEBUFFER,
+		STATE_TEXTURE,
+		STATE_CAPABILITY,
+		STATE_DEPTH_MASK,
+		STATE_BLEND_FUNC,
+		STATE_VIEWPORT,
+		STATE_MAX
+	};
+
+	struct Stats {
+		size_t requests[STATE_MAX]	= {};	//calls made to the cache
+		size_t redundant[STATE_MAX] = {};	//calls that matched the cached state
+
+		size_t TotalRequests()	const;
+		size_t TotalRedundant() const;
+	};
+
+	GLStateCache();
+	~GLStateCache() {}
+
+	//All the renderers share one context, so they share one cache too
+	static GLStateCache& GetShared();
+
+	static void	SetSkipRedundantCalls(bool state)	{ skipRedundantCalls = state; }
+	static bool	GetSkipRedundantCalls()				{ return skipRedundantCalls; }
+
+	void	UseProgram(GLuint program);
+	void	BindVertexArray(GLuint vao);
+	//Call once a mesh has been drawn. Unbinds the VAO, unless calls are being
+	//skipped - then it's left bound, in case the next draw uses it too
+	void	ReleaseVertexArray();
+	//Binds to GL_FRAMEBUFFER, ie both draw and read
+	void	BindFramebuffer(GLuint fbo);
+	//Switches the active texture unit too, if it has to
+	void	BindTexture(int unit, GLenum target, GLuint texture);
+
+	//GL_BLEND, GL_CULL_FACE, GL_DEPTH_TEST, GL_SCISSOR_TEST and GL_STENCIL_TEST
+	//are cached, anything else goes straight through
+	void	SetCapability(GLenum cap, bool enabled);
+	void	SetDepthMask(bool enabled);
+	void	SetBlendFunc(GLenum source, GLenum destination);
+	void	SetViewport(GLint x, GLint y, GLsizei width, GLsizei height);
+
+	//Deleting a bound object unbinds it, so the cache has to be told
+	void	ForgetTexture(GLuint texture);
+	void	ForgetVertexArray(GLuint vao);
+	void	ForgetFramebuffer(GLuint fbo);
+	//A deleted program stays current until the next glUseProgram, and its name
+	//can be reused straight away - so this makes the next UseProgram go through
+	void	ForgetProgram(GLuint program);
+	//Forget everything - the next call of each kind always goes through
+	void	Invalidate();
+
+	void			EndFrame();
+	const Stats&	GetFrameStats() const	{ return lastFrame; }
+	const Stats&	GetCurrentStats() const { return thisFrame; }
+
+	static const int MAX_TEXTURE_UNITS	= 16;
+
+protected:
+	enum TextureTarget {
+		TARGET_2D,
+		TARGET_CUBE_MAP,
+		TARGET_MAX
+	};
+	enum Capability {
+		CAP_BLEND,
+		CAP_CULL_FACE,
+		CAP_DEPTH_TEST,
+		CAP_SCISSOR_TEST,
+		CAP_STENCIL_TEST,
+		CAP_MAX
+	};
+
+	static int	TargetIndex(GLenum target);
+	static int	CapabilityIndex(GLenum cap);
+
+	//Counts the request, and returns true if the GL call has to be made
+	bool	Changed(StateType type, bool redundant);
+	void	SetActiveUnit(int unit);
+
+	static const GLuint UNKNOWN = ~0u;	//state we can't vouch for
+
+	GLuint	program;
+	GLuint	vertexArray;
+	GLuint	framebuffer;
+	GLuint	activeUnit;
+	GLuint	textures[MAX_TEXTURE_UNITS][TARGET_MAX];
+	int		capabilities[CAP_MAX];	//1 on, 0 off, -1 unknown
+	int		depthMask;
+	GLenum	blendSource;
+	GLenum	blendDestination;
+	GLint	viewport[4];
+	bool	viewportKnown;
+
+	Stats	thisFrame;
+	Stats	lastFrame;
+
+	static bool skipRedundantCalls;
+};
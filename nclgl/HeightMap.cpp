@@ -1,24 +1,62 @@
 #include "HeightMap.h"
+#include "JobSystem.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <iterator>
+
+//SSE2 is part of the x64 baseline - as with MipGenerator
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define NCLGL_SIMD_SSE2
+#include <emmintrin.h>
+#endif
 
 using namespace std;
 
-HeightMap::HeightMap(const string& name) {
-	int iWidth, iHeight, iChans;
-	unsigned char* data = SOIL_load_image(name.c_str(), &iWidth, &iHeight, &iChans, 1);
-	if (!data) {
+// SOIL's copy of stb_image has an inflater, even though its PNG reader only
+// takes 8 bit images
+extern "C" char* stbi_zlib_decode_malloc(const char* buffer, int len, int* outlen);
+
+HeightMap::HeightMap(const string& name, bool buildMesh) : width(0), depth(0) {
+	vertexScale =			Vector3(16.0f, 1.0f, 16.0f);
+	textureScale =			Vector2(1/16.0f, 1/16.0f);
+	if (!LoadHeights(name)) {
 		cout << "Heightmap could not be loaded" << endl;
 		return;
 	}
+	heightMapSize.x = vertexScale.x * (width - 1);
+	heightMapSize.y = vertexScale.y * 255.0f;
+	heightMapSize.z = vertexScale.z * (depth - 1);
+
+	// the same radius BufferData would find from the mesh's vertices
+	float radiusSquared = 0.0f;
+	for (int z = 0; z < depth; ++z) {
+		for (int x = 0; x < width; ++x) {
+			Vector3 v = Vector3((float)x, heights[(size_t)z * width + x], (float)z) * vertexScale;
+			radiusSquared = max(radiusSquared, Vector3::Dot(v, v));
+		}
+	}
+	boundingRadius = sqrt(radiusSquared);
+
+	if (buildMesh) {
+		BuildMesh(name);
+	}
+	BuildPyramid();
+}
+
+void HeightMap::BuildMesh(const string& name) {
+	int iWidth =			width;
+	int iHeight =			depth;
 	numVertices =			iWidth * iHeight;
 	numIndices =			(iWidth - 1) * (iHeight - 1) * 6;
 	vertices =				new Vector3[numVertices];
 	textureCoords =			new Vector2[numVertices];
 	indices =				new GLuint[numIndices];
 
-	Vector3 vertexScale =	Vector3(16.0f, 1.0f, 16.0f);
-	Vector2 textureScale =	Vector2(1/16.0f, 1/16.0f);
-
 	// loop through each vertex in height map and translate vertices
 	//  and texture coords into 2D arrays
 	for (int z = 0; z < iHeight; z++)
@@ -28,12 +66,10 @@ HeightMap::HeightMap(const string& name) {
 			// this simply makes sure that when a data item goes off
 			// the edge of the 2D array this is represented in 1D array
 			int offset = (z * iWidth) + x;
-			vertices[offset] = Vector3(x, data[offset], z) * vertexScale;
+			vertices[offset] = Vector3(x, heights[offset], z) * vertexScale;
 			textureCoords[offset] = Vector2(x, z) * textureScale;
 		}
 	}
-	// deleted uneeded data
-	SOIL_free_image_data(data);
 
 	// creates the 2D plane which terrain will be created on
 	int i = 0;
@@ -56,11 +92,481 @@ HeightMap::HeightMap(const string& name) {
 			indices[i++] = d;
 		}
 	}
-	GenerateNormals();
+	GenerateGridNormals();
 	GenerateTangents();
+	OptimiseIfEnabled(name);
 	BufferData();
+}
 
-	heightMapSize.x = vertexScale.x * (iWidth - 1);
-	heightMapSize.y = vertexScale.y * 255.0f;
-	heightMapSize.z = vertexScale.z * (iHeight - 1);
-}
\ No newline at end of file
+bool HeightMap::LoadHeights(const string& name) {
+	string extension = name.substr(name.find_last_of('.') + 1);
+	for (char& c : extension) {
+		c = (char)tolower(c);
+	}
+	if (extension == "r16") {
+		return LoadRaw(name, 2);
+	}
+	if (extension == "r32") {
+		return LoadRaw(name, 4);
+	}
+	if (extension == "png" && LoadPNG16(name)) {
+		return true;
+	}
+	int iChans;
+	unsigned char* data = SOIL_load_image(name.c_str(), &width, &depth, &iChans, 1);
+	if (!data) {
+		width = depth = 0;
+		return false;
+	}
+	heights.assign(data, data + width * depth);
+	SOIL_free_image_data(data);
+	return true;
+}
+
+bool HeightMap::LoadRaw(const string& name, int bytesPerSample) {
+	ifstream file(name, ios::binary);
+	if (!file.is_open()) {
+		return false;
+	}
+	vector<unsigned char> bytes((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+	size_t count = bytes.size() / bytesPerSample;
+	int side = (int)lround(sqrt((double)count));
+	if (count < 4 || (size_t)side * side * bytesPerSample != bytes.size()) {
+		cout << name << " isn't a square of " << bytesPerSample * 8 << " bit samples" << endl;
+		return false;
+	}
+	width = depth = side;
+	heights.resize(count);
+	for (size_t i = 0; i < count; ++i) {
+		const unsigned char* b = &bytes[i * bytesPerSample];
+		if (bytesPerSample == 2) {
+			heights[i] = (b[0] | (b[1] << 8)) / 257.0f;
+		}
+		else {
+			float f;
+			memcpy(&f, b, sizeof(f));
+			heights[i] = f * 255.0f;
+		}
+	}
+	return true;
+}
+
+// Just enough PNG for heightmaps - 16 bit, not interlaced, with the first
+// channel taken as the height
+bool HeightMap::LoadPNG16(const string& name) {
+	ifstream file(name, ios::binary);
+	vector<unsigned char> bytes((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+	const unsigned char signature[8] = { 137, 'P', 'N', 'G', '\r', '\n', 26, '\n' };
+	if (bytes.size() < 33 || memcmp(bytes.data(), signature, 8) != 0) {
+		return false;
+	}
+	auto read32 = [&](size_t at) {
+		return (uint32_t)bytes[at] << 24 | (uint32_t)bytes[at + 1] << 16 | (uint32_t)bytes[at + 2] << 8 | bytes[at + 3];
+	};
+	// IHDR always comes first
+	uint32_t pngWidth	= read32(16);
+	uint32_t pngHeight	= read32(20);
+	int bitDepth		= bytes[24];
+	int colourType		= bytes[25];
+	int interlace		= bytes[28];
+	const int channelsForType[7] = { 1, 0, 3, 0, 2, 0, 4 };
+	if (bitDepth != 16 || colourType > 6 || channelsForType[colourType] == 0 || interlace != 0 ||
+		pngWidth < 2 || pngHeight < 2 || pngWidth > 65536 || pngHeight > 65536) {
+		return false;
+	}
+	vector<char> compressed;
+	for (size_t at = 8; at + 12 <= bytes.size(); ) {
+		uint32_t length = read32(at);
+		if (length > bytes.size() - at - 12) {
+			break;
+		}
+		if (memcmp(&bytes[at + 4], "IDAT", 4) == 0) {
+			compressed.insert(compressed.end(), bytes.begin() + at + 8, bytes.begin() + at + 8 + length);
+		}
+		at += length + 12;
+	}
+	int rawSize = 0;
+	unsigned char* raw = (unsigned char*)stbi_zlib_decode_malloc(compressed.data(), (int)compressed.size(), &rawSize);
+	size_t pixelBytes	= channelsForType[colourType] * 2;
+	size_t stride		= pngWidth * pixelBytes;
+	if (!raw || (size_t)rawSize < (stride + 1) * pngHeight) {
+		cout << name << " has a broken 16 bit image" << endl;
+		free(raw);
+		return false;
+	}
+
+	// undo each row's filter in place, against the row before it
+	vector<unsigned char> zeroes(stride, 0);
+	for (uint32_t y = 0; y < pngHeight; ++y) {
+		unsigned char* row			= raw + y * (stride + 1) + 1;
+		const unsigned char* above	= y > 0 ? raw + (y - 1) * (stride + 1) + 1 : zeroes.data();
+		int filter = row[-1];
+		for (size_t i = 0; i < stride; ++i) {
+			int a = i >= pixelBytes ? row[i - pixelBytes] : 0;
+			int b = above[i];
+			int c = i >= pixelBytes ? above[i - pixelBytes] : 0;
+			int predicted = 0;
+			switch (filter) {
+			case 1: predicted = a;				break;
+			case 2: predicted = b;				break;
+			case 3: predicted = (a + b) / 2;	break;
+			case 4: {
+				int p = a + b - c;
+				int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+				predicted = pa <= pb && pa <= pc ? a : (pb <= pc ? b : c);
+				break;
+			}
+			}
+			row[i] = (unsigned char)(row[i] + predicted);
+		}
+	}
+	width	= (int)pngWidth;
+	depth	= (int)pngHeight;
+	heights.resize((size_t)width * depth);
+	for (int y = 0; y < depth; ++y) {
+		const unsigned char* row = raw + y * (stride + 1) + 1;
+		for (int x = 0; x < width; ++x) {
+			heights[(size_t)y * width + x] = (row[x * pixelBytes] << 8 | row[x * pixelBytes + 1]) / 257.0f;
+		}
+	}
+	free(raw);
+	return true;
+}
+
+/*
+Queries. Heights are bilinear across each cell, and normals come from
+bilinearly blending the central difference gradients at its corners - the
+same gradients the terrain's vertex normals use - so they're smooth over cell
+edges rather than creased.
+*/
+void HeightMap::FindCell(float x, float z, int& cellX, int& cellZ, float& fx, float& fz) const {
+	float gx = min(max(x / vertexScale.x, 0.0f), (float)(width - 1));
+	float gz = min(max(z / vertexScale.z, 0.0f), (float)(depth - 1));
+	cellX	= min((int)gx, width - 2);
+	cellZ	= min((int)gz, depth - 2);
+	fx		= gx - cellX;
+	fz		= gz - cellZ;
+}
+
+void HeightMap::GetGradient(int x, int z, float& dx, float& dz) const {
+	int x0 = max(x - 1, 0), x1 = min(x + 1, width - 1);
+	int z0 = max(z - 1, 0), z1 = min(z + 1, depth - 1);
+	dx = (GetSample(x1, z) - GetSample(x0, z)) / ((x1 - x0) * vertexScale.x);
+	dz = (GetSample(x, z1) - GetSample(x, z0)) / ((z1 - z0) * vertexScale.z);
+}
+
+#ifdef NCLGL_SIMD_SSE2
+namespace {
+	// Normals for a row's samples from 1 onwards, 4 at a time while none of them
+	// are on the far edge - exactly what GetGradient and Vector3::Normalise work
+	// out. Returns the first sample it didn't do
+	int GridNormalsSSE2(const float* above, const float* row, const float* below, int width,
+		float scaleY, float spanX, float spanZ, Vector3* out) {
+		const __m128 sy		= _mm_set1_ps(scaleY);
+		const __m128 sx		= _mm_set1_ps(spanX);
+		const __m128 sz		= _mm_set1_ps(spanZ);
+		const __m128 one	= _mm_set1_ps(1.0f);
+		const __m128 sign	= _mm_set1_ps(-0.0f);
+		int x = 1;
+		for (; x + 4 <= width - 1; x += 4) {
+			__m128 dx = _mm_div_ps(_mm_sub_ps(_mm_mul_ps(_mm_loadu_ps(row + x + 1), sy),
+				_mm_mul_ps(_mm_loadu_ps(row + x - 1), sy)), sx);
+			__m128 dz = _mm_div_ps(_mm_sub_ps(_mm_mul_ps(_mm_loadu_ps(below + x), sy),
+				_mm_mul_ps(_mm_loadu_ps(above + x), sy)), sz);
+			// (-dx, 1, -dz) is never zero length
+			__m128 length	= _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), one), _mm_mul_ps(dz, dz)));
+			__m128 scale	= _mm_div_ps(one, length);
+
+			float n[3][4];
+			_mm_storeu_ps(n[0], _mm_xor_ps(_mm_mul_ps(dx, scale), sign));
+			_mm_storeu_ps(n[1], scale);
+			_mm_storeu_ps(n[2], _mm_xor_ps(_mm_mul_ps(dz, scale), sign));
+			for (int i = 0; i < 4; ++i) {
+				out[x + i] = Vector3(n[0][i], n[1][i], n[2][i]);
+			}
+		}
+		return x;
+	}
+}
+#endif
+
+void HeightMap::GenerateGridNormals() {
+	if (width < 2 || depth < 2) {
+		GenerateNormals();
+		return;
+	}
+	if (!normals)
+		normals = new Vector3[numVertices];
+	auto normalRows = [this](int first, int last) {
+		for (int z = first; z < last; ++z) {
+			Vector3* row = normals + (size_t)z * width;
+			auto gridNormal = [&](int x) {
+				float dx, dz;
+				GetGradient(x, z, dx, dz);
+				row[x] = Vector3(-dx, 1.0f, -dz).Normalised();
+			};
+			gridNormal(0);
+			int x = 1;
+#ifdef NCLGL_SIMD_SSE2
+			int z0 = max(z - 1, 0), z1 = min(z + 1, depth - 1);
+			x = GridNormalsSSE2(&heights[(size_t)z0 * width], &heights[(size_t)z * width], &heights[(size_t)z1 * width],
+				width, vertexScale.y, 2 * vertexScale.x, (z1 - z0) * vertexScale.z, row);
+#endif
+			for (; x < width; ++x) {
+				gridNormal(x);
+			}
+		}
+	};
+	// rows are split up the same way as SampleHeights' points
+	JobSystem& jobs = JobSystem::GetShared();
+	const int minBand = max(1024 / width, 1);
+	if (jobs.GetThreadCount() == 1 || depth < minBand * 2) {
+		normalRows(0, depth);
+		return;
+	}
+	int bands = min((int)jobs.GetThreadCount() * 4, depth / minBand);
+	JobGroup group;
+	for (int b = 0; b < bands; ++b) {
+		int first	= depth * b / bands;
+		int last	= depth * (b + 1) / bands;
+		jobs.Run(group, [=]() { normalRows(first, last); });
+	}
+	jobs.Wait(group);
+}
+
+void HeightMap::Sample(float x, float z, float* height, Vector3* normal) const {
+	if (width < 2 || depth < 2) {
+		if (height) *height = 0.0f;
+		if (normal) *normal = Vector3(0, 1, 0);
+		return;
+	}
+	int cx, cz;
+	float fx, fz;
+	FindCell(x, z, cx, cz, fx, fz);
+	float w[4] = { (1 - fx) * (1 - fz), fx * (1 - fz), (1 - fx) * fz, fx * fz };
+	if (height) {
+		*height =	GetSample(cx, cz) * w[0]		+ GetSample(cx + 1, cz) * w[1] +
+					GetSample(cx, cz + 1) * w[2]	+ GetSample(cx + 1, cz + 1) * w[3];
+	}
+	if (normal) {
+		float dx = 0.0f, dz = 0.0f;
+		for (int i = 0; i < 4; ++i) {
+			float gx, gz;
+			GetGradient(cx + (i & 1), cz + (i >> 1), gx, gz);
+			dx += gx * w[i];
+			dz += gz * w[i];
+		}
+		*normal = Vector3(-dx, 1.0f, -dz).Normalised();
+	}
+}
+
+float HeightMap::GetHeightAt(float x, float z) const {
+	float height;
+	Sample(x, z, &height, nullptr);
+	return height;
+}
+
+Vector3 HeightMap::GetNormalAt(float x, float z) const {
+	Vector3 normal;
+	Sample(x, z, nullptr, &normal);
+	return normal;
+}
+
+void HeightMap::SampleHeights(const Vector3* points, size_t count, float* heightsOut, Vector3* normalsOut, JobSystem* jobs) const {
+	auto sampleRange = [=](size_t first, size_t last) {
+		for (size_t i = first; i < last; ++i) {
+			Sample(points[i].x, points[i].z, heightsOut ? heightsOut + i : nullptr, normalsOut ? normalsOut + i : nullptr);
+		}
+	};
+	// not worth a job for less than this many
+	const size_t minBand = 1024;
+	if (!jobs || jobs->GetThreadCount() == 1 || count < minBand * 2) {
+		sampleRange(0, count);
+		return;
+	}
+	size_t bands = min((size_t)jobs->GetThreadCount() * 4, count / minBand);
+	JobGroup group;
+	for (size_t b = 0; b < bands; ++b) {
+		size_t first	= count * b / bands;
+		size_t last		= count * (b + 1) / bands;
+		jobs->Run(group, [=]() { sampleRange(first, last); });
+	}
+	jobs->Wait(group);
+}
+
+/*
+Ray casting. Everything under the surface counts as solid, so each pyramid
+node is a box from its cells' highest point down, and the ray only goes into
+the children of boxes it passes through - nearest child first, so the first
+cell it actually hits is the nearest hit. A ray that's already below a node's
+lowest point where it comes in (only possible through the map's sides) hits
+it there.
+*/
+void HeightMap::BuildPyramid() {
+	pyramid.clear();
+	pyramidWidths.clear();
+	if (width < 2 || depth < 2) {
+		return;
+	}
+	int levelWidth = width - 1;
+	int levelDepth = depth - 1;
+	vector<HeightRange> level((size_t)levelWidth * levelDepth);
+	for (int z = 0; z < levelDepth; ++z) {
+		for (int x = 0; x < levelWidth; ++x) {
+			float a = GetSample(x, z), b = GetSample(x + 1, z);
+			float c = GetSample(x, z + 1), d = GetSample(x + 1, z + 1);
+			level[(size_t)z * levelWidth + x] = { min(min(a, b), min(c, d)), max(max(a, b), max(c, d)) };
+		}
+	}
+	pyramid.push_back(move(level));
+	pyramidWidths.push_back(levelWidth);
+	while (levelWidth > 1 || levelDepth > 1) {
+		const vector<HeightRange>& below = pyramid.back();
+		int belowWidth = levelWidth;
+		int belowDepth = levelDepth;
+		levelWidth = (levelWidth + 1) / 2;
+		levelDepth = (levelDepth + 1) / 2;
+		vector<HeightRange> up((size_t)levelWidth * levelDepth, { FLT_MAX, -FLT_MAX });
+		for (int z = 0; z < belowDepth; ++z) {
+			for (int x = 0; x < belowWidth; ++x) {
+				const HeightRange& from = below[(size_t)z * belowWidth + x];
+				HeightRange& to = up[(size_t)(z / 2) * levelWidth + x / 2];
+				to.min = min(to.min, from.min);
+				to.max = max(to.max, from.max);
+			}
+		}
+		pyramid.push_back(move(up));
+		pyramidWidths.push_back(levelWidth);
+	}
+}
+
+bool HeightMap::RayCast(const Vector3& origin, const Vector3& direction, float maxDistance, Vector3& hit) const {
+	if (pyramid.empty()) {
+		return false;
+	}
+	bool overMap =	origin.x >= 0.0f && origin.x <= heightMapSize.x &&
+					origin.z >= 0.0f && origin.z <= heightMapSize.z;
+	if (overMap && origin.y <= GetHeightAt(origin.x, origin.z)) {
+		hit = origin;
+		return true;
+	}
+	// in samples across, so boxes line up with cells
+	Vector3 o(origin.x / vertexScale.x, origin.y, origin.z / vertexScale.z);
+	Vector3 d(direction.x / vertexScale.x, direction.y, direction.z / vertexScale.z);
+	const float oa[3]	= { o.x, o.y, o.z };
+	const float invD[3] = { 1.0f / d.x, 1.0f / d.y, 1.0f / d.z };	// infinities are fine here
+
+	// the slab test, over [tMin, tMax]
+	auto clip = [&](float minX, float maxX, float maxY, float minZ, float maxZ, float& tMin, float& tMax) {
+		float lows[3]	= { minX, -FLT_MAX, minZ };
+		float highs[3]	= { maxX, maxY, maxZ };
+		for (int axis = 0; axis < 3; ++axis) {
+			float t0 = (lows[axis] - oa[axis]) * invD[axis];
+			float t1 = (highs[axis] - oa[axis]) * invD[axis];
+			if (t0 != t0 || t1 != t1) {	// parallel to, and on, the slab's plane
+				if (oa[axis] < lows[axis] || oa[axis] > highs[axis]) {
+					return false;
+				}
+				continue;
+			}
+			tMin = max(tMin, min(t0, t1));
+			tMax = min(tMax, max(t0, t1));
+		}
+		return tMin <= tMax;
+	};
+
+	struct Entry {
+		int level;
+		int x;
+		int z;
+	};
+	Entry stack[64 * 3];
+	int top = 0;
+	stack[top++] = { (int)pyramid.size() - 1, 0, 0 };
+	// children are pushed far first, so they come off near first
+	int flipX = d.x < 0.0f ? 1 : 0;
+	int flipZ = d.z < 0.0f ? 1 : 0;
+	while (top > 0) {
+		Entry e = stack[--top];
+		int cells	= 1 << e.level;
+		float minX	= (float)(e.x * cells);
+		float minZ	= (float)(e.z * cells);
+		float maxX	= (float)min((e.x + 1) * cells, width - 1);
+		float maxZ	= (float)min((e.z + 1) * cells, depth - 1);
+		float tMin	= 0.0f;
+		float tMax	= maxDistance;
+		const HeightRange& range = pyramid[e.level][(size_t)e.z * pyramidWidths[e.level] + e.x];
+		if (!clip(minX, maxX, range.max, minZ, maxZ, tMin, tMax)) {
+			continue;
+		}
+		if (o.y + d.y * tMin <= range.min) {
+			hit = origin + direction * tMin;
+			return true;
+		}
+		if (e.level == 0) {
+			float t;
+			if (RayCastCell(e.x, e.z, o, d, tMin, tMax, t)) {
+				hit = origin + direction * t;
+				return true;
+			}
+			continue;
+		}
+		int belowWidth = pyramidWidths[e.level - 1];
+		int belowDepth = (int)(pyramid[e.level - 1].size() / belowWidth);
+		for (int i = 3; i >= 0; --i) {
+			int cx = e.x * 2 + ((i & 1) ^ flipX);
+			int cz = e.z * 2 + ((i >> 1) ^ flipZ);
+			if (cx < belowWidth && cz < belowDepth) {
+				stack[top++] = { e.level - 1, cx, cz };
+			}
+		}
+	}
+	return false;
+}
+
+// Along the ray, the bilinear surface's height is a quadratic in t, so the
+// hit is the first root of surface - ray height within the cell
+bool HeightMap::RayCastCell(int cellX, int cellZ, const Vector3& o, const Vector3& d, float tMin, float tMax, float& t) const {
+	float a = GetSample(cellX, cellZ);
+	float b = GetSample(cellX + 1, cellZ);
+	float c = GetSample(cellX, cellZ + 1);
+	float e = GetSample(cellX + 1, cellZ + 1);
+	float u0 = o.x - cellX;
+	float v0 = o.z - cellZ;
+	float k = a - b - c + e;
+	// surface - ray = A + Bt + Ct^2
+	float A = a + (b - a) * u0 + (c - a) * v0 + k * u0 * v0 - o.y;
+	float B = (b - a) * d.x + (c - a) * d.z + k * (u0 * d.z + v0 * d.x) - d.y;
+	float C = k * d.x * d.z;
+	auto under = [&](float s) { return A + (B + C * s) * s >= 0.0f; };
+	if (under(tMin)) {
+		t = tMin;
+		return true;
+	}
+	float roots[2];
+	int count = 0;
+	if (fabs(C) < 1e-12f) {
+		if (B != 0.0f) {
+			roots[count++] = -A / B;
+		}
+	}
+	else {
+		float disc = B * B - 4.0f * A * C;
+		if (disc < 0.0f) {
+			return false;
+		}
+		// the stable form, so a tiny C doesn't lose the near root
+		float q = -0.5f * (B + copysign(sqrtf(disc), B));
+		roots[count++] = q / C;
+		if (q != 0.0f) {
+			roots[count++] = A / q;
+		}
+	}
+	t = FLT_MAX;
+	for (int i = 0; i < count; ++i) {
+		if (roots[i] >= tMin && roots[i] <= tMax) {
+			t = min(t, roots[i]);
+		}
+	}
+	return t != FLT_MAX;
+}
@@ -1,15 +1,82 @@
 #pragma once
 
 #include <string>
+#include <vector>
 #include "Mesh.h"
 
+class JobSystem;
+
+// Heights can come from any image SOIL reads (as 8 bit grey), a 16 bit PNG,
+// or a raw square of little endian samples - .r16 (16 bit unsigned) or .r32
+// (float, 0-1). Whatever the source, samples end up in the same 0-255 range,
+// so the extra bits are just extra precision
 class HeightMap : public Mesh
 {
 public:
-	HeightMap(const std::string& name);
+	// Without buildMesh there's nothing to draw, just the heights, bounds and
+	// queries - for anything that makes its own geometry (see TerrainQuadtree)
+	HeightMap(const std::string& name, bool buildMesh = true);
 
 	Vector3 GetHeightMapSize() const { return heightMapSize; }
+
+	// the samples (0-255), row by row, kept for anything that wants to
+	// build its own geometry from them (see TerrainQuadtree)
+	const std::vector<float>&	GetHeights() const		{ return heights; }
+	int							GetWidth() const		{ return width; }
+	int							GetDepth() const		{ return depth; }
+	Vector3						GetVertexScale() const	{ return vertexScale; }
+	Vector2						GetTextureScale() const { return textureScale; }
+
+	// Queries are in the heightmap's own space (before any model matrix), over
+	// a surface that's bilinear between samples - so it can be a little off
+	// the drawn triangles. Points off the map get the nearest edge's values
+	float	GetHeightAt(float x, float z) const;
+	Vector3	GetNormalAt(float x, float z) const;
+	// The same for count points at once (their y is ignored), split over the
+	// JobSystem if there's one. Either output can be null
+	void	SampleHeights(const Vector3* points, size_t count, float* heightsOut, Vector3* normalsOut,
+				JobSystem* jobs = nullptr) const;
+	// Nearest point the ray meets the surface within maxDistance, found by
+	// stepping down a pyramid of min / max heights. direction must be
+	// normalised, and a ray starting under the surface hits straight away
+	bool	RayCast(const Vector3& origin, const Vector3& direction, float maxDistance, Vector3& hit) const;
+
 protected:
+	bool		LoadHeights(const std::string& name);
+	// false if it isn't a 16 bit PNG, so SOIL can have a go
+	bool		LoadPNG16(const std::string& name);
+	bool		LoadRaw(const std::string& name, int bytesPerSample);
+	// the whole grid as one mesh, uploaded straight away
+	void		BuildMesh(const std::string& name);
+	void		BuildPyramid();
+	// the mesh's normals straight from the grid's gradients, rather than by
+	// summing up triangles - the same normals GetNormalAt gives at each sample
+	void		GenerateGridNormals();
+
+	// where (x, z) falls - the cell's first sample, and how far across it
+	void		FindCell(float x, float z, int& cellX, int& cellZ, float& fx, float& fz) const;
+	float		GetSample(int x, int z) const { return heights[(size_t)z * width + x] * vertexScale.y; }
+	// dh/dx and dh/dz at a sample, from the samples either side
+	void		GetGradient(int x, int z, float& dx, float& dz) const;
+	void		Sample(float x, float z, float* height, Vector3* normal) const;
+	bool		RayCastCell(int cellX, int cellZ, const Vector3& origin, const Vector3& direction,
+					float tMin, float tMax, float& t) const;
+
 	Vector3 heightMapSize;
+
+	std::vector<float>	heights;
+	int					width;
+	int					depth;
+	Vector3				vertexScale;
+	Vector2				textureScale;
+
+	struct HeightRange {
+		float	min;
+		float	max;
+	};
+	// level 0 has each cell's range, and every level up has each 2x2 of the
+	// one below's - until the last, which covers the whole map
+	std::vector<std::vector<HeightRange>>	pyramid;
+	std::vector<int>						pyramidWidths;
 };
 
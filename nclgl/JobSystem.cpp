@@ -0,0 +1,124 @@
+#include "JobSystem.h"
+#include <algorithm>
+
+thread_local JobSystem*		JobSystem::currentSystem	= nullptr;
+thread_local unsigned int	JobSystem::currentQueue		= 0;
+
+JobSystem::JobSystem(unsigned int threadCount) : queuedJobs(0), quitting(false) {
+	if (threadCount == 0) {
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+	}
+	for (unsigned int i = 0; i < threadCount; ++i) {
+		queues.emplace_back(new JobQueue());
+	}
+	for (unsigned int i = 1; i < threadCount; ++i) {
+		workers.emplace_back(&JobSystem::WorkerLoop, this, i);
+	}
+}
+
+JobSystem::~JobSystem() {
+	{
+		std::lock_guard<std::mutex> guard(sleepLock);
+		quitting = true;
+	}
+	wakeUp.notify_all();
+	for (std::thread& t : workers) {
+		t.join();
+	}
+}
+
+JobSystem& JobSystem::GetShared() {
+	static JobSystem shared;
+	return shared;
+}
+
+unsigned int JobSystem::GetCurrentQueue() const {
+	return currentSystem == this ? currentQueue : 0;
+}
+
+void JobSystem::Run(JobGroup& group, std::function<void()> job) {
+	group.pending.fetch_add(1, std::memory_order_relaxed);
+
+	JobQueue& q = *queues[GetCurrentQueue()];
+	{
+		std::lock_guard<std::mutex> guard(q.lock);
+		q.jobs.push_back({ std::move(job), &group });
+	}
+	queuedJobs.fetch_add(1, std::memory_order_release);
+	{	//Taking the lock means a worker can't miss this between checking queuedJobs and sleeping
+		std::lock_guard<std::mutex> guard(sleepLock);
+	}
+	wakeUp.notify_one();
+}
+
+void JobSystem::Wait(JobGroup& group) {
+	unsigned int queue = GetCurrentQueue();
+	Job job;
+	while (!group.IsDone()) {
+		if (FindJob(queue, job)) {
+			Execute(job);
+		}
+		else {
+			std::this_thread::yield();	//whatever's left is running on other threads
+		}
+	}
+}
+
+bool JobSystem::RunOneJob() {
+	Job job;
+	if (!FindJob(GetCurrentQueue(), job)) {
+		return false;
+	}
+	Execute(job);
+	return true;
+}
+
+bool JobSystem::FindJob(unsigned int queue, Job& job) {
+	{	//Newest job from our own queue first...
+		JobQueue& q = *queues[queue];
+		std::lock_guard<std::mutex> guard(q.lock);
+		if (!q.jobs.empty()) {
+			job = std::move(q.jobs.back());
+			q.jobs.pop_back();
+			queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+			return true;
+		}
+	}
+	//...then the oldest (probably biggest) job from someone else's
+	const unsigned int count = (unsigned int)queues.size();
+	for (unsigned int i = 1; i < count; ++i) {
+		JobQueue& q = *queues[(queue + i) % count];
+		std::lock_guard<std::mutex> guard(q.lock);
+		if (!q.jobs.empty()) {
+			job = std::move(q.jobs.front());
+			q.jobs.pop_front();
+			queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+			return true;
+		}
+	}
+	return false;
+}
+
+void JobSystem::Execute(Job& job) {
+	job.function();
+	job.function = nullptr;
+	job.group->pending.fetch_sub(1, std::memory_order_release);
+}
+
+void JobSystem::WorkerLoop(unsigned int queue) {
+	currentSystem	= this;
+	currentQueue	= queue;
+
+	Job job;
+	while (true) {
+		if (FindJob(queue, job)) {
+			Execute(job);
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(sleepLock);
+		wakeUp.wait(lock, [&]() { return quitting || queuedJobs.load(std::memory_order_acquire) > 0; });
+		if (quitting) {
+			return;
+		}
+	}
+}
@@ -0,0 +1,78 @@
+#pragma once
+/*
+Class:JobSystem
+Description:A pool of worker threads (one per core, counting the thread that
+waits on the results) running small jobs. Each thread has its own deque of
+jobs - it pushes and pops at the back, so nested jobs stay hot in its cache,
+while idle threads steal from the front of everyone else's.
+
+Jobs are added to a JobGroup, and Wait on a group keeps the waiting thread
+busy running jobs until every job in that group has finished, so jobs can
+safely start and wait on jobs of their own.
+*/
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class JobGroup {
+public:
+	JobGroup() : pending(0) {}
+	~JobGroup() {}
+
+	bool IsDone() const { return pending.load(std::memory_order_acquire) == 0; }
+
+protected:
+	friend class JobSystem;
+	std::atomic<int> pending;
+};
+
+class JobSystem {
+public:
+	//0 means one thread per core
+	JobSystem(unsigned int threadCount = 0);
+	~JobSystem();
+
+	//Shared by everything in nclgl that wants to run work in parallel
+	static JobSystem&	GetShared();
+
+	void	Run(JobGroup& group, std::function<void()> job);
+	void	Wait(JobGroup& group);
+	//Runs one queued job on the calling thread, if there are any - lets a
+	//thread that's polling for results help out instead of just spinning
+	bool	RunOneJob();
+
+	//Includes the thread calling Wait
+	unsigned int GetThreadCount() const { return (unsigned int)workers.size() + 1; }
+
+protected:
+	struct Job {
+		std::function<void()>	function;
+		JobGroup*				group;
+	};
+	struct JobQueue {
+		std::mutex			lock;
+		std::deque<Job>		jobs;
+	};
+
+	void	WorkerLoop(unsigned int queue);
+	bool	FindJob(unsigned int queue, Job& job);
+	void	Execute(Job& job);
+	unsigned int GetCurrentQueue() const;
+
+	//Queue 0 is shared by any threads that aren't workers, the rest belong to one worker each
+	std::vector<std::unique_ptr<JobQueue>>	queues;
+	std::vector<std::thread>				workers;
+
+	std::atomic<int>		queuedJobs;
+	std::mutex				sleepLock;
+	std::condition_variable	wakeUp;
+	bool					quitting;
+
+	static thread_local JobSystem*		currentSystem;
+	static thread_local unsigned int	currentQueue;
+};
@@ -0,0 +1,96 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#include "common.h"
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(void) {
+	data	= nullptr;
+	size	= 0;
+#ifdef _WIN32
+	fileHandle		= INVALID_HANDLE_VALUE;
+	mappingHandle	= nullptr;
+#else
+	fileHandle		= -1;
+#endif
+}
+
+MappedFile::MappedFile(const std::string& filename) : MappedFile() {
+	Open(filename);
+}
+
+MappedFile::~MappedFile(void) {
+	Close();
+}
+
+bool MappedFile::Open(const std::string& filename) {
+	Close();
+#ifdef _WIN32
+	fileHandle = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (fileHandle == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0) {
+		Close();
+		return false;
+	}
+	mappingHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (!mappingHandle) {
+		Close();
+		return false;
+	}
+	data = (const char*)MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+	size = (size_t)fileSize.QuadPart;
+#else
+	fileHandle = open(filename.c_str(), O_RDONLY);
+	if (fileHandle < 0) {
+		return false;
+	}
+	struct stat fileInfo;
+	if (fstat(fileHandle, &fileInfo) != 0 || fileInfo.st_size == 0) {
+		Close();
+		return false;
+	}
+	void* mapped = mmap(nullptr, (size_t)fileInfo.st_size, PROT_READ, MAP_PRIVATE, fileHandle, 0);
+	data = (mapped == MAP_FAILED) ? nullptr : (const char*)mapped;
+	size = (size_t)fileInfo.st_size;
+#endif
+	if (!data) {
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void MappedFile::Close() {
+#ifdef _WIN32
+	if (data) {
+		UnmapViewOfFile(data);
+	}
+	if (mappingHandle) {
+		CloseHandle(mappingHandle);
+	}
+	if (fileHandle != INVALID_HANDLE_VALUE) {
+		CloseHandle(fileHandle);
+	}
+	fileHandle		= INVALID_HANDLE_VALUE;
+	mappingHandle	= nullptr;
+#else
+	if (data) {
+		munmap((void*)data, size);
+	}
+	if (fileHandle >= 0) {
+		close(fileHandle);
+	}
+	fileHandle		= -1;
+#endif
+	data = nullptr;
+	size = 0;
+}
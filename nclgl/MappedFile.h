@@ -0,0 +1,39 @@
+#pragma once
+/*
+Class:MappedFile
+Description:Read-only memory mapping of a whole file. The contents stay valid
+until the MappedFile is closed or destroyed, so anything that needs to outlive
+it (ie, mesh data that isn't going straight into a buffer object) must be
+copied out first.
+*/
+#include <string>
+
+class MappedFile
+{
+public:
+	MappedFile(void);
+	MappedFile(const std::string& filename);
+	~MappedFile(void);
+
+	bool	Open(const std::string& filename);
+	void	Close();
+
+	bool			IsOpen() const		{ return data != nullptr; }
+	const char*		GetData() const		{ return data; }
+	size_t			GetSize() const		{ return size; }
+
+protected:
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	const char*	data;
+	size_t		size;
+
+#ifdef _WIN32
+	void*		fileHandle;
+	void*		mappingHandle;
+#else
+	int			fileHandle;
+#endif
+};
+
@@ -246,4 +246,97 @@ Matrix4 Matrix4::Inverse()	const {
 	Matrix4 temp(*this);
 	temp.Invert();
 	return temp;
-}
\ No newline at end of file
+}
+
+#ifdef NCLGL_SIMD_AVX
+//Works out two columns of a * b at once - each 128 bit half of the register
+//holds one output column, so the columns of 'a' are broadcast into both halves.
+static inline void MultiplyAVX(const __m256 (&aCols)[4], const Matrix4 &b, Matrix4 &out) {
+	for (unsigned int r = 0; r < 4; r += 2) {
+		const __m256 bCols = _mm256_loadu_ps(&b.values[r * 4]);
+		__m256 col = _mm256_mul_ps(aCols[0], _mm256_shuffle_ps(bCols, bCols, 0x00));
+		col = _mm256_add_ps(col, _mm256_mul_ps(aCols[1], _mm256_shuffle_ps(bCols, bCols, 0x55)));
+		col = _mm256_add_ps(col, _mm256_mul_ps(aCols[2], _mm256_shuffle_ps(bCols, bCols, 0xAA)));
+		col = _mm256_add_ps(col, _mm256_mul_ps(aCols[3], _mm256_shuffle_ps(bCols, bCols, 0xFF)));
+		_mm256_storeu_ps(&out.values[r * 4], col);
+	}
+}
+
+static inline void LoadColumnsAVX(const Matrix4 &m, __m256 (&cols)[4]) {
+	for (int i = 0; i < 4; ++i) {
+		cols[i] = _mm256_broadcast_ps((const __m128*)&m.values[i * 4]);
+	}
+}
+#endif
+
+void Matrix4::MultiplyBatch(const Matrix4 &parent, const Matrix4* in, Matrix4* out, size_t count) {
+#ifdef NCLGL_SIMD_AVX
+	__m256 parentCols[4];
+	LoadColumnsAVX(parent, parentCols);
+	for (size_t i = 0; i < count; ++i) {
+		MultiplyAVX(parentCols, in[i], out[i]);
+	}
+#else
+	for (size_t i = 0; i < count; ++i) {
+		out[i] = parent * in[i];
+	}
+#endif
+}
+
+void Matrix4::MultiplyPairs(const Matrix4* a, const Matrix4* b, Matrix4* out, size_t count) {
+#ifdef NCLGL_SIMD_AVX
+	__m256 aCols[4];
+	for (size_t i = 0; i < count; ++i) {
+		LoadColumnsAVX(a[i], aCols);
+		MultiplyAVX(aCols, b[i], out[i]);
+	}
+#else
+	for (size_t i = 0; i < count; ++i) {
+		out[i] = a[i] * b[i];
+	}
+#endif
+}
+
+void Matrix4::TransformPoints(const Matrix4 &m, const Vector3* in, Vector3* out, size_t count) {
+#ifdef NCLGL_SIMD_SSE
+	const __m128 c0 = _mm_loadu_ps(&m.values[0]);
+	const __m128 c1 = _mm_loadu_ps(&m.values[4]);
+	const __m128 c2 = _mm_loadu_ps(&m.values[8]);
+	const __m128 c3 = _mm_loadu_ps(&m.values[12]);
+	for (size_t i = 0; i < count; ++i) {
+		__m128 v = _mm_mul_ps(c0, _mm_set1_ps(in[i].x));
+		v = _mm_add_ps(v, _mm_mul_ps(c1, _mm_set1_ps(in[i].y)));
+		v = _mm_add_ps(v, _mm_mul_ps(c2, _mm_set1_ps(in[i].z)));
+		v = _mm_add_ps(v, c3);
+		v = _mm_div_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3)));
+
+		float temp[4];
+		_mm_storeu_ps(temp, v);
+		out[i] = Vector3(temp[0], temp[1], temp[2]);
+	}
+#else
+	for (size_t i = 0; i < count; ++i) {
+		out[i] = m * in[i];
+	}
+#endif
+}
+
+void Matrix4::TransformPoints(const Matrix4 &m, const Vector4* in, Vector4* out, size_t count) {
+#ifdef NCLGL_SIMD_SSE
+	const __m128 c0 = _mm_loadu_ps(&m.values[0]);
+	const __m128 c1 = _mm_loadu_ps(&m.values[4]);
+	const __m128 c2 = _mm_loadu_ps(&m.values[8]);
+	const __m128 c3 = _mm_loadu_ps(&m.values[12]);
+	for (size_t i = 0; i < count; ++i) {
+		__m128 v = _mm_mul_ps(c0, _mm_set1_ps(in[i].x));
+		v = _mm_add_ps(v, _mm_mul_ps(c1, _mm_set1_ps(in[i].y)));
+		v = _mm_add_ps(v, _mm_mul_ps(c2, _mm_set1_ps(in[i].z)));
+		v = _mm_add_ps(v, _mm_mul_ps(c3, _mm_set1_ps(in[i].w)));
+		_mm_storeu_ps(&out[i].x, v);
+	}
+#else
+	for (size_t i = 0; i < count; ++i) {
+		out[i] = m * in[i];
+	}
+#endif
+}
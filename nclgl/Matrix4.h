@@ -20,6 +20,19 @@ _-_-_-_-_-_-_-""  ""
 #include "Vector3.h"
 #include "Vector4.h"
 
+//SSE is part of the x64 baseline, so this is on for every x64 build. AVX is only
+//used by the batch functions, and only when the compiler is allowed to emit it
+//(/arch:AVX or -mavx).
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define NCLGL_SIMD_SSE
+#include <xmmintrin.h>
+#endif
+
+#if defined(NCLGL_SIMD_SSE) && defined(__AVX__)
+#define NCLGL_SIMD_AVX
+#include <immintrin.h>
+#endif
+
 class Vector3;
 
 class Matrix4	{
@@ -79,7 +92,21 @@ public:
 	//Multiplies 'this' matrix by matrix 'a'. Performs the multiplication in 'OpenGL' order (ie, backwards)
 	inline Matrix4 operator*(const Matrix4 &a) const{	
 		Matrix4 out;
-		//Students! You should be able to think up a really easy way of speeding this up...
+#ifdef NCLGL_SIMD_SSE
+		//Each output column is a linear combination of our columns, weighted by
+		//the matching column of 'a'. Summed in the same order as the scalar path.
+		const __m128 c0 = _mm_loadu_ps(&values[0]);
+		const __m128 c1 = _mm_loadu_ps(&values[4]);
+		const __m128 c2 = _mm_loadu_ps(&values[8]);
+		const __m128 c3 = _mm_loadu_ps(&values[12]);
+		for(unsigned int r = 0; r < 4; ++r) {
+			__m128 col = _mm_mul_ps(c0, _mm_set1_ps(a.values[(r*4)+0]));
+			col = _mm_add_ps(col, _mm_mul_ps(c1, _mm_set1_ps(a.values[(r*4)+1])));
+			col = _mm_add_ps(col, _mm_mul_ps(c2, _mm_set1_ps(a.values[(r*4)+2])));
+			col = _mm_add_ps(col, _mm_mul_ps(c3, _mm_set1_ps(a.values[(r*4)+3])));
+			_mm_storeu_ps(&out.values[r*4], col);
+		}
+#else
 		for(unsigned int r = 0; r < 4; ++r) {
 			for(unsigned int c = 0; c < 4; ++c) {
 				out.values[c + (r*4)] = 0.0f;
@@ -88,9 +115,22 @@ public:
 				}
 			}
 		}
+#endif
 		return out;
 	}
 
+	//Batch versions of the operators above, for scene graphs and skinning palettes.
+	//'out' may not alias any of the inputs.
+
+	//out[i] = parent * in[i]
+	static void MultiplyBatch(const Matrix4 &parent, const Matrix4* in, Matrix4* out, size_t count);
+	//out[i] = a[i] * b[i]
+	static void MultiplyPairs(const Matrix4* a, const Matrix4* b, Matrix4* out, size_t count);
+	//out[i] = m * in[i], including the divide by w (as operator*(Vector3) does)
+	static void TransformPoints(const Matrix4 &m, const Vector3* in, Vector3* out, size_t count);
+	//out[i] = m * in[i]
+	static void TransformPoints(const Matrix4 &m, const Vector4* in, Vector4* out, size_t count);
+
 	inline Vector3 operator*(const Vector3 &v) const {
 		Vector3 vec;
 
@@ -1,8 +1,102 @@
 #include "Mesh.h"
 #include "Matrix2.h"
+#include "MeshFile.h"
+#include "MappedFile.h"
+#include "MeshOptimiser.h"
+#include "VertexPacking.h"
+#include "GLStateCache.h"
+#include "JobSystem.h"
+#include <algorithm>
+#include <cstdint>
 
 using std::string;
 
+namespace {
+	const GLuint PARALLEL_ITEMS = 4096;	//fewer triangles / vertices than this aren't worth splitting up
+
+	bool IsWorthSplitting(GLuint count) {
+		return JobSystem::GetShared().GetThreadCount() > 1 && count >= PARALLEL_ITEMS * 2;
+	}
+
+	//Calls work(first, last) over bands of [0, count), on the shared JobSystem
+	template <typename F> void ForEachBand(GLuint count, const F& work) {
+		if (!IsWorthSplitting(count)) {
+			work(0, count);
+			return;
+		}
+		JobSystem& jobs = JobSystem::GetShared();
+		GLuint bands = std::min(jobs.GetThreadCount() * 4, count / PARALLEL_ITEMS);
+		JobGroup group;
+		for (GLuint b = 0; b < bands; ++b) {
+			GLuint first	= (GLuint)((uint64_t)count * b / bands);
+			GLuint last		= (GLuint)((uint64_t)count * (b + 1) / bands);
+			jobs.Run(group, [&work, first, last]() { work(first, last); });
+		}
+		jobs.Wait(group);
+	}
+
+	//The triangles using each vertex, in order - vertex v's are
+	//triangles[offsets[v]] up to triangles[offsets[v + 1]]
+	void BuildVertexTriangles(const GLuint* indices, GLuint numVertices, GLuint triCount,
+		std::vector<GLuint>& offsets, std::vector<GLuint>& triangles) {
+		GLuint corners = triCount * 3;
+		offsets.assign(numVertices + 1, 0);
+		for (GLuint i = 0; i < corners; i++) {
+			offsets[indices ? indices[i] : i]++;
+		}
+		// running totals leave each offset at the end of its vertex's list...
+		GLuint total = 0;
+		for (GLuint v = 0; v <= numVertices; v++) {
+			total += offsets[v];
+			offsets[v] = total;
+		}
+		// ...and filling them from the back moves it to the start
+		triangles.resize(corners);
+		for (GLuint i = corners; i-- > 0;) {
+			triangles[--offsets[indices ? indices[i] : i]] = i / 3;
+		}
+	}
+
+	//Sets out[v] to zero plus faceValue(t) for every triangle t using vertex v,
+	//added up in triangle order - so the sums come out the same either way
+	template <typename T, typename F> void SumAroundVertices(T* out, GLuint numVertices, const GLuint* indices,
+		GLuint triCount, const T& zero, const F& faceValue) {
+		if (!IsWorthSplitting(triCount)) {
+			// nothing to gain from the vertex -> triangle list on one thread
+			std::fill(out, out + numVertices, zero);
+			for (GLuint t = 0; t < triCount; t++) {
+				T value = faceValue(t);
+				for (GLuint i = t * 3; i < t * 3 + 3; i++) {
+					out[indices ? indices[i] : i] += value;
+				}
+			}
+			return;
+		}
+		std::vector<T> faces(triCount);
+		ForEachBand(triCount, [&](GLuint first, GLuint last) {
+			for (GLuint t = first; t < last; t++) {
+				faces[t] = faceValue(t);
+			}
+		});
+		std::vector<GLuint> offsets;
+		std::vector<GLuint> triangles;
+		BuildVertexTriangles(indices, numVertices, triCount, offsets, triangles);
+		ForEachBand(numVertices, [&](GLuint first, GLuint last) {
+			for (GLuint v = first; v < last; v++) {
+				T sum = zero;
+				for (GLuint i = offsets[v]; i < offsets[v + 1]; i++) {
+					sum += faces[triangles[i]];
+				}
+				out[v] = sum;
+			}
+		});
+	}
+}
+
+bool Mesh::optimiseOnLoad = false;
+bool Mesh::reportOptimisation = false;
+bool Mesh::packVertices	= false;
+
 Mesh::Mesh(void)	{
 	glGenVertexArrays(1, &arrayObject);
 	
@@ -11,6 +105,7 @@ Mesh::Mesh(void)	{
 	}
 
 	numVertices  = 0;
+	boundingRadius = 0.0f;
 	// edit to change shape created
 	type = GL_TRIANGLES;
 
@@ -23,9 +118,12 @@ Mesh::Mesh(void)	{
 	colours			= nullptr;
 	weights			= nullptr;
 	weightIndices	= nullptr;
+	bindPose		= nullptr;
+	inverseBindPose	= nullptr;
 }
 
 Mesh::~Mesh(void)	{
+	GLStateCache::GetShared().ForgetVertexArray(arrayObject);
 	glDeleteVertexArrays(1, &arrayObject);			//Delete our VAO
 	glDeleteBuffers(MAX_BUFFER, bufferObject);		//Delete our VBOs
 
@@ -37,6 +135,8 @@ Mesh::~Mesh(void)	{
 	delete[]	colours;
 	delete[]	weights;
 	delete[]	weightIndices;
+	delete[]	bindPose;
+	delete[]	inverseBindPose;
 }
 
 Mesh* Mesh::GenerateTriangle() {
@@ -127,29 +227,25 @@ void Mesh::GenerateTangents() {
 		return;
 	if (!tangents)
 		tangents = new Vector4[numVertices];
-	for (GLuint i = 0; i < numVertices; i++) {
-		tangents[i] = Vector4(0, 0, 0, 0);
-	}
-	int triCount = GetTriCount();
-
-	// for every vertex generate a tangent
-	for (int i = 0; i < triCount; i++) {
-		unsigned int a = 0;
-		unsigned int b = 0;
-		unsigned int c = 0;
-		GetVertexIndicesForTri(i,a,b,c);
-		Vector4 tangent = GenerateTangent(a,b,c);
-		tangents[a] += tangent;
-		tangents[b] += tangent;
-		tangents[c] += tangent;
-	}
 
-	for (GLuint i = 0; i < numVertices; i++) {
-		float handedness = tangents[i].w > 0.0f ? 1.0f : -1.0f;
-		tangents[i].w = 0.0f;
-		tangents[i].Normalise();
-		tangents[i].w = handedness;
-	}
+	// for every vertex add up the tangents of its triangles
+	SumAroundVertices(tangents, numVertices, numIndices > 0 ? indices : nullptr, GetTriCount(), Vector4(0, 0, 0, 0),
+		[this](GLuint i) {
+			unsigned int a = 0;
+			unsigned int b = 0;
+			unsigned int c = 0;
+			GetVertexIndicesForTri(i, a, b, c);
+			return GenerateTangent(a, b, c);
+		});
+
+	ForEachBand(numVertices, [&](GLuint first, GLuint last) {
+		for (GLuint i = first; i < last; i++) {
+			float handedness = tangents[i].w > 0.0f ? 1.0f : -1.0f;
+			tangents[i].w = 0.0f;
+			tangents[i].Normalise();
+			tangents[i].w = handedness;
+		}
+	});
 }
 
 Vector4 Mesh::GenerateTangent(int a, int b, int c) {
@@ -182,27 +278,21 @@ void Mesh::GenerateNormals() {
 	if (!normals)
 		normals = new Vector3[numVertices];
 
-	for (GLuint i = 0; i < numVertices; i++) {
-		normals[i] = Vector3();
-	}
-	int triCount = GetTriCount();
-
-	// generate the actual normals
-	for (int i = 0; i < triCount; i++) {
-		unsigned int a = 0;
-		unsigned int b = 0;
-		unsigned int c = 0;
-		GetVertexIndicesForTri(i,a,b,c);
-
-		Vector3 normal = Vector3::Cross((vertices[b] - vertices[a]), (vertices[c] - vertices[a]));
-
-		normals[a] += normal;
-		normals[b] += normal;
-		normals[c] += normal;
-	}
-	for (GLuint i = 0; i < numVertices; i++) {
-		normals[i].Normalise();
-	}
+	// generate the actual normals - left unnormalised, so bigger triangles count for more
+	SumAroundVertices(normals, numVertices, numIndices > 0 ? indices : nullptr, GetTriCount(), Vector3(),
+		[this](GLuint i) {
+			unsigned int a = 0;
+			unsigned int b = 0;
+			unsigned int c = 0;
+			GetVertexIndicesForTri(i, a, b, c);
+			return Vector3::Cross((vertices[b] - vertices[a]), (vertices[c] - vertices[a]));
+		});
+
+	ForEachBand(numVertices, [&](GLuint first, GLuint last) {
+		for (GLuint i = first; i < last; i++) {
+			normals[i].Normalise();
+		}
+	});
 }
 
 // returns false if triangle is not in the given mesh (a,b,c are traiangle vertices)
@@ -225,14 +315,14 @@ bool Mesh::GetVertexIndicesForTri(unsigned int i, unsigned int& a, unsigned int&
 }
 
 void Mesh::Draw()	{
-	glBindVertexArray(arrayObject);
+	GLStateCache::GetShared().BindVertexArray(arrayObject);
 	if(bufferObject[INDEX_BUFFER]) {
 		glDrawElements(type, numIndices, GL_UNSIGNED_INT, 0);
 	}
 	else{
 		glDrawArrays(type, 0, numVertices);
 	}
-	glBindVertexArray(0);	
+	GLStateCache::GetShared().ReleaseVertexArray();
 }
 
 void Mesh::DrawSubMesh(int i) {
@@ -241,7 +331,7 @@ void Mesh::DrawSubMesh(int i) {
 	}
 	SubMesh m = meshLayers[i];
 
-	glBindVertexArray(arrayObject);
+	GLStateCache::GetShared().BindVertexArray(arrayObject);
 	if (bufferObject[INDEX_BUFFER]) {
 		const GLvoid* offset = (const GLvoid * )(m.start * sizeof(unsigned int)); 
 		glDrawElements(type, m.count, GL_UNSIGNED_INT, offset);
@@ -249,7 +339,7 @@ void Mesh::DrawSubMesh(int i) {
 	else {
 		glDrawArrays(type, m.start, m.count);	//Draw the triangle!
 	}
-	glBindVertexArray(0);
+	GLStateCache::GetShared().ReleaseVertexArray();
 }
 
 void UploadAttribute(GLuint* id, int numElements, int dataSize, int attribSize, int attribID, void* pointer, const string&debugName) {
@@ -264,8 +354,35 @@ void UploadAttribute(GLuint* id, int numElements, int dataSize, int attribSize,
 }
 
 void	Mesh::BufferData()	{
-	glBindVertexArray(arrayObject);
+	float radiusSquared = 0.0f;
+	for (GLuint i = 0; vertices && i < numVertices; ++i) {
+		radiusSquared = std::max(radiusSquared, Vector3::Dot(vertices[i], vertices[i]));
+	}
+	boundingRadius = sqrt(radiusSquared);
 
+	GLStateCache::GetShared().BindVertexArray(arrayObject);
+
+	if (packVertices) {
+		BufferPackedVertices();
+	}
+	else {
+		BufferSeparateVertices();
+	}
+
+	//buffer index data
+	if(indices) {
+		glGenBuffers(1, &bufferObject[INDEX_BUFFER]);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bufferObject[INDEX_BUFFER]);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, numIndices*sizeof(GLuint), indices, GL_STATIC_DRAW);
+
+		glObjectLabel(GL_BUFFER, bufferObject[INDEX_BUFFER], -1, "Indices");
+	}
+	GLStateCache::GetShared().BindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+void	Mesh::BufferSeparateVertices() {
 	////Buffer vertex data
 	UploadAttribute(&bufferObject[VERTEX_BUFFER], numVertices, sizeof(Vector3), 3, VERTEX_BUFFER, vertices, "Positions");
 
@@ -299,18 +416,39 @@ void	Mesh::BufferData()	{
 
 		glObjectLabel(GL_BUFFER, bufferObject[WEIGHTINDEX_BUFFER], -1, "Weight Indices");
 	}
+}
 
-	//buffer index data
-	if(indices) {
-		glGenBuffers(1, &bufferObject[INDEX_BUFFER]);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bufferObject[INDEX_BUFFER]);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, numIndices*sizeof(GLuint), indices, GL_STATIC_DRAW);
+void PackedAttribute(int attribID, int offset, GLint size, GLenum type, GLboolean normalised, int stride) {
+	if (offset < 0) {
+		return;
+	}
+	glVertexAttribPointer(attribID, size, type, normalised, stride, (const GLvoid*)(size_t)offset);
+	glEnableVertexAttribArray(attribID);
+}
 
-		glObjectLabel(GL_BUFFER, bufferObject[INDEX_BUFFER], -1, "Indices");
+//Everything goes in the VERTEX_BUFFER object, the other attribute buffers stay empty.
+//The shaders don't need to know - normalised attributes still arrive as floats
+void	Mesh::BufferPackedVertices() {
+	std::vector<uint8_t> packed;
+	PackedVertexLayout layout = PackVertices(numVertices, vertices, textureCoords, colours,
+		normals, tangents, weights, weightIndices, packed);
+
+	glGenBuffers(1, &bufferObject[VERTEX_BUFFER]);
+	glBindBuffer(GL_ARRAY_BUFFER, bufferObject[VERTEX_BUFFER]);
+	glBufferData(GL_ARRAY_BUFFER, packed.size(), packed.data(), GL_STATIC_DRAW);
+	glObjectLabel(GL_BUFFER, bufferObject[VERTEX_BUFFER], -1, "Packed Vertices");
+
+	PackedAttribute(VERTEX_BUFFER,		layout.positionOffset,	3, GL_FLOAT,				GL_FALSE,	layout.stride);
+	PackedAttribute(TEXTURE_BUFFER,		layout.texCoordOffset,	2, GL_HALF_FLOAT,			GL_FALSE,	layout.stride);
+	PackedAttribute(COLOUR_BUFFER,		layout.colourOffset,	4, GL_UNSIGNED_BYTE,		GL_TRUE,	layout.stride);
+	PackedAttribute(NORMAL_BUFFER,		layout.normalOffset,	4, GL_INT_2_10_10_10_REV,	GL_TRUE,	layout.stride);
+	PackedAttribute(TANGENT_BUFFER,		layout.tangentOffset,	4, GL_INT_2_10_10_10_REV,	GL_TRUE,	layout.stride);
+	PackedAttribute(WEIGHTVALUE_BUFFER,	layout.weightOffset,	4, GL_UNSIGNED_BYTE,		GL_TRUE,	layout.stride);
+
+	if (layout.weightIndexOffset >= 0) {
+		glVertexAttribIPointer(WEIGHTINDEX_BUFFER, 4, GL_UNSIGNED_BYTE, layout.stride, (const GLvoid*)(size_t)layout.weightIndexOffset);
+		glEnableVertexAttribArray(WEIGHTINDEX_BUFFER);
 	}
-	glBindVertexArray(0);	
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 }
 
 
@@ -320,244 +458,237 @@ void	Mesh::BufferData()	{
 * 
 * */
 
-enum class GeometryChunkTypes {
-	VPositions		= 1,
-	VNormals		= 2,
-	VTangents		= 4,
-	VColors			= 8,
-	VTex0			= 16,
-	VTex1			= 32,
-	VWeightValues	= 64,
-	VWeightIndices	= 128,
-	Indices			= 256,
-	JointNames		= 512,
-	JointParents	= 1024,
-	BindPose		= 2048,
-	BindPoseInv		= 4096,
-	Material		= 65536,
-	SubMeshes		= 1 << 14,
-	SubMeshNames	= 1 << 15
-};
-
-void ReadTextFloats(std::ifstream& file, vector<Vector2>& element, int numVertices) {
-	for (int i = 0; i < numVertices; ++i) {
-		Vector2 temp;
-		file >> temp.x;
-		file >> temp.y;
-		element.emplace_back(temp);
+template <typename T>
+static T* CopyMeshData(const vector<T>& from) {
+	if (from.empty()) {
+		return nullptr;
 	}
+	T* into = new T[from.size()];
+	std::copy(from.begin(), from.end(), into);
+	return into;
 }
 
-void ReadTextFloats(std::ifstream& file, vector<Vector3>& element, int numVertices) {
-	for (int i = 0; i < numVertices; ++i) {
-		Vector3 temp;
-		file >> temp.x;
-		file >> temp.y;
-		file >> temp.z;
-		element.emplace_back(temp);
-	}
-}
+Mesh* Mesh::FromMeshFileData(const MeshFileData& data) {
+	Mesh* mesh = new Mesh();
 
-void ReadTextFloats(std::ifstream& file, vector<Vector4>& element, int numVertices) {
-	for (int i = 0; i < numVertices; ++i) {
-		Vector4 temp;
-		file >> temp.x;
-		file >> temp.y;
-		file >> temp.z;
-		file >> temp.w;
-		element.emplace_back(temp);
+	mesh->numVertices	= data.numVertices;
+	mesh->numIndices	= data.numIndices;
+
+	mesh->vertices			= CopyMeshData(data.positions);
+	mesh->colours			= CopyMeshData(data.colours);
+	mesh->normals			= CopyMeshData(data.normals);
+	mesh->tangents			= CopyMeshData(data.tangents);
+	mesh->textureCoords		= CopyMeshData(data.uvs);
+	mesh->indices			= CopyMeshData(data.indices);
+	mesh->weights			= CopyMeshData(data.weights);
+	mesh->weightIndices		= CopyMeshData(data.weightIndices);
+	mesh->bindPose			= CopyMeshData(data.bindPose);
+	mesh->inverseBindPose	= CopyMeshData(data.inverseBindPose);
+
+	mesh->jointNames	= data.jointNames;
+	mesh->jointParents	= data.jointParents;
+	mesh->layerNames	= data.subMeshNames;
+	for (const MeshFileSubMesh& m : data.subMeshes) {
+		mesh->meshLayers.emplace_back(SubMesh{ m.start, m.count });
 	}
+	return mesh;
 }
 
-void ReadTextVertexIndices(std::ifstream& file, vector<int>& element, int numVertices) {
-	for (int i = 0; i < numVertices; ++i) {
-		int indices[4];
-		file >> indices[0];
-		file >> indices[1];
-		file >> indices[2];
-		file >> indices[3];
-		element.emplace_back(indices[0]);
-		element.emplace_back(indices[1]);
-		element.emplace_back(indices[2]);
-		element.emplace_back(indices[3]);
-	}
+static bool EndsWith(const string& s, const string& ending) {
+	return s.size() >= ending.size() && s.compare(s.size() - ending.size(), ending.size(), ending) == 0;
 }
 
-void ReadIndices(std::ifstream& file, vector<unsigned int>& elements, int numIndices) {
-	for (int i = 0; i < numIndices; ++i) {
-		unsigned int temp;
-		file >> temp;
-		elements.emplace_back(temp);
+Mesh* Mesh::LoadFromMeshFile(const string& name) {
+	if (EndsWith(name, ".mshb")) {
+		return LoadFromBinaryMeshFile(name);
 	}
-}
-
-void ReadJointParents(std::ifstream& file, vector<int>& dest) {
-	int jointCount = 0;
-	file >> jointCount;
-
-	for (int i = 0; i < jointCount; ++i) {
-		int id = -1;
-		file >> id;
-		dest.emplace_back(id);
+	MeshFileData data;
+	if (!ReadTextMeshFile(MESHDIR + name, data)) {
+		return nullptr;
 	}
-}
+	//Now that the data has been read, we can shove it into the actual Mesh object
+	Mesh* mesh = FromMeshFileData(data);
+	mesh->OptimiseIfEnabled(name);
+	mesh->BufferData();
 
-void ReadJointNames(std::ifstream& file, vector<string>& dest) {
-	int jointCount = 0;
-	file >> jointCount;
-	for (int i = 0; i < jointCount; ++i) {
-		std::string jointName;
-		file >> jointName;
-		dest.emplace_back(jointName);
-	}
+	return mesh;
 }
 
-void ReadRigPose(std::ifstream& file, Matrix4** into) {
-	int matCount = 0;
-	file >> matCount;
-
-	*into = new Matrix4[matCount];
-
-	for (int i = 0; i < matCount; ++i) {
-		Matrix4 mat;
-		for (int i = 0; i < 16; ++i) {
-			file >> mat.values[i];
+bool Mesh::ConvertMeshFile(const string& textName, const string& binaryName, bool optimiseIndices) {
+	MeshFileData data;
+	if (!ReadTextMeshFile(MESHDIR + textName, data)) {
+		return false;
+	}
+	if (optimiseIndices && !data.indices.empty()) {
+		MeshOptimiserReport report = MeshOptimiser::Optimise(data.indices.data(), data.indices.size(),
+			data.positions.empty() ? nullptr : data.positions.data(), data.numVertices, data.subMeshes);
+		if (reportOptimisation) {
+			std::cout << "Optimised " << textName << ": " << report << std::endl;
 		}
-		(*into)[i] = mat;
 	}
+	return WriteBinaryMeshFile(MESHDIR + binaryName, data);
 }
 
-void ReadSubMeshes(std::ifstream& file, int count, vector<Mesh::SubMesh> & subMeshes) {
-	for (int i = 0; i < count; ++i) {
-		Mesh::SubMesh m;
-		file >> m.start;
-		file >> m.count;
-		subMeshes.emplace_back(m);
+/*
+The vertex attributes and indices in a binary mesh file are uploaded straight
+out of the mapped file, with no parsing or copying. Only the skeleton data,
+which the CPU needs to keep hold of for skinning, is copied out.
+*/
+Mesh* Mesh::LoadFromBinaryMeshFile(const string& name) {
+	MappedFile file(MESHDIR + name);
+	if (!file.IsOpen() || file.GetSize() < sizeof(BinaryMeshHeader)) {
+		std::cout << "Can't open binary mesh file " << name << "!" << std::endl;
+		return nullptr;
 	}
-}
+	const char* fileData = file.GetData();
 
-void ReadSubMeshNames(std::ifstream& file, int count, vector<string>& names) {
-	std::string scrap;
-	std::getline(file, scrap);
+	BinaryMeshHeader header;
+	memcpy(&header, fileData, sizeof(header));
 
-	for (int i = 0; i < count; ++i) {
-		std::string meshName;
-		std::getline(file, meshName);
-		names.emplace_back(meshName);
+	if (memcmp(header.magic, BINARY_MESH_MAGIC, sizeof(header.magic)) != 0) {
+		std::cout << "File is not a binary MeshGeometry file!" << std::endl;
+		return nullptr;
 	}
-}
-
-Mesh* Mesh::LoadFromMeshFile(const string& name) {
-	Mesh* mesh = new Mesh();
-
-	std::ifstream file(MESHDIR + name);
-
-	std::string filetype;
-	int fileVersion;
-
-	file >> filetype;
-
-	if (filetype != "MeshGeometry") {
-		std::cout << "File is not a MeshGeometry file!" << std::endl;
+	if (header.version != BINARY_MESH_VERSION) {
+		std::cout << "Binary MeshGeometry file has incompatible version!" << std::endl;
 		return nullptr;
 	}
-
-	file >> fileVersion;
-
-	if (fileVersion != 1) {
-		std::cout << "MeshGeometry file has incompatible version!" << std::endl;
+	size_t tableEnd = sizeof(header) + (size_t)header.numChunks * sizeof(BinaryMeshChunk);
+	if (tableEnd > file.GetSize()) {
+		std::cout << "Binary MeshGeometry file is truncated!" << std::endl;
 		return nullptr;
 	}
+	const BinaryMeshChunk* chunks = (const BinaryMeshChunk*)(fileData + sizeof(header));
 
-	int numMeshes	= 0; //read
-	int numVertices = 0; //read
-	int numIndices	= 0; //read
-	int numChunks	= 0; //read
-
-	file >> numMeshes;
-	file >> numVertices;
-	file >> numIndices;
-	file >> numChunks;
-
-	vector<Vector3> readPositions;
-	vector<Vector4> readColours;
-	vector<Vector3> readNormals;
-	vector<Vector4> readTangents;
-	vector<Vector2> readUVs;
-	vector<Vector4> readWeights;
-	vector<int> readWeightIndices;
-
-	vector<unsigned int>		readIndices;
-
-	for (int i = 0; i < numChunks; ++i) {
-		int chunkType = (int)GeometryChunkTypes::VPositions;
-
-		file >> chunkType;
-
-		switch ((GeometryChunkTypes)chunkType) {
-		case GeometryChunkTypes::VPositions:ReadTextFloats(file, readPositions, numVertices);  break;
-		case GeometryChunkTypes::VColors:	ReadTextFloats(file, readColours, numVertices);  break;
-		case GeometryChunkTypes::VNormals:	ReadTextFloats(file, readNormals, numVertices);  break;
-		case GeometryChunkTypes::VTangents:	ReadTextFloats(file, readTangents, numVertices);  break;
-		case GeometryChunkTypes::VTex0:		ReadTextFloats(file, readUVs, numVertices);  break;
-		case GeometryChunkTypes::Indices:	ReadIndices(file, readIndices, numIndices); break;
-
-		case GeometryChunkTypes::VWeightValues:		ReadTextFloats(file, readWeights, numVertices);  break;
-		case GeometryChunkTypes::VWeightIndices:	ReadTextVertexIndices(file, readWeightIndices, numVertices);  break;
-		case GeometryChunkTypes::JointNames:		ReadJointNames(file, mesh->jointNames);  break;
-		case GeometryChunkTypes::JointParents:		ReadJointParents(file, mesh->jointParents);  break;
-		case GeometryChunkTypes::BindPose:			ReadRigPose(file, &mesh->bindPose);  break;
-		case GeometryChunkTypes::BindPoseInv:		ReadRigPose(file, &mesh->inverseBindPose);  break;
-		case GeometryChunkTypes::SubMeshes: 		ReadSubMeshes(file, numMeshes, mesh->meshLayers); break;
-		case GeometryChunkTypes::SubMeshNames: 		ReadSubMeshNames(file, numMeshes, mesh->layerNames); break;
+	Mesh* mesh = new Mesh();
+	mesh->numVertices	= header.numVertices;
+	mesh->numIndices	= header.numIndices;
+
+	//The attribute pointers are into the mapped file, which is about to be closed
+	auto forgetFileData = [mesh]() {
+		mesh->vertices		= nullptr;
+		mesh->colours		= nullptr;
+		mesh->normals		= nullptr;
+		mesh->tangents		= nullptr;
+		mesh->textureCoords	= nullptr;
+		mesh->weights		= nullptr;
+		mesh->weightIndices	= nullptr;
+		mesh->indices		= nullptr;
+	};
+	auto discard = [mesh, &forgetFileData]() {
+		forgetFileData();
+		delete mesh;
+	};
+
+	for (uint32_t i = 0; i < header.numChunks; ++i) {
+		const BinaryMeshChunk& c = chunks[i];
+		if (c.offset > file.GetSize() || c.size > file.GetSize() - c.offset) {
+			std::cout << "Binary MeshGeometry file has a bad chunk!" << std::endl;
+			discard();
+			return nullptr;
+		}
+		const char* chunkData = fileData + c.offset;
+
+		//Attribute chunks must be exactly the size the header says, as BufferData trusts numVertices / numIndices
+		size_t expected = 0;
+		switch ((GeometryChunkTypes)c.type) {
+		case GeometryChunkTypes::VPositions:		expected = mesh->numVertices * sizeof(Vector3);	break;
+		case GeometryChunkTypes::VNormals:			expected = mesh->numVertices * sizeof(Vector3);	break;
+		case GeometryChunkTypes::VTex0:				expected = mesh->numVertices * sizeof(Vector2);	break;
+		case GeometryChunkTypes::VColors:
+		case GeometryChunkTypes::VTangents:
+		case GeometryChunkTypes::VWeightValues:		expected = mesh->numVertices * sizeof(Vector4);	break;
+		case GeometryChunkTypes::VWeightIndices:	expected = mesh->numVertices * sizeof(int) * 4;	break;
+		case GeometryChunkTypes::Indices:			expected = mesh->numIndices * sizeof(unsigned int);	break;
+		case GeometryChunkTypes::JointParents:		expected = c.elementCount * sizeof(int);			break;
+		case GeometryChunkTypes::BindPose:
+		case GeometryChunkTypes::BindPoseInv:		expected = c.elementCount * sizeof(Matrix4);		break;
+		case GeometryChunkTypes::SubMeshes:			expected = c.elementCount * sizeof(MeshFileSubMesh);	break;
+		default:									expected = (size_t)c.size;	break;
+		}
+		if (expected != c.size) {
+			std::cout << "Binary MeshGeometry chunk " << c.type << " has the wrong size!" << std::endl;
+			discard();
+			return nullptr;
 		}
-	}
-	//Now that the data has been read, we can shove it into the actual Mesh object
-
-	mesh->numVertices	= numVertices;
-	mesh->numIndices	= numIndices;
 
-	if (!readPositions.empty()) {
-		mesh->vertices = new Vector3[numVertices];
-		memcpy(mesh->vertices, readPositions.data(), numVertices * sizeof(Vector3));
+		switch ((GeometryChunkTypes)c.type) {
+		case GeometryChunkTypes::VPositions:		mesh->vertices		= (Vector3*)chunkData;	break;
+		case GeometryChunkTypes::VColors:			mesh->colours		= (Vector4*)chunkData;	break;
+		case GeometryChunkTypes::VNormals:			mesh->normals		= (Vector3*)chunkData;	break;
+		case GeometryChunkTypes::VTangents:			mesh->tangents		= (Vector4*)chunkData;	break;
+		case GeometryChunkTypes::VTex0:				mesh->textureCoords	= (Vector2*)chunkData;	break;
+		case GeometryChunkTypes::VWeightValues:		mesh->weights		= (Vector4*)chunkData;	break;
+		case GeometryChunkTypes::VWeightIndices:	mesh->weightIndices	= (int*)chunkData;		break;
+		case GeometryChunkTypes::Indices:			mesh->indices		= (unsigned int*)chunkData;	break;
+
+		case GeometryChunkTypes::JointNames:	ReadStringTable(chunkData, (size_t)c.size, c.elementCount, mesh->jointNames);	break;
+		case GeometryChunkTypes::SubMeshNames:	ReadStringTable(chunkData, (size_t)c.size, c.elementCount, mesh->layerNames);	break;
+		case GeometryChunkTypes::JointParents: {
+			const int* parents = (const int*)chunkData;
+			mesh->jointParents.assign(parents, parents + c.elementCount);
+		}break;
+		case GeometryChunkTypes::BindPose: {
+			mesh->bindPose = new Matrix4[c.elementCount];
+			memcpy(mesh->bindPose, chunkData, (size_t)c.size);
+		}break;
+		case GeometryChunkTypes::BindPoseInv: {
+			mesh->inverseBindPose = new Matrix4[c.elementCount];
+			memcpy(mesh->inverseBindPose, chunkData, (size_t)c.size);
+		}break;
+		case GeometryChunkTypes::SubMeshes: {
+			const MeshFileSubMesh* subMeshes = (const MeshFileSubMesh*)chunkData;
+			for (uint32_t j = 0; j < c.elementCount; ++j) {
+				mesh->meshLayers.emplace_back(SubMesh{ subMeshes[j].start, subMeshes[j].count });
+			}
+		}break;
+		default: break;
+		}
 	}
-
-	if (!readColours.empty()) {
-		mesh->colours = new Vector4[numVertices];
-		memcpy(mesh->colours, readColours.data(), numVertices * sizeof(Vector4));
+	if (mesh->numVertices > 0 && !mesh->vertices) {
+		std::cout << "Binary MeshGeometry file has no positions!" << std::endl;
+		discard();
+		return nullptr;
 	}
-
-	if (!readNormals.empty()) {
-		mesh->normals = new Vector3[numVertices];
-		memcpy(mesh->normals, readNormals.data(), numVertices * sizeof(Vector3));
+	//GL would read past the end of the buffers for anything out of range here
+	GLuint drawable = mesh->indices ? mesh->numIndices : mesh->numVertices;
+	bool outOfRange = false;
+	for (GLuint i = 0; mesh->indices && i < mesh->numIndices; ++i) {
+		outOfRange = outOfRange || mesh->indices[i] >= mesh->numVertices;
 	}
-
-	if (!readTangents.empty()) {
-		mesh->tangents = new Vector4[numVertices];
-		memcpy(mesh->tangents, readTangents.data(), numVertices * sizeof(Vector4));
+	for (const SubMesh& m : mesh->meshLayers) {
+		outOfRange = outOfRange || m.start < 0 || m.count < 0 || (int64_t)m.start + m.count > (int64_t)drawable;
+	}
+	if (outOfRange) {
+		std::cout << "Binary MeshGeometry file has indices or submeshes out of range!" << std::endl;
+		discard();
+		return nullptr;
 	}
+	mesh->BufferData();
+	forgetFileData();
+
+	return mesh;
+}
 
-	if (!readUVs.empty()) {
-		mesh->textureCoords = new Vector2[numVertices];
-		memcpy(mesh->textureCoords, readUVs.data(), numVertices * sizeof(Vector2));
+MeshOptimiserReport Mesh::OptimiseIndices(bool overdraw) {
+	if (!indices || type != GL_TRIANGLES) {
+		return MeshOptimiserReport();
 	}
-	if (!readIndices.empty()) {
-		mesh->indices = new unsigned int[numIndices];
-		memcpy(mesh->indices, readIndices.data(), numIndices * sizeof(unsigned int));
+	vector<MeshFileSubMesh> subMeshes;
+	for (const SubMesh& m : meshLayers) {
+		subMeshes.push_back({ m.start, m.count });
 	}
+	return MeshOptimiser::Optimise(indices, numIndices, vertices, numVertices, subMeshes, overdraw);
+}
 
-	if (!readWeights.empty()) {
-		mesh->weights = new Vector4[numVertices];
-		memcpy(mesh->weights, readWeights.data(), numVertices * sizeof(Vector4));
+void Mesh::OptimiseIfEnabled(const string& debugName) {
+	if (!optimiseOnLoad || !indices) {
+		return;
 	}
-
-	if (!readWeightIndices.empty()) {
-		mesh->weightIndices = new int[numVertices * 4];
-		memcpy(mesh->weightIndices, readWeightIndices.data(), numVertices * sizeof(int) * 4);
+	optimiserReport = OptimiseIndices();
+	if (reportOptimisation) {
+		std::cout << "Optimised " << debugName << ": " << optimiserReport << std::endl;
 	}
-	mesh->BufferData();
-
-	return mesh;
 }
 
 int Mesh::GetIndexForJoint(const std::string& name) const {
@@ -19,6 +19,7 @@ _-_-_-_-_-_-_-""  ""
 #pragma once
 
 #include "OGLRenderer.h"
+#include "MeshOptimiser.h"
 #include <vector>
 #include <string>
 
@@ -55,6 +56,9 @@ public:
 
 	static Mesh* GenerateQuad();
 
+	//Both add up the triangles around each vertex. Spread over the shared
+	//JobSystem, each vertex gathers its own triangles' values through a
+	//vertex -> triangle list, so no two threads ever write to the same one
 	void GenerateNormals();
 
 	bool GetVertexIndicesForTri(unsigned int i, unsigned int& a, unsigned int& b, unsigned int& c) const;
@@ -66,10 +70,39 @@ public:
 	void Draw();
 	void DrawSubMesh(int i);
 
+	//Loads a text MeshGeometry file, or a binary one if the name ends in ".mshb"
 	static Mesh* LoadFromMeshFile(const std::string& name);
+	static Mesh* LoadFromBinaryMeshFile(const std::string& name);
+
+	//Converts a text MeshGeometry file into the binary format. Doesn't need a GL context.
+	//Optimises the index order on the way, unless told otherwise
+	static bool	 ConvertMeshFile(const std::string& textName, const std::string& binaryName, bool optimiseIndices = true);
+
+	//Reorders the index list (within each sub mesh) for vertex cache use and then
+	//overdraw. Has to happen before BufferData to make any difference!
+	MeshOptimiserReport OptimiseIndices(bool overdraw = true);
+
+	//If set, loaded meshes and heightmaps get OptimiseIndices called on them before buffering
+	static void	SetOptimiseOnLoad(bool state)	{ optimiseOnLoad = state; }
+	//If set, each of those (and ConvertMeshFile) prints its before / after cache stats
+	static void	SetReportOptimisation(bool state)	{ reportOptimisation = state; }
+
+	//What OptimiseOnLoad did to this mesh - all zeroes if it didn't run
+	const MeshOptimiserReport& GetOptimiserReport() const {
+		return optimiserReport;
+	}
+
+	//If set, BufferData interleaves the vertex attributes into a single buffer using
+	//the compact formats in VertexPacking.h, rather than one float buffer each
+	static void	SetPackVertices(bool state)		{ packVertices = state; }
+
+	//Distance from the model's origin to its furthest vertex, worked out in BufferData
+	float	GetBoundingRadius() const {
+		return boundingRadius;
+	}
 
 	unsigned int GetTriCount() const {
-		int primCount = indices ? numIndices : numVertices;
+		int primCount = numIndices ? numIndices : numVertices;
 		return primCount / 3;
 	}
 
@@ -99,6 +132,17 @@ public:
 
 protected:
 	void	BufferData();
+	void	BufferSeparateVertices();
+	void	BufferPackedVertices();
+
+	static Mesh* FromMeshFileData(const MeshFileData& data);
+	void	OptimiseIfEnabled(const std::string& debugName);
+
+	static bool optimiseOnLoad;
+	static bool reportOptimisation;
+	static bool packVertices;
+
+	MeshOptimiserReport optimiserReport;
 
 	GLuint	arrayObject;
 
@@ -106,6 +150,7 @@ protected:
 
 	GLuint	numVertices;
 	GLuint	numIndices;
+	float	boundingRadius;
 	
 	GLuint	type;
 
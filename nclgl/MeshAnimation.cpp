@@ -1,8 +1,10 @@
 #include "MeshAnimation.h"
 #include "Matrix4.h"
+#include "MappedFile.h"
+#include "TextParser.h"
 
-#include <fstream>
 #include <string>
+#include <iostream>
 
 MeshAnimation::MeshAnimation() {
 	jointCount = 0;
@@ -11,32 +13,34 @@ MeshAnimation::MeshAnimation() {
 }
 
 MeshAnimation::MeshAnimation(const std::string& filename) : MeshAnimation() {
-	std::ifstream file(MESHDIR + filename);
+	MappedFile file(MESHDIR + filename);
+	if (!file.IsOpen()) {
+		std::cout << "Can't open MeshAnim file " << filename << "!" << std::endl;
+		return;
+	}
+	TextParser parser(file.GetData(), file.GetData() + file.GetSize());
 
 	std::string filetype;
 	int fileVersion;
 
-	file >> filetype;
-
-	if (filetype != "MeshAnim") {
+	if (!parser.Read(filetype) || filetype != "MeshAnim") {
 		std::cout << "File is not a MeshAnim file!" << std::endl;
 		return;
 	}
-	file >> fileVersion;
-	file >> frameCount;
-	file >> jointCount;
-	file >> frameRate;
-
-	allJoints.reserve(frameCount * jointCount);
-
-	for (unsigned int f = 0; f < frameCount; ++f) {
-		for (unsigned int j = 0; j < jointCount; ++j) {
-			Matrix4 mat;
-			for (int i = 0; i < 16; ++i) {
-				file >> mat.values[i];
-			}
-			allJoints.emplace_back(mat);
-		}
+	if (!parser.Read(fileVersion) || !parser.Read(frameCount) ||
+		!parser.Read(jointCount) || !parser.Read(frameRate)) {
+		std::cout << "MeshAnim file " << filename << " has a bad header!" << std::endl;
+		frameCount = 0;
+		jointCount = 0;
+		return;
+	}
+
+	allJoints.resize(frameCount * jointCount);
+
+	if (!parser.ReadArrayParallel((float*)allJoints.data(), allJoints.size() * 16)) {
+		std::cout << "MeshAnim file " << filename << " could not be parsed!" << std::endl;
+		allJoints.clear();
+		frameCount = 0;
 	}
 }
 
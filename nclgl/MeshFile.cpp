@@ -0,0 +1,316 @@
+#include "MeshFile.h"
+#include "MappedFile.h"
+#include "TextParser.h"
+
+#include <fstream>
+#include <iostream>
+#include <cstring>
+
+using std::string;
+using std::vector;
+
+/*
+Text reading. The file is mapped in one go, and a quick first pass skips over the
+tokens of each chunk to find where they start and end. The chunks are then
+converted in parallel - each one writes to its own member of MeshFileData, so
+they don't need to share anything.
+*/
+struct TextChunk {
+	GeometryChunkTypes	type;
+	const char*			start;
+	const char*			end;
+};
+
+template <typename T>
+static bool ReadTextFloats(TextParser& parser, vector<T>& element, int numVertices) {
+	const size_t floatsPerElement = sizeof(T) / sizeof(float);
+	element.resize(numVertices);
+	return parser.ReadArray((float*)element.data(), numVertices * floatsPerElement);
+}
+
+static bool ReadCountedArray(TextParser& parser, vector<int>& dest) {
+	int count = 0;
+	if (!parser.Read(count)) {
+		return false;
+	}
+	dest.resize(count);
+	return parser.ReadArray(dest.data(), count);
+}
+
+static bool ReadJointNames(TextParser& parser, vector<string>& dest) {
+	int jointCount = 0;
+	if (!parser.Read(jointCount)) {
+		return false;
+	}
+	dest.resize(jointCount);
+	for (int i = 0; i < jointCount; ++i) {
+		if (!parser.Read(dest[i])) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool ReadRigPose(TextParser& parser, vector<Matrix4>& into) {
+	int matCount = 0;
+	if (!parser.Read(matCount)) {
+		return false;
+	}
+	into.resize(matCount);
+	for (int i = 0; i < matCount; ++i) {
+		if (!parser.ReadArray(into[i].values, 16)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool ReadSubMeshNames(TextParser& parser, int count, vector<string>& names) {
+	parser.ReadLine();	//rest of the chunk type line
+	for (int i = 0; i < count; ++i) {
+		names.emplace_back(parser.ReadLine());
+	}
+	return true;
+}
+
+//Moves the parser past a chunk, without converting anything
+static bool SkipTextChunk(TextParser& parser, GeometryChunkTypes type, const MeshFileData& header) {
+	const size_t v = header.numVertices;
+	switch (type) {
+	case GeometryChunkTypes::VPositions:
+	case GeometryChunkTypes::VNormals:		return parser.SkipTokens(v * 3);
+	case GeometryChunkTypes::VTex0:			return parser.SkipTokens(v * 2);
+	case GeometryChunkTypes::VColors:
+	case GeometryChunkTypes::VTangents:
+	case GeometryChunkTypes::VWeightValues:
+	case GeometryChunkTypes::VWeightIndices:return parser.SkipTokens(v * 4);
+	case GeometryChunkTypes::Indices:		return parser.SkipTokens(header.numIndices);
+	case GeometryChunkTypes::SubMeshes:		return parser.SkipTokens(header.numMeshes * 2);
+	case GeometryChunkTypes::JointNames:
+	case GeometryChunkTypes::JointParents:
+	case GeometryChunkTypes::BindPose:
+	case GeometryChunkTypes::BindPoseInv: {
+		int count = 0;
+		if (!parser.Read(count)) {
+			return false;
+		}
+		bool isMatrix = (type == GeometryChunkTypes::BindPose || type == GeometryChunkTypes::BindPoseInv);
+		return parser.SkipTokens(isMatrix ? count * 16 : count);
+	}
+	case GeometryChunkTypes::SubMeshNames: {
+		vector<string> scrap;
+		return ReadSubMeshNames(parser, header.numMeshes, scrap);
+	}
+	default: return false;
+	}
+}
+
+static bool ReadTextChunk(const TextChunk& chunk, MeshFileData& into) {
+	TextParser parser(chunk.start, chunk.end);
+
+	switch (chunk.type) {
+	case GeometryChunkTypes::VPositions:	return ReadTextFloats(parser, into.positions, into.numVertices);
+	case GeometryChunkTypes::VColors:		return ReadTextFloats(parser, into.colours, into.numVertices);
+	case GeometryChunkTypes::VNormals:		return ReadTextFloats(parser, into.normals, into.numVertices);
+	case GeometryChunkTypes::VTangents:		return ReadTextFloats(parser, into.tangents, into.numVertices);
+	case GeometryChunkTypes::VTex0:			return ReadTextFloats(parser, into.uvs, into.numVertices);
+	case GeometryChunkTypes::Indices: {
+		into.indices.resize(into.numIndices);
+		return parser.ReadArray(into.indices.data(), into.numIndices);
+	}
+	case GeometryChunkTypes::VWeightValues:	return ReadTextFloats(parser, into.weights, into.numVertices);
+	case GeometryChunkTypes::VWeightIndices: {
+		into.weightIndices.resize(into.numVertices * 4);
+		return parser.ReadArray(into.weightIndices.data(), into.weightIndices.size());
+	}
+	case GeometryChunkTypes::JointNames:	return ReadJointNames(parser, into.jointNames);
+	case GeometryChunkTypes::JointParents:	return ReadCountedArray(parser, into.jointParents);
+	case GeometryChunkTypes::BindPose:		return ReadRigPose(parser, into.bindPose);
+	case GeometryChunkTypes::BindPoseInv:	return ReadRigPose(parser, into.inverseBindPose);
+	case GeometryChunkTypes::SubMeshes: {
+		into.subMeshes.resize(into.numMeshes);
+		return parser.ReadArray((int*)into.subMeshes.data(), into.numMeshes * 2);
+	}
+	case GeometryChunkTypes::SubMeshNames:	return ReadSubMeshNames(parser, into.numMeshes, into.subMeshNames);
+	default: return false;
+	}
+}
+
+bool ReadTextMeshFile(const string& filename, MeshFileData& into) {
+	MappedFile file(filename);
+	if (!file.IsOpen()) {
+		std::cout << "Can't open MeshGeometry file " << filename << "!" << std::endl;
+		return false;
+	}
+	TextParser parser(file.GetData(), file.GetData() + file.GetSize());
+
+	std::string filetype;
+	int fileVersion = 0;
+
+	if (!parser.Read(filetype) || filetype != "MeshGeometry") {
+		std::cout << "File is not a MeshGeometry file!" << std::endl;
+		return false;
+	}
+
+	if (!parser.Read(fileVersion) || fileVersion != 1) {
+		std::cout << "MeshGeometry file has incompatible version!" << std::endl;
+		return false;
+	}
+
+	int numChunks = 0;
+
+	if (!parser.Read(into.numMeshes) || !parser.Read(into.numVertices) ||
+		!parser.Read(into.numIndices) || !parser.Read(numChunks)) {
+		std::cout << "MeshGeometry file has a bad header!" << std::endl;
+		return false;
+	}
+
+	vector<TextChunk> chunks;
+	for (int i = 0; i < numChunks; ++i) {
+		int chunkType = 0;
+		if (!parser.Read(chunkType)) {
+			std::cout << "MeshGeometry file has a bad chunk header!" << std::endl;
+			return false;
+		}
+
+		TextChunk c;
+		c.type	= (GeometryChunkTypes)chunkType;
+		c.start = parser.GetPosition();
+		if (!SkipTextChunk(parser, c.type, into)) {
+			std::cout << "MeshGeometry file has a bad chunk (type " << chunkType << ")!" << std::endl;
+			return false;
+		}
+		c.end = parser.GetPosition();
+		chunks.emplace_back(c);
+	}
+
+	vector<std::function<bool()>> jobs;
+	for (const TextChunk& c : chunks) {
+		jobs.emplace_back([&c, &into]() { return ReadTextChunk(c, into); });
+	}
+	if (!RunParseJobs(jobs)) {
+		std::cout << "MeshGeometry file " << filename << " could not be parsed!" << std::endl;
+		return false;
+	}
+	if (into.numVertices > 0 && into.positions.empty()) {
+		std::cout << "MeshGeometry file " << filename << " has no positions!" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool ReadStringTable(const char* data, size_t size, uint32_t count, vector<string>& into) {
+	size_t at = 0;
+	for (uint32_t i = 0; i < count; ++i) {
+		size_t start = at;
+		while (at < size && data[at] != '\0') {
+			++at;
+		}
+		if (at >= size) {
+			return false;	//ran off the end of the chunk
+		}
+		into.emplace_back(data + start, at - start);
+		++at;
+	}
+	return true;
+}
+
+/*
+Binary writing - chunks are gathered up as (type, count, bytes) first, so that the
+chunk table can be written with final offsets before any of the payloads.
+*/
+struct PendingChunk {
+	GeometryChunkTypes	type;
+	uint32_t			elementCount;
+	vector<char>		bytes;
+};
+
+template <typename T>
+static void AddChunk(vector<PendingChunk>& chunks, GeometryChunkTypes type, const vector<T>& data, uint32_t elementCount) {
+	if (data.empty()) {
+		return;
+	}
+	PendingChunk c;
+	c.type			= type;
+	c.elementCount	= elementCount;
+	c.bytes.resize(data.size() * sizeof(T));
+	memcpy(c.bytes.data(), data.data(), c.bytes.size());
+	chunks.emplace_back(std::move(c));
+}
+
+static void AddStringChunk(vector<PendingChunk>& chunks, GeometryChunkTypes type, const vector<string>& names) {
+	if (names.empty()) {
+		return;
+	}
+	PendingChunk c;
+	c.type			= type;
+	c.elementCount	= (uint32_t)names.size();
+	for (const string& s : names) {
+		c.bytes.insert(c.bytes.end(), s.begin(), s.end());
+		c.bytes.emplace_back('\0');
+	}
+	chunks.emplace_back(std::move(c));
+}
+
+static size_t AlignUp(size_t v) {
+	return (v + BINARY_MESH_ALIGNMENT - 1) & ~(BINARY_MESH_ALIGNMENT - 1);
+}
+
+bool WriteBinaryMeshFile(const string& filename, const MeshFileData& from) {
+	vector<PendingChunk> chunks;
+
+	AddChunk(chunks, GeometryChunkTypes::VPositions,	from.positions,		from.numVertices);
+	AddChunk(chunks, GeometryChunkTypes::VColors,		from.colours,		from.numVertices);
+	AddChunk(chunks, GeometryChunkTypes::VNormals,		from.normals,		from.numVertices);
+	AddChunk(chunks, GeometryChunkTypes::VTangents,		from.tangents,		from.numVertices);
+	AddChunk(chunks, GeometryChunkTypes::VTex0,			from.uvs,			from.numVertices);
+	AddChunk(chunks, GeometryChunkTypes::VWeightValues,	from.weights,		from.numVertices);
+	AddChunk(chunks, GeometryChunkTypes::VWeightIndices,from.weightIndices,	from.numVertices);
+	AddChunk(chunks, GeometryChunkTypes::Indices,		from.indices,		from.numIndices);
+
+	AddStringChunk(chunks, GeometryChunkTypes::JointNames, from.jointNames);
+	AddChunk(chunks, GeometryChunkTypes::JointParents,	from.jointParents,		(uint32_t)from.jointParents.size());
+	AddChunk(chunks, GeometryChunkTypes::BindPose,		from.bindPose,			(uint32_t)from.bindPose.size());
+	AddChunk(chunks, GeometryChunkTypes::BindPoseInv,	from.inverseBindPose,	(uint32_t)from.inverseBindPose.size());
+
+	AddChunk(chunks, GeometryChunkTypes::SubMeshes,		from.subMeshes,		(uint32_t)from.subMeshes.size());
+	AddStringChunk(chunks, GeometryChunkTypes::SubMeshNames, from.subMeshNames);
+
+	BinaryMeshHeader header;
+	memcpy(header.magic, BINARY_MESH_MAGIC, sizeof(header.magic));
+	header.version		= BINARY_MESH_VERSION;
+	header.numMeshes	= (uint32_t)from.numMeshes;
+	header.numVertices	= (uint32_t)from.numVertices;
+	header.numIndices	= (uint32_t)from.numIndices;
+	header.numChunks	= (uint32_t)chunks.size();
+
+	vector<BinaryMeshChunk> table;
+	size_t offset = AlignUp(sizeof(BinaryMeshHeader) + chunks.size() * sizeof(BinaryMeshChunk));
+	for (const PendingChunk& c : chunks) {
+		BinaryMeshChunk entry;
+		entry.type			= (uint32_t)c.type;
+		entry.elementCount	= c.elementCount;
+		entry.offset		= offset;
+		entry.size			= c.bytes.size();
+		table.emplace_back(entry);
+		offset = AlignUp(offset + c.bytes.size());
+	}
+
+	std::ofstream file(filename, std::ios::binary);
+	if (!file.is_open()) {
+		std::cout << "Can't write binary mesh file " << filename << "!" << std::endl;
+		return false;
+	}
+	const char padding[BINARY_MESH_ALIGNMENT] = { 0 };
+
+	file.write((const char*)&header, sizeof(header));
+	file.write((const char*)table.data(), table.size() * sizeof(BinaryMeshChunk));
+	size_t written = sizeof(header) + table.size() * sizeof(BinaryMeshChunk);
+
+	for (size_t i = 0; i < chunks.size(); ++i) {
+		file.write(padding, table[i].offset - written);
+		file.write(chunks[i].bytes.data(), chunks[i].bytes.size());
+		written = (size_t)(table[i].offset + table[i].size);
+	}
+	return file.good();
+}
@@ -0,0 +1,96 @@
+#pragma once
+/*
+Description:CPU-side reading and writing of MeshGeometry files, kept apart from
+Mesh so that files can be parsed and converted without touching OpenGL.
+
+Two formats are supported - the original text MeshGeometry format, and a
+versioned binary version of it. The binary file is a header, followed by a table
+of chunks (using the same GeometryChunkTypes as the text format), followed by
+the chunk payloads. Payloads are stored exactly as Mesh holds them in memory, and
+start on 16 byte boundaries, so a memory mapped file can be handed straight to
+glBufferData.
+*/
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "Vector2.h"
+#include "Vector3.h"
+#include "Vector4.h"
+#include "Matrix4.h"
+
+enum class GeometryChunkTypes {
+	VPositions		= 1,
+	VNormals		= 2,
+	VTangents		= 4,
+	VColors			= 8,
+	VTex0			= 16,
+	VTex1			= 32,
+	VWeightValues	= 64,
+	VWeightIndices	= 128,
+	Indices			= 256,
+	JointNames		= 512,
+	JointParents	= 1024,
+	BindPose		= 2048,
+	BindPoseInv		= 4096,
+	Material		= 65536,
+	SubMeshes		= 1 << 14,
+	SubMeshNames	= 1 << 15
+};
+
+struct MeshFileSubMesh {
+	int start;
+	int count;
+};
+
+//Everything a MeshGeometry file can contain. Empty vectors are chunks that
+//weren't in the file.
+struct MeshFileData {
+	int numMeshes	= 0;
+	int numVertices = 0;
+	int numIndices	= 0;
+
+	std::vector<Vector3>		positions;
+	std::vector<Vector4>		colours;
+	std::vector<Vector3>		normals;
+	std::vector<Vector4>		tangents;
+	std::vector<Vector2>		uvs;
+	std::vector<Vector4>		weights;
+	std::vector<int>			weightIndices;	//4 per vertex
+	std::vector<unsigned int>	indices;
+
+	std::vector<std::string>	jointNames;
+	std::vector<int>			jointParents;
+	std::vector<Matrix4>		bindPose;
+	std::vector<Matrix4>		inverseBindPose;
+
+	std::vector<MeshFileSubMesh>	subMeshes;
+	std::vector<std::string>		subMeshNames;
+};
+
+//Binary format layout. Bump BINARY_MESH_VERSION whenever this changes!
+const char		BINARY_MESH_MAGIC[4]	= { 'M', 'S', 'H', 'B' };
+const uint32_t	BINARY_MESH_VERSION		= 1;
+const size_t	BINARY_MESH_ALIGNMENT	= 16;
+
+struct BinaryMeshHeader {
+	char		magic[4];
+	uint32_t	version;
+	uint32_t	numMeshes;
+	uint32_t	numVertices;
+	uint32_t	numIndices;
+	uint32_t	numChunks;
+};
+
+struct BinaryMeshChunk {
+	uint32_t	type;			//a GeometryChunkTypes value
+	uint32_t	elementCount;	//vertices, indices, joints, matrices, names...
+	uint64_t	offset;			//from the start of the file
+	uint64_t	size;			//in bytes
+};
+
+//Name chunks are stored as back to back null terminated strings
+bool	ReadStringTable(const char* data, size_t size, uint32_t count, std::vector<std::string>& into);
+
+bool	ReadTextMeshFile(const std::string& filename, MeshFileData& into);
+bool	WriteBinaryMeshFile(const std::string& filename, const MeshFileData& from);
@@ -0,0 +1,277 @@
+#include "MeshOptimiser.h"
+
+#include <algorithm>
+#include <cmath>
+
+using std::vector;
+
+VertexCacheStats MeshOptimiser::AnalyseVertexCache(const unsigned int* indices, size_t numIndices, size_t numVertices, unsigned int cacheSize) {
+	VertexCacheStats stats;
+	stats.triangles = numIndices / 3;
+
+	//Each vertex remembers when it entered the cache - it's still in there if
+	//fewer than cacheSize misses have happened since
+	vector<size_t>	enteredAt(numVertices, 0);
+	vector<bool>	seen(numVertices, false);
+
+	for (size_t i = 0; i < stats.triangles * 3; ++i) {
+		unsigned int v = indices[i];
+		if (!seen[v]) {
+			seen[v] = true;
+			stats.vertices++;
+		}
+		else if (stats.misses - enteredAt[v] < cacheSize) {
+			continue;	//hit!
+		}
+		stats.misses++;
+		enteredAt[v] = stats.misses;
+	}
+	return stats;
+}
+
+/*
+Vertex cache optimisation
+*/
+const int	FORSYTH_CACHE_SIZE			= 32;
+const float	FORSYTH_DECAY_POWER			= 1.5f;
+const float	FORSYTH_LAST_TRI_SCORE		= 0.75f;
+const float	FORSYTH_VALENCE_BOOST_SCALE	= 2.0f;
+const float	FORSYTH_VALENCE_BOOST_POWER	= 0.5f;
+
+static float ForsythVertexScore(int cachePosition, unsigned int remainingTris) {
+	if (remainingTris == 0) {
+		return -1.0f;	//no triangles left to use it, so it doesn't matter
+	}
+	float score = 0.0f;
+	if (cachePosition >= 0) {
+		if (cachePosition < 3) {
+			score = FORSYTH_LAST_TRI_SCORE;	//used by the last triangle - fixed score, so we don't favour any one edge
+		}
+		else {
+			float scaler = 1.0f - (cachePosition - 3) / (float)(FORSYTH_CACHE_SIZE - 3);
+			score = std::pow(scaler, FORSYTH_DECAY_POWER);
+		}
+	}
+	//Vertices with only a few triangles left get a boost, so they're finished off and don't linger
+	score += FORSYTH_VALENCE_BOOST_SCALE * std::pow((float)remainingTris, -FORSYTH_VALENCE_BOOST_POWER);
+	return score;
+}
+
+void MeshOptimiser::OptimiseVertexCache(unsigned int* indices, size_t numIndices, size_t numVertices) {
+	const size_t numTris = numIndices / 3;
+	if (numTris == 0) {
+		return;
+	}
+	//Build vertex -> triangle adjacency. Each vertex's remaining triangles are kept
+	//at the front of its slice of 'adjacency', so finished ones can be dropped off the end
+	vector<unsigned int> remaining(numVertices, 0);
+	for (size_t i = 0; i < numTris * 3; ++i) {
+		remaining[indices[i]]++;
+	}
+	vector<unsigned int> offsets(numVertices + 1, 0);
+	for (size_t v = 0; v < numVertices; ++v) {
+		offsets[v + 1] = offsets[v] + remaining[v];
+	}
+	vector<unsigned int> adjacency(numTris * 3);
+	{
+		vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+		for (size_t i = 0; i < numTris * 3; ++i) {
+			adjacency[fill[indices[i]]++] = (unsigned int)(i / 3);
+		}
+	}
+
+	vector<int>		cachePosition(numVertices, -1);
+	vector<float>	vertexScore(numVertices);
+	for (size_t v = 0; v < numVertices; ++v) {
+		vertexScore[v] = ForsythVertexScore(-1, remaining[v]);
+	}
+	vector<bool>	triAdded(numTris, false);
+
+	vector<unsigned int> output;
+	output.reserve(numTris * 3);
+
+	unsigned int	cache[FORSYTH_CACHE_SIZE + 3];
+	int				cacheSize	= 0;
+	size_t			scanCursor	= 0;	//where to look for a new start triangle if the cache runs dry
+	int				bestTri		= -1;
+
+	while (output.size() < numTris * 3) {
+		if (bestTri < 0) {
+			//Nothing in the cache has triangles left - start a new island with the next unused triangle
+			while (triAdded[scanCursor]) {
+				++scanCursor;
+			}
+			bestTri = (int)scanCursor;
+		}
+		const unsigned int* tri = &indices[bestTri * 3];
+		triAdded[bestTri] = true;
+		for (int i = 0; i < 3; ++i) {
+			unsigned int v = tri[i];
+			output.emplace_back(v);
+
+			unsigned int* adj = &adjacency[offsets[v]];
+			for (unsigned int j = 0; j < remaining[v]; ++j) {
+				if (adj[j] == (unsigned int)bestTri) {
+					adj[j] = adj[remaining[v] - 1];
+					break;
+				}
+			}
+			remaining[v]--;
+		}
+
+		//The new triangle's vertices go to the front of the LRU cache, and everything else shuffles down
+		unsigned int newCache[FORSYTH_CACHE_SIZE + 3];
+		int newSize = 0;
+		newCache[newSize++] = tri[0];
+		newCache[newSize++] = tri[1];
+		newCache[newSize++] = tri[2];
+		for (int i = 0; i < cacheSize; ++i) {
+			unsigned int v = cache[i];
+			if (v != tri[0] && v != tri[1] && v != tri[2]) {
+				newCache[newSize++] = v;
+			}
+		}
+		for (int i = 0; i < newSize; ++i) {
+			unsigned int v = newCache[i];
+			cachePosition[v]	= (i < FORSYTH_CACHE_SIZE) ? i : -1;
+			vertexScore[v]		= ForsythVertexScore(cachePosition[v], remaining[v]);
+		}
+
+		//Only triangles touching the cache can have changed score, so the next
+		//triangle is picked from those
+		bestTri = -1;
+		float bestScore = -1.0f;
+		for (int i = 0; i < newSize; ++i) {
+			unsigned int v = newCache[i];
+			const unsigned int* adj = &adjacency[offsets[v]];
+			for (unsigned int j = 0; j < remaining[v]; ++j) {
+				unsigned int t = adj[j];
+				float score = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+				if (score > bestScore) {
+					bestScore	= score;
+					bestTri		= (int)t;
+				}
+			}
+		}
+		cacheSize = std::min(newSize, FORSYTH_CACHE_SIZE);
+		std::copy(newCache, newCache + cacheSize, cache);
+	}
+	std::copy(output.begin(), output.end(), indices);
+}
+
+/*
+Overdraw optimisation
+*/
+struct TriangleCluster {
+	size_t	firstTri;
+	size_t	triCount;
+	float	sortKey;
+};
+
+void MeshOptimiser::OptimiseOverdraw(unsigned int* indices, size_t numIndices, const Vector3* vertices, size_t numVertices, float threshold) {
+	const size_t numTris = numIndices / 3;
+	if (numTris < 2) {
+		return;
+	}
+	const float meshACMR = AnalyseVertexCache(indices, numTris * 3, numVertices).GetACMR();
+
+	//Split the list into clusters. Each cluster is simulated from a cold cache, and
+	//can end once its own ACMR is within 'threshold' of the whole list's - so moving
+	//clusters around afterwards can't make the vertex cache much worse.
+	vector<TriangleCluster> clusters;
+	{
+		vector<size_t> enteredAt(numVertices, 0);
+		vector<size_t> clusterID(numVertices, 0);	//which cluster a vertex was last cached in (1 based)
+
+		size_t clusterStart		= 0;
+		size_t clusterMisses	= 0;
+		for (size_t t = 0; t < numTris; ++t) {
+			for (int i = 0; i < 3; ++i) {
+				unsigned int v = indices[t * 3 + i];
+				bool hit = clusterID[v] == clusters.size() + 1 && clusterMisses - enteredAt[v] < DEFAULT_CACHE_SIZE;
+				if (!hit) {
+					clusterMisses++;
+					enteredAt[v] = clusterMisses;
+					clusterID[v] = clusters.size() + 1;
+				}
+			}
+			size_t clusterTris = t + 1 - clusterStart;
+			if (clusterMisses <= threshold * meshACMR * clusterTris || t == numTris - 1) {
+				clusters.push_back({ clusterStart, clusterTris, 0.0f });
+				clusterStart	= t + 1;
+				clusterMisses	= 0;
+			}
+		}
+	}
+
+	Vector3 meshCentre;
+	float	meshArea = 0.0f;
+	vector<Vector3> clusterCentres(clusters.size());
+	vector<Vector3> clusterNormals(clusters.size());
+
+	for (size_t c = 0; c < clusters.size(); ++c) {
+		float area = 0.0f;
+		for (size_t t = clusters[c].firstTri; t < clusters[c].firstTri + clusters[c].triCount; ++t) {
+			const Vector3& a = vertices[indices[t * 3]];
+			const Vector3& b = vertices[indices[t * 3 + 1]];
+			const Vector3& d = vertices[indices[t * 3 + 2]];
+
+			Vector3 normal	= Vector3::Cross(b - a, d - a);	//length is twice the area
+			float triArea	= normal.Length();
+
+			clusterCentres[c] += (a + b + d) * (triArea / 3.0f);
+			clusterNormals[c] += normal;
+			area += triArea;
+		}
+		meshCentre	+= clusterCentres[c];
+		meshArea	+= area;
+		clusterCentres[c] = (area > 0.0f) ? clusterCentres[c] / area : vertices[indices[clusters[c].firstTri * 3]];
+	}
+	if (meshArea > 0.0f) {
+		meshCentre = meshCentre / meshArea;
+	}
+
+	//Clusters facing away from the middle of the mesh are the ones that occlude others
+	for (size_t c = 0; c < clusters.size(); ++c) {
+		clusters[c].sortKey = Vector3::Dot(clusterCentres[c] - meshCentre, clusterNormals[c].Normalised());
+	}
+	std::stable_sort(clusters.begin(), clusters.end(), [](const TriangleCluster& a, const TriangleCluster& b) {
+		return a.sortKey > b.sortKey;
+	});
+
+	vector<unsigned int> output;
+	output.reserve(numTris * 3);
+	for (const TriangleCluster& c : clusters) {
+		output.insert(output.end(), indices + c.firstTri * 3, indices + (c.firstTri + c.triCount) * 3);
+	}
+	std::copy(output.begin(), output.end(), indices);
+}
+
+MeshOptimiserReport MeshOptimiser::Optimise(unsigned int* indices, size_t numIndices, const Vector3* vertices, size_t numVertices,
+	const vector<MeshFileSubMesh>& subMeshes, bool overdraw) {
+	vector<MeshFileSubMesh> ranges = subMeshes;
+	if (ranges.empty()) {
+		ranges.push_back({ 0, (int)numIndices });
+	}
+	MeshOptimiserReport report;
+	for (const MeshFileSubMesh& r : ranges) {
+		if (r.start < 0 || r.count < 0 || (size_t)(r.start + r.count) > numIndices) {
+			continue;
+		}
+		unsigned int* rangeIndices = indices + r.start;
+		report.before += AnalyseVertexCache(rangeIndices, r.count, numVertices);
+
+		OptimiseVertexCache(rangeIndices, r.count, numVertices);
+		if (overdraw && vertices) {
+			OptimiseOverdraw(rangeIndices, r.count, vertices, numVertices);
+		}
+		report.after += AnalyseVertexCache(rangeIndices, r.count, numVertices);
+	}
+	return report;
+}
+
+std::ostream& operator<<(std::ostream& o, const MeshOptimiserReport& r) {
+	o << "ACMR " << r.before.GetACMR() << " -> " << r.after.GetACMR();
+	o << ", ATVR " << r.before.GetATVR() << " -> " << r.after.GetATVR();
+	return o;
+}
@@ -0,0 +1,63 @@
+#pragma once
+/*
+Class:MeshOptimiser
+Description:Reorders triangle index lists so the GPU does less work drawing them.
+
+OptimiseVertexCache uses Tom Forsyth's "Linear-Speed Vertex Cache Optimisation"
+to keep triangles that share vertices close together in the index list, so the
+post-transform cache hits more often. OptimiseOverdraw then follows Sander et
+al's Tipsify paper - the list is cut into clusters that start with a (mostly)
+cold cache, and the clusters are sorted so that outward facing ones on the edge
+of the mesh draw first, and occlude what's behind them.
+
+Everything works on raw index arrays, so it can run on a Mesh before
+BufferData, or on MeshFileData when converting files.
+*/
+#include <iosfwd>
+#include <vector>
+#include "Vector3.h"
+#include "MeshFile.h"
+
+//Post-transform vertex cache statistics, from simulating a FIFO cache
+struct VertexCacheStats {
+	size_t misses		= 0;	//vertices transformed
+	size_t triangles	= 0;
+	size_t vertices		= 0;	//unique vertices referenced
+
+	//Average Cache Miss Ratio - transformed vertices per triangle. 0.5 is ideal for a big grid, 3 is the worst case
+	float	GetACMR() const { return triangles ? misses / (float)triangles : 0.0f; }
+	//Average Transformed Vertex Ratio - how many times each vertex gets transformed. 1 is ideal
+	float	GetATVR() const { return vertices ? misses / (float)vertices : 0.0f; }
+
+	void operator+=(const VertexCacheStats& s) {
+		misses		+= s.misses;
+		triangles	+= s.triangles;
+		vertices	+= s.vertices;
+	}
+};
+
+struct MeshOptimiserReport {
+	VertexCacheStats before;
+	VertexCacheStats after;
+};
+
+class MeshOptimiser
+{
+public:
+	static const unsigned int DEFAULT_CACHE_SIZE = 16;
+
+	static VertexCacheStats	AnalyseVertexCache(const unsigned int* indices, size_t numIndices, size_t numVertices, unsigned int cacheSize = DEFAULT_CACHE_SIZE);
+
+	static void	OptimiseVertexCache(unsigned int* indices, size_t numIndices, size_t numVertices);
+
+	//'threshold' is how much worse than the whole list's ACMR a cluster may be. Higher
+	//values give more, smaller clusters - better overdraw, but worse vertex cache use
+	static void	OptimiseOverdraw(unsigned int* indices, size_t numIndices, const Vector3* vertices, size_t numVertices, float threshold = 1.05f);
+
+	//Runs both passes over each sub mesh separately (or the whole list if there are
+	//none), so sub mesh boundaries don't move. Triangle lists only!
+	static MeshOptimiserReport Optimise(unsigned int* indices, size_t numIndices, const Vector3* vertices, size_t numVertices,
+		const std::vector<MeshFileSubMesh>& subMeshes, bool overdraw = true);
+};
+
+std::ostream& operator<<(std::ostream& o, const MeshOptimiserReport& r);
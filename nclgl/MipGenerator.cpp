@@ -0,0 +1,327 @@
+#include "MipGenerator.h"
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+//SSE2 is part of the x64 baseline, AVX2 needs /arch:AVX2 or -mavx2 - as with Matrix4
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define NCLGL_SIMD_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(NCLGL_SIMD_SSE2) && defined(__AVX2__)
+#define NCLGL_SIMD_AVX2
+#include <immintrin.h>
+#endif
+
+namespace {
+	const int	SRGB_ENCODE_STEPS	= 1 << 14;	//fine enough to hit every 8 bit value near black
+	const int	LANCZOS_TAPS		= 12;		//3 lobes either side, at half resolution
+	const float PI					= 3.14159265358979f;
+
+	struct SRGBTables {
+		float			toLinear[256];
+		unsigned char	fromLinear[SRGB_ENCODE_STEPS + 1];
+
+		SRGBTables() {
+			for (int i = 0; i < 256; ++i) {
+				float s		= i / 255.0f;
+				toLinear[i] = s <= 0.04045f ? s / 12.92f : powf((s + 0.055f) / 1.055f, 2.4f);
+			}
+			for (int i = 0; i <= SRGB_ENCODE_STEPS; ++i) {
+				float l			= (float)i / SRGB_ENCODE_STEPS;
+				float s			= l <= 0.0031308f ? l * 12.92f : 1.055f * powf(l, 1.0f / 2.4f) - 0.055f;
+				fromLinear[i]	= (unsigned char)(s * 255.0f + 0.5f);
+			}
+		}
+	};
+
+	const SRGBTables& GetSRGBTables() {
+		static SRGBTables tables;
+		return tables;
+	}
+
+	inline unsigned char EncodeSRGB(const SRGBTables& t, float linear) {
+		linear = std::min(std::max(linear, 0.0f), 1.0f);
+		return t.fromLinear[(int)(linear * SRGB_ENCODE_STEPS + 0.5f)];
+	}
+
+	inline unsigned char EncodeUnorm(float v) {
+		return (unsigned char)(std::min(std::max(v, 0.0f), 1.0f) * 255.0f + 0.5f);
+	}
+
+	//Output pixel x sits halfway between source pixels 2x and 2x + 1, so tap t
+	//reads source pixel 2x + t - 5, at distance (t - 5.5) / 2 output pixels
+	struct LanczosWeights {
+		float w[LANCZOS_TAPS];
+
+		LanczosWeights() {
+			float total = 0.0f;
+			for (int t = 0; t < LANCZOS_TAPS; ++t) {
+				float x = (t - 5.5f) * 0.5f;
+				w[t]	= 3.0f * sinf(PI * x) * sinf(PI * x / 3.0f) / (PI * PI * x * x);
+				total	+= w[t];
+			}
+			for (float& f : w) {
+				f /= total;
+			}
+		}
+	};
+
+	const LanczosWeights& GetLanczosWeights() {
+		static LanczosWeights weights;
+		return weights;
+	}
+
+#ifdef NCLGL_SIMD_SSE2
+	//Each takes 8 sums of 2 rows, and adds horizontally neighbouring pixels
+	//together, leaving 4 results in the bottom half
+	template <int C> __m128i PairSum(__m128i v);
+
+	template <> inline __m128i PairSum<4>(__m128i v) {
+		return _mm_add_epi16(v, _mm_srli_si128(v, 8));
+	}
+	template <> inline __m128i PairSum<2>(__m128i v) {
+		__m128i t = _mm_add_epi16(v, _mm_srli_si128(v, 4));
+		return _mm_shuffle_epi32(t, _MM_SHUFFLE(3, 3, 2, 0));
+	}
+	template <> inline __m128i PairSum<1>(__m128i v) {
+		__m128i t = _mm_and_si128(_mm_add_epi16(v, _mm_srli_epi32(v, 16)), _mm_set1_epi32(0xFFFF));
+		return _mm_packs_epi32(t, t);
+	}
+
+	//Box filters the start of a row, 8 output bytes at a time, returning how many it did
+	template <int C> int BoxSpanSSE2(const unsigned char* r0, const unsigned char* r1, unsigned char* out, int outBytes) {
+		const __m128i zero	= _mm_setzero_si128();
+		const __m128i two	= _mm_set1_epi16(2);
+		int i = 0;
+		for (; i + 8 <= outBytes; i += 8) {
+			__m128i a	= _mm_loadu_si128((const __m128i*)(r0 + i * 2));
+			__m128i b	= _mm_loadu_si128((const __m128i*)(r1 + i * 2));
+			__m128i lo	= PairSum<C>(_mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero)));
+			__m128i hi	= PairSum<C>(_mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero)));
+			__m128i sum = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(lo, hi), two), 2);
+			_mm_storel_epi64((__m128i*)(out + i), _mm_packus_epi16(sum, sum));
+		}
+		return i;
+	}
+#endif
+
+#ifdef NCLGL_SIMD_AVX2
+	//As above, on each 128 bit half
+	template <int C> __m256i PairSum256(__m256i v);
+
+	template <> inline __m256i PairSum256<4>(__m256i v) {
+		return _mm256_add_epi16(v, _mm256_srli_si256(v, 8));
+	}
+	template <> inline __m256i PairSum256<2>(__m256i v) {
+		__m256i t = _mm256_add_epi16(v, _mm256_srli_si256(v, 4));
+		return _mm256_shuffle_epi32(t, _MM_SHUFFLE(3, 3, 2, 0));
+	}
+	template <> inline __m256i PairSum256<1>(__m256i v) {
+		__m256i t = _mm256_and_si256(_mm256_add_epi16(v, _mm256_srli_epi32(v, 16)), _mm256_set1_epi32(0xFFFF));
+		return _mm256_packs_epi32(t, t);
+	}
+
+	template <int C> int BoxSpanAVX2(const unsigned char* r0, const unsigned char* r1, unsigned char* out, int outBytes) {
+		const __m256i zero	= _mm256_setzero_si256();
+		const __m256i two	= _mm256_set1_epi16(2);
+		int i = 0;
+		for (; i + 16 <= outBytes; i += 16) {
+			__m256i a	= _mm256_loadu_si256((const __m256i*)(r0 + i * 2));
+			__m256i b	= _mm256_loadu_si256((const __m256i*)(r1 + i * 2));
+			__m256i lo	= PairSum256<C>(_mm256_add_epi16(_mm256_unpacklo_epi8(a, zero), _mm256_unpacklo_epi8(b, zero)));
+			__m256i hi	= PairSum256<C>(_mm256_add_epi16(_mm256_unpackhi_epi8(a, zero), _mm256_unpackhi_epi8(b, zero)));
+			__m256i sum = _mm256_srli_epi16(_mm256_add_epi16(_mm256_unpacklo_epi64(lo, hi), two), 2);
+			//each half packed its 8 results into its bottom 64 bits
+			__m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(sum, sum), _MM_SHUFFLE(3, 1, 2, 0));
+			_mm_storeu_si128((__m128i*)(out + i), _mm256_castsi256_si128(packed));
+		}
+		return i;
+	}
+#endif
+
+	template <int C> int BoxSpan(const unsigned char* r0, const unsigned char* r1, unsigned char* out, int outBytes) {
+		int i = 0;
+#ifdef NCLGL_SIMD_AVX2
+		i = BoxSpanAVX2<C>(r0, r1, out, outBytes);
+#endif
+#ifdef NCLGL_SIMD_SSE2
+		i += BoxSpanSSE2<C>(r0 + i * 2, r1 + i * 2, out + i, outBytes - i);
+#endif
+		return i;
+	}
+
+	//Adds two rows together, for channel counts the shuffles above don't cover
+	void VerticalSum(const unsigned char* r0, const unsigned char* r1, uint16_t* sums, int bytes) {
+		int i = 0;
+#ifdef NCLGL_SIMD_AVX2
+		for (; i + 16 <= bytes; i += 16) {
+			__m256i a = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(r0 + i)));
+			__m256i b = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(r1 + i)));
+			_mm256_storeu_si256((__m256i*)(sums + i), _mm256_add_epi16(a, b));
+		}
+#elif defined(NCLGL_SIMD_SSE2)
+		const __m128i zero = _mm_setzero_si128();
+		for (; i + 16 <= bytes; i += 16) {
+			__m128i a = _mm_loadu_si128((const __m128i*)(r0 + i));
+			__m128i b = _mm_loadu_si128((const __m128i*)(r1 + i));
+			_mm_storeu_si128((__m128i*)(sums + i),		_mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero)));
+			_mm_storeu_si128((__m128i*)(sums + i + 8),	_mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero)));
+		}
+#endif
+		for (; i < bytes; ++i) {
+			sums[i] = r0[i] + r1[i];
+		}
+	}
+
+	template <int C> void HorizontalPairs(const uint16_t* sums, unsigned char* out, int outWidth) {
+		for (int x = 0; x < outWidth; ++x, sums += C * 2, out += C) {
+			for (int k = 0; k < C; ++k) {
+				out[k] = (unsigned char)((sums[k] + sums[C + k] + 2) >> 2);
+			}
+		}
+	}
+}
+
+void MipGenerator::Downsample(const unsigned char* src, int srcWidth, int srcHeight, int channels,
+	unsigned char* dst, JobSystem* jobs) const {
+	Level l;
+	l.src		= src;
+	l.srcWidth	= srcWidth;
+	l.srcHeight = srcHeight;
+	l.channels	= channels;
+	l.dst		= dst;
+	l.dstWidth	= std::max(1, srcWidth / 2);
+	l.dstHeight = std::max(1, srcHeight / 2);
+
+	if (!jobs || jobs->GetThreadCount() == 1 || srcWidth * srcHeight < PARALLEL_PIXELS) {
+		DownsampleRows(l, 0, l.dstHeight);
+		return;
+	}
+	int		bands = std::min((int)jobs->GetThreadCount() * 4, l.dstHeight);
+	JobGroup group;
+	for (int b = 0; b < bands; ++b) {
+		int first	= l.dstHeight * b / bands;
+		int last	= l.dstHeight * (b + 1) / bands;
+		jobs->Run(group, [this, &l, first, last]() { DownsampleRows(l, first, last); });
+	}
+	jobs->Wait(group);
+}
+
+void MipGenerator::DownsampleRows(const Level& l, int firstRow, int lastRow) const {
+	if (filter == MipFilter::Lanczos) {
+		LanczosRows(l, firstRow, lastRow);
+		return;
+	}
+	std::vector<uint16_t> scratch(sRGB ? 0 : (size_t)l.srcWidth * l.channels);
+	for (int y = firstRow; y < lastRow; ++y) {
+		if (sRGB) {
+			BoxRowSRGB(l, y);
+		}
+		else {
+			BoxRow(l, y, scratch.data());
+		}
+	}
+}
+
+void MipGenerator::BoxRow(const Level& l, int y, uint16_t* scratch) const {
+	const int				c			= l.channels;
+	const size_t			rowBytes	= (size_t)l.srcWidth * c;
+	const unsigned char*	r0			= l.src + std::min(y * 2,		l.srcHeight - 1) * rowBytes;
+	const unsigned char*	r1			= l.src + std::min(y * 2 + 1,	l.srcHeight - 1) * rowBytes;
+	unsigned char*			out			= l.dst + (size_t)y * l.dstWidth * c;
+	const int				outBytes	= l.dstWidth * c;
+
+	int i = 0;
+	if (l.srcWidth > 1) {	//a 1 pixel wide source has no pairs, so it all goes the slow way
+		switch (c) {
+			case 1: i = BoxSpan<1>(r0, r1, out, outBytes); break;
+			case 2: i = BoxSpan<2>(r0, r1, out, outBytes); break;
+			case 4: i = BoxSpan<4>(r0, r1, out, outBytes); break;
+			case 3:
+				VerticalSum(r0, r1, scratch, outBytes * 2);
+				HorizontalPairs<3>(scratch, out, l.dstWidth);
+				i = outBytes;
+				break;
+		}
+	}
+	for (; i < outBytes; ++i) {
+		int x	= i / c;
+		int k	= i - x * c;
+		int x0	= x * 2 * c + k;
+		int x1	= std::min(x * 2 + 1, l.srcWidth - 1) * c + k;
+		out[i]	= (unsigned char)((r0[x0] + r0[x1] + r1[x0] + r1[x1] + 2) >> 2);
+	}
+}
+
+void MipGenerator::BoxRowSRGB(const Level& l, int y) const {
+	const SRGBTables&		t			= GetSRGBTables();
+	const int				c			= l.channels;
+	const int				alpha		= (c == 2 || c == 4) ? c - 1 : -1;
+	const size_t			rowBytes	= (size_t)l.srcWidth * c;
+	const unsigned char*	r0			= l.src + std::min(y * 2,		l.srcHeight - 1) * rowBytes;
+	const unsigned char*	r1			= l.src + std::min(y * 2 + 1,	l.srcHeight - 1) * rowBytes;
+	unsigned char*			out			= l.dst + (size_t)y * l.dstWidth * c;
+
+	for (int x = 0; x < l.dstWidth; ++x) {
+		int x0 = x * 2 * c;
+		int x1 = std::min(x * 2 + 1, l.srcWidth - 1) * c;
+		for (int k = 0; k < c; ++k) {
+			if (k == alpha) {
+				*out++ = (unsigned char)((r0[x0 + k] + r0[x1 + k] + r1[x0 + k] + r1[x1 + k] + 2) >> 2);
+			}
+			else {
+				float sum = t.toLinear[r0[x0 + k]] + t.toLinear[r0[x1 + k]] + t.toLinear[r1[x0 + k]] + t.toLinear[r1[x1 + k]];
+				*out++ = EncodeSRGB(t, sum * 0.25f);
+			}
+		}
+	}
+}
+
+void MipGenerator::LanczosRows(const Level& l, int firstRow, int lastRow) const {
+	const SRGBTables&		t		= GetSRGBTables();
+	const LanczosWeights&	w		= GetLanczosWeights();
+	const int				c		= l.channels;
+	const int				alpha	= (c == 2 || c == 4) ? c - 1 : -1;
+	const int				half	= LANCZOS_TAPS / 2 - 1;
+
+	//Filter every source row this band reaches horizontally first...
+	const int	firstSrc	= std::max(0, firstRow * 2 - half);
+	const int	lastSrc		= std::min(l.srcHeight - 1, (lastRow - 1) * 2 + half + 1);
+	const int	outStride	= l.dstWidth * c;
+	std::vector<float> linear((size_t)l.srcWidth * c);
+	std::vector<float> horizontal((size_t)(lastSrc - firstSrc + 1) * outStride);
+
+	for (int sy = firstSrc; sy <= lastSrc; ++sy) {
+		const unsigned char* row = l.src + (size_t)sy * l.srcWidth * c;
+		for (int i = 0; i < l.srcWidth * c; ++i) {
+			linear[i] = (sRGB && i % c != alpha) ? t.toLinear[row[i]] : row[i] * (1.0f / 255.0f);
+		}
+		float* out = horizontal.data() + (size_t)(sy - firstSrc) * outStride;
+		for (int x = 0; x < l.dstWidth; ++x) {
+			for (int k = 0; k < c; ++k) {
+				float sum = 0.0f;
+				for (int tap = 0; tap < LANCZOS_TAPS; ++tap) {
+					int sx = std::min(std::max(x * 2 + tap - half, 0), l.srcWidth - 1);
+					sum += w.w[tap] * linear[sx * c + k];
+				}
+				*out++ = sum;
+			}
+		}
+	}
+	//...then down the columns
+	for (int y = firstRow; y < lastRow; ++y) {
+		unsigned char* out = l.dst + (size_t)y * outStride;
+		for (int i = 0; i < outStride; ++i) {
+			float sum = 0.0f;
+			for (int tap = 0; tap < LANCZOS_TAPS; ++tap) {
+				int sy = std::min(std::max(y * 2 + tap - half, 0), l.srcHeight - 1);
+				sum += w.w[tap] * horizontal[(size_t)(sy - firstSrc) * outStride + i];
+			}
+			out[i] = (sRGB && i % c != alpha) ? EncodeSRGB(t, sum) : EncodeUnorm(sum);
+		}
+	}
+}
@@ -0,0 +1,57 @@
+#pragma once
+/*
+Class:MipGenerator
+Description:Halves 8 bit images for mip chains. The box filter averages each
+2x2 block, with SSE2 (or AVX2, when built with /arch:AVX2) for 1, 2 and 4
+channel images and a SIMD vertical pass for RGB ones. Lanczos is the
+slower, sharper option - a separable 3 lobe kernel, done in floating point.
+
+In sRGB mode colours are filtered as linear light, going through lookup
+tables either way - alpha (the last channel of 2 and 4 channel images) is
+always filtered as it is.
+
+Levels with more than PARALLEL_PIXELS pixels are split into bands of rows
+across a JobSystem, if one's given. That's safe from inside another job.
+*/
+#include <cstdint>
+
+class JobSystem;
+
+enum class MipFilter {
+	Box,
+	Lanczos
+};
+
+class MipGenerator {
+public:
+	static const int PARALLEL_PIXELS = 256 * 256;
+
+	MipGenerator(MipFilter filter = MipFilter::Box, bool sRGB = false) : filter(filter), sRGB(sRGB) {}
+	~MipGenerator() {}
+
+	//dst must have room for max(1, srcWidth / 2) * max(1, srcHeight / 2) pixels
+	void	Downsample(const unsigned char* src, int srcWidth, int srcHeight, int channels,
+				unsigned char* dst, JobSystem* jobs = nullptr) const;
+
+	MipFilter	GetFilter() const	{ return filter; }
+	bool		IsSRGB()	const	{ return sRGB; }
+
+protected:
+	struct Level {
+		const unsigned char*	src;
+		int						srcWidth;
+		int						srcHeight;
+		int						channels;
+		unsigned char*			dst;
+		int						dstWidth;
+		int						dstHeight;
+	};
+
+	void	DownsampleRows(const Level& l, int firstRow, int lastRow) const;
+	void	BoxRow(const Level& l, int y, uint16_t* scratch) const;
+	void	BoxRowSRGB(const Level& l, int y) const;
+	void	LanczosRows(const Level& l, int firstRow, int lastRow) const;
+
+	MipFilter	filter;
+	bool		sRGB;
+};
@@ -17,6 +17,15 @@ _-_-_-_-_-_-_-""  ""
 #include "Light.h"
 #include <algorithm>
 
+static const int MODEL_MATRIX	= Shader::GetUniformID("modelMatrix");
+static const int VIEW_MATRIX	= Shader::GetUniformID("viewMatrix");
+static const int PROJ_MATRIX	= Shader::GetUniformID("projMatrix");
+static const int TEXTURE_MATRIX = Shader::GetUniformID("textureMatrix");
+static const int SHADOW_MATRIX	= Shader::GetUniformID("shadowMatrix");
+static const int LIGHT_POS		= Shader::GetUniformID("lightPos");
+static const int LIGHT_COLOUR	= Shader::GetUniformID("lightColour");
+static const int LIGHT_RADIUS	= Shader::GetUniformID("lightRadius");
+
 using std::string;
 
 
@@ -34,7 +43,7 @@ Creates an OpenGL 3.2 CORE PROFILE rendering context. Sets itself
 as the current renderer of the passed 'parent' Window. Not the best
 way to do it - but it kept the Tutorial code down to a minimum!
 */
-OGLRenderer::OGLRenderer(Window &window)	{
+OGLRenderer::OGLRenderer(Window &window) : glState(GLStateCache::GetShared())	{
 	init					= false;
 	HWND windowHandle = window.GetHandle();
 
@@ -169,7 +178,7 @@ to call.
 void OGLRenderer::Resize(int x, int y)	{
 	width	= std::max(x,1);	
 	height	= std::max(y,1);
-	glViewport(0,0,width,height);
+	glState.SetViewport(0,0,width,height);
 }
 
 /*
@@ -181,6 +190,7 @@ void OGLRenderer::SwapBuffers() {
 	//We call the windows OS SwapBuffers on win32. Wrapping it in this 
 	//function keeps all the tutorial code 100% cross-platform (kinda).
 	::SwapBuffers(deviceContext);
+	glState.EndFrame();
 }
 /*
 Used by some later tutorials when we want to have framerate-independent
@@ -205,30 +215,30 @@ call.
 */
 void OGLRenderer::UpdateShaderMatrices()	{
 	if(currentShader) {
-		glUniformMatrix4fv(glGetUniformLocation(currentShader->GetProgram(), "modelMatrix")   ,	1,false, modelMatrix.values);
-		glUniformMatrix4fv(glGetUniformLocation(currentShader->GetProgram(), "viewMatrix")    ,	1,false, viewMatrix.values);
-		glUniformMatrix4fv(glGetUniformLocation(currentShader->GetProgram(), "projMatrix")    ,	1,false, projMatrix.values);
-		glUniformMatrix4fv(glGetUniformLocation(currentShader->GetProgram(), "textureMatrix") , 1,false, textureMatrix.values);
-		glUniformMatrix4fv(glGetUniformLocation(currentShader->GetProgram(), "shadowMatrix")  , 1,false, shadowMatrix.values);
+		currentShader->SetUniform(MODEL_MATRIX,		modelMatrix);
+		currentShader->SetUniform(VIEW_MATRIX,		viewMatrix);
+		currentShader->SetUniform(PROJ_MATRIX,		projMatrix);
+		currentShader->SetUniform(TEXTURE_MATRIX,	textureMatrix);
+		currentShader->SetUniform(SHADOW_MATRIX,	shadowMatrix);
 	}
 }
 
 void OGLRenderer::BindShader(Shader*s) {
 	currentShader = s;
-	glUseProgram(s->GetProgram());
+	glState.UseProgram(s->GetProgram());
 }
 
 void OGLRenderer::SetTextureRepeating(GLuint target, bool repeating) {
-	glBindTexture(GL_TEXTURE_2D, target);
+	glState.BindTexture(0, GL_TEXTURE_2D, target);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, repeating ? GL_REPEAT : GL_CLAMP);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, repeating ? GL_REPEAT : GL_CLAMP);
-	glBindTexture(GL_TEXTURE_2D, 0);
+	glState.BindTexture(0, GL_TEXTURE_2D, 0);
 }
 
 void OGLRenderer::SetShaderLight(const Light& light) {
-	glUniform3fv(glGetUniformLocation(currentShader->GetProgram(), "lightPos"),		1, (float*)&light.GetPosition());
-	glUniform4fv(glGetUniformLocation(currentShader->GetProgram(), "lightColour"),	1, (float*)&light.GetColour());
-	glUniform1f	(glGetUniformLocation(currentShader->GetProgram(), "lightRadius"),				light.GetRadius());
+	currentShader->SetUniform(LIGHT_POS,	light.GetPosition());
+	currentShader->SetUniform(LIGHT_COLOUR,	light.GetColour());
+	currentShader->SetUniform(LIGHT_RADIUS,	light.GetRadius());
 }
 
 #ifdef OPENGL_DEBUGGING
@@ -35,6 +35,7 @@ _-_-_-_-_-_-_-""  ""
 #include "Window.h"
 #include "Shader.h"
 #include "Mesh.h"
+#include "GLStateCache.h"
 
 using std::vector;
 
@@ -56,6 +57,9 @@ public:
 	void			SwapBuffers();
 
 	bool			HasInitialised() const;	
+
+	//Whatever BindShader last bound, for nodes that set their own uniforms
+	Shader*			GetCurrentShader() const { return currentShader; }
 	
 protected:
 	virtual void	Resize(int x, int y);	
@@ -78,6 +82,8 @@ protected:
 	Matrix4 textureMatrix;	//Texture matrix
 	Matrix4 shadowMatrix;
 
+	GLStateCache& glState;	//Binds through here can skip redundant calls
+
 	int		width;			//Render area width (not quite the same as window width)
 	int		height;			//Render area height (not quite the same as window height)
 	bool	init;			//Did the renderer initialise properly?
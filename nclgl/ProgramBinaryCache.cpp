@@ -0,0 +1,201 @@
+#include "ProgramBinaryCache.h"
+#include "MappedFile.h"
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+namespace {
+	const uint32_t ENTRY_MAGIC		= 0x4250434E;	//"NCPB"
+	//Bump this if anything baked into a linked program changes, eg the
+	//attribute locations Shader binds before linking
+	const uint32_t ENTRY_VERSION	= 1;
+
+	struct EntryHeader {
+		uint32_t magic;
+		uint32_t version;
+		uint64_t key;
+		uint32_t format;
+		uint32_t length;
+		uint64_t checksum;
+	};
+
+	const uint64_t FNV_OFFSET	= 14695981039346656037ull;
+	const uint64_t FNV_PRIME	= 1099511628211ull;
+
+	uint64_t Hash(const void* data, size_t size, uint64_t hash = FNV_OFFSET) {
+		const unsigned char* bytes = (const unsigned char*)data;
+		for (size_t i = 0; i < size; ++i) {
+			hash ^= bytes[i];
+			hash *= FNV_PRIME;
+		}
+		return hash;
+	}
+
+	std::string GetGLString(GLenum name) {
+		const char* s = (const char*)glGetString(name);
+		return s ? s : "";
+	}
+}
+
+ProgramBinaryCache::ProgramBinaryCache(const std::string& directory) : directory(directory) {
+	if (!directory.empty() && directory.back() != '/' && directory.back() != '\\') {
+		this->directory += '/';
+	}
+}
+
+bool ProgramBinaryCache::IsSupported() {
+	static GLint numFormats = -1;
+	if (numFormats < 0) {
+		numFormats = 0;
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+	}
+	return numFormats > 0;
+}
+
+std::string ProgramBinaryCache::GetDriverString() {
+	return	GetGLString(GL_VENDOR) + "\n" + GetGLString(GL_RENDERER) + "\n" +
+			GetGLString(GL_VERSION) + "\n" + GetGLString(GL_SHADING_LANGUAGE_VERSION);
+}
+
+uint64_t ProgramBinaryCache::MakeKey(const std::string* sources, int count) {
+	if (!IsSupported()) {
+		return 0;
+	}
+	return MakeKey(sources, count, GetDriverString());
+}
+
+uint64_t ProgramBinaryCache::MakeKey(const std::string* sources, int count, const std::string& driver) {
+	uint64_t hash = Hash(&ENTRY_VERSION, sizeof(ENTRY_VERSION));
+	hash = Hash(driver.data(), driver.size(), hash);
+	for (int i = 0; i < count; ++i) {
+		//hash the length too, so text can't move between stages unnoticed
+		uint64_t length = sources[i].size();
+		hash = Hash(&length, sizeof(length), hash);
+		hash = Hash(sources[i].data(), sources[i].size(), hash);
+	}
+	return hash ? hash : 1;	//0 means 'don't cache'
+}
+
+void ProgramBinaryCache::SetRetrievable(GLuint program) {
+	if (IsSupported()) {
+		glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
+}
+
+std::string ProgramBinaryCache::GetEntryPath(uint64_t key) const {
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+	return directory + name;
+}
+
+bool ProgramBinaryCache::ReadEntry(uint64_t key, GLenum& format, std::vector<char>& binary) const {
+	MappedFile file;
+	if (!file.Open(GetEntryPath(key))) {
+		return false;	//not cached yet
+	}
+	EntryHeader header;
+	bool valid = file.GetSize() >= sizeof(EntryHeader);
+	if (valid) {
+		memcpy(&header, file.GetData(), sizeof(EntryHeader));
+		valid =	header.magic	== ENTRY_MAGIC		&&
+				header.version	== ENTRY_VERSION	&&
+				header.key		== key				&&
+				header.length	== file.GetSize() - sizeof(EntryHeader);
+	}
+	if (valid) {
+		const char* payload = file.GetData() + sizeof(EntryHeader);
+		valid = Hash(payload, header.length) == header.checksum;
+		if (valid) {
+			format = header.format;
+			binary.assign(payload, payload + header.length);
+		}
+	}
+	file.Close();
+	if (!valid) {
+		std::cout << "ProgramBinaryCache: Discarding corrupt entry " << GetEntryPath(key) << "\n";
+		RemoveEntry(key);
+	}
+	return valid;
+}
+
+bool ProgramBinaryCache::WriteEntry(uint64_t key, GLenum format, const std::vector<char>& binary) const {
+	std::error_code error;
+	std::filesystem::create_directories(directory, error);
+
+	EntryHeader header;
+	header.magic	= ENTRY_MAGIC;
+	header.version	= ENTRY_VERSION;
+	header.key		= key;
+	header.format	= format;
+	header.length	= (uint32_t)binary.size();
+	header.checksum = Hash(binary.data(), binary.size());
+
+	//write to the side and rename, so a crash can't leave half an entry behind
+	std::string path		= GetEntryPath(key);
+	std::string tempPath	= path + ".tmp";
+	{
+		std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+		if (!file) {
+			std::cout << "ProgramBinaryCache: Can't write to " << tempPath << "\n";
+			return false;
+		}
+		file.write((const char*)&header, sizeof(header));
+		file.write(binary.data(), binary.size());
+		if (!file) {
+			file.close();
+			std::filesystem::remove(tempPath, error);
+			return false;
+		}
+	}
+	std::filesystem::rename(tempPath, path, error);
+	if (error) {
+		std::filesystem::remove(tempPath, error);
+		return false;
+	}
+	return true;
+}
+
+void ProgramBinaryCache::RemoveEntry(uint64_t key) const {
+	std::error_code error;
+	std::filesystem::remove(GetEntryPath(key), error);
+}
+
+bool ProgramBinaryCache::Load(GLuint program, uint64_t key) {
+	if (!key) {
+		return false;
+	}
+	GLenum				format;
+	std::vector<char>	binary;
+	if (!ReadEntry(key, format, binary)) {
+		return false;
+	}
+	glProgramBinary(program, format, binary.data(), (GLsizei)binary.size());
+
+	GLint linked = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	if (linked != GL_TRUE) {
+		//the driver doesn't like it any more - recompile, and save a fresh one
+		RemoveEntry(key);
+		return false;
+	}
+	return true;
+}
+
+bool ProgramBinaryCache::Save(GLuint program, uint64_t key) {
+	if (!key) {
+		return false;
+	}
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0) {
+		return false;
+	}
+	std::vector<char>	binary(length);
+	GLenum				format = 0;
+	glGetProgramBinary(program, length, &length, &format, binary.data());
+	binary.resize(length);
+	return WriteEntry(key, format, binary);
+}
@@ -0,0 +1,50 @@
+#pragma once
+/*
+Class:ProgramBinaryCache
+Description:Keeps linked shader programs on disk, via glGetProgramBinary, so
+later runs can skip compiling and linking them. Entries are keyed on a hash of
+every stage's source plus the GL vendor, renderer and version strings, so
+editing a shader or updating the driver just misses the cache.
+
+Each entry has a small header holding the key, binary format, length and a
+checksum of the binary. Anything that doesn't check out - a truncated or
+corrupt file, or a binary the driver refuses to load - is deleted, and the
+caller compiles from source as normal.
+*/
+#include "KHR\khrplatform.h"
+#include "glad\glad.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class ProgramBinaryCache {
+public:
+	ProgramBinaryCache(const std::string& directory);
+	~ProgramBinaryCache() {}
+
+	//Needs a current context. Returns 0 if the driver can't save binaries
+	static uint64_t	MakeKey(const std::string* sources, int count);
+	static uint64_t	MakeKey(const std::string* sources, int count, const std::string& driver);
+	static std::string	GetDriverString();
+
+	//Call before linking a program that will be saved
+	static void	SetRetrievable(GLuint program);
+
+	//Returns true if program is now linked from the cached binary
+	bool	Load(GLuint program, uint64_t key);
+	//Call once program has linked successfully
+	bool	Save(GLuint program, uint64_t key);
+
+	//The file side of things, which doesn't need GL at all
+	bool	ReadEntry(uint64_t key, GLenum& format, std::vector<char>& binary) const;
+	bool	WriteEntry(uint64_t key, GLenum format, const std::vector<char>& binary) const;
+	void	RemoveEntry(uint64_t key) const;
+
+	std::string	GetEntryPath(uint64_t key) const;
+
+protected:
+	static bool	IsSupported();
+
+	std::string directory;
+};
@@ -0,0 +1,89 @@
+#include "RenderQueue.h"
+#include "SceneNode.h"
+#include <cstring>
+
+//The top 24 bits of a positive float sort the same way as the float does
+static uint64_t QuantiseDepth(float depth) {
+	if (!(depth > 0.0f)) {
+		return 0;
+	}
+	uint32_t bits;
+	memcpy(&bits, &depth, sizeof(bits));
+	return bits >> 8;
+}
+
+uint64_t RenderQueue::MakeKey(Pass pass, uint32_t shader, uint32_t texture, uint32_t mesh, float depth) {
+	uint64_t state =	((uint64_t)(shader	& 0x3FF) << 24) |
+						((uint64_t)(texture	& 0xFFF) << 12) |
+						 (uint64_t)(mesh	& 0xFFF);
+	uint64_t d = QuantiseDepth(depth);
+
+	if (pass == PASS_OPAQUE) {
+		return ((uint64_t)pass << 62) | (state << 24) | d;
+	}
+	return ((uint64_t)pass << 62) | ((0xFFFFFF - d) << 34) | state;
+}
+
+void RenderQueue::Clear() {
+	keys.clear();
+	nodes.clear();
+}
+
+void RenderQueue::Add(SceneNode* node, float cameraDistance) {
+	Pass		pass	= node->GetColour().w < 1.0f ? PASS_TRANSPARENT : PASS_OPAQUE;
+	Shader*		shader	= node->GetShader();
+	uint32_t	program = shader ? shader->GetProgram() : 0;
+	uint32_t	mesh	= (uint32_t)((uintptr_t)node->GetMesh() >> 4);	//allocations are at least 16 byte aligned
+
+	keys.push_back(MakeKey(pass, program, node->GetTexture(), mesh, cameraDistance));
+	nodes.push_back(node);
+}
+
+//LSD radix sort, a byte at a time. Bytes that are the same in every key
+//(most of them, for a small scene) are skipped without moving anything
+void RenderQueue::Sort() {
+	const size_t count = keys.size();
+	if (count < 2) {
+		return;
+	}
+	tempKeys.resize(count);
+	tempNodes.resize(count);
+
+	size_t histograms[8][256];
+	memset(histograms, 0, sizeof(histograms));
+	for (size_t i = 0; i < count; ++i) {
+		uint64_t k = keys[i];
+		for (int b = 0; b < 8; ++b) {
+			histograms[b][(k >> (b * 8)) & 0xFF]++;
+		}
+	}
+
+	uint64_t*	srcKeys		= keys.data();
+	SceneNode**	srcNodes	= nodes.data();
+	uint64_t*	dstKeys		= tempKeys.data();
+	SceneNode**	dstNodes	= tempNodes.data();
+
+	for (int b = 0; b < 8; ++b) {
+		size_t* histogram = histograms[b];
+		if (histogram[(srcKeys[0] >> (b * 8)) & 0xFF] == count) {
+			continue;
+		}
+		size_t offset = 0;
+		for (int i = 0; i < 256; ++i) {
+			size_t n		= histogram[i];
+			histogram[i]	= offset;
+			offset			+= n;
+		}
+		for (size_t i = 0; i < count; ++i) {
+			size_t to = histogram[(srcKeys[i] >> (b * 8)) & 0xFF]++;
+			dstKeys[to]		= srcKeys[i];
+			dstNodes[to]	= srcNodes[i];
+		}
+		std::swap(srcKeys, dstKeys);
+		std::swap(srcNodes, dstNodes);
+	}
+	if (srcKeys != keys.data()) {	//odd number of passes - results are in the scratch buffers
+		keys.swap(tempKeys);
+		nodes.swap(tempNodes);
+	}
+}
@@ -0,0 +1,53 @@
+#pragma once
+/*
+Class:RenderQueue
+Description:Collects the SceneNodes to draw in a frame, each with a 64 bit sort
+key, and sorts them with an LSD radix sort. The buffers are kept between
+frames, so once they've grown big enough sorting doesn't allocate.
+
+Key layout, most significant bits first:
+	Opaque:			pass (2) | shader (10) | texture (12) | mesh (12) | depth (24)
+	Transparent:	pass (2) | inverted depth (24) | shader (10) | texture (12) | mesh (12)
+So opaque nodes are grouped by state and then drawn front to back within each
+group, while transparent ones are drawn back to front, after everything opaque.
+
+State IDs only take the low bits of GL names / pointers - a clash just means
+two states don't get grouped together, it can't draw anything wrongly.
+*/
+#include <vector>
+#include <cstdint>
+
+class SceneNode;
+
+class RenderQueue {
+public:
+	enum Pass {
+		PASS_OPAQUE			= 0,
+		PASS_TRANSPARENT	= 1,
+	};
+
+	RenderQueue() {}
+	~RenderQueue() {}
+
+	void	Clear();
+	//Nodes with a colour alpha under 1 go in the transparent pass. cameraDistance
+	//can be any positive measure that grows with distance (eg squared distance)
+	void	Add(SceneNode* node, float cameraDistance);
+	void	Sort();
+
+	size_t		GetSize() const			{ return nodes.size(); }
+	SceneNode*	GetNode(size_t i) const	{ return nodes[i]; }
+
+	std::vector<SceneNode*>::const_iterator begin() const	{ return nodes.begin(); }
+	std::vector<SceneNode*>::const_iterator end() const		{ return nodes.end(); }
+
+	static uint64_t	MakeKey(Pass pass, uint32_t shader, uint32_t texture, uint32_t mesh, float depth);
+
+protected:
+	std::vector<uint64_t>	keys;
+	std::vector<SceneNode*>	nodes;
+
+	//Sort scratch space
+	std::vector<uint64_t>	tempKeys;
+	std::vector<SceneNode*>	tempNodes;
+};
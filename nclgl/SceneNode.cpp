@@ -1,4 +1,12 @@
 #include "SceneNode.h"
+#include "JobSystem.h"
+#include "TextureCache.h"
+
+int		SceneNode::transformUpdateCount = 0;
+bool	SceneNode::parallelUpdate		= false;
+
+//Subtrees smaller than this aren't worth the cost of a job
+const int PARALLEL_UPDATE_GRAIN = 64;
 
 SceneNode::SceneNode(Mesh* mesh, Vector4 colour) {
 	this->mesh = mesh;
@@ -6,9 +14,10 @@ SceneNode::SceneNode(Mesh* mesh, Vector4 colour) {
 	this->isHeightMap = 0;
 	this->isSkinned = 0;
 	parent = NULL;
+	hierarchyNode = GetHierarchy().AddNode();
+	subtreeSize = 1;
 	modelScale = Vector3(1, 1, 1);
 	shader = NULL;
-	boundingRadius = 1.0f;
 	distanceFromCamera = 0.0f;
 	texture = 0;
 }
@@ -19,12 +28,29 @@ SceneNode::~SceneNode(void) {
 	}
 
 	delete shader;
-	glDeleteTextures(1, &texture);
+	TextureCache::GetShared().Release(texture);	//textures from anywhere else aren't ours to delete
+	GetHierarchy().RemoveNode(hierarchyNode);
+}
+
+void SceneNode::SetTexture(GLuint tex) {
+	TextureCache::GetShared().AddReference(tex);
+	TextureCache::GetShared().Release(texture);
+	texture = tex;
+}
+
+TransformHierarchy& SceneNode::GetHierarchy() {
+	static TransformHierarchy hierarchy;
+	return hierarchy;
 }
 
 void SceneNode::AddChild(SceneNode* newChild) {
 	children.push_back(newChild);
 	newChild->parent = this;
+	GetHierarchy().SetParent(newChild->hierarchyNode, hierarchyNode);
+
+	for (SceneNode* n = this; n; n = n->parent) {
+		n->subtreeSize += newChild->subtreeSize;
+	}
 }
 
 void SceneNode::Draw(const OGLRenderer &r) {
@@ -33,15 +59,36 @@ void SceneNode::Draw(const OGLRenderer &r) {
 }
 
 void SceneNode::Update(float dt) {
-	if (parent) { 
-		worldTransform = parent->worldTransform * transform;
+	UpdateChildren(dt);
+
+	//World transforms are done in one serial pass afterwards, so the results
+	//don't depend on how the children got split up
+	if (!parent) {
+		transformUpdateCount += (int)GetHierarchy().UpdateWorldTransforms();
 	}
-	else { worldTransform = transform; }
+}
 
-	for (vector<SceneNode*>::iterator i = children.begin(); i != children.end(); ++i)
-	{
-		(*i)->Update(dt);
+void SceneNode::UpdateChildren(float dt) {
+	if (!parallelUpdate || subtreeSize < PARALLEL_UPDATE_GRAIN * 2) {
+		for (vector<SceneNode*>::iterator i = children.begin(); i != children.end(); ++i)
+		{
+			(*i)->Update(dt);
+		}
+		return;
+	}
+	JobSystem& jobs = JobSystem::GetShared();
+	JobGroup group;
+	for (SceneNode* child : children) {
+		if (child->subtreeSize >= PARALLEL_UPDATE_GRAIN) {
+			jobs.Run(group, [child, dt]() { child->Update(dt); });
+		}
+	}
+	for (SceneNode* child : children) {	//small ones are quicker done here
+		if (child->subtreeSize < PARALLEL_UPDATE_GRAIN) {
+			child->Update(dt);
+		}
 	}
+	jobs.Wait(group);
 }
 
 // ignore
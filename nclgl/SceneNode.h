@@ -6,6 +6,7 @@
 #include "Mesh.h"
 #include <vector>
 #include "Shader.h"
+#include "TransformHierarchy.h"
 
 class SceneNode
 {
@@ -13,9 +14,10 @@ public:
 	SceneNode(Mesh* m = NULL, Vector4 colour = Vector4(1, 1, 1, 1));
 	~SceneNode(void);
 
-	void			SetTransform(const Matrix4 &matrix)		{ transform = matrix; }
-	const Matrix4	GetTransform() const					{ return transform; }
-	Matrix4			GetWorldTransform() const				{ return worldTransform; }
+	//Marks this node (and so everything below it) for a world transform update
+	void			SetTransform(const Matrix4 &matrix)		{ GetHierarchy().SetLocalTransform(hierarchyNode, matrix); }
+	const Matrix4	GetTransform() const					{ return GetHierarchy().GetLocalTransform(hierarchyNode); }
+	Matrix4			GetWorldTransform() const				{ return GetHierarchy().GetWorldTransform(hierarchyNode); }
 
 	Vector4			GetColour() const						{ return colour; }
 	void			SetColour(Vector4 newColour)			{ colour = newColour; }
@@ -43,13 +45,14 @@ public:
 
 	// tutorial 7
 
-	float			GetBoundingRadius() const				{ return boundingRadius; }
-	void			SetBoundingRadius(float f)				{ boundingRadius = f; }
+	float			GetBoundingRadius() const				{ return GetHierarchy().GetBoundingRadius(hierarchyNode); }
+	void			SetBoundingRadius(float f)				{ GetHierarchy().SetBoundingRadius(hierarchyNode, f); }
 
 	float			GetCameraDistance() const				{ return distanceFromCamera; }
 	void			SetCameraDistance(float f)				{ distanceFromCamera = f; }
 
-	void			SetTexture(GLuint tex)					{ texture = tex; }
+	//Holds a TextureCache reference to tex, if it came from there
+	void			SetTexture(GLuint tex);
 	GLuint			GetTexture() const						{ return texture; }
 
 	virtual GLuint	GetPlanetTexture();
@@ -58,23 +61,41 @@ public:
 	void			SetShader(Shader* inputShader)			{ shader = inputShader; }
 	Shader*			GetShader()								{ return shader; }
 
+	//Transforms and bounding radii for every SceneNode live in here. Calling Update
+	//on a root node runs the per-node Updates, then recomputes the world transforms
+	//for the whole hierarchy in one pass
+	static TransformHierarchy&	GetHierarchy();
+
+	//How many world transforms Update has recomputed since the last reset - static
+	//nodes only get theirs recomputed when something above them moves
+	static int		GetTransformUpdateCount()				{ return transformUpdateCount; }
+	static void		ResetTransformUpdateCount()				{ transformUpdateCount = 0; }
+
+	//If set, Update hands big child subtrees to the shared JobSystem. Overridden
+	//Update functions must then only touch their own node and its subtree
+	static void		SetParallelUpdate(bool state)			{ parallelUpdate = state; }
+
 	static bool		CompareByCameraDistance(SceneNode* a, SceneNode* b) {
 		return (a->distanceFromCamera < b->distanceFromCamera) ? true : false;
 	}
 
 protected:
 	SceneNode*				parent;
+	void			UpdateChildren(float dt);
+
 	Mesh*					mesh;
-	Matrix4					worldTransform;
-	Matrix4					transform;
+	int						hierarchyNode;
+	int						subtreeSize;	//this node plus all its descendants
 	Vector3					modelScale;
 	Vector4					colour;
 	std::vector<SceneNode*> children;
 
+	static int				transformUpdateCount;
+	static bool				parallelUpdate;
+
 	// tutorial 7
 
 	float distanceFromCamera;
-	float boundingRadius;
 	GLuint texture;
 	Shader* shader;
 	int isHeightMap;
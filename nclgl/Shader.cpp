@@ -1,12 +1,18 @@
 #include "Shader.h"
 #include "Mesh.h"
+#include "ProgramBinaryCache.h"
+#include "ShaderPreprocessor.h"
+#include <algorithm>
 #include <iostream>
 
 using std::string;
 using std::cout;
-using std::ifstream;
 
 vector<Shader*> Shader::allShaders;
+ProgramBinaryCache* Shader::binaryCache = nullptr;
+
+bool				Shader::skipRedundantUploads = false;
+ShaderUniformStats	Shader::uniformStats;
 
 GLuint shaderTypes[SHADER_MAX] = {
 	GL_VERTEX_SHADER,
@@ -35,10 +41,39 @@ Shader::Shader(const string& vertex, const string& fragment, const string& geome
 	allShaders.emplace_back(this);
 }
 
+Shader::Shader(const string* files, const vector<string>& defines) : defines(defines) {
+	for (int i = 0; i < SHADER_MAX; ++i) {
+		shaderFiles[i] = files[i];
+	}
+	Reload(false);
+	allShaders.emplace_back(this);
+}
+
 Shader::~Shader(void)	{
+	for (auto& v : variants) {
+		delete v.second;
+	}
+	allShaders.erase(std::remove(allShaders.begin(), allShaders.end(), this), allShaders.end());
 	DeleteIDs();
 }
 
+Shader* Shader::GetVariant(const vector<string>& variantDefines) {
+	vector<string> sorted = variantDefines;
+	std::sort(sorted.begin(), sorted.end());
+
+	string key;
+	for (const string& d : sorted) {
+		key += d + "\n";
+	}
+	Shader*& variant = variants[key];
+	if (!variant) {
+		vector<string> allDefines = defines;
+		allDefines.insert(allDefines.end(), sorted.begin(), sorted.end());
+		variant = new Shader(shaderFiles, allDefines);
+	}
+	return variant;
+}
+
 void	Shader::Reload(bool deleteOld) {
 	if(deleteOld) {
 		DeleteIDs();
@@ -46,52 +81,58 @@ void	Shader::Reload(bool deleteOld) {
 
 	programID		= glCreateProgram();
 
+	string	sources[SHADER_MAX];
+	bool	loaded[SHADER_MAX];
+	bool	allLoaded = true;
+	for (int i = 0; i < SHADER_MAX; ++i) {
+		objectIDs[i]	= 0;
+		shaderValid[i]	= 0;
+		loaded[i]		= shaderFiles[i].empty() || LoadShaderFile(shaderFiles[i], sources[i]);
+		allLoaded		= allLoaded && loaded[i];
+	}
+
+	uint64_t cacheKey = (binaryCache && allLoaded) ? ProgramBinaryCache::MakeKey(sources, SHADER_MAX) : 0;
+	if (cacheKey && binaryCache->Load(programID, cacheKey)) {
+		for (int i = 0; i < SHADER_MAX; ++i) {
+			shaderValid[i] = shaderFiles[i].empty() ? 0 : GL_TRUE;
+		}
+		programValid = GL_TRUE;
+		ReflectUniforms();
+		return;
+	}
+
 	for (int i = 0; i < SHADER_MAX; ++i) {
-		if (!shaderFiles[i].empty()) {
-			GenerateShaderObject(i);
+		if (shaderFiles[i].empty()) {
+			continue;
 		}
-		else {
-			objectIDs[i]	= 0;
-			shaderValid[i]	= 0;
+		if (!loaded[i]) {
+			cout << "Loading failed!\n";
+			continue;
 		}
+		GenerateShaderObject(i, sources[i]);
 	}
 	SetDefaultAttributes();
+	if (cacheKey) {
+		ProgramBinaryCache::SetRetrievable(programID);
+	}
 	LinkProgram();
 	PrintLinkLog(programID);
-}
-
-bool	Shader::LoadShaderFile(const string& filename, string &into)	{
-	ifstream	file(SHADERDIR + filename);
-	string		textLine;
-
-	cout << "Loading shader text from " << filename << "\n\n";
-
-	if(!file.is_open()){
-		cout << "ERROR ERROR ERROR ERROR: File does not exist!\n";
-		return false;
+	if (cacheKey && programValid == GL_TRUE) {
+		binaryCache->Save(programID, cacheKey);
 	}
-	int lineNum = 1; 
-	while(!file.eof()){
-		getline(file,textLine);
-		textLine += "\n";
-		into += textLine;
-		cout << "(" << lineNum << ") :" << textLine;
-		++lineNum;
-	}
-	cout << "\nLoaded shader text!\n\n";
-	return true;
+	ReflectUniforms();
 }
 
-void	Shader::GenerateShaderObject(unsigned int i)	{
-	cout << "Compiling Shader...\n";
+void	Shader::SetBinaryCacheDirectory(const string& directory) {
+	delete binaryCache;
+	binaryCache = directory.empty() ? nullptr : new ProgramBinaryCache(directory);
+}
 
-	string shaderText;
-	if(!LoadShaderFile(shaderFiles[i],shaderText)) {
-		cout << "Loading failed!\n";
-		shaderValid[i] = false;
-		return;
-	}
+bool	Shader::LoadShaderFile(const string& filename, string &into)	{
+	return ShaderPreprocessor::Process(filename, defines, into);
+}
 
+void	Shader::GenerateShaderObject(unsigned int i, const string& shaderText)	{
 	objectIDs[i] = glCreateShader(shaderTypes[i]);
 
 	const char *chars	= shaderText.c_str();
@@ -102,11 +143,16 @@ void	Shader::GenerateShaderObject(unsigned int i)	{
 	glGetShaderiv(objectIDs[i], GL_COMPILE_STATUS, &shaderValid[i]);
 
 	if (!shaderValid[i]) {
-		cout << "Compiling failed!\n";
+		cout << "Compiling " << ShaderNames[i] << " shader " << shaderFiles[i] << " failed!\n";
 		PrintCompileLog(objectIDs[i]);
-	}
-	else {
-		cout << "Compiling success!\n\n";
+
+		//log lines are given as source(line), where source counts files in include order
+		vector<string>	files;
+		string			unused;
+		ShaderPreprocessor::Process(shaderFiles[i], defines, unused, &files);
+		for (size_t f = 1; f < files.size(); ++f) {
+			cout << "Source " << f << ": " << files[f] << "\n";
+		}
 	}
 
 	glObjectLabel(GL_SHADER, objectIDs[i], -1, shaderFiles[i].c_str());
@@ -139,6 +185,7 @@ void	Shader::DeleteIDs() {
 			glDeleteShader(objectIDs[i]);
 		}
 	}
+	GLStateCache::GetShared().ForgetProgram(programID);
 	glDeleteProgram(programID);
 	programID = 0;
 }
@@ -166,7 +213,139 @@ void	Shader::PrintLinkLog(GLuint program) {
 	}
 }
 
+void Shader::ReflectUniforms() {
+	uniforms.clear();
+	uniformForID.clear();
+	if (programValid != GL_TRUE) {
+		return;
+	}
+	GLint count		= 0;
+	GLint maxLength = 0;
+	glGetProgramiv(programID, GL_ACTIVE_UNIFORMS, &count);
+	glGetProgramiv(programID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+	std::vector<char> name(std::max(maxLength, 1));
+	for (GLint i = 0; i < count; ++i) {
+		GLsizei length	= 0;
+		GLint	size	= 0;
+		GLenum	type	= 0;
+		glGetActiveUniform(programID, i, (GLsizei)name.size(), &length, &size, &type, name.data());
+
+		string uniformName(name.data(), length);
+		if (uniformName.size() > 3 && uniformName.compare(uniformName.size() - 3, 3, "[0]") == 0) {
+			uniformName.resize(uniformName.size() - 3);	//arrays are reported as name[0]
+		}
+		GLint location = glGetUniformLocation(programID, uniformName.c_str());
+		if (location < 0) {
+			continue;	//uniform block members don't have one
+		}
+		int id = GetUniformID(uniformName);
+		if (id >= (int)uniformForID.size()) {
+			uniformForID.resize(id + 1, -1);
+		}
+		uniformForID[id] = (int)uniforms.size();
+
+		Uniform u;
+		u.location = location;
+		u.hasValue = false;
+		uniforms.emplace_back(u);
+	}
+}
+
+std::unordered_map<std::string, int>& Shader::GetUniformIDTable() {
+	static std::unordered_map<std::string, int> uniformIDs;
+	return uniformIDs;
+}
+
+int Shader::GetUniformID(const std::string& name) {
+	uniformStats.lookups++;
+	std::unordered_map<std::string, int>& uniformIDs = GetUniformIDTable();
+	std::unordered_map<std::string, int>::iterator i = uniformIDs.find(name);
+	if (i != uniformIDs.end()) {
+		return i->second;
+	}
+	int id = (int)uniformIDs.size();
+	uniformIDs.insert(std::make_pair(name, id));
+	return id;
+}
+
+GLint Shader::GetUniformLocation(int id) const {
+	if (id < 0 || id >= (int)uniformForID.size() || uniformForID[id] < 0) {
+		return -1;
+	}
+	return uniforms[uniformForID[id]].location;
+}
+
+bool Shader::PrepareUpload(int id, const void* value, size_t size, GLint& location) {
+	if (id < 0 || id >= (int)uniformForID.size() || uniformForID[id] < 0) {
+		return false;	//not in this shader - glUniform would ignore it anyway
+	}
+	Uniform& u = uniforms[uniformForID[id]];
+	location = u.location;
+	if (skipRedundantUploads && u.hasValue && memcmp(u.value, value, size) == 0) {
+		uniformStats.skipped++;
+		return false;
+	}
+	memcpy(u.value, value, size);
+	u.hasValue = true;
+	uniformStats.uploads++;
+	return true;
+}
+
+void Shader::SetUniform(int id, int value) {
+	GLint location;
+	if (PrepareUpload(id, &value, sizeof(value), location)) {
+		glUniform1i(location, value);
+	}
+}
+
+void Shader::SetUniform(int id, float value) {
+	GLint location;
+	if (PrepareUpload(id, &value, sizeof(value), location)) {
+		glUniform1f(location, value);
+	}
+}
+
+void Shader::SetUniform(int id, const Vector2& value) {
+	GLint location;
+	if (PrepareUpload(id, &value, sizeof(value), location)) {
+		glUniform2fv(location, 1, (float*)&value);
+	}
+}
+
+void Shader::SetUniform(int id, const Vector3& value) {
+	GLint location;
+	if (PrepareUpload(id, &value, sizeof(value), location)) {
+		glUniform3fv(location, 1, (float*)&value);
+	}
+}
+
+void Shader::SetUniform(int id, const Vector4& value) {
+	GLint location;
+	if (PrepareUpload(id, &value, sizeof(value), location)) {
+		glUniform4fv(location, 1, (float*)&value);
+	}
+}
+
+void Shader::SetUniform(int id, const Matrix4& value) {
+	GLint location;
+	if (PrepareUpload(id, value.values, sizeof(value.values), location)) {
+		glUniformMatrix4fv(location, 1, false, value.values);
+	}
+}
+
+void Shader::SetUniformArray(int id, const Matrix4* values, int count) {
+	GLint location = GetUniformLocation(id);
+	if (location < 0) {
+		return;
+	}
+	uniforms[uniformForID[id]].hasValue = false;	//element 0 may have changed
+	uniformStats.uploads++;
+	glUniformMatrix4fv(location, count, false, (float*)values);
+}
+
 void Shader::ReloadAllShaders() {
+	ShaderPreprocessor::ClearFileCache();
 	for (auto& i : allShaders) {
 		i->Reload();
 	}
@@ -16,6 +16,8 @@ _-_-_-_-_-_-_-""  ""
 
 #pragma once
 #include "OGLRenderer.h"
+#include <map>
+#include <unordered_map>
 
 enum ShaderStage {
 	SHADER_VERTEX,
@@ -26,12 +28,24 @@ enum ShaderStage {
 	SHADER_MAX
 };
 
+struct ShaderUniformStats {
+	size_t lookups	= 0;	//uniform names turned into IDs
+	size_t uploads	= 0;	//glUniform calls made by the setters
+	size_t skipped	= 0;	//setter calls that didn't need to make one
+};
+
+class ProgramBinaryCache;
+
 class Shader	{
 public:
 	Shader(const std::string& vertex, const std::string& fragment, const std::string& geometry = "", const std::string& domain = "", const std::string& hull = "");
 	~Shader(void);
 
 	GLuint  GetProgram() { return programID;}
+
+	//The same files compiled with extra #defines ("NAME" or "NAME=VALUE"), built
+	//the first time they're asked for. Variants belong to this Shader
+	Shader*	GetVariant(const std::vector<std::string>& defines);
 	
 	void	Reload(bool deleteOld = true);
 
@@ -40,16 +54,48 @@ public:
 	}
 
 	static void ReloadAllShaders();
+
+	//Linked programs get saved to, and loaded from, this directory. Empty
+	//turns the cache off, which is the default
+	static void	SetBinaryCacheDirectory(const std::string& directory);
+
+	//Uniform names get turned into IDs once, up front - an ID works with any Shader.
+	//Each Shader finds the locations of all its active uniforms when it links
+	static int	GetUniformID(const std::string& name);
+	GLint		GetUniformLocation(int id) const;
+
+	//Typed setters. The shader has to be bound, as with glUniform
+	void	SetUniform(int id, int value);
+	void	SetUniform(int id, float value);
+	void	SetUniform(int id, const Vector2& value);
+	void	SetUniform(int id, const Vector3& value);
+	void	SetUniform(int id, const Vector4& value);
+	void	SetUniform(int id, const Matrix4& value);
+	//Arrays are always uploaded
+	void	SetUniformArray(int id, const Matrix4* values, int count);
+
+	//If set, the setters don't upload values a uniform already has. Only safe if
+	//nothing sets those same uniforms with glUniform directly!
+	static void	SetSkipRedundantUploads(bool state) { skipRedundantUploads = state; }
+
+	static const ShaderUniformStats&	GetUniformStats()	{ return uniformStats; }
+	static void							ResetUniformStats() { uniformStats = ShaderUniformStats(); }
 	static void	PrintCompileLog(GLuint object);
 	static void	PrintLinkLog(GLuint program);
 
 protected:
+	Shader(const std::string* files, const std::vector<std::string>& defines);
+
 	void	DeleteIDs();
 
 	bool	LoadShaderFile(const  std::string& from, std::string &into);
-	void	GenerateShaderObject(unsigned int i);
+	void	GenerateShaderObject(unsigned int i, const std::string& shaderText);
 	void	SetDefaultAttributes();
 	void	LinkProgram();
+	void	ReflectUniforms();
+
+	//Returns false if the upload can be skipped
+	bool	PrepareUpload(int id, const void* value, size_t size, GLint& location);
 
 	GLuint	programID;
 	GLuint	objectIDs[SHADER_MAX];
@@ -57,7 +103,23 @@ protected:
 	GLint	shaderValid[SHADER_MAX];
 
 	std::string  shaderFiles[SHADER_MAX];
+	std::vector<std::string>		defines;
+	std::map<std::string, Shader*>	variants;
+
+	struct Uniform {
+		GLint	location;
+		bool	hasValue;
+		float	value[16];	//last value uploaded, big enough for a Matrix4
+	};
+	std::vector<Uniform>	uniforms;
+	std::vector<int>		uniformForID;	//index into uniforms, or -1
 
 	static std::vector<Shader*> allShaders;
+	static ProgramBinaryCache*	binaryCache;
+
+	//Function static, so IDs can be made during static initialisation
+	static std::unordered_map<std::string, int>& GetUniformIDTable();
+	static bool									skipRedundantUploads;
+	static ShaderUniformStats					uniformStats;
 };
 
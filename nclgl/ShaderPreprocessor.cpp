@@ -0,0 +1,171 @@
+#include "ShaderPreprocessor.h"
+#include "common.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+using std::string;
+using std::vector;
+
+namespace {
+	struct FileCache {
+		std::mutex											lock;
+		std::unordered_map<string, std::unique_ptr<string>>	files;
+	};
+
+	FileCache& GetFileCache() {
+		static FileCache cache;
+		return cache;
+	}
+
+	bool StartsWithDirective(const string& line, size_t start, const char* directive) {
+		size_t length = strlen(directive);
+		return line.compare(start, length, directive) == 0 &&
+			(start + length == line.size() || isspace((unsigned char)line[start + length]));
+	}
+
+	bool HasVersionLine(const string& source) {
+		size_t pos = 0;
+		while (pos < source.size()) {
+			size_t start = source.find_first_not_of(" \t", pos);
+			if (start != string::npos && source.compare(start, 8, "#version") == 0) {
+				return true;
+			}
+			pos = source.find('\n', pos);
+			pos = pos == string::npos ? pos : pos + 1;
+		}
+		return false;
+	}
+
+	string LineDirective(int line, size_t file) {
+		return "#line " + std::to_string(line) + " " + std::to_string(file) + "\n";
+	}
+}
+
+const string* ShaderPreprocessor::ReadFile(const string& filename) {
+	FileCache& cache = GetFileCache();
+	std::lock_guard<std::mutex> guard(cache.lock);
+
+	auto found = cache.files.find(filename);
+	if (found != cache.files.end()) {
+		return found->second.get();
+	}
+	std::ifstream file(SHADERDIR + filename, std::ios::binary | std::ios::ate);
+	if (!file.is_open()) {
+		return nullptr;
+	}
+	std::unique_ptr<string> contents(new string((size_t)file.tellg(), '\0'));
+	file.seekg(0);
+	file.read(&(*contents)[0], contents->size());
+	if (!file) {
+		return nullptr;
+	}
+	//line ends get handled the same either way, but stray \r's upset some compilers
+	contents->erase(std::remove(contents->begin(), contents->end(), '\r'), contents->end());
+
+	const string* result = contents.get();
+	cache.files.emplace(filename, std::move(contents));
+	return result;
+}
+
+void ShaderPreprocessor::ClearFileCache() {
+	FileCache& cache = GetFileCache();
+	std::lock_guard<std::mutex> guard(cache.lock);
+	cache.files.clear();
+}
+
+string ShaderPreprocessor::MakeDefineBlock(const vector<string>& defines) {
+	string block;
+	for (const string& d : defines) {
+		size_t equals = d.find('=');
+		block += "#define ";
+		if (equals == string::npos) {
+			block += d;
+		}
+		else {
+			block += d.substr(0, equals) + " " + d.substr(equals + 1);
+		}
+		block += "\n";
+	}
+	return block;
+}
+
+bool ShaderPreprocessor::Process(const string& filename, const vector<string>& defines, string& into, vector<string>* files) {
+	vector<string>	usedFiles;
+	string			defineBlock = MakeDefineBlock(defines);
+
+	into.clear();
+	bool success = Append(filename, &defineBlock, usedFiles, into);
+	if (files) {
+		*files = usedFiles;
+	}
+	return success;
+}
+
+bool ShaderPreprocessor::Append(const string& filename, const string* defineBlock, vector<string>& files, string& into) {
+	const string* source = ReadFile(filename);
+	if (!source) {
+		std::cout << "ShaderPreprocessor: Can't open " << filename << "\n";
+		return false;
+	}
+	size_t fileIndex = files.size();
+	files.emplace_back(filename);
+	into.reserve(into.size() + source->size());
+
+	bool injected = defineBlock == nullptr || defineBlock->empty();
+	if (!injected && !HasVersionLine(*source)) {
+		into += *defineBlock;	//no #version line - put the defines at the very top
+		into += LineDirective(1, fileIndex);
+		injected = true;
+	}
+
+	int		lineNum	= 1;
+	size_t	pos		= 0;
+	string	line;
+	while (pos < source->size()) {
+		size_t end = source->find('\n', pos);
+		if (end == string::npos) {
+			end = source->size();
+		}
+		line.assign(*source, pos, end - pos);
+		pos = end + 1;
+
+		size_t start = line.find_first_not_of(" \t");
+		if (start != string::npos && StartsWithDirective(line, start, "#version")) {
+			into += line + "\n";
+			if (!injected) {
+				into += *defineBlock;
+				into += LineDirective(lineNum + 1, fileIndex);
+				injected = true;
+			}
+		}
+		else if (start != string::npos && StartsWithDirective(line, start, "#include")) {
+			size_t open		= line.find('"', start);
+			size_t close	= open == string::npos ? string::npos : line.find('"', open + 1);
+			if (close == string::npos) {
+				std::cout << "ShaderPreprocessor: Bad #include in " << filename << " (" << lineNum << ")\n";
+				return false;
+			}
+			string includeName = line.substr(open + 1, close - open - 1);
+			if (std::find(files.begin(), files.end(), includeName) == files.end()) {
+				into += LineDirective(1, files.size());
+				if (!Append(includeName, nullptr, files, into)) {
+					std::cout << "ShaderPreprocessor: ...included from " << filename << " (" << lineNum << ")\n";
+					return false;
+				}
+			}
+			into += LineDirective(lineNum + 1, fileIndex);
+		}
+		else {
+			into += line + "\n";
+		}
+		++lineNum;
+	}
+	return true;
+}
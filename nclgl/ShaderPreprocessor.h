@@ -0,0 +1,37 @@
+#pragma once
+/*
+Class:ShaderPreprocessor
+Description:Turns a shader file into the source string handed to GL. Files are
+read in one go and kept in a shared in-memory cache, so a file included by
+several shaders (or several variants of one shader) is only read once.
+
+Two things are handled before GL sees the source:
+	#include "File.glsl"	- pastes in File.glsl from SHADERDIR, once per
+							  source string, whatever #ifdefs surround it
+	defines					- "NAME" or "NAME=VALUE" strings, added as #defines
+							  straight after the #version line
+
+#line directives are added around anything inserted, using each file's index
+in the include order as the source string number, so compile errors still
+point at the right line of the right file.
+*/
+#include <string>
+#include <vector>
+
+class ShaderPreprocessor {
+public:
+	//files, if given, gets the name of every file used, in include order
+	static bool	Process(const std::string& filename, const std::vector<std::string>& defines,
+						std::string& into, std::vector<std::string>* files = nullptr);
+
+	//Contents of a file in SHADERDIR, or nullptr if it can't be read. The
+	//pointer stays valid until the cache is cleared
+	static const std::string*	ReadFile(const std::string& filename);
+	//Call when files might have changed on disk, and not while loading
+	static void					ClearFileCache();
+
+protected:
+	static bool	Append(const std::string& filename, const std::string* defineBlock,
+						std::vector<std::string>& files, std::string& into);
+	static std::string	MakeDefineBlock(const std::vector<std::string>& defines);
+};
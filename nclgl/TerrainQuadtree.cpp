@@ -0,0 +1,873 @@
+#include "TerrainQuadtree.h"
+#include "HeightMap.h"
+#include "Frustrum.h"
+#include "GLStateCache.h"
+#include "JobSystem.h"
+#include "Mesh.h"
+#include "Shader.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cstddef>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+
+static const int TERRAIN_GRID	= Shader::GetUniformID("terrainGrid");
+static const int TERRAIN_SCALE	= Shader::GetUniformID("terrainScale");
+static const int TERRAIN_PATCH	= Shader::GetUniformID("terrainPatch");
+
+namespace {
+	//GL_INT_2_10_10_10_REV, normalised
+	uint32_t PackNormal(const Vector3& n) {
+		auto pack = [](float v) { return (uint32_t)(int)lroundf(std::min(std::max(v, -1.0f), 1.0f) * 511.0f) & 0x3FF; };
+		return pack(n.x) | (pack(n.y) << 10) | (pack(n.z) << 20);
+	}
+}
+
+TerrainQuadtree::TerrainQuadtree(const std::vector<float>& heights, int width, int depth, const Vector3& vertexScale,
+	const Vector2& textureScale, int patchSize, JobSystem* jobs) :
+	heights(heights), width(width), depth(depth), vertexScale(vertexScale), textureScale(textureScale),
+	patchSize(patchSize), depthCount(0), cellsX(0), cellsZ(0), indexBuffer(0), indexType(GL_UNSIGNED_INT),
+	memoryBudget(DEFAULT_MEMORY_BUDGET), frame(0), streamJobs(nullptr) {
+	Build(jobs);
+}
+
+TerrainQuadtree::TerrainQuadtree(const HeightMap& map, int patchSize, JobSystem* jobs) :
+	TerrainQuadtree(map.GetHeights(), map.GetWidth(), map.GetDepth(), map.GetVertexScale(), map.GetTextureScale(), patchSize, jobs) {
+}
+
+/*
+Streaming. Only the header and node table are read up front - they're all the
+selection needs. The tiles stay in the mapped file until they're asked for.
+*/
+TerrainQuadtree::TerrainQuadtree(const std::string& tileFile, JobSystem& jobs) :
+	width(0), depth(0), patchSize(0), depthCount(0), cellsX(0), cellsZ(0), indexBuffer(0), indexType(GL_UNSIGNED_INT),
+	memoryBudget(DEFAULT_MEMORY_BUDGET), frame(0), streamJobs(&jobs) {
+	if (!tiles.Open(tileFile) || tiles.GetSize() < sizeof(TerrainTileHeader)) {
+		std::cout << "TerrainQuadtree: Can't open tile file " << tileFile << "\n";
+		tiles.Close();
+		return;
+	}
+	TerrainTileHeader header;
+	memcpy(&header, tiles.GetData(), sizeof(header));
+	size_t tableEnd = sizeof(header) + (size_t)header.numNodes * sizeof(TerrainTileNode);
+	if (memcmp(header.magic, TERRAIN_TILE_MAGIC, sizeof(header.magic)) != 0 || header.version != TERRAIN_TILE_VERSION ||
+		header.numNodes == 0 || header.patchSize < 2 || header.patchSize > 4096 || header.width < 2 || header.depth < 2 ||
+		header.width > (1u << 30) || header.depth > (1u << 30) || tableEnd > tiles.GetSize()) {
+		std::cout << "TerrainQuadtree: " << tileFile << " isn't a tile file of this version\n";
+		tiles.Close();
+		return;
+	}
+	width			= (int)header.width;
+	depth			= (int)header.depth;
+	patchSize		= (int)header.patchSize;
+	vertexScale		= Vector3(header.vertexScale[0], header.vertexScale[1], header.vertexScale[2]);
+	textureScale	= Vector2(header.textureScale[0], header.textureScale[1]);
+	cellsX			= (width - 2) / patchSize + 1;
+	cellsZ			= (depth - 2) / patchSize + 1;
+
+	size_t tileSize = (size_t)(patchSize + 3) * (patchSize + 3) * sizeof(float);
+	std::vector<TerrainTileNode> table(header.numNodes);
+	memcpy(table.data(), tiles.GetData() + sizeof(header), table.size() * sizeof(TerrainTileNode));
+	//The node table decides how deep SelectNode goes, so it's checked as closely
+	//as the tiles are - WriteTiles puts children after their parents, which
+	//also means there's no way round back to a node already visited
+	for (size_t i = 0; i < table.size(); ++i) {
+		const TerrainTileNode& t = table[i];
+		bool badNode = t.depth >= 31 || t.x >= header.width || t.z >= header.depth;
+		for (int c = 0; c < 4; ++c) {
+			badNode = badNode || (t.children[c] >= 0 && ((size_t)t.children[c] <= i || (size_t)t.children[c] >= table.size()));
+		}
+		if (badNode) {
+			std::cout << "TerrainQuadtree: Tile file " << tileFile << " has a bad node table\n";
+			tiles.Close();
+			return;
+		}
+		depthCount = std::max(depthCount, (int)t.depth + 1);
+	}
+	nodes.resize(table.size());
+	for (size_t i = 0; i < table.size(); ++i) {
+		const TerrainTileNode& t = table[i];
+		Node& n = nodes[i];
+		if (t.offset > tiles.GetSize() || tileSize > tiles.GetSize() - t.offset || (t.offset & 3)) {
+			std::cout << "TerrainQuadtree: Tile file " << tileFile << " is truncated\n";
+			nodes.clear();
+			tiles.Close();
+			return;
+		}
+		n.x			= (int)t.x;
+		n.z			= (int)t.z;
+		n.depth		= (int)t.depth;
+		n.step		= 1 << (depthCount - 1 - n.depth);
+		n.parent	= -1;
+		n.minHeight = t.minHeight;
+		n.maxHeight = t.maxHeight;
+		n.error		= t.error;
+		n.tileOffset	= t.offset;
+		n.edges			= 0;
+		n.arrayObject	= 0;
+		n.vertexBuffer	= 0;
+		n.lastUsed		= -1;
+		n.loading		= false;
+		for (int c = 0; c < 4; ++c) {
+			n.children[c] = t.children[c] >= 0 ? t.children[c] : -1;
+		}
+	}
+	for (int i = 0; i < (int)nodes.size(); ++i) {
+		for (int child : nodes[i].children) {
+			if (child >= 0) {
+				nodes[child].parent = i;
+			}
+		}
+	}
+	BuildIndices();
+}
+
+TerrainQuadtree::~TerrainQuadtree() {
+	if (streamJobs) {
+		streamJobs->Wait(loadGroup);
+	}
+	for (int i : resident) {
+		FreePatch(nodes[i]);
+	}
+	if (indexBuffer) {
+		glDeleteBuffers(1, &indexBuffer);
+	}
+}
+
+/*
+Building the tree only works out each node's bounds and error - no vertices
+are made until a patch is drawn. Errors go from the leaves up, as a node's
+error includes its children's, but every node at one depth can be measured
+at the same time.
+*/
+void TerrainQuadtree::Build(JobSystem* jobs) {
+	if (width < 2 || depth < 2 || (int)heights.size() < width * depth) {
+		return;
+	}
+	cellsX		= (width - 2) / patchSize + 1;
+	cellsZ		= (depth - 2) / patchSize + 1;
+	depthCount	= 1;
+	while ((patchSize << (depthCount - 1)) < std::max(width - 1, depth - 1)) {
+		++depthCount;
+	}
+	AddNode(0, 0, 0, -1);
+
+	std::vector<std::vector<int>> byDepth(depthCount);
+	for (int i = 0; i < (int)nodes.size(); ++i) {
+		byDepth[nodes[i].depth].push_back(i);
+	}
+	for (int d = depthCount - 1; d >= 0; --d) {
+		const std::vector<int>& level = byDepth[d];
+		if (!jobs || jobs->GetThreadCount() == 1 || level.size() < 2) {
+			for (int i : level) {
+				MeasureNode(nodes[i]);
+			}
+			continue;
+		}
+		int		bands = std::min((int)jobs->GetThreadCount() * 4, (int)level.size());
+		JobGroup group;
+		for (int b = 0; b < bands; ++b) {
+			size_t first	= level.size() * b / bands;
+			size_t last		= level.size() * (b + 1) / bands;
+			jobs->Run(group, [this, &level, first, last]() {
+				for (size_t i = first; i < last; ++i) {
+					MeasureNode(nodes[level[i]]);
+				}
+			});
+		}
+		jobs->Wait(group);
+	}
+	BuildIndices();
+}
+
+int TerrainQuadtree::AddNode(int x, int z, int d, int parent) {
+	Node n;
+	n.x			= x;
+	n.z			= z;
+	n.depth		= d;
+	n.step		= 1 << (depthCount - 1 - d);
+	n.parent	= parent;
+	n.minHeight = 0.0f;
+	n.maxHeight = 0.0f;
+	n.error		= 0.0f;
+	n.edges		= 0;
+	n.arrayObject	= 0;
+	n.vertexBuffer	= 0;
+	n.lastUsed		= -1;
+	n.loading		= false;
+	n.tileOffset	= 0;
+	std::fill(n.children, n.children + 4, -1);
+
+	int index = (int)nodes.size();
+	nodes.push_back(n);
+	if (d == depthCount - 1) {
+		return index;
+	}
+	int half = patchSize * n.step / 2;
+	for (int i = 0; i < 4; ++i) {
+		int cx = x + (i & 1) * half;
+		int cz = z + (i >> 1) * half;
+		if (cx < width - 1 && cz < depth - 1) {
+			int child = AddNode(cx, cz, d + 1, index);
+			nodes[index].children[i] = child;
+		}
+	}
+	return index;
+}
+
+float TerrainQuadtree::GetHeight(int x, int z) const {
+	x = std::min(std::max(x, 0), width - 1);
+	z = std::min(std::max(z, 0), depth - 1);
+	return heights[(size_t)z * width + x] * vertexScale.y;
+}
+
+bool TerrainQuadtree::IsPartial(const Node& n) const {
+	return n.x + patchSize * n.step > width - 1 || n.z + patchSize * n.step > depth - 1;
+}
+
+//Height of the node's own surface over sample (x, z) - quads are split from
+//their low corner to their high one, as HeightMap splits them
+float TerrainQuadtree::InterpolateHeight(const Node& n, int x, int z) const {
+	int qx = std::min((x - n.x) / n.step, patchSize - 1);
+	int qz = std::min((z - n.z) / n.step, patchSize - 1);
+	float fx = (x - n.x - qx * n.step) / (float)n.step;
+	float fz = (z - n.z - qz * n.step) / (float)n.step;
+
+	int x0 = n.x + qx * n.step;
+	int z0 = n.z + qz * n.step;
+	float a = GetHeight(x0,				z0);
+	float b = GetHeight(x0 + n.step,	z0);
+	float c = GetHeight(x0 + n.step,	z0 + n.step);
+	float d = GetHeight(x0,				z0 + n.step);
+	if (fx >= fz) {
+		return a + fx * (b - a) + fz * (c - b);
+	}
+	return a + fz * (d - a) + fx * (c - d);
+}
+
+void TerrainQuadtree::MeasureNode(Node& n) const {
+	int size = patchSize * n.step;
+	bool hasChildren = false;
+	n.minHeight = FLT_MAX;
+	n.maxHeight = -FLT_MAX;
+	float childError = 0.0f;
+	for (int child : n.children) {
+		if (child >= 0) {
+			const Node& c = nodes[child];
+			n.minHeight = std::min(n.minHeight, c.minHeight);
+			n.maxHeight = std::max(n.maxHeight, c.maxHeight);
+			childError	= std::max(childError, c.error);
+			hasChildren = true;
+		}
+	}
+	if (!hasChildren) {
+		for (int z = n.z; z <= std::min(n.z + size, depth - 1); ++z) {
+			for (int x = n.x; x <= std::min(n.x + size, width - 1); ++x) {
+				float h = GetHeight(x, z);
+				n.minHeight = std::min(n.minHeight, h);
+				n.maxHeight = std::max(n.maxHeight, h);
+			}
+		}
+		n.error = 0.0f;
+		return;
+	}
+	//Partly filled nodes would need their own geometry to measure properly, so
+	//they just never stand in for their children
+	if (IsPartial(n)) {
+		n.error = FLT_MAX;
+		return;
+	}
+	//Only the samples the children have and this node doesn't can differ
+	int half = n.step / 2;
+	float furthest = 0.0f;
+	for (int z = n.z; z <= n.z + size; z += half) {
+		bool oddRow = ((z - n.z) / half) & 1;
+		for (int x = n.x + (oddRow ? 0 : half); x <= n.x + size; x += oddRow ? half : n.step) {
+			furthest = std::max(furthest, std::fabs(GetHeight(x, z) - InterpolateHeight(n, x, z)));
+		}
+	}
+	n.error = furthest + childError;
+}
+
+/*
+LOD selection. A node's error, seen from distance d, covers about
+error * pixelsPerUnit / d pixels of the screen - too many and it's swapped
+for its children.
+*/
+void TerrainQuadtree::SelectLOD(const Vector3& cameraPos, float fov, int viewportHeight, float maxPixelError) {
+	++frame;
+	selected.clear();
+	if (nodes.empty()) {
+		return;
+	}
+	if (IsStreaming()) {
+		ReceiveTiles();
+		//Everything else can fall back on the root, so it's read here and now
+		if (!nodes[0].arrayObject) {
+			std::vector<PatchVertex> vertices;
+			MakeVertices(nodes[0], (const float*)(tiles.GetData() + nodes[0].tileOffset), vertices);
+			UploadPatch(nodes[0], vertices);
+		}
+	}
+	float pixelsPerUnit = viewportHeight / (2.0f * tanf(fov * 0.5f * 3.14159265f / 180.0f));
+	SelectNode(0, cameraPos, pixelsPerUnit, maxPixelError);
+	BalanceSelection();
+	FindStitching();
+	if (IsStreaming()) {
+		RequestTiles(cameraPos);
+	}
+
+	stats.selectedPatches	= (int)selected.size();
+	stats.pendingLoads		= (int)loads.size();
+	stats.selectedTriangles = 0;
+	for (int i : selected) {
+		stats.selectedTriangles += GetVariantTriangles(nodes[i].edges);
+	}
+}
+
+bool TerrainQuadtree::NeedsSplit(const Node& n, const Vector3& cameraPos, float pixelsPerUnit, float maxPixelError) const {
+	if (n.children[0] < 0) {
+		return false;
+	}
+	if (n.error == FLT_MAX) {
+		return true;
+	}
+	return n.error * pixelsPerUnit > maxPixelError * GetDistance(n, cameraPos);
+}
+
+//To the node's box
+float TerrainQuadtree::GetDistance(const Node& n, const Vector3& cameraPos) const {
+	int size = patchSize * n.step;
+	float minX = n.x * vertexScale.x;
+	float maxX = std::min(n.x + size, width - 1) * vertexScale.x;
+	float minZ = n.z * vertexScale.z;
+	float maxZ = std::min(n.z + size, depth - 1) * vertexScale.z;
+	float dx = std::max(std::max(minX - cameraPos.x, cameraPos.x - maxX), 0.0f);
+	float dy = std::max(std::max(n.minHeight - cameraPos.y, cameraPos.y - n.maxHeight), 0.0f);
+	float dz = std::max(std::max(minZ - cameraPos.z, cameraPos.z - maxZ), 0.0f);
+	return std::max(sqrtf(dx * dx + dy * dy + dz * dz), 0.0001f);
+}
+
+//Streamed nodes are only split once all their children are resident - until
+//then the node stands in for them, and is put on the wanted list
+void TerrainQuadtree::SelectNode(int node, const Vector3& cameraPos, float pixelsPerUnit, float maxPixelError) {
+	Node& n = nodes[node];
+	n.lastUsed = frame;
+	if (NeedsSplit(n, cameraPos, pixelsPerUnit, maxPixelError)) {
+		bool ready = true;
+		for (int child : n.children) {
+			if (child < 0) {
+				continue;
+			}
+			nodes[child].lastUsed = frame;	//so the ones already in aren't evicted to make room for the rest
+			ready = ready && IsAvailable(nodes[child]);
+		}
+		if (!ready) {
+			wanted.push_back(node);
+		}
+		else {
+			for (int child : n.children) {
+				if (child >= 0) {
+					SelectNode(child, cameraPos, pixelsPerUnit, maxPixelError);
+				}
+			}
+			return;
+		}
+	}
+	selected.push_back(node);
+}
+
+void TerrainQuadtree::MarkCells(int node) {
+	const Node& n = nodes[node];
+	int cx0 = n.x / patchSize;
+	int cz0 = n.z / patchSize;
+	for (int cz = cz0; cz < std::min(cz0 + n.step, cellsZ); ++cz) {
+		for (int cx = cx0; cx < std::min(cx0 + n.step, cellsX); ++cx) {
+			cellNodes[cz * cellsX + cx] = node;
+		}
+	}
+}
+
+/*
+Stitching can only close a gap of one level, so any selected node with a
+neighbour more than one level coarser has to be fixed - by splitting that
+neighbour when all the heights are in memory, or by falling back to the finer
+node's parent when streaming (whose tiles are always resident), while the
+neighbour's children are asked for. Either can push the problem further out,
+so it goes round until nothing changes. Splitting only ever makes nodes finer
+and falling back only coarser, so it always gets there.
+*/
+void TerrainQuadtree::BalanceSelection() {
+	cellNodes.assign((size_t)cellsX * cellsZ, -1);
+	std::vector<int> split;
+	std::vector<int> tooFine;
+	while (true) {
+		for (int i : selected) {
+			MarkCells(i);
+		}
+		split.clear();
+		tooFine.clear();
+		for (int i : selected) {
+			const Node& n = nodes[i];
+			int cx0 = n.x / patchSize;
+			int cz0 = n.z / patchSize;
+			int cx1 = std::min(cx0 + n.step, cellsX);
+			int cz1 = std::min(cz0 + n.step, cellsZ);
+			auto check = [&](int cx, int cz) {
+				int neighbour = cellNodes[cz * cellsX + cx];
+				if (neighbour < 0 || nodes[neighbour].depth >= n.depth - 1) {
+					return;
+				}
+				if (!IsStreaming()) {
+					split.push_back(neighbour);
+					return;
+				}
+				tooFine.push_back(i);
+				wanted.push_back(neighbour);
+			};
+			for (int cz = cz0; cz < cz1; ++cz) {
+				if (cx0 > 0)		check(cx0 - 1, cz);
+				if (cx1 < cellsX)	check(cx1, cz);
+			}
+			for (int cx = cx0; cx < cx1; ++cx) {
+				if (cz0 > 0)		check(cx, cz0 - 1);
+				if (cz1 < cellsZ)	check(cx, cz1);
+			}
+		}
+		if (!tooFine.empty()) {
+			Coarsen(tooFine);
+			continue;
+		}
+		if (split.empty()) {
+			return;
+		}
+		std::sort(split.begin(), split.end());
+		split.erase(std::unique(split.begin(), split.end()), split.end());
+
+		selected.erase(std::remove_if(selected.begin(), selected.end(),
+			[&](int i) { return std::binary_search(split.begin(), split.end(), i); }), selected.end());
+		for (int i : split) {
+			for (int child : nodes[i].children) {
+				if (child >= 0) {
+					selected.push_back(child);
+				}
+			}
+		}
+	}
+}
+
+//Swaps each of tooFine's parents in for everything selected below it
+void TerrainQuadtree::Coarsen(const std::vector<int>& tooFine) {
+	std::vector<int> parents;
+	for (int i : tooFine) {
+		parents.push_back(nodes[i].parent);
+	}
+	std::sort(parents.begin(), parents.end());
+	parents.erase(std::unique(parents.begin(), parents.end()), parents.end());
+
+	auto belowParent = [&](int i) {
+		for (int p = nodes[i].parent; p >= 0; p = nodes[p].parent) {
+			if (std::binary_search(parents.begin(), parents.end(), p)) {
+				return true;
+			}
+		}
+		return false;
+	};
+	selected.erase(std::remove_if(selected.begin(), selected.end(), belowParent), selected.end());
+	for (int p : parents) {
+		if (!belowParent(p)) {
+			selected.push_back(p);
+		}
+	}
+}
+
+//After balancing, a coarser neighbour is exactly one level up and covers the
+//whole of the shared edge, so one cell across it is enough to look at
+void TerrainQuadtree::FindStitching() {
+	for (int i : selected) {
+		Node& n = nodes[i];
+		int cx0 = n.x / patchSize;
+		int cz0 = n.z / patchSize;
+		int cx1 = cx0 + n.step;
+		int cz1 = cz0 + n.step;
+		auto coarser = [&](int cx, int cz) {
+			int neighbour = cellNodes[cz * cellsX + cx];
+			return neighbour >= 0 && nodes[neighbour].depth < n.depth;
+		};
+		n.edges = 0;
+		if (cx0 > 0			&& coarser(cx0 - 1, cz0))	n.edges |= EDGE_LOW_X;
+		if (cx1 < cellsX	&& coarser(cx1, cz0))		n.edges |= EDGE_HIGH_X;
+		if (cz0 > 0			&& coarser(cx0, cz0 - 1))	n.edges |= EDGE_LOW_Z;
+		if (cz1 < cellsZ	&& coarser(cx0, cz1))		n.edges |= EDGE_HIGH_Z;
+	}
+}
+
+/*
+Every patch has the same grid of vertices, so the 16 ways of stitching it can
+be shared. A stitched edge has each of its odd vertices moved onto the even
+one before it, which gives the edge the same segments as the coarser patch
+next to it - the triangles that collapse are left out.
+*/
+//Patches with no more than 65536 vertices get 16 bit indices
+void TerrainQuadtree::BuildIndices() {
+	int row = patchSize + 1;
+	indexType = row * row <= 65536 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+	for (int edges = 0; edges < 16; ++edges) {
+		auto vertex = [&](int x, int z) {
+			if ((edges & EDGE_LOW_X)	&& x == 0			&& (z & 1)) --z;
+			if ((edges & EDGE_HIGH_X)	&& x == patchSize	&& (z & 1)) --z;
+			if ((edges & EDGE_LOW_Z)	&& z == 0			&& (x & 1)) --x;
+			if ((edges & EDGE_HIGH_Z)	&& z == patchSize	&& (x & 1)) --x;
+			return (GLuint)(z * row + x);
+		};
+		auto triangle = [&](GLuint a, GLuint b, GLuint c) {
+			if (a != b && b != c && a != c) {
+				variantIndices.push_back(a);
+				variantIndices.push_back(b);
+				variantIndices.push_back(c);
+			}
+		};
+		variants[edges].first = (int)variantIndices.size();
+		for (int z = 0; z < patchSize; ++z) {
+			for (int x = 0; x < patchSize; ++x) {
+				GLuint a = vertex(x,		z);
+				GLuint b = vertex(x + 1,	z);
+				GLuint c = vertex(x + 1,	z + 1);
+				GLuint d = vertex(x,		z + 1);
+				triangle(a, c, b);
+				triangle(c, a, d);
+			}
+		}
+		variants[edges].count = (int)variantIndices.size() - variants[edges].first;
+	}
+}
+
+/*
+Drawing. A patch's vertices come from a tile of the heights at its own spacing
+- taken from memory, or read from the tile file on a job. Normals come from
+the heights either side, so distant patches aren't lit by bumps they can't
+show. Vertices only keep their height and normal - everything else follows
+from where they are on the grid, which the vertex shader works out.
+*/
+size_t TerrainQuadtree::GetPatchBytes() const {
+	return (size_t)(patchSize + 1) * (patchSize + 1) * sizeof(PatchVertex);
+}
+
+void TerrainQuadtree::ExtractTile(const Node& n, float* tile) const {
+	for (int j = -1; j <= patchSize + 1; ++j) {
+		for (int i = -1; i <= patchSize + 1; ++i) {
+			*tile++ = GetHeight(n.x + i * n.step, n.z + j * n.step);
+		}
+	}
+}
+
+void TerrainQuadtree::MakeVertices(const Node& n, const float* tile, std::vector<PatchVertex>& vertices) const {
+	int tileRow = patchSize + 3;
+	auto clampX = [&](int i) { return std::min(std::max(n.x + i * n.step, 0), width - 1); };
+	auto clampZ = [&](int j) { return std::min(std::max(n.z + j * n.step, 0), depth - 1); };
+
+	vertices.resize((size_t)(patchSize + 1) * (patchSize + 1));
+	PatchVertex* v = vertices.data();
+	for (int j = 0; j <= patchSize; ++j) {
+		const float* row = tile + (j + 1) * tileRow + 1;
+		for (int i = 0; i <= patchSize; ++i) {
+			int across	= std::max(clampX(i + 1) - clampX(i - 1), 1);
+			int along	= std::max(clampZ(j + 1) - clampZ(j - 1), 1);
+			float dx = (row[i + 1] - row[i - 1]) / (across * vertexScale.x);
+			float dz = (row[i + tileRow] - row[i - tileRow]) / (along * vertexScale.z);
+
+			v->height = row[i];
+			v->normal = PackNormal(Vector3(-dx, 1.0f, -dz).Normalised());
+			++v;
+		}
+	}
+}
+
+void TerrainQuadtree::UploadPatch(Node& n, const std::vector<PatchVertex>& vertices) {
+	//The patch's VAO has to be bound before the index buffer is - with redundant
+	//calls skipped, whatever VAO was last drawn may still be bound, and would
+	//have its own index buffer swapped for this one
+	glGenVertexArrays(1, &n.arrayObject);
+	GLStateCache::GetShared().BindVertexArray(n.arrayObject);
+
+	if (!indexBuffer) {
+		glGenBuffers(1, &indexBuffer);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+		if (indexType == GL_UNSIGNED_SHORT) {
+			std::vector<GLushort> shortIndices(variantIndices.begin(), variantIndices.end());
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, shortIndices.size() * sizeof(GLushort), shortIndices.data(), GL_STATIC_DRAW);
+		}
+		else {
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, variantIndices.size() * sizeof(GLuint), variantIndices.data(), GL_STATIC_DRAW);
+		}
+		glObjectLabel(GL_BUFFER, indexBuffer, -1, "Terrain Indices");
+	}
+
+	glGenBuffers(1, &n.vertexBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, n.vertexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(PatchVertex), vertices.data(), GL_STATIC_DRAW);
+
+	const GLsizei stride = sizeof(PatchVertex);
+	glVertexAttribPointer(VERTEX_BUFFER, 1, GL_FLOAT,				GL_FALSE, stride, (const GLvoid*)offsetof(PatchVertex, height));
+	glVertexAttribPointer(NORMAL_BUFFER, 4, GL_INT_2_10_10_10_REV,	GL_TRUE,  stride, (const GLvoid*)offsetof(PatchVertex, normal));
+	glEnableVertexAttribArray(VERTEX_BUFFER);
+	glEnableVertexAttribArray(NORMAL_BUFFER);
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+	GLStateCache::GetShared().BindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	n.lastUsed = frame;
+	resident.push_back((int)(&n - nodes.data()));
+	if (!n.loading) {
+		stats.residentBytes += GetPatchBytes();	//streamed tiles were counted when they were asked for
+	}
+	stats.patchesBuilt++;
+}
+
+void TerrainQuadtree::FreePatch(Node& n) {
+	GLStateCache::GetShared().ForgetVertexArray(n.arrayObject);
+	glDeleteVertexArrays(1, &n.arrayObject);
+	glDeleteBuffers(1, &n.vertexBuffer);
+	n.arrayObject	= 0;
+	n.vertexBuffer	= 0;
+	stats.residentBytes -= GetPatchBytes();
+}
+
+/*
+Tiles are asked for a whole set of children at a time, coarsest and nearest
+first, and only if they'll all fit in the budget once anything not used this
+frame has been thrown out - otherwise a tight budget gets spread over
+half-loaded families that can never be drawn.
+*/
+void TerrainQuadtree::RequestTiles(const Vector3& cameraPos) {
+	std::sort(wanted.begin(), wanted.end());
+	wanted.erase(std::unique(wanted.begin(), wanted.end()), wanted.end());
+	std::vector<float> distances(nodes.size());
+	for (int i : wanted) {
+		distances[i] = GetDistance(nodes[i], cameraPos);
+	}
+	std::sort(wanted.begin(), wanted.end(), [&](int a, int b) {
+		return nodes[a].depth != nodes[b].depth ? nodes[a].depth < nodes[b].depth : distances[a] < distances[b];
+	});
+
+	for (int i : wanted) {
+		int missing = 0;
+		for (int child : nodes[i].children) {
+			if (child >= 0 && !nodes[child].arrayObject && !nodes[child].loading) {
+				++missing;
+			}
+		}
+		if (missing == 0) {
+			continue;
+		}
+		size_t bytes = missing * GetPatchBytes();
+		if ((int)loads.size() + missing > MAX_PENDING_LOADS) {
+			break;
+		}
+		EvictPatches(bytes);
+		if (stats.residentBytes + bytes > memoryBudget) {
+			break;
+		}
+		for (int child : nodes[i].children) {
+			if (child >= 0 && !nodes[child].arrayObject && !nodes[child].loading) {
+				LoadTile(child);
+			}
+		}
+	}
+	wanted.clear();
+}
+
+void TerrainQuadtree::LoadTile(int node) {
+	Node& n = nodes[node];
+	n.loading = true;
+	stats.residentBytes += GetPatchBytes();
+
+	TileLoad* load = new TileLoad();
+	load->node = node;
+	load->done = false;
+	loads.emplace_back(load);
+	streamJobs->Run(loadGroup, [this, load]() {
+		const Node& n = nodes[load->node];
+		MakeVertices(n, (const float*)(tiles.GetData() + n.tileOffset), load->vertices);
+		load->done.store(true, std::memory_order_release);
+	});
+}
+
+void TerrainQuadtree::ReceiveTiles() {
+	for (size_t i = 0; i < loads.size(); ) {
+		TileLoad& load = *loads[i];
+		if (!load.done.load(std::memory_order_acquire)) {
+			++i;
+			continue;
+		}
+		Node& n = nodes[load.node];
+		UploadPatch(n, load.vertices);
+		n.loading = false;
+		loads[i].swap(loads.back());
+		loads.pop_back();
+	}
+}
+
+/*
+Patches used this frame are never evicted, so the budget can be overrun if
+the selection needs more than it allows. Streamed patches go children first
+(parents are used whenever their children are, so they're never older), and
+never while they have children resident or on the way.
+*/
+void TerrainQuadtree::EvictPatches(size_t wanted) {
+	if (stats.residentBytes + wanted <= memoryBudget) {
+		return;
+	}
+	std::sort(resident.begin(), resident.end(), [this](int a, int b) {
+		return nodes[a].lastUsed != nodes[b].lastUsed ? nodes[a].lastUsed < nodes[b].lastUsed : nodes[a].depth > nodes[b].depth;
+	});
+	auto hasChildren = [this](const Node& n) {
+		for (int child : n.children) {
+			if (child >= 0 && (nodes[child].arrayObject || nodes[child].loading)) {
+				return true;
+			}
+		}
+		return false;
+	};
+	size_t kept = 0;
+	for (size_t i = 0; i < resident.size(); ++i) {
+		Node& n = nodes[resident[i]];
+		bool evict = stats.residentBytes + wanted > memoryBudget && n.lastUsed != frame &&
+			!(IsStreaming() && (resident[i] == 0 || hasChildren(n)));
+		if (evict) {
+			FreePatch(n);
+		}
+		else {
+			resident[kept++] = resident[i];
+		}
+	}
+	resident.resize(kept);
+}
+
+void TerrainQuadtree::DrawNode(Node& n, Shader* shader) {
+	if (!n.arrayObject) {
+		if (IsStreaming()) {
+			return;
+		}
+		std::vector<float> tile((size_t)(patchSize + 3) * (patchSize + 3));
+		std::vector<PatchVertex> vertices;
+		ExtractTile(n, tile.data());
+		MakeVertices(n, tile.data(), vertices);
+		UploadPatch(n, vertices);
+	}
+	n.lastUsed = frame;
+
+	const Variant& v = variants[n.edges];
+	if (shader) {
+		shader->SetUniform(TERRAIN_PATCH, Vector3((float)n.x, (float)n.z, (float)n.step));
+	}
+	size_t indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+	GLStateCache::GetShared().BindVertexArray(n.arrayObject);
+	glDrawElements(GL_TRIANGLES, v.count, indexType, (const GLvoid*)(v.first * indexSize));
+	GLStateCache::GetShared().ReleaseVertexArray();
+
+	stats.drawnPatches++;
+	stats.drawnTriangles += v.count / 3;
+}
+
+void TerrainQuadtree::SetGridUniforms(Shader* shader) const {
+	if (shader) {
+		shader->SetUniform(TERRAIN_GRID, Vector3((float)(patchSize + 1), (float)(width - 1), (float)(depth - 1)));
+		shader->SetUniform(TERRAIN_SCALE, Vector4(vertexScale.x, vertexScale.z, textureScale.x, textureScale.y));
+	}
+}
+
+void TerrainQuadtree::GetBounds(const Node& n, Vector3& minCorner, Vector3& maxCorner) const {
+	int size = patchSize * n.step;
+	minCorner = Vector3(n.x * vertexScale.x, n.minHeight, n.z * vertexScale.z);
+	maxCorner = Vector3(std::min(n.x + size, width - 1) * vertexScale.x, n.maxHeight, std::min(n.z + size, depth - 1) * vertexScale.z);
+}
+
+void TerrainQuadtree::Draw(const Frustrum& frustum, Shader* shader) {
+	stats.drawnPatches		= 0;
+	stats.drawnTriangles	= 0;
+	SetGridUniforms(shader);
+	for (int i : selected) {
+		Node& n = nodes[i];
+		Vector3 minCorner, maxCorner;
+		GetBounds(n, minCorner, maxCorner);
+		if (frustum.BoxInFrustrum((minCorner + maxCorner) * 0.5f, (maxCorner - minCorner) * 0.5f)) {
+			DrawNode(n, shader);
+		}
+	}
+	EvictPatches(0);
+	stats.residentPatches = (int)resident.size();
+}
+
+void TerrainQuadtree::Draw(Shader* shader) {
+	stats.drawnPatches		= 0;
+	stats.drawnTriangles	= 0;
+	SetGridUniforms(shader);
+	for (int i : selected) {
+		DrawNode(nodes[i], shader);
+	}
+	EvictPatches(0);
+	stats.residentPatches = (int)resident.size();
+}
+
+static size_t AlignUp(size_t v) {
+	return (v + 15) & ~(size_t)15;
+}
+
+bool TerrainQuadtree::WriteTiles(const std::string& filename) const {
+	if (nodes.empty() || IsStreaming()) {
+		return false;
+	}
+	TerrainTileHeader header;
+	memcpy(header.magic, TERRAIN_TILE_MAGIC, sizeof(header.magic));
+	header.version			= TERRAIN_TILE_VERSION;
+	header.width			= (uint32_t)width;
+	header.depth			= (uint32_t)depth;
+	header.patchSize		= (uint32_t)patchSize;
+	header.numNodes			= (uint32_t)nodes.size();
+	header.vertexScale[0]	= vertexScale.x;
+	header.vertexScale[1]	= vertexScale.y;
+	header.vertexScale[2]	= vertexScale.z;
+	header.textureScale[0]	= textureScale.x;
+	header.textureScale[1]	= textureScale.y;
+	header.padding			= 0;
+
+	size_t tileSize = (size_t)(patchSize + 3) * (patchSize + 3) * sizeof(float);
+	size_t offset	= AlignUp(sizeof(header) + nodes.size() * sizeof(TerrainTileNode));
+	std::vector<TerrainTileNode> table(nodes.size());
+	for (size_t i = 0; i < nodes.size(); ++i) {
+		const Node& n = nodes[i];
+		TerrainTileNode& t = table[i];
+		t.x			= (uint32_t)n.x;
+		t.z			= (uint32_t)n.z;
+		t.depth		= (uint32_t)n.depth;
+		std::copy(n.children, n.children + 4, t.children);
+		t.minHeight = n.minHeight;
+		t.maxHeight = n.maxHeight;
+		t.error		= n.error;
+		t.offset	= offset;
+		offset		= AlignUp(offset + tileSize);
+	}
+
+	std::ofstream file(filename, std::ios::binary);
+	if (!file.is_open()) {
+		std::cout << "TerrainQuadtree: Can't write tile file " << filename << "\n";
+		return false;
+	}
+	const char padding[16] = { 0 };
+	file.write((const char*)&header, sizeof(header));
+	file.write((const char*)table.data(), table.size() * sizeof(TerrainTileNode));
+	size_t written = sizeof(header) + table.size() * sizeof(TerrainTileNode);
+
+	std::vector<float> tile(tileSize / sizeof(float));
+	for (size_t i = 0; i < nodes.size(); ++i) {
+		ExtractTile(nodes[i], tile.data());
+		file.write(padding, table[i].offset - written);
+		file.write((const char*)tile.data(), tileSize);
+		written = (size_t)table[i].offset + tileSize;
+	}
+	return file.good();
+}
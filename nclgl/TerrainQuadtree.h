@@ -0,0 +1,249 @@
+#pragma once
+/*
+Class:TerrainQuadtree
+Description:Draws a heightfield as a quadtree of fixed size patches, rather than
+as one mesh with a vertex per sample. Every patch is patchSize x patchSize quads
+- the leaves sample every height, and each level up covers twice the ground with
+every other sample, so how much gets drawn depends on what's on screen rather
+than on how big the heightfield is.
+
+Each node knows how far (in height units) its surface can be from the full
+detail one, and SelectLOD splits nodes until that error projects to no more
+than maxPixelError pixels. Neighbouring patches are then kept within one level
+of each other, and the finer side of each level change drops every other vertex
+along the shared edge so there are no cracks - one of 16 index lists, shared by
+every patch. Draw culls the selected patches against their bounding boxes.
+
+Patch vertices are just a height and a packed normal (8 bytes, rather than a
+full Mesh vertex's 48) - positions, texture coordinates and tangents are
+worked out in the vertex shader from gl_VertexID and the uniforms Draw sets,
+so anything drawing the terrain has to include Shaders/TerrainGrid.glsl. The
+index lists are 16 bit whenever a patch has few enough vertices.
+
+Heights can either all be in memory, or be streamed from a tile file (see
+WriteTiles) that holds every node's own samples. Streamed nodes are read and
+turned into vertices on the JobSystem, and until they're ready the selection
+just stops at their parent. Either way, patches only take up memory while
+they're resident - once the budget's used up, the ones used longest ago are
+thrown away (streamed ones only ever after their children, so any node that's
+resident can always fall back on its parent).
+
+Heightfields work best with 2^n + 1 samples a side; anything else leaves some
+partly filled patches along the far edges, which are always drawn at full detail.
+*/
+#include "KHR\khrplatform.h"
+#include "glad\glad.h"
+
+#include "JobSystem.h"
+#include "MappedFile.h"
+#include "Vector2.h"
+#include "Vector3.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+class HeightMap;
+class Frustrum;
+class Shader;
+
+//Tile file layout - a header, then a TerrainTileNode for every node (root
+//first, children after their parents), then each node's tile of heights:
+//(patchSize + 3)^2 floats, in local units, with a one sample border at the
+//node's own spacing for the normals. Tiles start on 16 byte boundaries.
+//Bump TERRAIN_TILE_VERSION whenever this changes!
+const char		TERRAIN_TILE_MAGIC[4]	= { 'T', 'T', 'I', 'L' };
+const uint32_t	TERRAIN_TILE_VERSION	= 1;
+
+struct TerrainTileHeader {
+	char		magic[4];
+	uint32_t	version;
+	uint32_t	width;
+	uint32_t	depth;
+	uint32_t	patchSize;
+	uint32_t	numNodes;
+	float		vertexScale[3];
+	float		textureScale[2];
+	uint32_t	padding;
+};
+
+struct TerrainTileNode {
+	uint32_t	x;
+	uint32_t	z;
+	uint32_t	depth;
+	int32_t		children[4];
+	float		minHeight;
+	float		maxHeight;
+	float		error;
+	uint64_t	offset;		//of its tile, from the start of the file
+};
+
+class TerrainQuadtree {
+public:
+	static const int	DEFAULT_PATCH_SIZE		= 64;
+	static const size_t	DEFAULT_MEMORY_BUDGET	= 64 * 1024 * 1024;
+	//Streamed tiles being read at once
+	static const int	MAX_PENDING_LOADS		= 16;
+
+	struct Stats {
+		int		selectedPatches		= 0;
+		int		selectedTriangles	= 0;
+		int		drawnPatches		= 0;	//by the last Draw, after culling
+		int		drawnTriangles		= 0;
+		int		residentPatches		= 0;
+		size_t	residentBytes		= 0;	//patch vertices, plus any tiles being read
+		int		pendingLoads		= 0;
+		int		patchesBuilt		= 0;	//since construction
+	};
+
+	//heights has width * depth raw samples, row by row. Local positions are
+	//(x, height, z) * vertexScale and texture coordinates (x, z) * textureScale
+	TerrainQuadtree(const std::vector<float>& heights, int width, int depth, const Vector3& vertexScale,
+		const Vector2& textureScale, int patchSize = DEFAULT_PATCH_SIZE, JobSystem* jobs = nullptr);
+	TerrainQuadtree(const HeightMap& map, int patchSize = DEFAULT_PATCH_SIZE, JobSystem* jobs = nullptr);
+	//Streams from a file written by WriteTiles. The root is read straight away
+	TerrainQuadtree(const std::string& tileFile, JobSystem& jobs = JobSystem::GetShared());
+	//Waits for any tiles still being read
+	~TerrainQuadtree();
+
+	bool	IsValid() const { return !nodes.empty(); }
+	bool	IsStreaming() const { return tiles.IsOpen(); }
+
+	//Only for quadtrees with all their heights in memory. Doesn't need GL
+	bool	WriteTiles(const std::string& filename) const;
+
+	//cameraPos is in the terrain's local space. fov is vertical, in degrees, as
+	//Matrix4::Perspective takes it. Also uploads any tiles that have been read
+	void	SelectLOD(const Vector3& cameraPos, float fov, int viewportHeight, float maxPixelError = 2.0f);
+	//Draws the selected patches that are inside frustum, which needs to be in
+	//local space too (ie built from projection * view * model). shader is the
+	//one that's bound - it's given the grid uniforms TerrainGrid.glsl reads
+	void	Draw(const Frustrum& frustum, Shader* shader);
+	void	Draw(Shader* shader);
+
+	void	SetMemoryBudget(size_t bytes)	{ memoryBudget = bytes; }
+	size_t	GetMemoryBudget() const			{ return memoryBudget; }
+	//What one resident patch costs
+	size_t	GetPatchBytes() const;
+
+	int		GetPatchSize() const			{ return patchSize; }
+	int		GetDepthCount() const			{ return depthCount; }
+	const Stats& GetStats() const			{ return stats; }
+
+	//Triangles in each of the 16 stitched index lists - bit 0 set drops every
+	//other vertex along x = 0, bit 1 x = max, bit 2 z = 0 and bit 3 z = max
+	int		GetVariantTriangles(int edges) const	{ return variants[edges].count / 3; }
+	const GLuint* GetVariantIndices(int edges) const { return variantIndices.data() + variants[edges].first; }
+
+protected:
+	TerrainQuadtree(const TerrainQuadtree&) = delete;
+	TerrainQuadtree& operator=(const TerrainQuadtree&) = delete;
+
+	enum Edge {
+		EDGE_LOW_X	= 1,
+		EDGE_HIGH_X	= 2,
+		EDGE_LOW_Z	= 4,
+		EDGE_HIGH_Z	= 8
+	};
+
+	struct Node {
+		int		x;			//first sample covered
+		int		z;
+		int		depth;		//0 is the root
+		int		step;		//samples between vertices
+		int		parent;		//-1 for the root
+		int		children[4];	//-1 if there aren't any
+		float	minHeight;	//over every sample covered, in local units
+		float	maxHeight;
+		float	error;		//furthest this patch's surface gets from the full detail one
+		uint64_t tileOffset;	//if streaming
+
+		int		edges;		//stitching for this frame
+		GLuint	arrayObject;
+		GLuint	vertexBuffer;
+		int		lastUsed;	//frame number
+		bool	loading;
+	};
+
+	struct Variant {
+		int		first;
+		int		count;
+	};
+
+	//Matches the attributes UploadPatch sets up
+	struct PatchVertex {
+		float		height;		//in local units
+		uint32_t	normal;		//GL_INT_2_10_10_10_REV
+	};
+
+	//A streamed tile on its way in - the vertices are filled in by a job
+	struct TileLoad {
+		int							node;
+		std::vector<PatchVertex>	vertices;
+		std::atomic<bool>	done;
+	};
+
+	void	Build(JobSystem* jobs);
+	int		AddNode(int x, int z, int depth, int parent);
+	void	MeasureNode(Node& n) const;
+	float	GetHeight(int x, int z) const;
+	float	InterpolateHeight(const Node& n, int x, int z) const;
+	bool	IsPartial(const Node& n) const;
+	//In local space - what Draw culls against
+	void	GetBounds(const Node& n, Vector3& minCorner, Vector3& maxCorner) const;
+
+	bool	NeedsSplit(const Node& n, const Vector3& cameraPos, float pixelsPerUnit, float maxPixelError) const;
+	float	GetDistance(const Node& n, const Vector3& cameraPos) const;
+	bool	IsAvailable(const Node& n) const { return !IsStreaming() || n.arrayObject; }
+	void	SelectNode(int node, const Vector3& cameraPos, float pixelsPerUnit, float maxPixelError);
+	void	BalanceSelection();
+	void	Coarsen(const std::vector<int>& tooFine);
+	void	MarkCells(int node);
+	void	FindStitching();
+
+	void	BuildIndices();
+	//Heights for a node's vertices, plus a border - (patchSize + 3)^2 of them
+	void	ExtractTile(const Node& n, float* tile) const;
+	void	MakeVertices(const Node& n, const float* tile, std::vector<PatchVertex>& vertices) const;
+	void	UploadPatch(Node& n, const std::vector<PatchVertex>& vertices);
+	void	FreePatch(Node& n);
+	//Loads the children of every node in wanted that needs them
+	void	RequestTiles(const Vector3& cameraPos);
+	void	LoadTile(int node);
+	void	ReceiveTiles();
+	void	EvictPatches(size_t wanted);
+	void	SetGridUniforms(Shader* shader) const;
+	void	DrawNode(Node& n, Shader* shader);
+
+	std::vector<float>	heights;	//empty if streaming
+	int					width;
+	int					depth;
+	Vector3				vertexScale;
+	Vector2				textureScale;
+	int					patchSize;
+	int					depthCount;
+
+	std::vector<Node>	nodes;		//nodes[0] is the root
+	std::vector<int>	selected;
+	std::vector<int>	cellNodes;	//the selected node over each leaf sized cell
+	int					cellsX;
+	int					cellsZ;
+
+	std::vector<GLuint>	variantIndices;
+	Variant				variants[16];
+	GLuint				indexBuffer;
+	GLenum				indexType;	//of indexBuffer - variantIndices are always 32 bit
+
+	std::vector<int>	resident;
+	size_t				memoryBudget;
+	int					frame;
+	Stats				stats;
+
+	MappedFile			tiles;
+	JobSystem*			streamJobs;
+	JobGroup			loadGroup;
+	std::vector<std::unique_ptr<TileLoad>>	loads;
+	std::vector<int>	wanted;		//nodes that would have split this frame, or been split by balancing
+};
@@ -0,0 +1,49 @@
+#include "TextParser.h"
+#include "JobSystem.h"
+
+std::string TextParser::ReadLine() {
+	const char* start = at;
+	while (at < end && *at != '\n') {
+		++at;
+	}
+	const char* stop = at;
+	if (at < end) {
+		++at;	//step over the '\n'
+	}
+	if (stop > start && *(stop - 1) == '\r') {
+		--stop;
+	}
+	return std::string(start, stop);
+}
+
+bool TextParser::SkipTokens(size_t count) {
+	for (size_t i = 0; i < count; ++i) {
+		SkipWhitespace();
+		if (at >= end) {
+			return false;
+		}
+		while (at < end && !IsWhitespace(*at)) {
+			++at;
+		}
+	}
+	return true;
+}
+
+bool RunParseJobs(std::vector<std::function<bool()>>& jobs) {
+	if (jobs.size() == 1) {
+		return jobs[0]();
+	}
+	std::atomic<bool> success(true);
+
+	JobSystem& jobSystem = JobSystem::GetShared();
+	JobGroup group;
+	for (std::function<bool()>& job : jobs) {
+		jobSystem.Run(group, [&job, &success]() {
+			if (!job()) {
+				success = false;
+			}
+		});
+	}
+	jobSystem.Wait(group);
+	return success;
+}
@@ -0,0 +1,128 @@
+#pragma once
+/*
+Class:TextParser
+Description:Fast, locale-independent reading of whitespace separated text, for
+the MeshGeometry and MeshAnim formats. Works on a block of memory (usually a
+MappedFile) rather than a stream, and parses numbers with std::from_chars.
+
+Large runs of numbers can be split into pieces and parsed on several threads -
+splitting only needs a quick pass skipping over tokens, which is far cheaper
+than converting them.
+*/
+#include <string>
+#include <vector>
+#include <charconv>
+#include <functional>
+#include <algorithm>
+
+class TextParser
+{
+public:
+	TextParser(const char* start, const char* end) {
+		at		= start;
+		this->end = end;
+	}
+	~TextParser(void) {}
+
+	const char*	GetPosition() const	{ return at; }
+	bool		AtEnd()				{ SkipWhitespace(); return at >= end; }
+
+	//Reads the next whitespace separated token, as a number or a string
+	template <typename T>
+	bool Read(T& value) {
+		const char* start;
+		const char* stop;
+		if (!NextToken(start, stop)) {
+			return false;
+		}
+		if (*start == '+') {	//operator>> allows this, from_chars doesn't
+			++start;
+		}
+		std::from_chars_result r = std::from_chars(start, stop, value);
+		return r.ec == std::errc() && r.ptr == stop;
+	}
+
+	bool Read(std::string& value) {
+		const char* start;
+		const char* stop;
+		if (!NextToken(start, stop)) {
+			return false;
+		}
+		value.assign(start, stop);
+		return true;
+	}
+
+	template <typename T>
+	bool ReadArray(T* into, size_t count) {
+		for (size_t i = 0; i < count; ++i) {
+			if (!Read(into[i])) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	//Reads up to the end of the current line, without the line ending
+	std::string ReadLine();
+
+	bool SkipTokens(size_t count);
+
+	//Reads 'count' numbers into 'into', splitting the work across threads if
+	//there's enough of it. Moves past all of the numbers either way.
+	template <typename T>
+	bool ReadArrayParallel(T* into, size_t count);
+
+protected:
+	void SkipWhitespace() {
+		while (at < end && IsWhitespace(*at)) {
+			++at;
+		}
+	}
+
+	bool NextToken(const char*& start, const char*& stop) {
+		SkipWhitespace();
+		if (at >= end) {
+			return false;
+		}
+		start = at;
+		while (at < end && !IsWhitespace(*at)) {
+			++at;
+		}
+		stop = at;
+		return true;
+	}
+
+	static bool IsWhitespace(char c) {
+		return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\v' || c == '\f';
+	}
+
+	const char* at;
+	const char* end;
+};
+
+//Runs each job, spreading them across hardware threads. Returns true if every job did.
+bool RunParseJobs(std::vector<std::function<bool()>>& jobs);
+
+template <typename T>
+bool TextParser::ReadArrayParallel(T* into, size_t count) {
+	const size_t minPerJob = 16384;
+	size_t jobCount = count / minPerJob;
+	if (jobCount < 2) {
+		return ReadArray(into, count);
+	}
+	std::vector<std::function<bool()>> jobs;
+	size_t perJob = (count + jobCount - 1) / jobCount;
+	for (size_t first = 0; first < count; first += perJob) {
+		size_t n = std::min(perJob, count - first);
+		const char* start = at;
+		if (!SkipTokens(n)) {
+			return false;
+		}
+		const char* stop = at;
+		jobs.emplace_back([start, stop, into, first, n]() {
+			TextParser piece(start, stop);
+			return piece.ReadArray(into + first, n);
+		});
+	}
+	return RunParseJobs(jobs);
+}
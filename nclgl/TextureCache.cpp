@@ -0,0 +1,230 @@
+#include "TextureCache.h"
+#include "GLStateCache.h"
+#include "TextureImage.h"
+#include "SOIL/SOIL.h"
+
+#include <iostream>
+
+namespace {
+	GLenum GetCompressedFormat(BlockFormat format) {
+		switch (format) {
+			case BlockFormat::BC1:	return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+			case BlockFormat::BC3:	return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+			case BlockFormat::BC4:	return GL_COMPRESSED_RED_RGTC1;
+			default:				return GL_COMPRESSED_RG_RGTC2;
+		}
+	}
+}
+
+TextureCache& TextureCache::GetShared() {
+	static TextureCache shared;
+	return shared;
+}
+
+std::string TextureCache::MakeKey(const std::string& filename, unsigned int flags) {
+	return filename + "|" + std::to_string(flags);
+}
+
+std::string TextureCache::MakeCubeMapKey(const std::string faces[6], unsigned int flags) {
+	std::string key;
+	for (int i = 0; i < 6; ++i) {
+		key += faces[i] + "|";
+	}
+	return key + std::to_string(flags);
+}
+
+GLuint TextureCache::Acquire(const std::string& key) {
+	auto found = textureForKey.find(key);
+	if (found == textureForKey.end()) {
+		stats.misses++;
+		return 0;
+	}
+	stats.hits++;
+	entries[found->second].references++;
+	return found->second;
+}
+
+void TextureCache::Adopt(const std::string& key, GLuint texture, GLenum target) {
+	Entry e;
+	e.key			= key;
+	e.references	= 1;
+	e.bytes			= MeasureTexture(texture, target);
+
+	textureForKey[key]	= texture;
+	entries[texture]	= e;
+
+	stats.textures++;
+	stats.residentBytes += e.bytes;
+}
+
+GLuint TextureCache::Load(const std::string& filename, unsigned int flags) {
+	std::string key = MakeKey(filename, flags);
+	if (GLuint texture = Acquire(key)) {
+		return texture;
+	}
+	GLuint texture = 0;
+	if (TextureImage::IsCookedFile(filename)) {
+		TextureImage image;
+		texture = image.Map(filename) ? Upload(&image, 1, flags) : 0;
+	}
+	else {
+		texture = SOIL_load_OGL_texture(filename.c_str(), SOIL_LOAD_AUTO, SOIL_CREATE_NEW_ID, flags);
+		//SOIL binds with plain GL calls, behind the state cache's back
+		GLStateCache::GetShared().Invalidate();
+	}
+	if (!texture) {
+		std::cout << "TextureCache: Can't load " << filename << ": " <<
+			(TextureImage::IsCookedFile(filename) ? "Bad cooked texture" : SOIL_last_result()) << "\n";
+		return 0;
+	}
+	Adopt(key, texture, GL_TEXTURE_2D);
+	return texture;
+}
+
+GLuint TextureCache::LoadCubeMap(const std::string faces[6], unsigned int flags) {
+	std::string key = MakeCubeMapKey(faces, flags);
+	if (GLuint texture = Acquire(key)) {
+		return texture;
+	}
+	GLuint texture = 0;
+	bool cooked = false;
+	for (int i = 0; i < 6; ++i) {
+		cooked |= TextureImage::IsCookedFile(faces[i]);
+	}
+	if (cooked) {
+		//SOIL can't read the cooked faces, so do the lot the same way the async loader does
+		TextureImage images[6];
+		bool loaded = true;
+		for (int i = 0; i < 6 && loaded; ++i) {
+			loaded = images[i].Load(faces[i], flags, SOIL_LOAD_RGB);
+		}
+		texture = loaded ? Upload(images, 6, flags) : 0;
+	}
+	else {
+		texture = SOIL_load_OGL_cubemap(faces[0].c_str(), faces[1].c_str(), faces[2].c_str(),
+			faces[3].c_str(), faces[4].c_str(), faces[5].c_str(), SOIL_LOAD_RGB, SOIL_CREATE_NEW_ID, flags);
+		GLStateCache::GetShared().Invalidate();
+	}
+	if (!texture) {
+		std::cout << "TextureCache: Can't load cube map " << faces[0] << ": " <<
+			(cooked ? "Bad cooked texture" : SOIL_last_result()) << "\n";
+		return 0;
+	}
+	Adopt(key, texture, GL_TEXTURE_CUBE_MAP);
+	return texture;
+}
+
+void TextureCache::AddReference(GLuint texture) {
+	auto found = entries.find(texture);
+	if (found != entries.end()) {
+		found->second.references++;
+	}
+}
+
+void TextureCache::Release(GLuint texture) {
+	auto found = entries.find(texture);
+	if (found == entries.end() || --found->second.references > 0) {
+		return;
+	}
+	stats.textures--;
+	stats.residentBytes -= found->second.bytes;
+	textureForKey.erase(found->second.key);
+	entries.erase(found);
+
+	GLStateCache::GetShared().ForgetTexture(texture);
+	glDeleteTextures(1, &texture);
+}
+
+size_t TextureCache::MeasureTexture(GLuint texture, GLenum target) {
+	GLStateCache::GetShared().BindTexture(0, target, texture);
+
+	GLenum	levelTarget	= target == GL_TEXTURE_CUBE_MAP ? GL_TEXTURE_CUBE_MAP_POSITIVE_X : target;
+	size_t	faces		= target == GL_TEXTURE_CUBE_MAP ? 6 : 1;
+	size_t	bytes		= 0;
+	for (GLint level = 0; ; ++level) {
+		GLint width		= 0;
+		GLint height	= 0;
+		glGetTexLevelParameteriv(levelTarget, level, GL_TEXTURE_WIDTH,	&width);
+		glGetTexLevelParameteriv(levelTarget, level, GL_TEXTURE_HEIGHT, &height);
+		if (width == 0 || height == 0) {
+			break;
+		}
+		GLint compressed = GL_FALSE;
+		glGetTexLevelParameteriv(levelTarget, level, GL_TEXTURE_COMPRESSED, &compressed);
+		if (compressed) {
+			GLint size = 0;
+			glGetTexLevelParameteriv(levelTarget, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+			bytes += size * faces;
+			continue;
+		}
+		GLint bits = 0;
+		const GLenum channels[] = { GL_TEXTURE_RED_SIZE, GL_TEXTURE_GREEN_SIZE, GL_TEXTURE_BLUE_SIZE, GL_TEXTURE_ALPHA_SIZE };
+		for (GLenum c : channels) {
+			GLint size = 0;
+			glGetTexLevelParameteriv(levelTarget, level, c, &size);
+			bits += size;
+		}
+		bytes += (size_t)width * height * ((bits + 7) / 8) * faces;
+	}
+	GLStateCache::GetShared().BindTexture(0, target, 0);
+	return bytes;
+}
+
+GLuint TextureCache::Upload(const TextureImage* faces, int faceCount, unsigned int flags) {
+	const TextureImage& first	= faces[0];
+	GLenum				target	= faceCount == 6 ? GL_TEXTURE_CUBE_MAP : GL_TEXTURE_2D;
+	for (int i = 1; i < faceCount; ++i) {
+		if (faces[i].GetWidth() != first.GetWidth() || faces[i].GetHeight() != first.GetHeight() ||
+			faces[i].GetChannels() != first.GetChannels() || faces[i].GetLevelCount() != first.GetLevelCount() ||
+			faces[i].IsCompressed() != first.IsCompressed() || faces[i].GetBlockFormat() != first.GetBlockFormat()) {
+			return 0;	//cube map faces all have to match
+		}
+	}
+	const GLenum formats[]			= { GL_RED, GL_RG, GL_RGB, GL_RGBA };
+	const GLenum internalFormats[]	= { GL_R8,	GL_RG8, GL_RGB8, GL_RGBA8 };
+	GLenum format			= formats[first.GetChannels() - 1];
+	GLenum internalFormat	= internalFormats[first.GetChannels() - 1];
+
+	GLStateCache& glState = GLStateCache::GetShared();
+	GLuint texture = 0;
+	glGenTextures(1, &texture);
+	glState.BindTexture(0, target, texture);
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);	//RGB rows aren't always 4 byte aligned
+	for (int face = 0; face < faceCount; ++face) {
+		const TextureImage& image		= faces[face];
+		GLenum				faceTarget	= faceCount == 6 ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + face : GL_TEXTURE_2D;
+		for (int level = 0; level < image.GetLevelCount(); ++level) {
+			const TextureImage::Level& l = image.GetLevel(level);
+			if (image.IsCompressed()) {
+				glCompressedTexImage2D(faceTarget, level, GetCompressedFormat(image.GetBlockFormat()), l.width, l.height, 0, (GLsizei)l.size, image.GetLevelData(level));
+			}
+			else {
+				glTexImage2D(faceTarget, level, internalFormat, l.width, l.height, 0, format, GL_UNSIGNED_BYTE, image.GetLevelData(level));
+			}
+		}
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+	//Same sampling as SOIL sets up. Grey images read back as grey, like SOIL's GL_LUMINANCE ones did
+	if (first.GetChannels() == 1) {
+		const GLint swizzle[] = { GL_RED, GL_RED, GL_RED, GL_ONE };
+		glTexParameteriv(target, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+	}
+	else if (first.GetChannels() == 2) {
+		const GLint swizzle[] = { GL_RED, GL_RED, GL_RED, GL_GREEN };
+		glTexParameteriv(target, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+	}
+	glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, first.GetLevelCount() - 1);
+	glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(target, GL_TEXTURE_MIN_FILTER, first.GetLevelCount() > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+
+	GLint wrap = (flags & SOIL_FLAG_TEXTURE_REPEATS) ? GL_REPEAT : GL_CLAMP_TO_EDGE;
+	glTexParameteri(target, GL_TEXTURE_WRAP_S, wrap);
+	glTexParameteri(target, GL_TEXTURE_WRAP_T, wrap);
+	if (target == GL_TEXTURE_CUBE_MAP) {
+		glTexParameteri(target, GL_TEXTURE_WRAP_R, wrap);
+	}
+	glState.BindTexture(0, target, 0);
+	return texture;
+}
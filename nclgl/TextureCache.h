@@ -0,0 +1,77 @@
+#pragma once
+/*
+Class:TextureCache
+Description:Loads textures through SOIL, keyed by file name(s) and SOIL flags,
+so asking for the same image with the same flags twice hands back the same GL
+texture instead of decoding the file again.
+
+Textures are reference counted - each Load or AddReference needs a matching
+Release, and the texture is deleted when the last one goes. Textures that
+didn't come from the cache are ignored by AddReference and Release, so code
+that's handed a texture can always release it without worrying about where it
+came from.
+
+Cooked files (see TextureImage) are mapped and uploaded as they are, rather
+than going through SOIL - their flags were applied when they were cooked, so
+only SOIL_FLAG_TEXTURE_REPEATS still means anything for them.
+*/
+#include "KHR\khrplatform.h"
+#include "glad\glad.h"
+
+#include <string>
+#include <unordered_map>
+
+class TextureImage;
+
+class TextureCache {
+public:
+	struct Stats {
+		size_t hits				= 0;	//loads answered from the cache
+		size_t misses			= 0;	//loads that had to decode a file
+		size_t textures			= 0;	//textures currently held
+		size_t residentBytes	= 0;	//their size, all mip levels included
+	};
+
+	TextureCache() {}
+	~TextureCache() {}	//Textures still held die with the context
+
+	static TextureCache& GetShared();
+
+	//Returns 0 if the file couldn't be loaded. flags are SOIL_FLAG_xxx values
+	GLuint	Load(const std::string& filename, unsigned int flags);
+	//Faces in the order +x, -x, +y, -y, +z, -z
+	GLuint	LoadCubeMap(const std::string faces[6], unsigned int flags);
+
+	//For loaders that make their own textures (see AsyncTextureLoader) - Acquire
+	//returns the texture already cached under key with a new reference, or 0,
+	//and Adopt hands a new texture over to the cache with one reference
+	static std::string	MakeKey(const std::string& filename, unsigned int flags);
+	static std::string	MakeCubeMapKey(const std::string faces[6], unsigned int flags);
+	GLuint	Acquire(const std::string& key);
+	void	Adopt(const std::string& key, GLuint texture, GLenum target);
+	//Makes a texture from 1 image, or 6 cube map faces (which must all match),
+	//sampled the way SOIL would with the same flags. Returns 0 on failure
+	static GLuint	Upload(const TextureImage* faces, int faceCount, unsigned int flags);
+
+	void	AddReference(GLuint texture);
+	void	Release(GLuint texture);
+	bool	Owns(GLuint texture) const { return entries.count(texture) > 0; }
+
+	const Stats& GetStats() const { return stats; }
+
+protected:
+	TextureCache(const TextureCache&) = delete;
+	TextureCache& operator=(const TextureCache&) = delete;
+
+	struct Entry {
+		std::string key;
+		int			references;
+		size_t		bytes;
+	};
+
+	static size_t	MeasureTexture(GLuint texture, GLenum target);
+
+	std::unordered_map<std::string, GLuint>	textureForKey;
+	std::unordered_map<GLuint, Entry>		entries;
+	Stats									stats;
+};
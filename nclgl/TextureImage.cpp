@@ -0,0 +1,292 @@
+#include "TextureImage.h"
+#include "SOIL/SOIL.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+bool TextureImage::Decode(const std::string& filename, int forceChannels) {
+	int width		= 0;
+	int height		= 0;
+	int fileChannels = 0;
+	unsigned char* data = SOIL_load_image(filename.c_str(), &width, &height, &fileChannels, forceChannels);
+	if (!data) {
+		return false;
+	}
+	mapped.reset();
+	channels	= forceChannels ? forceChannels : fileChannels;
+	compressed	= false;
+	pixels.assign(data, data + (size_t)width * height * channels);
+	SOIL_free_image_data(data);
+
+	levels.clear();
+	levels.push_back({ width, height, 0, pixels.size() });
+	return true;
+}
+
+void TextureImage::FlipVertically() {
+	if (compressed || mapped || levels.empty()) {
+		return;
+	}
+	const Level&	top		= levels[0];
+	size_t			rowSize = (size_t)top.width * channels;
+	std::vector<unsigned char> row(rowSize);
+	unsigned char* data = pixels.data() + top.offset;
+	for (int y = 0; y < top.height / 2; ++y) {
+		unsigned char* a = data + y * rowSize;
+		unsigned char* b = data + (top.height - 1 - y) * rowSize;
+		memcpy(row.data(), a, rowSize);
+		memcpy(a, b, rowSize);
+		memcpy(b, row.data(), rowSize);
+	}
+}
+
+void TextureImage::GenerateMips(const MipGenerator& generator, JobSystem* jobs) {
+	if (compressed || mapped || levels.empty()) {
+		return;
+	}
+	levels.resize(1);
+	size_t total = (size_t)levels[0].width * levels[0].height * channels;
+	for (int w = levels[0].width, h = levels[0].height; w > 1 || h > 1; ) {
+		w = std::max(1, w / 2);
+		h = std::max(1, h / 2);
+		levels.push_back({ w, h, total, (size_t)w * h * channels });
+		total += levels.back().size;
+	}
+	pixels.resize(total);
+
+	for (size_t i = 1; i < levels.size(); ++i) {
+		const Level& src = levels[i - 1];
+		generator.Downsample(pixels.data() + src.offset, src.width, src.height, channels, pixels.data() + levels[i].offset, jobs);
+	}
+}
+
+void TextureImage::Compress(BlockFormat blockFormat, JobSystem* jobs) {
+	if (compressed || mapped || levels.empty()) {
+		return;
+	}
+	size_t total = 0;
+	for (const Level& l : levels) {
+		total += BlockCompressor::GetCompressedSize(l.width, l.height, blockFormat);
+	}
+	std::vector<unsigned char> blocks(total);
+	size_t offset = 0;
+	for (Level& l : levels) {
+		BlockCompressor::Compress(pixels.data() + l.offset, l.width, l.height, channels, blockFormat, blocks.data() + offset, jobs);
+		l.offset	= offset;
+		l.size		= BlockCompressor::GetCompressedSize(l.width, l.height, blockFormat);
+		offset		+= l.size;
+	}
+	pixels.swap(blocks);
+	compressed	= true;
+	format		= blockFormat;
+}
+
+size_t TextureImage::GetSize() const {
+	size_t size = 0;
+	for (const Level& l : levels) {
+		size += l.size;
+	}
+	return size;
+}
+
+bool TextureImage::Load(const std::string& filename, unsigned int flags, int forceChannels, const MipGenerator& generator, JobSystem* jobs) {
+	if (IsCookedFile(filename)) {
+		return Map(filename);
+	}
+	if (!Decode(filename, forceChannels)) {
+		return false;
+	}
+	if (flags & SOIL_FLAG_INVERT_Y) {
+		FlipVertically();
+	}
+	if (flags & SOIL_FLAG_MIPMAPS) {
+		GenerateMips(generator, jobs);
+	}
+	if (flags & SOIL_FLAG_COMPRESS_TO_DXT) {
+		Compress(BlockCompressor::ChooseFormat(channels), jobs);
+	}
+	return true;
+}
+
+/*
+Cooked files are only ever read through the mapping. Everything in the level
+table is checked against the file's size up front, so a truncated or stale
+file is turned away here rather than read past the end of during an upload.
+NeedsCooking makes the same checks from just the file's first few hundred
+bytes, without mapping it.
+*/
+static bool ReadCookedTable(const std::string& filename, const unsigned char* data, size_t available, uint64_t fileSize,
+	CookedTextureHeader& header, std::vector<TextureImage::Level>& levels) {
+	if (available < sizeof(header)) {
+		std::cout << "TextureImage: Can't open cooked texture " << filename << "\n";
+		return false;
+	}
+	memcpy(&header, data, sizeof(header));
+
+	if (memcmp(header.magic, COOKED_TEXTURE_MAGIC, sizeof(header.magic)) != 0 || header.version != COOKED_TEXTURE_VERSION) {
+		std::cout << "TextureImage: " << filename << " isn't a cooked texture of this version\n";
+		return false;
+	}
+	size_t tableEnd = sizeof(header) + (size_t)header.numLevels * sizeof(CookedTextureLevel);
+	if (header.channels < 1 || header.channels > 4 || header.compressed > (uint32_t)BlockFormat::BC5 + 1 ||
+		header.numLevels == 0 || header.numLevels > COOKED_TEXTURE_MAX_LEVELS || tableEnd > available) {
+		std::cout << "TextureImage: Cooked texture " << filename << " has a bad header\n";
+		return false;
+	}
+	BlockFormat blockFormat = header.compressed ? (BlockFormat)(header.compressed - 1) : BlockFormat::BC1;
+
+	levels.resize(header.numLevels);
+	for (uint32_t i = 0; i < header.numLevels; ++i) {
+		CookedTextureLevel l;
+		memcpy(&l, data + sizeof(header) + i * sizeof(l), sizeof(l));
+
+		size_t expected = header.compressed ?
+			BlockCompressor::GetCompressedSize(l.width, l.height, blockFormat) :
+			(size_t)l.width * l.height * header.channels;
+		if (l.width == 0 || l.height == 0 || l.size != expected ||
+			l.offset > fileSize || l.size > fileSize - l.offset) {
+			std::cout << "TextureImage: Cooked texture " << filename << " has a bad level\n";
+			return false;
+		}
+		levels[i] = { (int)l.width, (int)l.height, (size_t)l.offset, (size_t)l.size };
+	}
+	return true;
+}
+
+bool TextureImage::Map(const std::string& filename) {
+	std::unique_ptr<MappedFile> file(new MappedFile(filename));
+	if (!file->IsOpen()) {
+		std::cout << "TextureImage: Can't open cooked texture " << filename << "\n";
+		return false;
+	}
+	CookedTextureHeader header;
+	std::vector<Level> fileLevels;
+	if (!ReadCookedTable(filename, (const unsigned char*)file->GetData(), file->GetSize(), file->GetSize(), header, fileLevels)) {
+		return false;
+	}
+
+	//Fault every page in now, so the disk reads happen on whichever thread is
+	//loading rather than in the middle of the upload
+	volatile char touched = 0;
+	for (size_t i = 0; i < file->GetSize(); i += 4096) {
+		touched += file->GetData()[i];
+	}
+
+	channels			= (int)header.channels;
+	compressed			= header.compressed != 0;
+	format				= header.compressed ? (BlockFormat)(header.compressed - 1) : BlockFormat::BC1;
+	cookedFlags			= header.flags;
+	cookedForceChannels	= (int)header.forceChannels;
+	levels.swap(fileLevels);
+	pixels.clear();
+	pixels.shrink_to_fit();
+	mapped.swap(file);
+	return true;
+}
+
+//The flags that change what gets cooked - the rest only matter at upload time
+static unsigned int BakedFlags(unsigned int flags) {
+	return flags & (SOIL_FLAG_INVERT_Y | SOIL_FLAG_MIPMAPS | SOIL_FLAG_COMPRESS_TO_DXT);
+}
+
+static size_t AlignUp(size_t v) {
+	return (v + COOKED_TEXTURE_ALIGNMENT - 1) & ~(COOKED_TEXTURE_ALIGNMENT - 1);
+}
+
+bool TextureImage::Save(const std::string& filename, unsigned int flags, int forceChannels) const {
+	if (levels.empty()) {
+		return false;
+	}
+	CookedTextureHeader header;
+	memcpy(header.magic, COOKED_TEXTURE_MAGIC, sizeof(header.magic));
+	header.version		= COOKED_TEXTURE_VERSION;
+	header.width		= (uint32_t)GetWidth();
+	header.height		= (uint32_t)GetHeight();
+	header.channels		= (uint32_t)channels;
+	header.compressed	= compressed ? (uint32_t)format + 1 : 0;
+	header.numLevels	= (uint32_t)levels.size();
+	header.flags		= BakedFlags(flags);
+	header.forceChannels	= (uint32_t)forceChannels;
+	header.padding		= 0;
+
+	std::vector<CookedTextureLevel> table;
+	size_t offset = AlignUp(sizeof(header) + levels.size() * sizeof(CookedTextureLevel));
+	for (const Level& l : levels) {
+		table.push_back({ (uint32_t)l.width, (uint32_t)l.height, offset, l.size });
+		offset = AlignUp(offset + l.size);
+	}
+
+	//write to the side and rename, so NeedsCooking never sees half a file
+	std::string tempName = filename + ".tmp";
+	{
+		std::ofstream file(tempName, std::ios::binary | std::ios::trunc);
+		if (!file) {
+			std::cout << "TextureImage: Can't write to " << tempName << "\n";
+			return false;
+		}
+		const char padding[COOKED_TEXTURE_ALIGNMENT] = { 0 };
+		file.write((const char*)&header, sizeof(header));
+		file.write((const char*)table.data(), table.size() * sizeof(CookedTextureLevel));
+		size_t written = sizeof(header) + table.size() * sizeof(CookedTextureLevel);
+		for (size_t i = 0; i < levels.size(); ++i) {
+			file.write(padding, table[i].offset - written);
+			file.write((const char*)GetLevelData((int)i), levels[i].size);
+			written = (size_t)(table[i].offset + table[i].size);
+		}
+		if (!file) {
+			return false;
+		}
+	}
+	std::error_code error;
+	std::filesystem::rename(tempName, filename, error);
+	if (error) {
+		std::filesystem::remove(tempName, error);
+		return false;
+	}
+	return true;
+}
+
+bool TextureImage::Cook(const std::string& source, const std::string& cooked, unsigned int flags, int forceChannels, JobSystem* jobs) {
+	TextureImage image;
+	if (!image.Load(source, flags, forceChannels, MipGenerator(), jobs)) {
+		std::cout << "TextureImage: Can't cook " << source << "\n";
+		return false;
+	}
+	return image.Save(cooked, flags, forceChannels);
+}
+
+bool TextureImage::NeedsCooking(const std::string& source, const std::string& cooked, unsigned int flags, int forceChannels) {
+	std::error_code error;
+	auto cookedTime = std::filesystem::last_write_time(cooked, error);
+	if (error) {
+		return true;
+	}
+	auto sourceTime = std::filesystem::last_write_time(source, error);
+	if (!error && sourceTime > cookedTime) {
+		return true;
+	}
+	//just the header and level table - the pixels are left for Load to read, off this thread
+	uint64_t fileSize = std::filesystem::file_size(cooked, error);
+	std::ifstream file(cooked, std::ios::binary);
+	if (error || !file) {
+		return true;
+	}
+	unsigned char table[sizeof(CookedTextureHeader) + COOKED_TEXTURE_MAX_LEVELS * sizeof(CookedTextureLevel)];
+	file.read((char*)table, sizeof(table));
+
+	CookedTextureHeader header;
+	std::vector<Level> levels;
+	return	!ReadCookedTable(cooked, table, (size_t)file.gcount(), fileSize, header, levels) ||
+			header.flags != BakedFlags(flags) || (int)header.forceChannels != forceChannels;
+}
+
+bool TextureImage::IsCookedFile(const std::string& filename) {
+	return filename.size() >= 5 && filename.compare(filename.size() - 5, 5, ".ctex") == 0;
+}
+
+std::string TextureImage::GetCookedName(const std::string& source) {
+	return source + ".ctex";
+}
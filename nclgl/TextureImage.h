@@ -0,0 +1,127 @@
+#pragma once
+/*
+Class:TextureImage
+Description:An image decoded into CPU memory, ready to go to GL - optionally
+with its whole mip chain, stored back to back in one buffer, and optionally
+block compressed. Nothing in here touches GL, so images can be decoded,
+mipmapped and compressed on any thread.
+
+Images can also be cooked - saved once they're flipped, mipmapped and
+compressed - into a small container file (see CookedTextureHeader). Loading a
+cooked file just maps it: the levels are read straight out of the mapping, so
+there's no decoding or per pixel work left to do before the upload.
+*/
+#include "BlockCompressor.h"
+#include "MappedFile.h"
+#include "MipGenerator.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+class JobSystem;
+
+//Cooked file layout - a header, a table of levels (largest first), and then
+//the level payloads, each starting on a 16 byte boundary so they can go
+//straight from the mapping to glTexImage2D. Bump COOKED_TEXTURE_VERSION
+//whenever this changes!
+const char		COOKED_TEXTURE_MAGIC[4]		= { 'C', 'T', 'E', 'X' };
+const uint32_t	COOKED_TEXTURE_VERSION		= 2;
+const size_t	COOKED_TEXTURE_ALIGNMENT	= 16;
+const uint32_t	COOKED_TEXTURE_MAX_LEVELS	= 32;
+
+struct CookedTextureHeader {
+	char		magic[4];
+	uint32_t	version;
+	uint32_t	width;
+	uint32_t	height;
+	uint32_t	channels;
+	uint32_t	compressed;		//0, or 1 + a BlockFormat value
+	uint32_t	numLevels;
+	uint32_t	flags;			//the SOIL flags that were baked in
+	uint32_t	forceChannels;	//as given to Cook
+	uint32_t	padding;
+};
+
+struct CookedTextureLevel {
+	uint32_t	width;
+	uint32_t	height;
+	uint64_t	offset;			//from the start of the file
+	uint64_t	size;			//in bytes
+};
+
+class TextureImage {
+public:
+	struct Level {
+		int		width;
+		int		height;
+		size_t	offset;	//into the pixel buffer
+		size_t	size;
+	};
+
+	TextureImage() : channels(0), compressed(false), format(BlockFormat::BC1), cookedFlags(0), cookedForceChannels(0) {}
+	~TextureImage() {}
+
+	//forceChannels works as in SOIL_load_image - 0 keeps whatever the file has
+	bool	Decode(const std::string& filename, int forceChannels = 0);
+	void	FlipVertically();
+	//Rebuilds every level below the top one, halving down to 1x1. Big levels
+	//are split across jobs, if given some
+	void	GenerateMips(const MipGenerator& generator = MipGenerator(), JobSystem* jobs = nullptr);
+	//Compresses every level - so flip and mipmap first, as neither works afterwards
+	void	Compress(BlockFormat format, JobSystem* jobs = nullptr);
+
+	//Maps a cooked file, or decodes any other file and then applies the
+	//SOIL_FLAG_INVERT_Y, SOIL_FLAG_MIPMAPS and SOIL_FLAG_COMPRESS_TO_DXT flags.
+	//Cooked files already have those baked in, so they ignore flags and forceChannels
+	bool	Load(const std::string& filename, unsigned int flags, int forceChannels = 0,
+				const MipGenerator& generator = MipGenerator(), JobSystem* jobs = nullptr);
+
+	//Mapped images are read only - flipping, mipmapping and compressing them does nothing
+	bool	Map(const std::string& filename);
+	//flags and forceChannels are only recorded in the header, for NeedsCooking
+	bool	Save(const std::string& filename, unsigned int flags = 0, int forceChannels = 0) const;
+
+	//The offline half - Loads source with flags and saves it to cooked
+	static bool			Cook(const std::string& source, const std::string& cooked, unsigned int flags,
+							int forceChannels = 0, JobSystem* jobs = nullptr);
+	//True if cooked is missing, older than source, cooked with different flags or
+	//forceChannels, or won't Map (eg it's been truncated). Only reads the header
+	//and level table, so it's cheap enough to call before handing the file to a loader
+	static bool			NeedsCooking(const std::string& source, const std::string& cooked,
+							unsigned int flags, int forceChannels = 0);
+	static bool			IsCookedFile(const std::string& filename);
+	//source with ".ctex" added, so x.jpg and x.png don't share a cooked file
+	static std::string	GetCookedName(const std::string& source);
+
+	int		GetWidth()		const { return levels.empty() ? 0 : levels[0].width; }
+	int		GetHeight()		const { return levels.empty() ? 0 : levels[0].height; }
+	int		GetChannels()	const { return channels; }
+	int		GetLevelCount() const { return (int)levels.size(); }
+	bool	IsCompressed()	const { return compressed; }
+	bool	IsMapped()		const { return mapped != nullptr; }
+	BlockFormat GetBlockFormat() const { return format; }
+	//What a mapped image was cooked with
+	unsigned int	GetCookedFlags()			const { return cookedFlags; }
+	int				GetCookedForceChannels()	const { return cookedForceChannels; }
+
+	const Level&			GetLevel(int i)		const { return levels[i]; }
+	const unsigned char*	GetLevelData(int i) const { return GetData() + levels[i].offset; }
+	//All of the levels' data, mapped or not
+	size_t					GetSize()			const;
+
+protected:
+	const unsigned char*	GetData() const {
+		return mapped ? (const unsigned char*)mapped->GetData() : pixels.data();
+	}
+
+	int							channels;
+	bool						compressed;
+	BlockFormat					format;		//if compressed
+	std::vector<unsigned char>	pixels;
+	std::vector<Level>			levels;		//offsets are into the file, if mapped
+	unsigned int				cookedFlags;
+	int							cookedForceChannels;
+	std::unique_ptr<MappedFile>	mapped;
+};
@@ -0,0 +1,160 @@
+#include "TransformHierarchy.h"
+#include <algorithm>
+
+int TransformHierarchy::AddNode(int parent) {
+	int node;
+	if (!freeNodes.empty()) {
+		node = freeNodes.back();
+		freeNodes.pop_back();
+	}
+	else {
+		node = (int)slots.size();
+		slots.push_back(INVALID_NODE);
+	}
+	int slot = (int)nodes.size();
+	slots[node] = slot;
+
+	localTransforms.emplace_back();
+	worldTransforms.emplace_back();
+	parentSlots.push_back(parent == INVALID_NODE ? INVALID_NODE : slots[parent]);
+	boundingRadii.push_back(1.0f);
+	flags.push_back(NODE_DIRTY);
+	nodes.push_back(node);
+	return node;
+}
+
+void TransformHierarchy::RemoveNode(int node) {
+	int slot = slots[node];
+	if (slot == INVALID_NODE) {
+		return;
+	}
+	flags[slot]			= NODE_REMOVED;
+	parentSlots[slot]	= INVALID_NODE;
+	slots[node]			= INVALID_NODE;
+	freeNodes.push_back(node);
+	needsSort = true;	//compacts the slot away, and detaches any children
+}
+
+void TransformHierarchy::SetParent(int node, int parent) {
+	int slot		= slots[node];
+	int parentSlot	= (parent == INVALID_NODE) ? INVALID_NODE : slots[parent];
+
+	parentSlots[slot]	= parentSlot;
+	flags[slot]			|= NODE_DIRTY;
+	if (parentSlot > slot) {
+		needsSort = true;
+	}
+}
+
+int TransformHierarchy::GetParent(int node) const {
+	int parentSlot = parentSlots[slots[node]];
+	return parentSlot == INVALID_NODE ? INVALID_NODE : nodes[parentSlot];
+}
+
+void TransformHierarchy::SetLocalTransform(int node, const Matrix4& m) {
+	int slot = slots[node];
+	localTransforms[slot] = m;
+	flags[slot] |= NODE_DIRTY;
+}
+
+size_t TransformHierarchy::UpdateWorldTransforms() {
+	if (needsSort) {
+		SortSlots();
+	}
+	size_t updated = 0;
+	const size_t count = nodes.size();
+	for (size_t i = 0; i < count; ++i) {
+		int		parent	= parentSlots[i];
+		uint8_t f		= flags[i];
+		if ((f & NODE_DIRTY) || (parent != INVALID_NODE && (flags[parent] & NODE_WORLD_CHANGED))) {
+			worldTransforms[i] = (parent == INVALID_NODE) ? localTransforms[i] : worldTransforms[parent] * localTransforms[i];
+			flags[i] = NODE_WORLD_CHANGED;
+			++updated;
+		}
+		else {
+			flags[i] = 0;
+		}
+	}
+	return updated;
+}
+
+//Stable counting sort of the live slots by depth, which puts every parent before its children
+void TransformHierarchy::SortSlots() {
+	const int count = (int)nodes.size();
+	std::vector<int> depths(count, -1);
+	std::vector<int> stack;
+	int maxDepth = 0;
+
+	for (int i = 0; i < count; ++i) {
+		if (flags[i] & NODE_REMOVED) {
+			continue;
+		}
+		//Walk up until we hit a slot with a known depth, then fill in on the way back down
+		int s = i;
+		while (depths[s] < 0) {
+			int p = parentSlots[s];
+			if (p != INVALID_NODE && (flags[p] & NODE_REMOVED)) {
+				parentSlots[s] = p = INVALID_NODE;
+				flags[s] |= NODE_DIRTY;
+			}
+			if (p == INVALID_NODE) {
+				depths[s] = 0;
+				break;
+			}
+			stack.push_back(s);
+			s = p;
+		}
+		while (!stack.empty()) {
+			int child = stack.back();
+			stack.pop_back();
+			depths[child] = depths[parentSlots[child]] + 1;
+			maxDepth = std::max(maxDepth, depths[child]);
+		}
+	}
+
+	std::vector<int> depthStart(maxDepth + 2, 0);
+	for (int i = 0; i < count; ++i) {
+		if (depths[i] >= 0) {
+			depthStart[depths[i] + 1]++;
+		}
+	}
+	for (int d = 1; d < (int)depthStart.size(); ++d) {
+		depthStart[d] += depthStart[d - 1];
+	}
+	const int liveCount = depthStart.back();
+
+	std::vector<int> newSlot(count, INVALID_NODE);
+	for (int i = 0; i < count; ++i) {
+		if (depths[i] >= 0) {
+			newSlot[i] = depthStart[depths[i]]++;
+		}
+	}
+
+	std::vector<Matrix4>	newLocal(liveCount);
+	std::vector<Matrix4>	newWorld(liveCount);
+	std::vector<int>		newParents(liveCount);
+	std::vector<float>		newRadii(liveCount);
+	std::vector<uint8_t>	newFlags(liveCount);
+	std::vector<int>		newNodes(liveCount);
+
+	for (int i = 0; i < count; ++i) {
+		int to = newSlot[i];
+		if (to == INVALID_NODE) {
+			continue;
+		}
+		newLocal[to]	= localTransforms[i];
+		newWorld[to]	= worldTransforms[i];
+		newParents[to]	= parentSlots[i] == INVALID_NODE ? INVALID_NODE : newSlot[parentSlots[i]];
+		newRadii[to]	= boundingRadii[i];
+		newFlags[to]	= flags[i];
+		newNodes[to]	= nodes[i];
+		slots[nodes[i]] = to;
+	}
+	localTransforms.swap(newLocal);
+	worldTransforms.swap(newWorld);
+	parentSlots.swap(newParents);
+	boundingRadii.swap(newRadii);
+	flags.swap(newFlags);
+	nodes.swap(newNodes);
+	needsSort = false;
+}
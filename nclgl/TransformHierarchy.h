@@ -0,0 +1,74 @@
+#pragma once
+/*
+Class:TransformHierarchy
+Description:Flat storage for a tree of transforms. Local and world matrices,
+parents, bounding radii and flags live in parallel arrays, kept in
+parent-before-child order - so recomputing every world transform is one
+linear loop instead of a recursive walk through scattered nodes.
+
+Nodes are referred to by handles, which stay valid while the arrays get
+reordered underneath them (reparenting can put a parent after its child,
+which gets fixed by a re-sort before the next update).
+
+Only dirty nodes, and nodes whose parent's world transform changed in the
+same update, have their world transform recomputed.
+*/
+#include <vector>
+#include <cstdint>
+#include "Matrix4.h"
+
+class TransformHierarchy {
+public:
+	static constexpr int INVALID_NODE = -1;
+
+	TransformHierarchy() {}
+	~TransformHierarchy() {}
+
+	int		AddNode(int parent = INVALID_NODE);
+	//Children of a removed node become roots
+	void	RemoveNode(int node);
+
+	void	SetParent(int node, int parent);
+	int		GetParent(int node) const;
+
+	void			SetLocalTransform(int node, const Matrix4& m);
+	const Matrix4&	GetLocalTransform(int node) const	{ return localTransforms[slots[node]]; }
+	//As of the last UpdateWorldTransforms
+	const Matrix4&	GetWorldTransform(int node) const	{ return worldTransforms[slots[node]]; }
+
+	void	SetBoundingRadius(int node, float radius)	{ boundingRadii[slots[node]] = radius; }
+	float	GetBoundingRadius(int node) const			{ return boundingRadii[slots[node]]; }
+
+	//Returns how many world transforms were recomputed
+	size_t	UpdateWorldTransforms();
+
+	//The raw arrays, in parent-before-child order. Only tightly packed (no removed
+	//nodes, no out of order parents) straight after UpdateWorldTransforms
+	size_t			GetSlotCount() const				{ return nodes.size(); }
+	const Matrix4*	GetWorldTransforms() const			{ return worldTransforms.data(); }
+	const float*	GetBoundingRadii() const			{ return boundingRadii.data(); }
+	const int*		GetSlotNodes() const				{ return nodes.data(); }
+
+protected:
+	enum NodeFlags : uint8_t {
+		NODE_DIRTY			= 1,	//local transform changed since the last update
+		NODE_WORLD_CHANGED	= 2,	//world transform was recomputed in the last update
+		NODE_REMOVED		= 4,
+	};
+
+	void	SortSlots();
+
+	//Per slot
+	std::vector<Matrix4>	localTransforms;
+	std::vector<Matrix4>	worldTransforms;
+	std::vector<int>		parentSlots;
+	std::vector<float>		boundingRadii;
+	std::vector<uint8_t>	flags;
+	std::vector<int>		nodes;			//which node handle is in each slot
+
+	//Per node handle
+	std::vector<int>		slots;
+	std::vector<int>		freeNodes;
+
+	bool	needsSort = false;
+};
@@ -0,0 +1,204 @@
+#include "VertexPacking.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+uint16_t FloatToHalf(float f) {
+	uint32_t bits;
+	memcpy(&bits, &f, sizeof(bits));
+
+	uint32_t sign		= (bits >> 16) & 0x8000;
+	int32_t	 exponent	= (int32_t)((bits >> 23) & 0xFF) - 127 + 15;
+	uint32_t mantissa	= bits & 0x007FFFFF;
+
+	if (((bits >> 23) & 0xFF) == 0xFF) {	//infinity or NaN
+		return (uint16_t)(sign | 0x7C00 | (mantissa ? 0x200 : 0));
+	}
+	if (exponent >= 31) {					//too big - clamp to infinity
+		return (uint16_t)(sign | 0x7C00);
+	}
+	if (exponent <= 0) {					//denormal, or too small to represent at all
+		if (exponent < -10) {
+			return (uint16_t)sign;
+		}
+		mantissa |= 0x00800000;
+		uint32_t shift		= (uint32_t)(14 - exponent);
+		uint32_t half		= mantissa >> shift;
+		uint32_t remainder	= mantissa & ((1u << shift) - 1);
+		uint32_t halfway	= 1u << (shift - 1);
+		if (remainder > halfway || (remainder == halfway && (half & 1))) {
+			++half;
+		}
+		return (uint16_t)(sign | half);
+	}
+	uint32_t half = sign | ((uint32_t)exponent << 10) | (mantissa >> 13);
+	uint32_t remainder = mantissa & 0x1FFF;
+	if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1))) {
+		++half;	//round to nearest even - can carry into the exponent, which is still correct
+	}
+	return (uint16_t)half;
+}
+
+float HalfToFloat(uint16_t h) {
+	uint32_t sign		= (uint32_t)(h & 0x8000) << 16;
+	uint32_t exponent	= (h >> 10) & 0x1F;
+	uint32_t mantissa	= h & 0x3FF;
+	uint32_t bits;
+
+	if (exponent == 0) {
+		if (mantissa == 0) {
+			bits = sign;
+		}
+		else {	//denormal - normalise it
+			exponent = 127 - 15 + 1;
+			while (!(mantissa & 0x400)) {
+				mantissa <<= 1;
+				--exponent;
+			}
+			mantissa &= 0x3FF;
+			bits = sign | (exponent << 23) | (mantissa << 13);
+		}
+	}
+	else if (exponent == 31) {
+		bits = sign | 0x7F800000 | (mantissa << 13);
+	}
+	else {
+		bits = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+	}
+	float f;
+	memcpy(&f, &bits, sizeof(f));
+	return f;
+}
+
+int16_t PackSnorm16(float f) {
+	return (int16_t)std::lround(std::min(std::max(f, -1.0f), 1.0f) * 32767.0f);
+}
+
+float UnpackSnorm16(int16_t v) {
+	return std::max(v / 32767.0f, -1.0f);
+}
+
+uint8_t PackUnorm8(float f) {
+	return (uint8_t)std::lround(std::min(std::max(f, 0.0f), 1.0f) * 255.0f);
+}
+
+float UnpackUnorm8(uint8_t v) {
+	return v / 255.0f;
+}
+
+static uint32_t PackSnormBits(float f, int bits) {
+	const float maxValue = (float)((1 << (bits - 1)) - 1);
+	int32_t v = (int32_t)std::lround(std::min(std::max(f, -1.0f), 1.0f) * maxValue);
+	return (uint32_t)v & ((1u << bits) - 1);
+}
+
+static float UnpackSnormBits(uint32_t packed, int bits) {
+	const float maxValue = (float)((1 << (bits - 1)) - 1);
+	int32_t v = (int32_t)(packed << (32 - bits)) >> (32 - bits);	//sign extend
+	return std::max(v / maxValue, -1.0f);
+}
+
+uint32_t PackSnorm1010102(const Vector4& v) {
+	return PackSnormBits(v.x, 10) | (PackSnormBits(v.y, 10) << 10) | (PackSnormBits(v.z, 10) << 20) | (PackSnormBits(v.w, 2) << 30);
+}
+
+Vector4 UnpackSnorm1010102(uint32_t packed) {
+	return Vector4(
+		UnpackSnormBits(packed & 0x3FF, 10),
+		UnpackSnormBits((packed >> 10) & 0x3FF, 10),
+		UnpackSnormBits((packed >> 20) & 0x3FF, 10),
+		UnpackSnormBits((packed >> 30) & 0x3, 2));
+}
+
+uint32_t PackUnorm8x4(const Vector4& v) {
+	return PackUnorm8(v.x) | (PackUnorm8(v.y) << 8) | (PackUnorm8(v.z) << 16) | ((uint32_t)PackUnorm8(v.w) << 24);
+}
+
+Vector4 UnpackUnorm8x4(uint32_t packed) {
+	return Vector4(
+		UnpackUnorm8(packed & 0xFF),
+		UnpackUnorm8((packed >> 8) & 0xFF),
+		UnpackUnorm8((packed >> 16) & 0xFF),
+		UnpackUnorm8((packed >> 24) & 0xFF));
+}
+
+//Rounding each weight on its own can leave the total a step or two away from 255,
+//which would scale the skinned vertex - so any difference goes on the biggest weight
+static uint32_t PackSkinWeights(const Vector4& w) {
+	const float values[4] = { w.x, w.y, w.z, w.w };
+	int packed[4];
+	int total	= 0;
+	int biggest = 0;
+	for (int i = 0; i < 4; ++i) {
+		packed[i] = PackUnorm8(values[i]);
+		total += packed[i];
+		if (packed[i] > packed[biggest]) {
+			biggest = i;
+		}
+	}
+	if (total > 0) {
+		packed[biggest] = std::min(std::max(packed[biggest] + (255 - total), 0), 255);
+	}
+	return packed[0] | (packed[1] << 8) | (packed[2] << 16) | ((uint32_t)packed[3] << 24);
+}
+
+static void AddAttribute(bool present, int size, int& offset, int& stride) {
+	if (present) {
+		offset = stride;
+		stride += size;
+	}
+}
+
+template <typename T>
+static void Store(std::vector<uint8_t>& into, size_t vertexStart, int offset, const T& value) {
+	memcpy(&into[vertexStart + offset], &value, sizeof(T));
+}
+
+PackedVertexLayout PackVertices(size_t numVertices, const Vector3* positions, const Vector2* texCoords,
+	const Vector4* colours, const Vector3* normals, const Vector4* tangents,
+	const Vector4* weights, const int* weightIndices, std::vector<uint8_t>& into) {
+	PackedVertexLayout layout;
+	AddAttribute(positions		!= nullptr, sizeof(float) * 3,		layout.positionOffset,		layout.stride);
+	AddAttribute(texCoords		!= nullptr, sizeof(uint16_t) * 2,	layout.texCoordOffset,		layout.stride);
+	AddAttribute(colours		!= nullptr, sizeof(uint32_t),		layout.colourOffset,		layout.stride);
+	AddAttribute(normals		!= nullptr, sizeof(uint32_t),		layout.normalOffset,		layout.stride);
+	AddAttribute(tangents		!= nullptr, sizeof(uint32_t),		layout.tangentOffset,		layout.stride);
+	AddAttribute(weights		!= nullptr, sizeof(uint32_t),		layout.weightOffset,		layout.stride);
+	AddAttribute(weightIndices	!= nullptr, sizeof(uint8_t) * 4,	layout.weightIndexOffset,	layout.stride);
+
+	into.assign(numVertices * layout.stride, 0);
+
+	for (size_t i = 0; i < numVertices; ++i) {
+		size_t start = i * layout.stride;
+		if (positions) {
+			const float p[3] = { positions[i].x, positions[i].y, positions[i].z };
+			Store(into, start, layout.positionOffset, p);
+		}
+		if (texCoords) {
+			const uint16_t t[2] = { FloatToHalf(texCoords[i].x), FloatToHalf(texCoords[i].y) };
+			Store(into, start, layout.texCoordOffset, t);
+		}
+		if (colours) {
+			Store(into, start, layout.colourOffset, PackUnorm8x4(colours[i]));
+		}
+		if (normals) {
+			const Vector3& n = normals[i];
+			Store(into, start, layout.normalOffset, PackSnorm1010102(Vector4(n.x, n.y, n.z, 0.0f)));
+		}
+		if (tangents) {
+			Store(into, start, layout.tangentOffset, PackSnorm1010102(tangents[i]));
+		}
+		if (weights) {
+			Store(into, start, layout.weightOffset, PackSkinWeights(weights[i]));
+		}
+		if (weightIndices) {
+			uint8_t joints[4];
+			for (int j = 0; j < 4; ++j) {
+				joints[j] = (uint8_t)std::min(std::max(weightIndices[i * 4 + j], 0), 255);
+			}
+			Store(into, start, layout.weightIndexOffset, joints);
+		}
+	}
+	return layout;
+}
@@ -0,0 +1,55 @@
+#pragma once
+/*
+Description:Conversions between floats and the compact formats OpenGL can read
+vertex attributes from, and a function to pack a Mesh's separate attribute
+arrays into one interleaved buffer using them.
+
+Packed layout, per vertex:
+	position		3 x float32		(kept full precision - terrain is big!)
+	texCoord		2 x float16		(GL_HALF_FLOAT)
+	colour			4 x unorm8		(GL_UNSIGNED_BYTE, normalised)
+	normal			10:10:10:2 snorm	(GL_INT_2_10_10_10_REV, normalised)
+	tangent			10:10:10:2 snorm	(w keeps the handedness)
+	jointWeights	4 x unorm8		(normalised, rounded so they still sum to 1)
+	jointIndices	4 x uint8		(glVertexAttribIPointer)
+Attributes a mesh doesn't have take up no space.
+*/
+#include <vector>
+#include <cstdint>
+
+#include "Vector2.h"
+#include "Vector3.h"
+#include "Vector4.h"
+
+uint16_t	FloatToHalf(float f);
+float		HalfToFloat(uint16_t h);
+
+int16_t		PackSnorm16(float f);
+float		UnpackSnorm16(int16_t v);
+
+uint8_t		PackUnorm8(float f);
+float		UnpackUnorm8(uint8_t v);
+
+//x, y and z take 10 bits each, w the top 2 (so it can only be -1, 0 or 1)
+uint32_t	PackSnorm1010102(const Vector4& v);
+Vector4		UnpackSnorm1010102(uint32_t packed);
+
+uint32_t	PackUnorm8x4(const Vector4& v);
+Vector4		UnpackUnorm8x4(uint32_t packed);
+
+//Offsets are in bytes from the start of a vertex, or -1 if the attribute isn't there
+struct PackedVertexLayout {
+	int stride				= 0;
+	int positionOffset		= -1;
+	int texCoordOffset		= -1;
+	int colourOffset		= -1;
+	int normalOffset		= -1;
+	int tangentOffset		= -1;
+	int weightOffset		= -1;
+	int weightIndexOffset	= -1;
+};
+
+//Any of the attribute arrays (other than positions) can be null
+PackedVertexLayout PackVertices(size_t numVertices, const Vector3* positions, const Vector2* texCoords,
+	const Vector4* colours, const Vector3* normals, const Vector4* tangents,
+	const Vector4* weights, const int* weightIndices, std::vector<uint8_t>& into);